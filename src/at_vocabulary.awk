@@ -0,0 +1,194 @@
+# at_vocabulary.awk -- generates the perfect hash table of known AT names
+#
+# Copyright 2016 Otto Linnemann
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# usage: awk -f at_vocabulary.awk at_vocabulary.def [vendor.def] > tcm_at_vocabulary_table.h
+#
+# Reads the vocabulary files described in at_vocabulary.def and writes the C
+# tables included by tcm_at_vocabulary.c. The hash function must match the
+# function hash() in tcm_at_vocabulary.c. Since POSIX awk provides neither
+# bitwise operators nor 32 bit integers, unsigned 32 bit arithmetic is
+# emulated with floating point numbers which are exact up to 2^53.
+#
+# The table is built using hash and displace: names are distributed to
+# buckets by hash(name, 0), then beginning with the largest bucket a seed is
+# searched for each bucket which maps all of its names to free slots by
+# hash(name, seed). A lookup takes two hash computations and one string
+# comparison.
+
+function mul32( a, b,     ah, al )
+{
+  ah = int( a / 65536 )
+  al = a % 65536
+  return ( ( ah * b ) % 65536 * 65536 + al * b ) % 4294967296
+}
+
+function hash( s, seed,     h, i )
+{
+  h = ( 2166136261 + seed ) % 4294967296
+  for( i = 1; i <= length( s ); ++i )
+    h = mul32( ( h + ord[substr( s, i, 1 )] ) % 4294967296, 16777619 )
+  h = ( h + int( h / 65536 ) ) % 4294967296
+  h = mul32( h, 73244475 )
+  h = ( h + int( h / 65536 ) ) % 4294967296
+  return h
+}
+
+function fail( msg )
+{
+  printf( "%s:%d: %s\n", FILENAME, FNR, msg ) > "/dev/stderr"
+  error = 1
+  exit 1
+}
+
+function c_categories( cats,     n, i, a, s )
+{
+  n = split( cats, a, "," )
+  s = ""
+  for( i = 1; i <= n; ++i ) {
+    if( a[i] == "command" )
+      a[i] = "TCM_AT_COMMAND"
+    else if( a[i] == "urc" )
+      a[i] = "TCM_AT_URC"
+    else if( a[i] == "final" )
+      a[i] = "TCM_AT_FINAL"
+    else
+      return ""
+    s = s ( i > 1 ? " | " : "" ) a[i]
+  }
+  return s
+}
+
+BEGIN {
+  for( i = 32; i < 127; ++i )
+    ord[sprintf( "%c", i )] = i
+  nr_names = 0
+  files = ""
+}
+
+FNR == 1 {
+  files = files ( files == "" ? "" : " " ) FILENAME
+}
+
+/^[ \t]*(#|$)/ {
+  next
+}
+
+{
+  if( NF < 3 )
+    fail( "category, priority and name expected" )
+
+  cats = c_categories( $1 )
+  if( cats == "" )
+    fail( "invalid category " $1 )
+
+  if( $2 !~ /^[0-3]$/ )
+    fail( "priority must be between 0 and 3" )
+
+  name = $0
+  sub( /^[ \t]*[^ \t]+[ \t]+[^ \t]+[ \t]+/, "", name )
+  sub( /[ \t]+$/, "", name )
+  name = toupper( name )
+  if( length( name ) >= 32 )
+    fail( "name " name " exceeds 31 characters" )
+  if( name ~ /[\\"]/ || name ~ /[^ -~]/ )
+    fail( "name " name " contains invalid characters" )
+
+  if( !( name in id ) ) {
+    id[name] = ++nr_names
+    names[nr_names] = name
+  }
+  category[name] = cats
+  priority[name] = $2
+}
+
+END {
+  if( error )
+    exit 1
+
+  if( nr_names == 0 ) {
+    print "no names given" > "/dev/stderr"
+    exit 1
+  }
+
+  # slot table with load factor of at most 0.8, four names per bucket
+  nr_slots = 1
+  while( nr_slots * 4 < nr_names * 5 )
+    nr_slots *= 2
+  nr_buckets = int( ( nr_names + 3 ) / 4 )
+
+  max_size = 0
+  for( i = 1; i <= nr_names; ++i ) {
+    b = hash( names[i], 0 ) % nr_buckets
+    bucket[b, ++size[b]] = i
+    if( size[b] > max_size )
+      max_size = size[b]
+  }
+
+  for( s = 0; s < nr_slots; ++s )
+    slot[s] = 0
+
+  for( n = max_size; n > 0; --n ) {
+    for( b = 0; b < nr_buckets; ++b ) {
+      if( size[b] != n )
+        continue
+
+      for( seed = 1; seed < 1000000; ++seed ) {
+        ok = 1
+        for( j = 1; j <= n && ok; ++j ) {
+          s = hash( names[bucket[b, j]], seed ) % nr_slots
+          if( slot[s] )
+            ok = 0
+          for( k = 1; k < j && ok; ++k )
+            if( trial[k] == s )
+              ok = 0
+          trial[j] = s
+        }
+        if( ok )
+          break
+      }
+
+      if( !ok ) {
+        print "no perfect hash function found" > "/dev/stderr"
+        exit 1
+      }
+
+      seeds[b] = seed
+      for( j = 1; j <= n; ++j )
+        slot[trial[j]] = bucket[b, j]
+    }
+  }
+
+  print "/* generated by at_vocabulary.awk from " files ", do not edit */"
+  print ""
+  print "#define TCM_AT_VOCABULARY_SIZE     " nr_names
+  print "#define TCM_AT_VOCABULARY_SLOTS    " nr_slots
+  print "#define TCM_AT_VOCABULARY_BUCKETS  " nr_buckets
+  print ""
+  print "/* indexed by identifier */"
+  print "static const t_tcm_at_word vocabulary[TCM_AT_VOCABULARY_SIZE+1] = {"
+  print "  { \"\", 0, 0, 0 },"
+  for( i = 1; i <= nr_names; ++i )
+    printf( "  { \"%s\", %d, %s, %d }%s\n", names[i], i, category[names[i]],
+            priority[names[i]], i < nr_names ? "," : "" )
+  print "};"
+  print ""
+  print "/* seeds of the second hash computation, indexed by bucket */"
+  print "static const uint32_t seeds[TCM_AT_VOCABULARY_BUCKETS] = {"
+  for( b = 0; b < nr_buckets; ++b )
+    printf( "%s%d%s", b % 12 == 0 ? "  " : " ", seeds[b] ? seeds[b] : 0,
+            b < nr_buckets - 1 ? ( b % 12 == 11 ? ",\n" : "," ) : "\n" )
+  print "};"
+  print ""
+  print "/* identifiers indexed by slot, 0 for unused slots */"
+  print "static const unsigned short slots[TCM_AT_VOCABULARY_SLOTS] = {"
+  for( s = 0; s < nr_slots; ++s )
+    printf( "%s%d%s", s % 12 == 0 ? "  " : " ", slot[s],
+            s < nr_slots - 1 ? ( s % 12 == 11 ? ",\n" : "," ) : "\n" )
+  print "};"
+}
@@ -0,0 +1,244 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <base_channel.h>
+#include <dev_channel.h>
+#include <client_sock_channel.h>
+#include <server_sock_channel.h>
+#include <cmux_channel.h>
+#include <shm_channel.h>
+#include <local_channel.h>
+#include <tcm_await.h>
+#include <tcm_log.h>
+#include <tcm_flightrec.h>
+
+
+/*! channels reported by base_channel_snapshot() */
+static struct {
+  pthread_mutex_t               mutex;                  /*!< access protection */
+  t_base_channel*               channels[BASE_CHANNEL_MAX_REGISTERED]; /*!< registered channels */
+  int                           nr_channels;            /*!< number of registered channels */
+} registry = { PTHREAD_MUTEX_INITIALIZER };
+
+
+t_icom_evt* base_channel_alloc_evt( t_icom_events* p_events )
+{
+  t_icom_evt* p_evt;
+
+  /* unlink event for processing out of pool */
+  pthread_mutex_lock( & p_events->mutex );
+  if ( !IsListEmpty( & p_events->pool ) ) {
+    p_evt = (t_icom_evt*)RemoveHeadList( & p_events->pool );
+  }
+  else {
+    tcm_error("event queue overflow error, overwriting existing events\n");
+    p_evt = (t_icom_evt*)RemoveHeadList( & p_events->ready_list );
+    /* dropped events count as dispatched to keep the sequence in step */
+    base_channel_dispatched( (t_base_channel *)p_evt->p_user_ctx );
+    __atomic_add_fetch( & ((t_base_channel *)p_evt->p_user_ctx)->nr_overflows, 1, __ATOMIC_RELAXED );
+  }
+  pthread_mutex_unlock( & p_events->mutex );
+
+  return p_evt;
+}
+
+
+t_icom_evt* base_channel_try_alloc_evt( t_icom_events* p_events )
+{
+  t_icom_evt* p_evt = NULL;
+
+  pthread_mutex_lock( & p_events->mutex );
+  if ( !IsListEmpty( & p_events->pool ) )
+    p_evt = (t_icom_evt*)RemoveHeadList( & p_events->pool );
+  pthread_mutex_unlock( & p_events->mutex );
+
+  return p_evt;
+}
+
+
+int base_channel_pool_available( t_icom_events* p_events )
+{
+  int available;
+
+  pthread_mutex_lock( & p_events->mutex );
+  available = !IsListEmpty( & p_events->pool );
+  pthread_mutex_unlock( & p_events->mutex );
+
+  return available;
+}
+
+
+void base_channel_post_evt( t_icom_events* p_events, t_icom_evt* p_evt )
+{
+  t_base_channel* p_base = (t_base_channel *)p_evt->p_user_ctx;
+  long seq;
+  int depth;
+
+  /* event must be stamped before it can be dispatched */
+  seq = __atomic_load_n( & p_base->nr_posted, __ATOMIC_RELAXED );
+  tcm_trace_queued( p_base->trace_stamps, seq );
+  __atomic_store_n( & p_base->nr_posted, seq + 1, __ATOMIC_RELEASE );
+  depth = base_channel_queue_depth( p_base );
+  __atomic_add_fetch( & p_base->rx_bytes, p_evt->data_len, __ATOMIC_RELAXED );
+
+  /* insert newly created event in ready list */
+  pthread_mutex_lock( & p_events->mutex );
+  InsertTailList( & p_events->ready_list, & p_evt->node );
+  pthread_cond_signal( & p_events->signal );
+  pthread_mutex_unlock( & p_events->mutex );
+
+  if( p_evt->type == ICOM_EVT_SERVER_CON )
+    tcm_flightrec_add( t_tcm_flightrec_connect, p_base, NULL, 0, depth, 0 );
+  else if( p_evt->type == ICOM_EVT_SERVER_DIS )
+    tcm_flightrec_add( t_tcm_flightrec_disconnect, p_base, NULL, 0, depth, 0 );
+  else
+    tcm_flightrec_add( t_tcm_flightrec_rx, p_base, p_evt->p_data, p_evt->data_len, depth, 0 );
+}
+
+
+void base_channel_free_evt( t_icom_events* p_events, t_icom_evt* p_evt )
+{
+  pthread_mutex_lock( & p_events->mutex );
+  InsertTailList( & p_events->pool, & p_evt->node );
+  pthread_mutex_unlock( & p_events->mutex );
+}
+
+
+long base_channel_dispatched( t_base_channel* p )
+{
+  return __atomic_fetch_add( & p->nr_dispatched, 1, __ATOMIC_RELAXED );
+}
+
+
+int base_channel_queue_depth( t_base_channel* p )
+{
+  long depth = __atomic_load_n( & p->nr_posted, __ATOMIC_RELAXED ) - __atomic_load_n( & p->nr_dispatched, __ATOMIC_RELAXED );
+
+  /* events of client sockets are posted by libintercom and not counted */
+  return depth > 0 ? (int)depth : 0;
+}
+
+
+void base_channel_count_tx( t_base_channel* p, int len )
+{
+  if( len > 0 ) {
+    __atomic_add_fetch( & p->nr_tx, 1, __ATOMIC_RELAXED );
+    __atomic_add_fetch( & p->tx_bytes, len, __ATOMIC_RELAXED );
+  }
+}
+
+
+const char* base_channel_name( t_base_channel* p, char* buf, int size )
+{
+  t_icom_addr_decl* p_addr = NULL;
+
+  if( p->type == t_channel_dev_type )
+    snprintf( buf, size, "%s", ((t_dev_channel *)p)->name );
+  else if( p->type == t_channel_cmux_type )
+    snprintf( buf, size, "%s:dlci%d", ((t_cmux_channel *)p)->p_mux->p_serial->name, ((t_cmux_channel *)p)->dlci );
+  else if( p->type == t_channel_shm_type )
+    snprintf( buf, size, "shm:%s", ((t_shm_channel *)p)->name );
+  else if( p->type == t_channel_local_type )
+    snprintf( buf, size, "local:%s", ((t_local_channel *)p)->name );
+  else {
+    if( p->type == t_channel_client_sock_type )
+      p_addr = & ((t_client_sock_channel *)p)->addr_decl;
+    else
+      p_addr = & ((t_server_sock_channel *)p)->addr_decl;
+    if( p_addr->port )
+      snprintf( buf, size, "%s:%d", p_addr->address, p_addr->port );
+    else
+      snprintf( buf, size, "%s", p_addr->address );
+  }
+
+  return buf;
+}
+
+
+void base_channel_register( t_base_channel* p )
+{
+  pthread_mutex_lock( & registry.mutex );
+  if( registry.nr_channels < BASE_CHANNEL_MAX_REGISTERED )
+    registry.channels[registry.nr_channels++] = p;
+  else
+    tcm_error( "%s: too many channels, statistics not reported!\n", __func__ );
+  pthread_mutex_unlock( & registry.mutex );
+}
+
+
+void base_channel_unregister( t_base_channel* p )
+{
+  int i;
+
+  pthread_mutex_lock( & registry.mutex );
+  for( i = 0; i < registry.nr_channels; ++i ) {
+    if( registry.channels[i] == p ) {
+      registry.channels[i] = registry.channels[--registry.nr_channels];
+      break;
+    }
+  }
+  pthread_mutex_unlock( & registry.mutex );
+
+  /* replies can't arrive anymore */
+  tcm_await_cancel_channel( p );
+}
+
+
+int base_channel_snapshot( t_base_channel_stats* p_stats, int max )
+{
+  t_base_channel* p;
+  t_base_channel_stats* s;
+  int i, n;
+
+  /* the registry lock only prevents channels from being released meanwhile */
+  pthread_mutex_lock( & registry.mutex );
+  n = ( registry.nr_channels < max ) ? registry.nr_channels : max;
+  for( i = 0; i < n; ++i ) {
+    p = registry.channels[i];
+    s = & p_stats[i];
+    memset( s, 0, sizeof( t_base_channel_stats ) );
+    base_channel_name( p, s->name, sizeof( s->name ) );
+    s->type = p->type;
+    s->id = (long)p;
+    s->nr_rx = __atomic_load_n( & p->nr_posted, __ATOMIC_RELAXED );
+    s->rx_bytes = __atomic_load_n( & p->rx_bytes, __ATOMIC_RELAXED );
+    s->nr_tx = __atomic_load_n( & p->nr_tx, __ATOMIC_RELAXED );
+    s->tx_bytes = __atomic_load_n( & p->tx_bytes, __ATOMIC_RELAXED );
+    s->depth = base_channel_queue_depth( p );
+    s->nr_overflows = __atomic_load_n( & p->nr_overflows, __ATOMIC_RELAXED );
+    s->nr_opens = __atomic_load_n( & p->nr_opens, __ATOMIC_RELAXED );
+    s->nr_suppressed = __atomic_load_n( & p->nr_suppressed, __ATOMIC_RELAXED );
+    if( p->type == t_channel_server_sock_type ) {
+      s->nr_connections = __atomic_load_n( & ((t_server_sock_channel *)p)->nr_connections, __ATOMIC_RELAXED );
+      s->nr_evictions = __atomic_load_n( & ((t_server_sock_channel *)p)->nr_evictions, __ATOMIC_RELAXED );
+    }
+  }
+  pthread_mutex_unlock( & registry.mutex );
+
+  return n;
+}
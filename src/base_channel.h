@@ -31,8 +31,10 @@
 extern "C" {
 #endif
 
+#include <intercom/events.h>
 #include <tcm_server.h>
 #include <tinyscheme/scheme.h>
+#include <tcm_trace.h>
 
 
 /*!
@@ -43,6 +45,8 @@ extern "C" {
     @{
  */
 
+#define BASE_CHANNEL_MAX_REGISTERED    256             /*!< maximum number of reported channels */
+
 struct s_base_channel;
 
 /*!
@@ -88,7 +92,10 @@ typedef t_evt_cb  t_channel_cb;
 typedef enum {
   t_channel_dev_type,                                   /*!< file respectively device type */
   t_channel_client_sock_type,                           /*!< TCP or UDP client socket type */
-  t_channel_server_sock_type                            /*!< TCP or UDP server socket type */
+  t_channel_server_sock_type,                           /*!< TCP or UDP server socket type */
+  t_channel_cmux_type,                                  /*!< virtual channel of 27.010 multiplexer */
+  t_channel_shm_type,                                   /*!< shared memory channel to local process */
+  t_channel_local_type                                  /*!< in-process channel */
 } t_channel_type;
 
 
@@ -109,13 +116,169 @@ typedef struct s_base_channel {
   t_channel_handler_0           release;                /*!< close channel and processing thread */
   t_channel_handler_2           write;                  /*!< write handler */
   t_channel_cb                  read;                   /*!< read callback function, invoked from thread context */
+  void*                         p_user_data;            /*!< optional context of native (C) channel users */
 
   char                          cb_symbol_name[256];    /*!< scheme callback function symbol name */
   pointer                       p_cb_closure_code;      /*!< scheme callback closure to invoked */
+  int                           cb_with_conn_id;        /*!< when 1 callback closure takes connection id as 2nd arg */
+
+  char                          evt_cb_symbol_name[256];/*!< scheme connection event callback symbol name */
+  pointer                       p_evt_cb_closure_code;  /*!< optional scheme connection event closure or NULL */
+
+  long                          nr_posted;              /*!< events posted by reader thread, accessed atomically */
+  long                          nr_dispatched;          /*!< events dispatched to callback, accessed atomically */
+  t_tcm_trace_stamp             trace_stamps[TCM_TRACE_STAMPS]; /*!< latency stamps of queued events */
+
+  long                          rx_bytes;               /*!< received bytes, accessed atomically */
+  long                          nr_tx;                  /*!< number of writes, accessed atomically */
+  long                          tx_bytes;               /*!< written bytes, accessed atomically */
+  long                          nr_overflows;           /*!< events dropped on queue overflow, accessed atomically */
+  long                          nr_opens;               /*!< successful (re)opens of device, accessed atomically */
+  long                          nr_suppressed;          /*!< lines suppressed by URC coalescing, accessed atomically */
+
+  struct s_tcm_await*           p_awaits;               /*!< oldest pending request awaiting reply, see tcm_await.h */
 
 } t_base_channel;
 
 
+/*!
+ * snapshot of channel statistics
+ */
+typedef struct s_base_channel_stats {
+  char                          name[128];              /*!< channel name, device or address */
+  t_channel_type                type;                   /*!< type of channel */
+  long                          id;                     /*!< channel identifier as used in scheme */
+  long                          nr_rx;                  /*!< number of received events */
+  long                          rx_bytes;               /*!< received bytes */
+  long                          nr_tx;                  /*!< number of writes */
+  long                          tx_bytes;               /*!< written bytes */
+  int                           depth;                  /*!< queued events */
+  long                          nr_overflows;           /*!< events dropped on queue overflow */
+  long                          nr_opens;               /*!< successful (re)opens of device */
+  long                          nr_suppressed;          /*!< lines suppressed by URC coalescing */
+  int                           nr_connections;         /*!< open connections of server sockets */
+  long                          nr_evictions;           /*!< connections closed for being too slow */
+} t_base_channel_stats;
+
+
+/*!
+ * fetch an unused event from the channel's event pool
+ *
+ * When the pool is exhausted the oldest not yet processed event is taken
+ * from the ready list and thus overwritten.
+ *
+ * \param p_events pointer to libintercom event handler of the channel
+ * \return pointer to event object, never NULL
+ */
+t_icom_evt* base_channel_alloc_evt( t_icom_events* p_events );
+
+
+/*!
+ * fetch an unused event from the channel's event pool without overwriting
+ *
+ * Intended for readers which can stop reading from their source until the
+ * processing thread has released events again, refer to
+ * base_channel_pool_available().
+ *
+ * \param p_events pointer to libintercom event handler of the channel
+ * eturn pointer to event object or NULL when the pool is exhausted
+ */
+t_icom_evt* base_channel_try_alloc_evt( t_icom_events* p_events );
+
+
+/*!
+ * check whether the channel's event pool has unused events
+ *
+ * \param p_events pointer to libintercom event handler of the channel
+ * eturn 1 when at least one event is available, otherwise 0
+ */
+int base_channel_pool_available( t_icom_events* p_events );
+
+
+/*!
+ * insert event into the ready list and wake up the processing thread
+ *
+ * \param p_events pointer to libintercom event handler of the channel
+ * \param p_evt event to be processed, previously fetched with base_channel_alloc_evt()
+ */
+void base_channel_post_evt( t_icom_events* p_events, t_icom_evt* p_evt );
+
+
+/*!
+ * put unprocessed event back into the channel's event pool
+ *
+ * \param p_events pointer to libintercom event handler of the channel
+ * \param p_evt event to be released, previously fetched with base_channel_alloc_evt()
+ */
+void base_channel_free_evt( t_icom_events* p_events, t_icom_evt* p_evt );
+
+
+/*!
+ * count data written to channel
+ *
+ * \param p pointer to channel instance
+ * \param len number of written bytes
+ */
+void base_channel_count_tx( t_base_channel* p, int len );
+
+
+/*!
+ * human readable channel name, device name or socket address
+ *
+ * \param p pointer to channel instance
+ * \param buf buffer where the name is written to
+ * \param size size of the buffer
+ * \return pointer to buf
+ */
+const char* base_channel_name( t_base_channel* p, char* buf, int size );
+
+
+/*!
+ * add channel to the list of channels reported by base_channel_snapshot()
+ *
+ * \param p pointer to channel instance
+ */
+void base_channel_register( t_base_channel* p );
+
+
+/*!
+ * remove channel from list of reported channels, to be invoked before release
+ *
+ * \param p pointer to channel instance
+ */
+void base_channel_unregister( t_base_channel* p );
+
+
+/*!
+ * retrieve statistics of all registered channels
+ *
+ * Counters are read without taking any channel lock.
+ *
+ * \param p_stats array where statistics are written to
+ * \param max maximum number of array elements
+ * \return number of channels written
+ */
+int base_channel_snapshot( t_base_channel_stats* p_stats, int max );
+
+
+/*!
+ * count event as dispatched, to be invoked by the channel's read callback
+ *
+ * \param p pointer to channel instance
+ * \return sequence number of the dispatched event
+ */
+long base_channel_dispatched( t_base_channel* p );
+
+
+/*!
+ * number of posted events which are not yet dispatched
+ *
+ * \param p pointer to channel instance
+ * \return number of queued events
+ */
+int base_channel_queue_depth( t_base_channel* p );
+
+
 /*! @} */
 
 #ifdef __cplusplus
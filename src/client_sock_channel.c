@@ -29,6 +29,7 @@
 #include <client_sock_channel.h>
 #include <olcutils/alloc.h>
 #include <tcm_log.h>
+#include <tcm_rt.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -67,6 +68,7 @@ static int release_client_sock_channel( t_base_channel* p_base_channel )
   int retcode = 0;
 
   if( p ) {
+    base_channel_unregister( p_base_channel );
     icom_kill_client_connection_handler( p->handler );
     cul_free( p );
   }
@@ -79,6 +81,7 @@ t_client_sock_channel* init_client_sock_channel( t_tcm_server_ctx* p_tcm_server_
 {
   t_client_sock_channel* p;
   t_base_channel* p_base;
+  t_tcm_rt_saved rt_saved;
   int retcode;
 
   p = cul_malloc( sizeof( t_client_sock_channel ) );
@@ -105,12 +108,15 @@ t_client_sock_channel* init_client_sock_channel( t_tcm_server_ctx* p_tcm_server_
 
   strncpy( p->addr_decl.address, addr, sizeof(p->addr_decl.address) );
 
+  /* threads created by libintercom inherit the real-time settings */
+  tcm_rt_begin_spawn( t_channel_client_sock_type, & rt_saved );
   p->handler = icom_create_client_connection_handler(
     & p->addr_decl,
     CLIENT_SOCK_CH_MAX_DATA_SIZE,
     CLIENT_SOCK_CH_POOL_SIZE,
     p_read_cb,
     p );
+  tcm_rt_end_spawn( & rt_saved );
 
   if( p->handler == NULL ) {
     tcm_error( "%s: could not create client handler error!\n", __func__ );
@@ -118,5 +124,7 @@ t_client_sock_channel* init_client_sock_channel( t_tcm_server_ctx* p_tcm_server_
     return NULL;
   }
 
+  base_channel_register( p_base );
+
   return p;
 }
@@ -0,0 +1,855 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <cmux_channel.h>
+#include <olcutils/alloc.h>
+#include <tcm_log.h>
+#include <tcm_rt.h>
+
+
+/*! multiplexers accepted by cmux_is_valid() */
+static t_cmux* instances[CMUX_MAX_INSTANCES];
+static pthread_mutex_t instances_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static uint64_t now_ns( void )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+static uint64_t ms_from_now( int ms )
+{
+  return now_ns() + (uint64_t)ms * 1000000ULL;
+}
+
+
+/*
+ * write raw data to serial line, caller holds mutex
+ */
+static int write_serial( t_cmux* p, const void* data, int len )
+{
+  t_base_channel* p_serial = (t_base_channel *)p->p_serial;
+  int retcode;
+
+  retcode = p_serial->write( p_serial, data, len );
+  base_channel_count_tx( p_serial, retcode );
+
+  return retcode;
+}
+
+
+/*
+ * encode and send one frame, caller holds mutex
+ */
+static int send_frame( t_cmux* p, int dlci, int cr, int ctrl, const uint8_t* p_info, int len )
+{
+  uint8_t frame[TCM_CMUX_MAX_FRAME( TCM_CMUX_MAX_INFO )];
+  int n;
+
+  n = tcm_cmux_encode( p->mode, dlci, cr, ctrl, p_info, len, frame, sizeof( frame ) );
+  if( n < 0 ) {
+    tcm_error( "%s: frame with %d bytes exceeds maximum size error!\n", __func__, len );
+    return -1;
+  }
+
+  return ( write_serial( p, frame, n ) == n ) ? 0 : -1;
+}
+
+
+/*
+ * send message on control channel, caller holds mutex
+ */
+static void send_ctrl( t_cmux* p, int type, int cr, const uint8_t* p_value, int len )
+{
+  uint8_t msg[TCM_CMUX_MAX_INFO];
+
+  if( len + 4 > sizeof( msg ) || len + 2 > p->n1 )
+    return;
+
+  /* control messages are always sent as commands on the address level */
+  send_frame( p, 0, 1, TCM_CMUX_UIH, msg, tcm_cmux_encode_ctrl( type, cr, p_value, len, msg ) );
+}
+
+
+/*
+ * send modem status of DLCI with or without flow control bit, caller holds mutex
+ */
+static void send_msc( t_cmux* p, int dlci, int fc )
+{
+  uint8_t value[2];
+
+  value[0] = ( dlci << 2 ) | 0x02 | 0x01;
+  value[1] = TCM_CMUX_MSC_RTC | TCM_CMUX_MSC_RTR | TCM_CMUX_MSC_DV | ( fc ? TCM_CMUX_MSC_FC : 0 ) | 0x01;
+  send_ctrl( p, TCM_CMUX_CTRL_MSC, 1, value, sizeof( value ) );
+}
+
+
+/*
+ * send data as UIH frames of at most n1 bytes, caller holds mutex
+ */
+static int send_data( t_cmux_channel* p_ch, const char* data, int len )
+{
+  t_cmux* p = p_ch->p_mux;
+  int pos, n;
+
+  for( pos = 0; pos < len; pos += n ) {
+    n = ( len - pos < p->n1 ) ? len - pos : p->n1;
+    if( send_frame( p, p_ch->dlci, 1, TCM_CMUX_UIH, (const uint8_t *)data + pos, n ) )
+      return pos ? pos : -1;
+    ++p_ch->nr_tx_frames;
+  }
+
+  return len;
+}
+
+
+/*
+ * send data buffered while the modem stopped the DLCI, caller holds mutex
+ */
+static void flush_tx( t_cmux_channel* p_ch )
+{
+  int n;
+
+  if( p_ch->tx_len == 0 || p_ch->remote_fc || p_ch->p_mux->remote_fc || p_ch->state != t_cmux_open )
+    return;
+
+  n = send_data( p_ch, p_ch->p_tx_buf, p_ch->tx_len );
+  if( n < 0 )
+    n = p_ch->tx_len;
+  memmove( p_ch->p_tx_buf, p_ch->p_tx_buf + n, p_ch->tx_len - n );
+  p_ch->tx_len -= n;
+}
+
+
+/*
+ * all data link connections are lost, caller holds mutex
+ */
+static void reset_mux( t_cmux* p, t_cmux_state state, int delay_ms )
+{
+  t_cmux_channel* p_ch;
+  int i;
+
+  p->state = state;
+  p->retries = 0;
+  p->deadline_ns = delay_ms ? ms_from_now( delay_ms ) : 0;
+  p->remote_fc = 0;
+  p->response[0] = '\0';
+  tcm_cmux_decoder_init( & p->decoder, p->mode, p->n1 );
+
+  for( i = 1; i <= TCM_CMUX_MAX_DLCI; ++i ) {
+    p_ch = p->channels[i];
+    if( p_ch ) {
+      p_ch->state = t_cmux_closed;
+      p_ch->retries = 0;
+      p_ch->deadline_ns = 0;
+      p_ch->remote_fc = p_ch->local_fc = 0;
+      p_ch->tx_len = 0;
+    }
+  }
+}
+
+
+/*
+ * start multiplexer on freshly opened device, caller holds mutex
+ */
+static void start_mux( t_cmux* p )
+{
+  ++p->nr_restarts;
+  p->retries = 1;
+
+  if( p->init_cmd[0] ) {
+    tcm_message( "%s: switching %s to multiplexer mode\n", __func__, p->p_serial->name );
+    p->state = t_cmux_init;
+    p->deadline_ns = ms_from_now( CMUX_INIT_TIMEOUT_MS );
+    write_serial( p, p->init_cmd, strlen( p->init_cmd ) );
+  } else {
+    p->state = t_cmux_opening;
+    p->deadline_ns = ms_from_now( CMUX_T1_MS );
+    send_frame( p, 0, 1, TCM_CMUX_SABM | TCM_CMUX_PF, NULL, 0 );
+  }
+}
+
+
+/*
+ * control channel message received from modem, caller holds mutex
+ */
+static void handle_ctrl( t_cmux* p, const uint8_t* data, int len )
+{
+  t_cmux_channel* p_ch;
+  int type, cr, vlen, pos, dlci, i;
+  uint8_t nsc;
+
+  if( len < 2 )
+    return;
+
+  type = data[0] & 0xFC;
+  cr = ( data[0] >> 1 ) & 0x01;
+
+  /* length octets with extension bit */
+  vlen = 0;
+  for( pos = 1; pos < len; ++pos ) {
+    vlen |= ( data[pos] >> 1 ) << ( 7 * ( pos - 1 ) );
+    if( data[pos] & 0x01 )
+      break;
+  }
+  ++pos;
+  if( pos + vlen > len )
+    return;
+
+  /* responses to our commands carry no further information */
+  if( ! cr )
+    return;
+
+  switch( type ) {
+  case TCM_CMUX_CTRL_MSC:
+    if( vlen >= 2 ) {
+      dlci = data[pos] >> 2;
+      p_ch = ( dlci > 0 ) ? p->channels[dlci] : NULL;
+      if( p_ch ) {
+        p_ch->remote_fc = ( data[pos+1] & TCM_CMUX_MSC_FC ) ? 1 : 0;
+        flush_tx( p_ch );
+      }
+    }
+    send_ctrl( p, type, 0, data + pos, vlen );
+    break;
+
+  case TCM_CMUX_CTRL_FCON:
+  case TCM_CMUX_CTRL_FCOFF:
+    p->remote_fc = ( type == TCM_CMUX_CTRL_FCOFF );
+    send_ctrl( p, type, 0, NULL, 0 );
+    for( i = 1; i <= TCM_CMUX_MAX_DLCI; ++i )
+      if( p->channels[i] )
+        flush_tx( p->channels[i] );
+    break;
+
+  case TCM_CMUX_CTRL_CLD:
+    send_ctrl( p, type, 0, NULL, 0 );
+    tcm_error( "%s: modem closed down multiplexer on %s\n", __func__, p->p_serial->name );
+    reset_mux( p, t_cmux_closed, CMUX_RESTART_MS );
+    break;
+
+  case TCM_CMUX_CTRL_TEST:
+  case TCM_CMUX_CTRL_PN:
+  case TCM_CMUX_CTRL_PSC:
+    /* parameters are accepted as proposed */
+    send_ctrl( p, type, 0, data + pos, vlen );
+    break;
+
+  default:
+    nsc = data[0];
+    send_ctrl( p, TCM_CMUX_CTRL_NSC, 0, & nsc, 1 );
+    break;
+  }
+}
+
+
+/*
+ * payload for virtual channel, caller holds mutex
+ */
+static void post_data( t_cmux_channel* p_ch, const uint8_t* data, int len )
+{
+  t_icom_events* p_events = p_ch->p_icom_events;
+  t_icom_evt* p_evt;
+  int n;
+
+  ++p_ch->nr_rx_frames;
+
+  while( len > 0 ) {
+    p_evt = base_channel_alloc_evt( p_events );
+    p_evt->type = ICOM_EVT_CLIENT_DATA;
+    p_evt->p_user_ctx = p_ch;
+    memset( p_evt->p_data, 0, p_evt->max_data_size );
+
+    /* keep data zero terminated */
+    n = ( len < p_evt->max_data_size ) ? len : p_evt->max_data_size - 1;
+    memcpy( p_evt->p_data, data, n );
+    p_evt->data_len = n;
+    base_channel_post_evt( p_events, p_evt );
+
+    data += n;
+    len -= n;
+  }
+
+  if( ! p_ch->local_fc && base_channel_queue_depth( (t_base_channel *)p_ch ) >= CMUX_CH_FC_HIGH ) {
+    p_ch->local_fc = 1;
+    send_msc( p_ch->p_mux, p_ch->dlci, 1 );
+  }
+}
+
+
+/*
+ * frame received from modem, invoked by decoder with mutex held
+ */
+static void handle_frame( void* p_ctx, const t_tcm_cmux_frame* f )
+{
+  t_cmux* p = (t_cmux *)p_ctx;
+  t_cmux_channel* p_ch = ( f->dlci > 0 ) ? p->channels[f->dlci] : NULL;
+
+  switch( f->ctrl ) {
+  case TCM_CMUX_UA:
+    if( f->dlci == 0 && p->state == t_cmux_opening ) {
+      tcm_message( "%s: multiplexer on %s established\n", __func__, p->p_serial->name );
+      p->state = t_cmux_open;
+      p->deadline_ns = 0;
+      pthread_cond_signal( & p->cond );
+    } else if( p_ch && p_ch->state == t_cmux_opening ) {
+      p_ch->state = t_cmux_open;
+      p_ch->deadline_ns = 0;
+      send_msc( p, p_ch->dlci, p_ch->local_fc );
+      flush_tx( p_ch );
+    } else if( p_ch && p_ch->state == t_cmux_closing ) {
+      p_ch->state = t_cmux_closed;
+    }
+    break;
+
+  case TCM_CMUX_DM:
+    if( f->dlci == 0 && p->state == t_cmux_opening ) {
+      tcm_error( "%s: modem refused multiplexer on %s\n", __func__, p->p_serial->name );
+      reset_mux( p, t_cmux_closed, CMUX_RESTART_MS );
+    } else if( p_ch && p_ch->state != t_cmux_closed ) {
+      tcm_error( "%s: modem refused DLCI %d\n", __func__, f->dlci );
+      p_ch->state = t_cmux_closed;
+      p_ch->deadline_ns = ms_from_now( CMUX_RESTART_MS );
+    }
+    break;
+
+  case TCM_CMUX_SABM:
+    if( f->dlci == 0 || p_ch ) {
+      send_frame( p, f->dlci, 0, TCM_CMUX_UA | TCM_CMUX_PF, NULL, 0 );
+      if( p_ch )
+        p_ch->state = t_cmux_open;
+    } else {
+      send_frame( p, f->dlci, 0, TCM_CMUX_DM | TCM_CMUX_PF, NULL, 0 );
+    }
+    break;
+
+  case TCM_CMUX_DISC:
+    send_frame( p, f->dlci, 0, TCM_CMUX_UA | TCM_CMUX_PF, NULL, 0 );
+    if( f->dlci == 0 )
+      reset_mux( p, t_cmux_closed, CMUX_RESTART_MS );
+    else if( p_ch ) {
+      p_ch->state = t_cmux_closed;
+      p_ch->deadline_ns = ms_from_now( CMUX_RESTART_MS );
+    }
+    break;
+
+  case TCM_CMUX_UIH:
+  case TCM_CMUX_UI:
+    if( f->dlci == 0 )
+      handle_ctrl( p, f->p_info, f->len );
+    else if( p_ch && p_ch->state == t_cmux_open && f->len > 0 )
+      post_data( p_ch, f->p_info, f->len );
+    break;
+  }
+}
+
+
+/*
+ * scan response to initialization command, caller holds mutex
+ */
+static void scan_init_response( t_cmux* p, const char* data, int len )
+{
+  int n = strlen( p->response ), i;
+
+  for( i = 0; i < len; ++i ) {
+    if( n == sizeof( p->response ) - 1 ) {
+      memmove( p->response, p->response + 1, --n );
+    }
+    p->response[n++] = data[i] ? data[i] : ' ';
+    p->response[n] = '\0';
+
+    if( strstr( p->response, "OK" ) ) {
+      p->state = t_cmux_opening;
+      p->retries = 1;
+      p->deadline_ns = ms_from_now( CMUX_T1_MS );
+      send_frame( p, 0, 1, TCM_CMUX_SABM | TCM_CMUX_PF, NULL, 0 );
+      return;
+    }
+  }
+}
+
+
+/*
+ * data from serial line, invoked by processing thread of serial line channel
+ */
+static int serial_evt_cb( t_icom_evt* p_evt )
+{
+  t_base_channel* p_base = (t_base_channel *)p_evt->p_user_ctx;
+  t_cmux* p = (t_cmux *)p_base->p_user_data;
+
+  base_channel_dispatched( p_base );
+
+  if( p == NULL || p_evt->type != ICOM_EVT_CLIENT_DATA )
+    return 0; /* multiplexer not yet fully set up */
+
+  pthread_mutex_lock( & p->mutex );
+  if( p->state == t_cmux_init )
+    scan_init_response( p, p_evt->p_data, p_evt->data_len );
+  else if( p->state == t_cmux_opening || p->state == t_cmux_open )
+    tcm_cmux_decode( & p->decoder, (const uint8_t *)p_evt->p_data, p_evt->data_len, handle_frame, p );
+  pthread_mutex_unlock( & p->mutex );
+
+  return 0;
+}
+
+
+/*
+ * retransmission of SABM or DISC for virtual channel, caller holds mutex
+ */
+static void supervise_channel( t_cmux* p, t_cmux_channel* p_ch, uint64_t now )
+{
+  if( p_ch->deadline_ns && now < p_ch->deadline_ns )
+    return;
+
+  switch( p_ch->state ) {
+  case t_cmux_closed:
+    p_ch->state = t_cmux_opening;
+    p_ch->retries = 0;
+    /* fall through */
+  case t_cmux_opening:
+    if( p_ch->retries++ < CMUX_N2 ) {
+      p_ch->deadline_ns = now + CMUX_T1_MS * 1000000ULL;
+      send_frame( p, p_ch->dlci, 1, TCM_CMUX_SABM | TCM_CMUX_PF, NULL, 0 );
+    } else {
+      tcm_error( "%s: DLCI %d not acknowledged, retry in %d milliseconds\n", __func__, p_ch->dlci, CMUX_RESTART_MS );
+      p_ch->state = t_cmux_closed;
+      p_ch->deadline_ns = now + CMUX_RESTART_MS * 1000000ULL;
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+
+static void* supervisor_thread( void* p_arg )
+{
+  t_cmux* p = (t_cmux *)p_arg;
+  t_base_channel* p_serial = (t_base_channel *)p->p_serial;
+  struct timespec ts;
+  uint64_t now;
+  long opens;
+  int i;
+
+  pthread_mutex_lock( & p->mutex );
+
+  while( ! p->terminate ) {
+    now = now_ns();
+
+    /* modem has been reset or reconnected */
+    opens = __atomic_load_n( & p_serial->nr_opens, __ATOMIC_RELAXED );
+    if( opens != p->serial_opens ) {
+      p->serial_opens = opens;
+      reset_mux( p, t_cmux_closed, 0 );
+    }
+
+    if( ! p_serial->is_open( p_serial ) ) {
+      if( p->state != t_cmux_closed )
+        reset_mux( p, t_cmux_closed, 0 );
+    }
+    else if( p->deadline_ns == 0 || now >= p->deadline_ns ) {
+      switch( p->state ) {
+      case t_cmux_closed:
+        start_mux( p );
+        break;
+
+      case t_cmux_init:
+      case t_cmux_opening:
+        if( p->retries < CMUX_N2 ) {
+          ++p->retries;
+          if( p->state == t_cmux_init ) {
+            p->deadline_ns = now + CMUX_INIT_TIMEOUT_MS * 1000000ULL;
+            write_serial( p, p->init_cmd, strlen( p->init_cmd ) );
+          } else {
+            p->deadline_ns = now + CMUX_T1_MS * 1000000ULL;
+            send_frame( p, 0, 1, TCM_CMUX_SABM | TCM_CMUX_PF, NULL, 0 );
+          }
+        } else {
+          tcm_error( "%s: no multiplexer response on %s, restart in %d milliseconds\n", __func__,
+                     p->p_serial->name, CMUX_RESTART_MS );
+          reset_mux( p, t_cmux_closed, CMUX_RESTART_MS );
+        }
+        break;
+
+      case t_cmux_open:
+        for( i = 1; i <= TCM_CMUX_MAX_DLCI; ++i )
+          if( p->channels[i] )
+            supervise_channel( p, p->channels[i], now );
+        break;
+
+      default:
+        break;
+      }
+    }
+
+    clock_gettime( CLOCK_REALTIME, & ts );
+    ts.tv_nsec += 100 * 1000000L;
+    if( ts.tv_nsec >= 1000000000L ) {
+      ts.tv_nsec -= 1000000000L;
+      ++ts.tv_sec;
+    }
+    pthread_cond_timedwait( & p->cond, & p->mutex, & ts );
+  }
+
+  pthread_mutex_unlock( & p->mutex );
+
+  return p;
+}
+
+
+static int is_cmux_channel_open( t_base_channel* p_base_channel )
+{
+  t_cmux_channel* p_ch = (t_cmux_channel *)p_base_channel;
+
+  return ( p_ch->state == t_cmux_open ) ? 1 : 0;
+}
+
+
+static int write_cmux_channel( t_base_channel* p_base_channel, const void* p_arg, const int len )
+{
+  t_cmux_channel* p_ch = (t_cmux_channel *)p_base_channel;
+  t_cmux* p = p_ch->p_mux;
+  int retcode, n;
+
+  pthread_mutex_lock( & p->mutex );
+
+  if( p_ch->state != t_cmux_open ) {
+    tcm_error( "%s: DLCI %d of %s not established error!\n", __func__, p_ch->dlci, p->p_serial->name );
+    retcode = -1;
+  } else if( p_ch->remote_fc || p->remote_fc || p_ch->tx_len ) {
+    /* keep order behind data already buffered */
+    n = CMUX_CH_TX_BUFFER_SIZE - p_ch->tx_len;
+    if( n > len )
+      n = len;
+    memcpy( p_ch->p_tx_buf + p_ch->tx_len, p_arg, n );
+    p_ch->tx_len += n;
+    p_ch->nr_tx_dropped += len - n;
+    flush_tx( p_ch );
+    retcode = n;
+  } else {
+    retcode = send_data( p_ch, p_arg, len );
+  }
+
+  pthread_mutex_unlock( & p->mutex );
+
+  return retcode;
+}
+
+
+/*
+ * processing thread callback, resumes the modem once the queue has been drained
+ */
+static int cmux_channel_evt_cb( t_icom_evt* p_evt )
+{
+  t_cmux_channel* p_ch = (t_cmux_channel *)p_evt->p_user_ctx;
+  t_base_channel* p_base = (t_base_channel *)p_ch;
+  int retcode;
+
+  retcode = p_base->read( p_evt );
+
+  if( p_ch->local_fc && base_channel_queue_depth( p_base ) <= CMUX_CH_FC_LOW ) {
+    pthread_mutex_lock( & p_ch->p_mux->mutex );
+    if( p_ch->local_fc ) {
+      p_ch->local_fc = 0;
+      if( p_ch->state == t_cmux_open )
+        send_msc( p_ch->p_mux, p_ch->dlci, 0 );
+    }
+    pthread_mutex_unlock( & p_ch->p_mux->mutex );
+  }
+
+  return retcode;
+}
+
+
+static int release_cmux_channel( t_base_channel* p_base_channel )
+{
+  t_cmux_channel* p_ch = (t_cmux_channel *)p_base_channel;
+  t_cmux* p;
+
+  if( p_ch )
+  {
+    base_channel_unregister( p_base_channel );
+
+    p = p_ch->p_mux;
+    pthread_mutex_lock( & p->mutex );
+    if( p->channels[p_ch->dlci] == p_ch ) {
+      p->channels[p_ch->dlci] = NULL;
+      if( p_ch->state == t_cmux_open && p->state == t_cmux_open )
+        send_frame( p, p_ch->dlci, 1, TCM_CMUX_DISC | TCM_CMUX_PF, NULL, 0 );
+    }
+    pthread_mutex_unlock( & p->mutex );
+
+    if( p_ch->p_icom_events )
+      kill_icom_event_handler( p_ch->p_icom_events );
+
+    if( p_ch->p_tx_buf )
+      cul_free( p_ch->p_tx_buf );
+
+    cul_free( p_ch );
+  }
+
+  return 0;
+}
+
+
+t_cmux_channel* init_cmux_channel( t_cmux* p_mux, int dlci, t_channel_cb p_read_cb )
+{
+  t_cmux_channel* p_ch;
+  t_base_channel* p_base;
+  t_tcm_rt_saved rt_saved;
+
+  if( dlci < 1 || dlci > TCM_CMUX_MAX_DLCI ) {
+    tcm_error( "%s: DLCI must be between 1 and %d error!\n", __func__, TCM_CMUX_MAX_DLCI );
+    return NULL;
+  }
+
+  p_ch = cul_malloc( sizeof( t_cmux_channel ) );
+  if( p_ch == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+  p_base = ((t_base_channel *)p_ch);
+
+  memset( p_ch, 0, sizeof( t_cmux_channel ) );
+  p_base->p_tcm_server_ctx = p_mux->p_tcm_server_ctx;
+  p_base->type = t_channel_cmux_type;
+  p_base->is_open = is_cmux_channel_open;
+  p_base->read = p_read_cb;
+  p_base->write = write_cmux_channel;
+  p_base->release = release_cmux_channel;
+  p_ch->p_mux = p_mux;
+  p_ch->dlci = dlci;
+
+  p_ch->p_tx_buf = cul_malloc( CMUX_CH_TX_BUFFER_SIZE );
+  if( p_ch->p_tx_buf == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    cul_free( p_ch );
+    return NULL;
+  }
+
+  /* processing thread is scheduled like the ones of device channels */
+  tcm_rt_begin_spawn( t_channel_dev_type, & rt_saved );
+  p_ch->p_icom_events = icom_create_event_handler( CMUX_CH_MAX_DATA_SIZE, CMUX_CH_POOL_SIZE, cmux_channel_evt_cb );
+  tcm_rt_end_spawn( & rt_saved );
+  if( p_ch->p_icom_events == NULL ) {
+    tcm_error( "%s: creation of event handler failed\n", __func__ );
+    cul_free( p_ch->p_tx_buf );
+    cul_free( p_ch );
+    return NULL;
+  }
+
+  pthread_mutex_lock( & p_mux->mutex );
+  if( p_mux->channels[dlci] ) {
+    pthread_mutex_unlock( & p_mux->mutex );
+    tcm_error( "%s: DLCI %d already in use error!\n", __func__, dlci );
+    kill_icom_event_handler( p_ch->p_icom_events );
+    cul_free( p_ch->p_tx_buf );
+    cul_free( p_ch );
+    return NULL;
+  }
+  p_mux->channels[dlci] = p_ch;
+  pthread_cond_signal( & p_mux->cond );
+  pthread_mutex_unlock( & p_mux->mutex );
+
+  base_channel_register( p_base );
+
+  return p_ch;
+}
+
+
+int cmux_is_valid( const t_cmux* p )
+{
+  int i, valid = 0;
+
+  pthread_mutex_lock( & instances_mutex );
+  for( i = 0; p && i < CMUX_MAX_INSTANCES; ++i ) {
+    if( instances[i] == p )
+      valid = 1;
+  }
+  pthread_mutex_unlock( & instances_mutex );
+
+  return valid;
+}
+
+
+static void free_cmux( t_cmux* p )
+{
+  if( p->p_serial )
+    ((t_base_channel *)p->p_serial)->release( (t_base_channel *)p->p_serial );
+
+  pthread_cond_destroy( & p->cond );
+  pthread_mutex_destroy( & p->mutex );
+  cul_free( p );
+}
+
+
+int release_cmux( t_cmux* p )
+{
+  int i;
+
+  pthread_mutex_lock( & p->mutex );
+  for( i = 1; i <= TCM_CMUX_MAX_DLCI; ++i ) {
+    if( p->channels[i] ) {
+      pthread_mutex_unlock( & p->mutex );
+      tcm_error( "%s: virtual channel of DLCI %d still open error!\n", __func__, i );
+      return -1;
+    }
+  }
+
+  if( p->state == t_cmux_open )
+    send_ctrl( p, TCM_CMUX_CTRL_CLD, 1, NULL, 0 );
+  p->terminate = 1;
+  pthread_cond_signal( & p->cond );
+  pthread_mutex_unlock( & p->mutex );
+
+  pthread_join( p->supervisor, NULL );
+
+  pthread_mutex_lock( & instances_mutex );
+  for( i = 0; i < CMUX_MAX_INSTANCES; ++i ) {
+    if( instances[i] == p )
+      instances[i] = NULL;
+  }
+  pthread_mutex_unlock( & instances_mutex );
+
+  free_cmux( p );
+
+  return 0;
+}
+
+
+t_cmux* init_cmux( t_tcm_server_ctx* p_tcm_server_ctx, const char* filename, const t_dev_serial_cfg* p_cfg,
+                   t_tcm_cmux_mode mode, int n1, const char* init_cmd )
+{
+  pthread_condattr_t attr;
+  t_cmux* p;
+  int i, slot = -1;
+
+  if( n1 < 1 || n1 > TCM_CMUX_MAX_INFO ) {
+    tcm_error( "%s: frame size must be between 1 and %d error!\n", __func__, TCM_CMUX_MAX_INFO );
+    return NULL;
+  }
+
+  if( strlen( init_cmd ) >= CMUX_MAX_INIT_LEN ) {
+    tcm_error( "%s: initialization command exceeds %d characters error!\n", __func__, CMUX_MAX_INIT_LEN - 1 );
+    return NULL;
+  }
+
+  p = cul_malloc( sizeof( t_cmux ) );
+  if( p == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+
+  memset( p, 0, sizeof( t_cmux ) );
+  p->p_tcm_server_ctx = p_tcm_server_ctx;
+  p->mode = mode;
+  p->n1 = n1;
+  strcpy( p->init_cmd, init_cmd );
+  tcm_cmux_decoder_init( & p->decoder, mode, n1 );
+
+  pthread_mutex_init( & p->mutex, NULL );
+  pthread_condattr_init( & attr );
+  pthread_cond_init( & p->cond, & attr );
+  pthread_condattr_destroy( & attr );
+
+  p->p_serial = init_serial_channel( p_tcm_server_ctx, filename, p_cfg, serial_evt_cb );
+  if( p->p_serial == NULL ) {
+    tcm_error( "%s: could not create serial line channel %s error!\n", __func__, filename );
+    free_cmux( p );
+    return NULL;
+  }
+  ((t_base_channel *)p->p_serial)->p_user_data = p;
+
+  pthread_mutex_lock( & instances_mutex );
+  for( i = 0; i < CMUX_MAX_INSTANCES && slot < 0; ++i ) {
+    if( instances[i] == NULL )
+      slot = i;
+  }
+  if( slot >= 0 )
+    instances[slot] = p;
+  pthread_mutex_unlock( & instances_mutex );
+
+  if( slot < 0 ) {
+    tcm_error( "%s: maximum number of %d multiplexers exceeded error!\n", __func__, CMUX_MAX_INSTANCES );
+    free_cmux( p );
+    return NULL;
+  }
+
+  if( pthread_create( & p->supervisor, NULL, supervisor_thread, p ) ) {
+    tcm_error( "%s: creation of supervisor thread failed error!\n", __func__ );
+    pthread_mutex_lock( & instances_mutex );
+    instances[slot] = NULL;
+    pthread_mutex_unlock( & instances_mutex );
+    free_cmux( p );
+    return NULL;
+  }
+
+  return p;
+}
+
+
+int cmux_stats( t_cmux* p, t_cmux_stats* p_stats, int max )
+{
+  t_cmux_channel* p_ch;
+  int i, n = 0;
+
+  pthread_mutex_lock( & p->mutex );
+
+  if( n < max ) {
+    memset( & p_stats[n], 0, sizeof( t_cmux_stats ) );
+    p_stats[n].state = p->state;
+    p_stats[n].nr_rx_frames = p->decoder.nr_frames;
+    p_stats[n].remote_fc = p->remote_fc;
+    ++n;
+  }
+
+  for( i = 1; i <= TCM_CMUX_MAX_DLCI && n < max; ++i ) {
+    p_ch = p->channels[i];
+    if( p_ch == NULL )
+      continue;
+    p_stats[n].dlci = i;
+    p_stats[n].state = p_ch->state;
+    p_stats[n].nr_rx_frames = p_ch->nr_rx_frames;
+    p_stats[n].nr_tx_frames = p_ch->nr_tx_frames;
+    p_stats[n].nr_tx_dropped = p_ch->nr_tx_dropped;
+    p_stats[n].remote_fc = p_ch->remote_fc;
+    p_stats[n].local_fc = p_ch->local_fc;
+    ++n;
+  }
+
+  pthread_mutex_unlock( & p->mutex );
+
+  return n;
+}
@@ -0,0 +1,222 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_CMUX_CHANNEL_H
+#define TCM_CMUX_CHANNEL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <intercom/events.h>
+#include <base_channel.h>
+#include <dev_channel.h>
+#include <tcm_cmux.h>
+#include <tcm_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+    \file cmux_channel.h
+    \brief virtual channels of a 3GPP TS 27.010 multiplexer
+
+    The multiplexer owns a serial line channel. Once the device has been
+    opened it optionally sends an initialization command such as AT+CMUX=0,
+    establishes the control channel (DLCI 0) and then the data link
+    connection of each virtual channel. Frames are decoded in the processing
+    thread of the serial line channel and their payload is queued to the
+    virtual channel of the DLCI, which has its own processing thread and
+    callback like any other channel.
+
+    Flow control is done per virtual channel with the modem status command:
+    when the queue of a virtual channel fills up, the modem is asked to stop
+    sending on its DLCI until the queue has been drained. Likewise data
+    written while the modem has stopped a DLCI is buffered and sent when the
+    modem allows it again.
+
+    The multiplexer restarts from scratch whenever the serial device has been
+    reopened.
+
+    \addtogroup channels
+    @{
+ */
+
+#define CMUX_CH_MAX_DATA_SIZE      1024                 /*!< maximum data chunk size handed to callback at once */
+#define CMUX_CH_POOL_SIZE          32                   /*!< number of data chunks in ring buffer */
+#define CMUX_CH_FC_HIGH            24                   /*!< queued chunks to stop the modem */
+#define CMUX_CH_FC_LOW             8                    /*!< queued chunks to let the modem resume */
+#define CMUX_CH_TX_BUFFER_SIZE     4096                 /*!< written data buffered while the modem stopped the DLCI */
+#define CMUX_T1_MS                 300                  /*!< acknowledgement timer */
+#define CMUX_N2                    3                    /*!< maximum number of retransmissions */
+#define CMUX_INIT_TIMEOUT_MS       2000                 /*!< time to wait for response to initialization command */
+#define CMUX_RESTART_MS            3000                 /*!< delay before restart after failure */
+#define CMUX_MAX_INSTANCES         4                    /*!< maximum number of multiplexers */
+#define CMUX_MAX_INIT_LEN          64                   /*!< maximum length of initialization command */
+
+
+/*!
+ * state of multiplexer or data link connection
+ */
+typedef enum {
+  t_cmux_closed,                                        /*!< not established */
+  t_cmux_init,                                          /*!< multiplexer: waiting for OK to init command */
+  t_cmux_opening,                                       /*!< SABM sent, waiting for UA */
+  t_cmux_open,                                          /*!< established */
+  t_cmux_closing                                        /*!< DISC sent, waiting for UA */
+} t_cmux_state;
+
+
+struct s_cmux;
+
+/*!
+ * virtual channel object
+ */
+typedef struct s_cmux_channel {
+
+  t_base_channel                base;                   /*!< base class */
+
+  struct s_cmux*                p_mux;                  /*!< multiplexer */
+  int                           dlci;                   /*!< data link connection identifier */
+  t_icom_events*                p_icom_events;          /*!< processing thread and queue */
+
+  t_cmux_state                  state;                  /*!< state of data link connection */
+  int                           retries;                /*!< transmissions of pending SABM or DISC */
+  uint64_t                      deadline_ns;            /*!< retransmission or retry time */
+  int                           remote_fc;              /*!< 1 when the modem stopped us from sending */
+  int                           local_fc;               /*!< 1 when we stopped the modem from sending */
+  char*                         p_tx_buf;               /*!< data written while stopped */
+  int                           tx_len;                 /*!< length of buffered data */
+
+  long                          nr_rx_frames;           /*!< received data frames */
+  long                          nr_tx_frames;           /*!< sent data frames */
+  long                          nr_tx_dropped;          /*!< bytes dropped because the transmit buffer was full */
+} t_cmux_channel;
+
+
+/*!
+ * multiplexer object
+ */
+typedef struct s_cmux {
+  t_tcm_server_ctx*             p_tcm_server_ctx;       /*!< back reference to server context */
+  t_dev_channel*                p_serial;               /*!< serial line channel */
+  t_tcm_cmux_mode               mode;                   /*!< frame option */
+  int                           n1;                     /*!< maximum size of information field */
+  char                          init_cmd[CMUX_MAX_INIT_LEN]; /*!< command switching the modem to multiplexer mode */
+
+  pthread_mutex_t               mutex;                  /*!< protects everything below, serializes frames */
+  pthread_cond_t                cond;                   /*!< wakes up supervisor thread */
+  pthread_t                     supervisor;             /*!< connection establishment and retransmissions */
+  int                           terminate;              /*!< set to 1 to stop supervisor thread */
+
+  t_cmux_state                  state;                  /*!< state of multiplexer respectively control channel */
+  int                           retries;                /*!< transmissions of init command or SABM */
+  uint64_t                      deadline_ns;            /*!< retransmission or restart time */
+  long                          serial_opens;           /*!< number of serial device opens seen */
+  int                           remote_fc;              /*!< 1 when the modem stopped all DLCIs */
+  char                          response[16];           /*!< tail of response to init command */
+
+  t_tcm_cmux_decoder            decoder;                /*!< frame decoder */
+  t_cmux_channel*               channels[TCM_CMUX_MAX_DLCI+1]; /*!< virtual channels indexed by DLCI */
+  long                          nr_restarts;            /*!< (re)starts of the multiplexer */
+} t_cmux;
+
+
+/*!
+ * statistics of one data link connection
+ */
+typedef struct s_cmux_stats {
+  int                           dlci;                   /*!< data link connection identifier, 0 for control channel */
+  t_cmux_state                  state;                  /*!< state */
+  long                          nr_rx_frames;           /*!< received data frames, all frames for control channel */
+  long                          nr_tx_frames;           /*!< sent data frames */
+  long                          nr_tx_dropped;          /*!< bytes dropped because the transmit buffer was full */
+  int                           remote_fc;              /*!< 1 when the modem stopped us from sending */
+  int                           local_fc;               /*!< 1 when we stopped the modem from sending */
+} t_cmux_stats;
+
+
+/*!
+ * constructor for multiplexer
+ *
+ * \param p_tcm_server_ctx pointer to main instance object
+ * \param filename serial device file name e.g. /dev/ttyS1
+ * \param p_cfg pointer to serial line settings
+ * \param mode frame option
+ * \param n1 maximum size of information field
+ * \param init_cmd command switching modem to multiplexer mode or empty string
+ * \return pointer to multiplexer or NULL in case of error
+ */
+t_cmux* init_cmux( t_tcm_server_ctx* p_tcm_server_ctx, const char* filename, const t_dev_serial_cfg* p_cfg,
+                   t_tcm_cmux_mode mode, int n1, const char* init_cmd );
+
+
+/*!
+ * destructor for multiplexer, closes down multiplexer mode
+ *
+ * \param p pointer to multiplexer
+ * \return 0 in case of success, -1 when virtual channels are still open
+ */
+int release_cmux( t_cmux* p );
+
+
+/*!
+ * check whether pointer refers to existing multiplexer
+ *
+ * \param p pointer to check
+ * \return 1 when valid, otherwise 0
+ */
+int cmux_is_valid( const t_cmux* p );
+
+
+/*!
+ * constructor for virtual channel
+ *
+ * \param p_mux pointer to multiplexer
+ * \param dlci data link connection identifier between 1 and 63
+ * \param p_read_cb callback handler which is invoked by the processing thread
+ * \return pointer to channel instance or NULL in case of error
+ */
+t_cmux_channel* init_cmux_channel( t_cmux* p_mux, int dlci, t_channel_cb p_read_cb );
+
+
+/*!
+ * retrieve statistics of control channel and all virtual channels
+ *
+ * \param p pointer to multiplexer
+ * \param p_stats array for statistics
+ * \param max size of array
+ * \return number of returned entries
+ */
+int cmux_stats( t_cmux* p, t_cmux_stats* p_stats, int max );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_CMUX_CHANNEL_H */
@@ -29,38 +29,230 @@
 #include <dev_channel.h>
 #include <olcutils/alloc.h>
 #include <tcm_log.h>
+#include <tcm_rt.h>
+#include <tcm_boot.h>
+#include <tcm_scheme.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+
+/*! supported baud rates */
+static const struct {
+  int baud;
+  speed_t speed;
+} baud_table[] = {
+  { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+  { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+#ifdef B230400
+  { 230400, B230400 },
+#endif
+#ifdef B460800
+  { 460800, B460800 },
+#endif
+#ifdef B921600
+  { 921600, B921600 },
+#endif
+#ifdef B1000000
+  { 1000000, B1000000 },
+#endif
+#ifdef B2000000
+  { 2000000, B2000000 },
+#endif
+#ifdef B3000000
+  { 3000000, B3000000 },
+#endif
+#ifdef B4000000
+  { 4000000, B4000000 },
+#endif
+};
+
+speed_t dev_channel_baud_to_speed( int baud )
+{
+  int i;
+
+  for( i = 0; i < sizeof( baud_table ) / sizeof( baud_table[0] ); ++i ) {
+    if( baud_table[i].baud == baud )
+      return baud_table[i].speed;
+  }
+
+  return B0;
+}
+
+
+/*
+ * switch serial line to raw mode and apply channel's line settings
+ * returns 0 in case of success
+ */
+static int apply_serial_cfg( t_dev_channel* p )
+{
+  const t_dev_serial_cfg* p_cfg = & p->serial;
+  struct termios tio;
+  speed_t speed = dev_channel_baud_to_speed( p_cfg->baud );
+  int flags;
+
+  if( tcgetattr( p->fd, & tio ) ) {
+    tcm_error( "%s: %s is not a terminal device error!\n", __func__, p->name );
+    return -1;
+  }
+
+  cfmakeraw( & tio );
+  tio.c_cflag |= CLOCAL | CREAD;
+  if( p_cfg->rtscts )
+    tio.c_cflag |= CRTSCTS;
+  else
+    tio.c_cflag &= ~CRTSCTS;
+  tio.c_cc[VMIN] = p_cfg->vmin;
+  tio.c_cc[VTIME] = p_cfg->vtime;
+  cfsetispeed( & tio, speed );
+  cfsetospeed( & tio, speed );
+
+  if( tcsetattr( p->fd, TCSANOW, & tio ) ) {
+    tcm_error( "%s: could not configure %s error!\n", __func__, p->name );
+    return -1;
+  }
+
+  /* discard data received before the line has been configured */
+  tcflush( p->fd, TCIFLUSH );
+
+  if( p_cfg->low_latency ) {
+#if defined( TIOCGSERIAL ) && defined( ASYNC_LOW_LATENCY )
+    struct serial_struct ser;
+
+    if( ioctl( p->fd, TIOCGSERIAL, & ser ) == 0 ) {
+      ser.flags |= ASYNC_LOW_LATENCY;
+      if( ioctl( p->fd, TIOCSSERIAL, & ser ) )
+        tcm_error( "%s: could not set low latency mode for %s\n", __func__, p->name );
+    } else {
+      tcm_error( "%s: driver of %s does not support low latency mode\n", __func__, p->name );
+    }
+#else
+    tcm_error( "%s: low latency mode not supported on this platform\n", __func__ );
+#endif
+  }
+
+  /* device has been opened non blocking to avoid waiting for carrier */
+  flags = fcntl( p->fd, F_GETFL );
+  if( flags < 0 || fcntl( p->fd, F_SETFL, flags & ~O_NONBLOCK ) ) {
+    tcm_error( "%s: could not switch %s to blocking mode error!\n", __func__, p->name );
+    return -1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * post data as one or several events
+ */
+static void post_data( t_dev_channel* p, const char* data, int len )
+{
+  t_icom_events* p_events = p->p_icom_events;
+  int n;
+
+  while( len > 0 ) {
+    p->p_evt = base_channel_alloc_evt( p_events );
+
+    p->p_evt->type = ICOM_EVT_CLIENT_DATA;
+    p->p_evt->p_user_ctx = p;
+    memset( p->p_evt->p_data, 0, p->p_evt->max_data_size );
+
+    n = ( len < p->p_evt->max_data_size ) ? len : p->p_evt->max_data_size;
+    memcpy( p->p_evt->p_data, data, n );
+    p->p_evt->data_len = n;
+
+    base_channel_post_evt( p_events, p->p_evt );
+    p->p_evt = NULL;
+
+    data += n;
+    len -= n;
+  }
+}
+
+
+/*
+ * read through the coalescing stage, waiting for data at most until held lines are due
+ * returns -1 when the stream broke
+ */
+static int coalescing_read( t_dev_channel* p )
+{
+  char in[DEV_CH_MAX_DATA_SIZE];
+  char out[TCM_COALESCE_OUT_SIZE( DEV_CH_MAX_DATA_SIZE )];
+  struct pollfd pfd;
+  int timeout, len, ret;
+
+  timeout = tcm_coalesce_timeout_ms( p->p_coalesce );
+  if( timeout >= 0 ) {
+    pfd.fd = p->fd;
+    pfd.events = POLLIN;
+    ret = poll( & pfd, 1, timeout );
+    if( ret == 0 || ( ret < 0 && errno == EINTR ) ) {
+      post_data( p, out, tcm_coalesce_expire( p->p_coalesce, out, sizeof( out ) ) );
+      return 0;
+    }
+  }
+
+  len = read( p->fd, in, sizeof( in ) );
+  if( len <= 0 )
+    return -1;
+
+  tcm_trace_read_done();
+  post_data( p, out, tcm_coalesce_filter( p->p_coalesce, in, len, out, sizeof( out ) ) );
+
+  return 0;
+}
 
 
 static void* dev_read_handler( void* pCtx )
 {
   t_dev_channel* p = (t_dev_channel *)pCtx;
+  t_base_channel* p_base = (t_base_channel *)pCtx;
   t_icom_events* p_events = p->p_icom_events;
   long cnt = 0;
 
   while( 1 )  /* open loop */
   {
     tcm_message( "%s for dev name %s (re)started\n", __func__, p->name );
-    p->fd = open( p->name, O_RDWR );
+    if( p->serial.baud ) {
+      p->fd = open( p->name, O_RDWR | O_NOCTTY | O_NONBLOCK );
+      if( p->fd >= 0 && apply_serial_cfg( p ) ) {
+        close( p->fd );
+        p->fd = -1;
+      }
+    } else {
+      p->fd = open( p->name, O_RDWR );
+    }
+
     if( p->fd >= 0 ) {
       /* success */
       tcm_message( "%s: successfully opened %s, start reading form descriptor %d ...\n", __func__, p->name, p->fd );
+      __atomic_add_fetch( & p_base->nr_opens, 1, __ATOMIC_RELAXED );
+
+      if( tcm_boot_channel_live( p->name ) && p_base->p_tcm_server_ctx && p_base->p_tcm_server_ctx->p_scheme )
+        tcm_scheme_channel_live( p_base->p_tcm_server_ctx->p_scheme );
 
       while( 1 )   /* read loop */
       {
-        /* unlink event for processing out of pool */
-        pthread_mutex_lock( & p_events->mutex );
-        if ( !IsListEmpty( & p_events->pool ) ) {
-          p->p_evt = (t_icom_evt*)RemoveHeadList( & p_events->pool );
-        }
-        else {
-          tcm_error("event queue overflow error, overwriting existing events\n");
-          p->p_evt = (t_icom_evt*)RemoveHeadList( & p_events->ready_list );
+        /* rules are usually defined for modem channels only */
+        if( tcm_coalesce_active( p->p_coalesce ) ) {
+          if( coalescing_read( p ) == 0 )
+            continue;
+
+          tcm_error( "%s: file reader stream broke!\n", __func__ );
+          tcm_coalesce_reset( p->p_coalesce );
+          close( p->fd );
+          p->fd = -1;
+          break;
         }
-        pthread_mutex_unlock( & p_events->mutex );
+
+        p->p_evt = base_channel_alloc_evt( p_events );
 
         p->p_evt->type = ICOM_EVT_CLIENT_DATA;
         p->p_evt->p_user_ctx = p;
@@ -69,17 +261,15 @@ static void* dev_read_handler( void* pCtx )
         p->p_evt->data_len = read( p->fd, p->p_evt->p_data, p->p_evt->max_data_size );
         if( p->p_evt->data_len > 0 )
         {
+          tcm_trace_read_done();
 // #define TEST
 #ifdef TEST
           tcm_message( "received message: %s\n", p->p_evt->p_data );
 #endif /* #ifdef TEST */
 
           /* insert newly created event in ready list */
-          pthread_mutex_lock( & p_events->mutex );
-          InsertTailList( & p_events->ready_list, & p->p_evt->node);
+          base_channel_post_evt( p_events, p->p_evt );
           p->p_evt = NULL;
-          pthread_cond_signal( & p_events->signal );
-          pthread_mutex_unlock( & p_events->mutex );
 
           ++cnt;
         }
@@ -88,10 +278,8 @@ static void* dev_read_handler( void* pCtx )
           tcm_error( "%s: file reader stream broke!\n", __func__ );
 
           /* put unprocessed event back in pool */
-          pthread_mutex_lock( & p_events->mutex );
-          InsertTailList( & p_events->pool, & p->p_evt->node );
+          base_channel_free_evt( p_events, p->p_evt );
           p->p_evt = NULL;
-          pthread_mutex_unlock( & p_events->mutex );
 
           close( p->fd );
           p->fd = -1;
@@ -128,6 +316,9 @@ static int write_dev_channel( t_base_channel* p_base_channel, const void* p_arg,
 
   if( p->fd >= 0 ) {
     retcode = write( p->fd, (char *)p_arg, len );
+    /* the response must not be taken for URCs */
+    if( retcode > 0 )
+      tcm_coalesce_command( p->p_coalesce );
   } else {
     tcm_error("%s: could not write to channel %s error!\n", __func__, p->name );
     retcode = -1;
@@ -144,6 +335,8 @@ static int release_dev_channel( t_base_channel* p_base_channel )
 
   if( p )
   {
+    base_channel_unregister( p_base_channel );
+
     if( p->p_read_handler )
       pthread_cancel( p->p_read_handler );
 
@@ -155,23 +348,24 @@ static int release_dev_channel( t_base_channel* p_base_channel )
     if( p_events ) {
       if( p->p_evt ) {
         /* put eventually remaining tempory buffer back in pool */
-        pthread_mutex_lock( & p_events->mutex );
-        InsertTailList( & p_events->pool, & p->p_evt->node );
-        pthread_mutex_unlock( & p_events->mutex );
+        base_channel_free_evt( p_events, p->p_evt );
       }
       kill_icom_event_handler( p_events );
     }
 
+    tcm_coalesce_release( p->p_coalesce );
     cul_free( p );
   }
 
   return retcode;
 }
 
-t_dev_channel* init_dev_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* filename, t_channel_cb p_read_cb )
+static t_dev_channel* create_dev_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* filename,
+                                          const t_dev_serial_cfg* p_cfg, t_channel_cb p_read_cb )
 {
   t_dev_channel* p;
   t_base_channel* p_base;
+  t_tcm_rt_saved rt_saved;
   int retcode;
 
   p = cul_malloc( sizeof( t_dev_channel ) );
@@ -191,22 +385,59 @@ t_dev_channel* init_dev_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char*
   p->fd = -1; /* to indicate non initialized descriptor */
 
   strncpy( p->name, filename, sizeof( p->name ) );
+  if( p_cfg )
+    p->serial = *p_cfg;
+
+  p->p_coalesce = tcm_coalesce_create( & p_base->nr_suppressed );
+  if( p->p_coalesce == NULL ) {
+    release_dev_channel( p_base );
+    return NULL;
+  }
+
+  /* dispatcher and reader thread inherit the real-time settings */
+  tcm_rt_begin_spawn( t_channel_dev_type, & rt_saved );
 
   p->p_icom_events = icom_create_event_handler( DEV_CH_MAX_DATA_SIZE, DEV_CH_POOL_SIZE, p_read_cb );
   if( p->p_icom_events == NULL  ) {
+    tcm_rt_end_spawn( & rt_saved );
     tcm_error( "%s: creation of event handler failed\n", __func__ );
     release_dev_channel( p_base );
-    p = NULL;
+    return NULL;
   }
 
   retcode = pthread_create( &p->p_read_handler, NULL, dev_read_handler, p );
+  tcm_rt_end_spawn( & rt_saved );
   if( ! retcode )
     retcode = pthread_detach( p->p_read_handler );
   if( retcode ) {
     tcm_error( "%s: creation of read handler thread failed with error %d\n", __func__, retcode );
     release_dev_channel( p_base );
     p = NULL;
+  } else {
+    base_channel_register( p_base );
   }
 
   return p;
 }
+
+t_dev_channel* init_dev_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* filename, t_channel_cb p_read_cb )
+{
+  return create_dev_channel( p_tcm_server_ctx, filename, NULL, p_read_cb );
+}
+
+t_dev_channel* init_serial_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* filename,
+                                    const t_dev_serial_cfg* p_cfg, t_channel_cb p_read_cb )
+{
+  if( dev_channel_baud_to_speed( p_cfg->baud ) == B0 ) {
+    tcm_error( "%s: baud rate %d not supported error!\n", __func__, p_cfg->baud );
+    return NULL;
+  }
+
+  /* read() returns 0 on timeouts otherwise, which is taken for a broken stream */
+  if( p_cfg->vmin < 1 ) {
+    tcm_error( "%s: vmin must be at least 1 error!\n", __func__ );
+    return NULL;
+  }
+
+  return create_dev_channel( p_tcm_server_ctx, filename, p_cfg, p_read_cb );
+}
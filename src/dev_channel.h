@@ -27,9 +27,11 @@
 #ifndef TCM_DEV_CHANNEL_H
 #define TCM_DEV_CHANNEL_H
 
+#include <termios.h>
 #include <intercom/events.h>
 #include <base_channel.h>
 #include <tcm_server.h>
+#include <tcm_coalesce.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +49,18 @@ extern "C" {
 #define DEV_CH_POOL_SIZE           10                   /*!< number of data chunks in ring buffer */
 #define DEV_CH_REOPEN_TIME_MS      1000                 /*!< number of milliseconds timeout before retry opening file */
 
+/*!
+ * serial line settings applied whenever the device is (re)opened
+ */
+typedef struct s_dev_serial_cfg {
+  int                           baud;                   /*!< baud rate, 0 when device is not configured */
+  int                           rtscts;                 /*!< 1 to enable RTS/CTS hardware flow control */
+  int                           vmin;                   /*!< minimum number of characters for read, at least 1 */
+  int                           vtime;                  /*!< read timeout in tenths of a second */
+  int                           low_latency;            /*!< 1 to disable buffering in serial driver */
+} t_dev_serial_cfg;
+
+
 /*!
  * device channel object
  */
@@ -59,6 +73,8 @@ typedef struct s_dev_channel {
   pthread_t                     p_read_handler;         /*!< device read handler */
   t_icom_events*                p_icom_events;          /*!< device I/O handler */
   t_icom_evt*                   p_evt;                  /*!< next processed event */
+  t_dev_serial_cfg              serial;                 /*!< serial line settings */
+  t_tcm_coalesce*               p_coalesce;             /*!< coalescing of URC bursts */
 } t_dev_channel;
 
 
@@ -77,6 +93,31 @@ typedef struct s_dev_channel {
 t_dev_channel* init_dev_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* filename, t_channel_cb p_read_cb );
 
 
+/*!
+ * constructor for serial line channel
+ *
+ * Same as init_dev_channel() but the terminal is switched to raw mode and the
+ * given line settings are applied each time the device is (re)opened.
+ *
+ * \param p_tcm_server_ctx pointer to main instance object
+ * \param filename full qualified serial device file name e.g. /dev/ttyUSB0
+ * \param p_cfg pointer to serial line settings
+ * \param p_read_cb callback handler which is invoked by the processing thread
+ * \return pointer to channel instance or NULL in case of error
+ */
+t_dev_channel* init_serial_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* filename,
+                                    const t_dev_serial_cfg* p_cfg, t_channel_cb p_read_cb );
+
+
+/*!
+ * map numeric baud rate to termios speed constant
+ *
+ * \param baud baud rate e.g. 115200
+ * \return speed constant or B0 when the baud rate is not supported
+ */
+speed_t dev_channel_baud_to_speed( int baud );
+
+
 /*! @} */
 
 #ifdef __cplusplus
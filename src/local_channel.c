@@ -0,0 +1,273 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <local_channel.h>
+#include <olcutils/alloc.h>
+#include <tcm_log.h>
+#include <tcm_rt.h>
+
+
+/*! subscriptions of all local channels */
+static struct {
+  pthread_mutex_t               mutex;                  /*!< protects table */
+  struct {
+    char                        topic[LOCAL_CH_MAX_NAME]; /*!< topic name */
+    t_local_channel*            p_channel;              /*!< subscriber, NULL for free entry */
+  }                             entries[LOCAL_CH_MAX_SUBSCRIPTIONS];
+  int                           nr_entries;             /*!< number of used entries */
+} bus = { PTHREAD_MUTEX_INITIALIZER };
+
+
+/*
+ * queue reference to buffer, returns 0 in case of success and -1 when queue is full
+ */
+static int post_buf( t_local_channel* p, t_shared_buf* p_buf )
+{
+  t_base_channel* p_base = (t_base_channel *)p;
+  t_icom_evt* p_evt;
+  long done;
+  int retcode = -1;
+
+  pthread_mutex_lock( & p->post_mutex );
+
+  /*
+   * Events must never be taken from the ready list since each one stands for
+   * a reference. The event of the buffer released last may not yet be back
+   * in the pool, hence one is kept in reserve.
+   */
+  done = __atomic_load_n( & p->nr_bufs_done, __ATOMIC_ACQUIRE );
+  if( p->nr_bufs_posted - done < LOCAL_CH_POOL_SIZE - 1 ) {
+    p->p_bufs[p->nr_bufs_posted % LOCAL_CH_POOL_SIZE] = shared_buf_ref( p_buf );
+    __atomic_store_n( & p->nr_bufs_posted, p->nr_bufs_posted + 1, __ATOMIC_RELEASE );
+
+    p_evt = base_channel_alloc_evt( p->p_icom_events );
+    p_evt->type = ICOM_EVT_CLIENT_DATA;
+    p_evt->p_user_ctx = p;
+    p_evt->data_len = p_buf->len;
+    base_channel_post_evt( p->p_icom_events, p_evt );
+    retcode = 0;
+  } else {
+    __atomic_add_fetch( & p_base->nr_overflows, 1, __ATOMIC_RELAXED );
+  }
+
+  pthread_mutex_unlock( & p->post_mutex );
+
+  return retcode;
+}
+
+
+/*
+ * processing thread callback, hands the referenced data to the channel callback
+ */
+static int local_evt_cb( t_icom_evt* p_evt )
+{
+  t_local_channel* p = (t_local_channel *)p_evt->p_user_ctx;
+  t_base_channel* p_base = (t_base_channel *)p;
+  t_shared_buf* p_buf;
+  void* p_data;
+  long done;
+  int retcode;
+
+  /* events are processed in the order the buffers have been added */
+  done = p->nr_bufs_done;
+  p_buf = p->p_bufs[done % LOCAL_CH_POOL_SIZE];
+
+  /* data is passed in place, the event is restored before it returns to the pool */
+  p_data = p_evt->p_data;
+  p_evt->p_data = p_buf->data;
+  p_evt->data_len = p_buf->len;
+  retcode = p_base->read( p_evt );
+  p_evt->p_data = p_data;
+
+  __atomic_store_n( & p->nr_bufs_done, done + 1, __ATOMIC_RELEASE );
+  shared_buf_unref( p_buf );
+
+  return retcode;
+}
+
+
+static int is_local_channel_open( t_base_channel* p_base_channel )
+{
+  return 1;
+}
+
+
+static int write_local_channel( t_base_channel* p_base_channel, const void* p_arg, const int len )
+{
+  t_local_channel* p = (t_local_channel *)p_base_channel;
+  t_shared_buf* p_buf;
+  int retcode;
+
+  p_buf = shared_buf_new( p_arg, len );
+  if( p_buf == NULL )
+    return -1;
+
+  retcode = post_buf( p, p_buf ) ? -1 : len;
+  if( retcode < 0 )
+    tcm_error( "%s: queue of local channel %s full, message dropped error!\n", __func__, p->name );
+
+  shared_buf_unref( p_buf );
+
+  return retcode;
+}
+
+
+static int release_local_channel( t_base_channel* p_base_channel )
+{
+  t_local_channel* p = (t_local_channel *)p_base_channel;
+  int i;
+
+  if( p )
+  {
+    base_channel_unregister( p_base_channel );
+
+    pthread_mutex_lock( & bus.mutex );
+    for( i = 0; i < bus.nr_entries; ) {
+      if( bus.entries[i].p_channel == p )
+        bus.entries[i] = bus.entries[--bus.nr_entries];
+      else
+        ++i;
+    }
+    pthread_mutex_unlock( & bus.mutex );
+
+    if( p->p_icom_events )
+      kill_icom_event_handler( p->p_icom_events );
+
+    /* drop references of events which have not been processed */
+    for( ; p->nr_bufs_done < p->nr_bufs_posted; ++p->nr_bufs_done )
+      shared_buf_unref( p->p_bufs[p->nr_bufs_done % LOCAL_CH_POOL_SIZE] );
+
+    pthread_mutex_destroy( & p->post_mutex );
+    cul_free( p );
+  }
+
+  return 0;
+}
+
+
+t_local_channel* init_local_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* name, t_channel_cb p_read_cb )
+{
+  t_local_channel* p;
+  t_base_channel* p_base;
+  t_tcm_rt_saved rt_saved;
+
+  if( strlen( name ) >= LOCAL_CH_MAX_NAME ) {
+    tcm_error( "%s: name %s exceeds %d characters error!\n", __func__, name, LOCAL_CH_MAX_NAME - 1 );
+    return NULL;
+  }
+
+  p = cul_malloc( sizeof( t_local_channel ) );
+  if( p == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+  p_base = ((t_base_channel *)p);
+
+  memset( p, 0, sizeof( t_local_channel ) );
+  p_base->p_tcm_server_ctx = p_tcm_server_ctx;
+  p_base->type = t_channel_local_type;
+  p_base->is_open = is_local_channel_open;
+  p_base->read = p_read_cb;
+  p_base->write = write_local_channel;
+  p_base->release = release_local_channel;
+  pthread_mutex_init( & p->post_mutex, NULL );
+  strcpy( p->name, name );
+
+  /* events carry no data, processing is scheduled like for sockets */
+  tcm_rt_begin_spawn( t_channel_client_sock_type, & rt_saved );
+  p->p_icom_events = icom_create_event_handler( LOCAL_CH_EVT_DATA_SIZE, LOCAL_CH_POOL_SIZE, local_evt_cb );
+  tcm_rt_end_spawn( & rt_saved );
+
+  if( p->p_icom_events == NULL ) {
+    tcm_error( "%s: creation of event handler failed\n", __func__ );
+    release_local_channel( p_base );
+    return NULL;
+  }
+
+  base_channel_register( p_base );
+
+  return p;
+}
+
+
+int local_channel_subscribe( t_local_channel* p, const char* topic )
+{
+  int i, retcode = 0;
+
+  if( strlen( topic ) >= LOCAL_CH_MAX_NAME ) {
+    tcm_error( "%s: topic %s exceeds %d characters error!\n", __func__, topic, LOCAL_CH_MAX_NAME - 1 );
+    return -1;
+  }
+
+  pthread_mutex_lock( & bus.mutex );
+
+  for( i = 0; i < bus.nr_entries; ++i ) {
+    if( bus.entries[i].p_channel == p && ! strcmp( bus.entries[i].topic, topic ) )
+      break;
+  }
+
+  if( i < bus.nr_entries ) {
+    /* already subscribed */
+  } else if( bus.nr_entries < LOCAL_CH_MAX_SUBSCRIPTIONS ) {
+    strcpy( bus.entries[bus.nr_entries].topic, topic );
+    bus.entries[bus.nr_entries].p_channel = p;
+    ++bus.nr_entries;
+  } else {
+    tcm_error( "%s: maximum number of %d subscriptions exceeded error!\n", __func__, LOCAL_CH_MAX_SUBSCRIPTIONS );
+    retcode = -1;
+  }
+
+  pthread_mutex_unlock( & bus.mutex );
+
+  return retcode;
+}
+
+
+int local_channel_publish( const char* topic, const void* data, int len )
+{
+  t_shared_buf* p_buf;
+  int i, n = 0;
+
+  /* one copy shared by all subscribers */
+  p_buf = shared_buf_new( data, len );
+  if( p_buf == NULL )
+    return -1;
+
+  pthread_mutex_lock( & bus.mutex );
+  for( i = 0; i < bus.nr_entries; ++i ) {
+    if( ! strcmp( bus.entries[i].topic, topic ) && post_buf( bus.entries[i].p_channel, p_buf ) == 0 ) {
+      base_channel_count_tx( (t_base_channel *)bus.entries[i].p_channel, len );
+      ++n;
+    }
+  }
+  pthread_mutex_unlock( & bus.mutex );
+
+  shared_buf_unref( p_buf );
+
+  return n;
+}
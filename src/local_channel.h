@@ -0,0 +1,120 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_LOCAL_CHANNEL_H
+#define TCM_LOCAL_CHANNEL_H
+
+#include <pthread.h>
+#include <intercom/events.h>
+#include <base_channel.h>
+#include <shared_buf.h>
+#include <tcm_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+    \file local_channel.h
+    \brief in-process channels and publish/subscribe bus
+
+    Data written to a local channel is passed to its own callback through
+    its queue and processing thread like data received by any other
+    channel, but without involving the kernel. Local channels can also be
+    subscribed to topics of the bus: a message published to a topic is
+    stored once in a reference counted buffer which is queued to each
+    subscribed channel and handed to its callback without further copies.
+
+    Queued events refer to the buffers kept in the channel in the same
+    order. When the queue of a local channel is full, new messages are
+    dropped and counted as overflows instead of overwriting queued ones.
+
+    \addtogroup channels
+    @{
+ */
+
+#define LOCAL_CH_POOL_SIZE         64                   /*!< number of messages in event queue */
+#define LOCAL_CH_EVT_DATA_SIZE     16                   /*!< unused data buffer of events */
+#define LOCAL_CH_MAX_NAME          64                   /*!< maximum length of channel name respectively topic */
+#define LOCAL_CH_MAX_SUBSCRIPTIONS 256                  /*!< maximum number of subscriptions of all channels */
+
+/*!
+ * local channel object
+ */
+typedef struct s_local_channel {
+
+  t_base_channel                base;                   /*!< base class */
+  char                          name[LOCAL_CH_MAX_NAME]; /*!< channel name */
+  t_icom_events*                p_icom_events;          /*!< processing thread and queue */
+  pthread_mutex_t               post_mutex;             /*!< serializes producers */
+  t_shared_buf*                 p_bufs[LOCAL_CH_POOL_SIZE]; /*!< referenced buffers in order of queued events */
+  long                          nr_bufs_posted;         /*!< buffers added, modified by producers */
+  long                          nr_bufs_done;           /*!< buffers released, modified by processing thread */
+
+} t_local_channel;
+
+
+/*!
+ * constructor for local channel
+ *
+ * \param p_tcm_server_ctx pointer to main instance object
+ * \param name channel name used in logs and metrics
+ * \param p_read_cb callback handler which is invoked by the processing thread
+ * \return pointer to channel instance or NULL in case of error
+ */
+t_local_channel* init_local_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* name, t_channel_cb p_read_cb );
+
+
+/*!
+ * subscribe local channel to topic
+ *
+ * Subscriptions end when the channel is released.
+ *
+ * \param p pointer to channel
+ * \param topic name of topic
+ * \return 0 in case of success, otherwise -1
+ */
+int local_channel_subscribe( t_local_channel* p, const char* topic );
+
+
+/*!
+ * publish message to all channels subscribed to topic
+ *
+ * \param topic name of topic
+ * \param data message
+ * \param len length of message
+ * \return number of channels the message has been queued to, -1 in case of error
+ */
+int local_channel_publish( const char* topic, const void* data, int len );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_LOCAL_CHANNEL_H */
@@ -63,6 +63,44 @@
          #f)))
 
 
+;; Route macro definition which defines a route lambda expression
+;; which evaluates body when the AT command line contains the command
+;; name given as lower case symbol. Within body 'form' is bound to the
+;; command's form (execute, set, query or test) and 'params' to its
+;; parameters as returned by parse-at-command.
+;;
+;; Example:
+;;
+;; (msg-at-command +cfun (if (eq? form 'set) (begin "AT+CFUN=1") #f))
+;; (msg-at-command l (string-append "volume " (number->string (car params))))
+;;
+(define-macro (msg-at-command name . body)
+  `(lambda (s)
+     (let ((cmd (assq ',name (or (parse-at-command s) '()))))
+       (if cmd
+           (let ((form (cadr cmd)) (params (cddr cmd))) . ,body)
+           #f))))
+
+
+;; Route macro definition which defines a route lambda expression
+;; which evaluates body when message matches pattern. The pattern is
+;; either a regular expression string or a pattern object returned by
+;; compile-pattern, it is compiled once when the route is defined.
+;; Within body the list of captures is bound to 'captures'.
+;;
+;; Example:
+;;
+;; (msg-matches "^\\+CREG: [0-9],([15])" (string-append "registered " (cadr captures)))
+;; (msg-matches (compile-pattern "AT+C*?" 'glob 'nocase) (begin "query"))
+;;
+(define-macro (msg-matches pat . body)
+  (let ((p (gensym)))
+    `(let ((,p (let ((x ,pat)) (if (string? x) (compile-pattern x) x))))
+       (lambda (s)
+         (let ((captures (pattern-match ,p s)))
+           (if captures (begin . ,body) #f))))))
+
+
 ;; Examples
 ;;
 ;; (define my-routes
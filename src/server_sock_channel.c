@@ -24,48 +24,573 @@
     <http://www.gnu.org/licenses/>.
 */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* accept4() */
+#endif
+
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <server_sock_channel.h>
 #include <olcutils/alloc.h>
+#include <tcm_config.h>
 #include <tcm_log.h>
+#include <tcm_rt.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+#define EPOLL_TAG_WAKEUP      0xffffffffU               /*!< epoll tag of wakeup pipe */
+#define EPOLL_TAG_LISTEN      0xfffffffeU               /*!< epoll tag of listening socket */
+#define SLOT_MASK             ((1L << SERVER_SOCK_CH_SLOT_BITS) - 1)
 
-static int is_server_sock_channel_open( t_base_channel* p_base_channel )
+
+long server_sock_channel_evt_conn_id( const t_icom_evt* p_evt )
 {
-  t_server_sock_channel* p = (t_server_sock_channel *)p_base_channel;
-  t_icom_sock_listener* p_icom_sock_listener;
-  int retcode = 0;
+  return (long)(intptr_t)p_evt->p_source;
+}
+
+
+static void post_conn_evt( t_server_sock_channel* p, t_icom_evt* p_evt, t_icom_evt_type type, long conn_id )
+{
+  p_evt->type = type;
+  p_evt->p_user_ctx = p;
+  p_evt->p_source = (void *)(intptr_t)conn_id;
+  memset( p_evt->p_data, 0, p_evt->max_data_size );
+  p_evt->data_len = 0;
+
+  base_channel_post_evt( p->p_icom_events, p_evt );
+}
+
+
+int server_sock_channel_conn_index( long conn_id )
+{
+  return (int)( conn_id & SLOT_MASK );
+}
+
+
+/* connection identifiers encode the table index, lookup is O(1) */
+static t_server_sock_conn* find_conn( t_server_sock_channel* p, long conn_id )
+{
+  long slot = conn_id & SLOT_MASK;
+  t_server_sock_conn* p_conn;
+
+  if( conn_id <= 0 || slot >= p->max_connections )
+    return NULL;
+
+  p_conn = & p->conns[slot];
+  if( p_conn->id != conn_id || p_conn->fd < 0 )
+    return NULL;
+
+  return p_conn;
+}
+
+
+/* has to be called with connection table locked */
+static void set_conn_epoll_events( t_server_sock_channel* p, int slot, uint32_t events )
+{
+  struct epoll_event ev;
+
+  /* throttled connections are added again by resume_reading() */
+  if( p->conns[slot].throttled )
+    return;
 
-  pthread_mutex_lock( & p->handler->p_connections->mutex );
-  p_icom_sock_listener = slist_first( p->handler->p_connections->p_lst_listeners );
-  if( p_icom_sock_listener ) {
-    retcode = slist_cnt( p_icom_sock_listener->server_list );
+  memset( & ev, 0, sizeof( ev ) );
+  ev.events = events;
+  ev.data.u32 = (uint32_t) slot;
+  if( epoll_ctl( p->epoll_fd, EPOLL_CTL_MOD, p->conns[slot].fd, & ev ) < 0 )
+    tcm_error( "%s: could not modify epoll events error %d!\n", __func__, errno );
+}
+
+
+static void free_out_queue( t_server_sock_conn* p_conn )
+{
+  t_server_sock_out* p_out;
+
+  while( p_conn->p_out_head ) {
+    p_out = p_conn->p_out_head;
+    p_conn->p_out_head = p_out->next;
+    shared_buf_unref( p_out->p_buf );
+    cul_free( p_out );
   }
-  pthread_mutex_unlock( & p->handler->p_connections->mutex );
 
-  return retcode;
+  p_conn->p_out_tail = NULL;
+  p_conn->out_bytes = 0;
+}
+
+
+/* has to be called with connection table locked */
+static void evict_conn( t_server_sock_channel* p, t_server_sock_conn* p_conn )
+{
+  tcm_error( "%s: connection %ld exceeds output queue limit of %d bytes, disconnect slow consumer\n",
+             __func__, p_conn->id, p->max_out_queue );
+
+  p_conn->evicted = 1;
+  __atomic_add_fetch( & p->nr_evictions, 1, __ATOMIC_RELAXED );
+  free_out_queue( p_conn );
+
+  /* the reader thread detects the shutdown and releases the connection */
+  shutdown( p_conn->fd, SHUT_RDWR );
+}
+
+
+/* has to be called with connection table locked */
+static int conn_send( t_server_sock_channel* p, t_server_sock_conn* p_conn, t_shared_buf* p_buf )
+{
+  t_server_sock_out* p_out;
+  int sent = 0;
+
+  if( p_conn->evicted )
+    return -1;
+
+  if( p_conn->p_out_head == NULL ) {
+    /* fast path, nothing pending, try to write out immediately */
+    sent = send( p_conn->fd, p_buf->data, p_buf->len, MSG_NOSIGNAL | MSG_DONTWAIT );
+    if( sent < 0 ) {
+      if( errno != EAGAIN && errno != EWOULDBLOCK )
+        return -1;
+      sent = 0;
+    }
+    if( sent == p_buf->len )
+      return sent;
+  }
+
+  if( p_conn->out_bytes + p_buf->len - sent > p->max_out_queue ) {
+    evict_conn( p, p_conn );
+    return -1;
+  }
+
+  p_out = cul_malloc( sizeof( t_server_sock_out ) );
+  if( p_out == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return -1;
+  }
+
+  p_out->next = NULL;
+  p_out->p_buf = shared_buf_ref( p_buf );
+  p_out->offset = sent;
+
+  if( p_conn->p_out_tail ) {
+    p_conn->p_out_tail->next = p_out;
+  } else {
+    p_conn->p_out_head = p_out;
+    set_conn_epoll_events( p, p_conn - p->conns, EPOLLIN | EPOLLOUT );
+  }
+  p_conn->p_out_tail = p_out;
+  p_conn->out_bytes += p_buf->len - sent;
+
+  return p_buf->len;
+}
+
+
+static void flush_conn( t_server_sock_channel* p, int slot )
+{
+  t_server_sock_conn* p_conn = & p->conns[slot];
+  t_server_sock_out* p_out;
+  int len, sent;
+
+  pthread_mutex_lock( & p->mutex );
+  while( ( p_out = p_conn->p_out_head ) != NULL ) {
+    len = p_out->p_buf->len - p_out->offset;
+    sent = send( p_conn->fd, p_out->p_buf->data + p_out->offset, len, MSG_NOSIGNAL | MSG_DONTWAIT );
+    if( sent <= 0 )
+      break; /* retry when writable again, errors are detected by reader */
+
+    p_out->offset += sent;
+    p_conn->out_bytes -= sent;
+    if( sent < len )
+      break;
+
+    p_conn->p_out_head = p_out->next;
+    shared_buf_unref( p_out->p_buf );
+    cul_free( p_out );
+  }
+
+  if( p_conn->p_out_head == NULL ) {
+    p_conn->p_out_tail = NULL;
+    set_conn_epoll_events( p, slot, EPOLLIN );
+  }
+  pthread_mutex_unlock( & p->mutex );
+}
+
+
+/* has to be called with connection table locked, result is positive and fits into a long */
+static long next_conn_id( t_server_sock_channel* p, int slot )
+{
+  if( p->last_conn_seq >= SERVER_SOCK_CH_MAX_CONN_SEQ )
+    p->last_conn_seq = 0;
+
+  return ( ++p->last_conn_seq << SERVER_SOCK_CH_SLOT_BITS ) | slot;
+}
+
+
+static void set_listen_epoll_events( t_server_sock_channel* p, uint32_t events )
+{
+  struct epoll_event ev;
+
+  memset( & ev, 0, sizeof( ev ) );
+  ev.events = events;
+  ev.data.u32 = EPOLL_TAG_LISTEN;
+  if( epoll_ctl( p->epoll_fd, EPOLL_CTL_MOD, p->listen_fd, & ev ) < 0 )
+    tcm_error( "%s: could not modify epoll events error %d!\n", __func__, errno );
+}
+
+
+/* stop reading from connection until events are available again */
+static void throttle_conn( t_server_sock_channel* p, int slot )
+{
+  t_server_sock_conn* p_conn = & p->conns[slot];
+
+  pthread_mutex_lock( & p->mutex );
+  if( ! p_conn->throttled ) {
+    /* removed instead of masked, hangups would be reported anyway */
+    epoll_ctl( p->epoll_fd, EPOLL_CTL_DEL, p_conn->fd, NULL );
+    p_conn->throttled = 1;
+    ++p->nr_throttled;
+  }
+  pthread_mutex_unlock( & p->mutex );
+}
+
+
+static void resume_reading( t_server_sock_channel* p )
+{
+  t_server_sock_conn* p_conn;
+  struct epoll_event ev;
+  int i, slot;
+
+  if( p->listen_throttled ) {
+    set_listen_epoll_events( p, EPOLLIN );
+    p->listen_throttled = 0;
+  }
+
+  pthread_mutex_lock( & p->mutex );
+  for( i = 0; i < p->nr_connections && p->nr_throttled > 0; ++i ) {
+    slot = p->active[i];
+    p_conn = & p->conns[slot];
+    if( ! p_conn->throttled )
+      continue;
+
+    memset( & ev, 0, sizeof( ev ) );
+    ev.events = p_conn->p_out_head ? ( EPOLLIN | EPOLLOUT ) : EPOLLIN;
+    ev.data.u32 = (uint32_t) slot;
+    if( epoll_ctl( p->epoll_fd, EPOLL_CTL_ADD, p_conn->fd, & ev ) < 0 )
+      tcm_error( "%s: could not add connection to epoll set error %d!\n", __func__, errno );
+    p_conn->throttled = 0;
+    --p->nr_throttled;
+  }
+  pthread_mutex_unlock( & p->mutex );
+}
+
+
+static void accept_conns( t_server_sock_channel* p )
+{
+  t_server_sock_conn* p_conn;
+  struct epoll_event ev;
+  t_icom_evt* p_evt;
+  long conn_id;
+  int fd, slot;
+
+  /* listening socket is non-blocking, accept all pending connections */
+  while( 1 )
+  {
+    /* connect events are not dropped, pending clients wait in the backlog instead */
+    p_evt = base_channel_try_alloc_evt( p->p_icom_events );
+    if( p_evt == NULL ) {
+      set_listen_epoll_events( p, 0 );
+      p->listen_throttled = 1;
+      return;
+    }
+
+    fd = accept4( p->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+    if( fd < 0 ) {
+      base_channel_free_evt( p->p_icom_events, p_evt );
+      break;
+    }
+
+    pthread_mutex_lock( & p->mutex );
+    if( p->nr_free_slots == 0 ) {
+      pthread_mutex_unlock( & p->mutex );
+      base_channel_free_evt( p->p_icom_events, p_evt );
+      tcm_error( "%s: maximum number of %d connections exceeded, reject new one\n",
+                 __func__, p->max_connections );
+      close( fd );
+      continue;
+    }
+
+    slot = p->free_slots[--p->nr_free_slots];
+    p_conn = & p->conns[slot];
+    conn_id = next_conn_id( p, slot );
+    p_conn->id = conn_id;
+    p_conn->fd = fd;
+    p_conn->evicted = 0;
+    p_conn->throttled = 0;
+    p_conn->active_idx = p->nr_connections;
+    p->active[p->nr_connections] = slot;
+    __atomic_store_n( & p->nr_connections, p->nr_connections + 1, __ATOMIC_RELEASE );
+
+    memset( & ev, 0, sizeof( ev ) );
+    ev.events = EPOLLIN;
+    ev.data.u32 = (uint32_t) slot;
+    if( epoll_ctl( p->epoll_fd, EPOLL_CTL_ADD, fd, & ev ) < 0 )
+      tcm_error( "%s: could not add connection to epoll set error %d!\n", __func__, errno );
+    pthread_mutex_unlock( & p->mutex );
+
+    post_conn_evt( p, p_evt, ICOM_EVT_SERVER_CON, conn_id );
+  }
+
+  if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+    tcm_error( "%s: accept failed with error %d\n", __func__, errno );
+}
+
+
+/* disconnect event is posted with given event, hence it can't get lost */
+static void drop_conn( t_server_sock_channel* p, int slot, t_icom_evt* p_evt )
+{
+  t_server_sock_conn* p_conn = & p->conns[slot];
+  long conn_id = p_conn->id;
+  int last;
+
+  pthread_mutex_lock( & p->mutex );
+  epoll_ctl( p->epoll_fd, EPOLL_CTL_DEL, p_conn->fd, NULL );
+  close( p_conn->fd );
+  free_out_queue( p_conn );
+  p_conn->fd = -1;
+  p_conn->id = 0;
+
+  /* swap last active connection into the released position */
+  last = p->active[p->nr_connections - 1];
+  p->active[p_conn->active_idx] = last;
+  p->conns[last].active_idx = p_conn->active_idx;
+  __atomic_store_n( & p->nr_connections, p->nr_connections - 1, __ATOMIC_RELEASE );
+
+  p->free_slots[p->nr_free_slots++] = slot;
+  pthread_mutex_unlock( & p->mutex );
+
+  post_conn_evt( p, p_evt, ICOM_EVT_SERVER_DIS, conn_id );
+}
+
+
+static void read_conn( t_server_sock_channel* p, int slot )
+{
+  t_server_sock_conn* p_conn = & p->conns[slot];
+  t_icom_events* p_events = p->p_icom_events;
+  t_icom_evt* p_evt = base_channel_try_alloc_evt( p_events );
+  int len;
+
+  /* data is left in the socket buffer instead of overwriting pending events */
+  if( p_evt == NULL ) {
+    throttle_conn( p, slot );
+    return;
+  }
+
+  p_evt->type = ICOM_EVT_SERVER_DATA;
+  p_evt->p_user_ctx = p;
+  p_evt->p_source = (void *)(intptr_t)p_conn->id;
+  memset( p_evt->p_data, 0, p_evt->max_data_size );
+
+  /* keep one byte for null termination */
+  len = read( p_conn->fd, p_evt->p_data, p_evt->max_data_size - 1 );
+  if( len > 0 ) {
+    tcm_trace_read_done();
+    p_evt->data_len = len;
+    base_channel_post_evt( p_events, p_evt );
+  } else if( len == 0 || ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) ) {
+    drop_conn( p, slot, p_evt );
+  } else {
+    base_channel_free_evt( p_events, p_evt );
+  }
+}
+
+
+static void* server_read_handler( void* pCtx )
+{
+  t_server_sock_channel* p = (t_server_sock_channel *)pCtx;
+  struct epoll_event events[SERVER_SOCK_CH_MAX_EPOLL_EVENTS];
+  uint32_t tag;
+  int nfds, i, timeout;
+
+  tcm_message( "%s for address %s:%d started\n", __func__, p->addr_decl.address, p->addr_decl.port );
+
+  while( ! p->terminate )
+  {
+    /* the processing thread does not signal released events, hence poll for them */
+    timeout = ( p->nr_throttled || p->listen_throttled ) ? SERVER_SOCK_CH_RESUME_MS : -1;
+    nfds = epoll_wait( p->epoll_fd, events, SERVER_SOCK_CH_MAX_EPOLL_EVENTS, timeout );
+    if( nfds < 0 ) {
+      if( errno == EINTR )
+        continue;
+      tcm_error( "%s: epoll_wait failed with error %d\n", __func__, errno );
+      break;
+    }
+
+    for( i = 0; i < nfds && ! p->terminate; ++i ) {
+      tag = events[i].data.u32;
+
+      if( tag == EPOLL_TAG_WAKEUP ) {
+        continue; /* termination request */
+      }
+      else if( tag == EPOLL_TAG_LISTEN ) {
+        accept_conns( p );
+      }
+      else if( p->conns[tag].fd >= 0 && ! p->conns[tag].throttled ) {
+        if( events[i].events & EPOLLOUT )
+          flush_conn( p, tag );
+        if( events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) )
+          read_conn( p, tag );
+      }
+    }
+
+    if( ( p->nr_throttled || p->listen_throttled ) && base_channel_pool_available( p->p_icom_events ) )
+      resume_reading( p );
+  }
+
+  tcm_message( "%s for address %s:%d stopped\n", __func__, p->addr_decl.address, p->addr_decl.port );
+
+  return p;
+}
+
+
+static int open_listen_socket( t_server_sock_channel* p )
+{
+  struct sockaddr_in in_addr;
+  struct sockaddr_un un_addr;
+  struct sockaddr* p_addr;
+  socklen_t addr_len;
+  int fd, reuse = 1;
+
+  if( p->addr_decl.sock_family == AF_INET ) {
+    memset( & in_addr, 0, sizeof( in_addr ) );
+    in_addr.sin_family = AF_INET;
+    in_addr.sin_port = htons( p->addr_decl.port );
+    if( inet_pton( AF_INET, p->addr_decl.address, & in_addr.sin_addr ) != 1 ) {
+      tcm_error( "%s: invalid IP address %s error!\n", __func__, p->addr_decl.address );
+      return -1;
+    }
+    p_addr = (struct sockaddr *) & in_addr;
+    addr_len = sizeof( in_addr );
+  } else {
+    memset( & un_addr, 0, sizeof( un_addr ) );
+    un_addr.sun_family = AF_UNIX;
+    strncpy( un_addr.sun_path, p->addr_decl.address, sizeof( un_addr.sun_path ) - 1 );
+    unlink( un_addr.sun_path ); /* remove stale socket file */
+    p_addr = (struct sockaddr *) & un_addr;
+    addr_len = sizeof( un_addr );
+  }
+
+  fd = socket( p->addr_decl.sock_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+  if( fd < 0 ) {
+    tcm_error( "%s: could not create socket error %d!\n", __func__, errno );
+    return -1;
+  }
+
+  setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, & reuse, sizeof( reuse ) );
+
+  if( bind( fd, p_addr, addr_len ) < 0 || listen( fd, SERVER_SOCK_CH_BACKLOG ) < 0 ) {
+    tcm_error( "%s: could not bind to address %s:%d error %d!\n",
+               __func__, p->addr_decl.address, p->addr_decl.port, errno );
+    close( fd );
+    return -1;
+  }
+
+  return fd;
+}
+
+
+static int add_epoll_tag( t_server_sock_channel* p, int fd, uint32_t tag )
+{
+  struct epoll_event ev;
+
+  memset( & ev, 0, sizeof( ev ) );
+  ev.events = EPOLLIN;
+  ev.data.u32 = tag;
+
+  return epoll_ctl( p->epoll_fd, EPOLL_CTL_ADD, fd, & ev );
+}
+
+
+static int is_server_sock_channel_open( t_base_channel* p_base_channel )
+{
+  t_server_sock_channel* p = (t_server_sock_channel *)p_base_channel;
+
+  return __atomic_load_n( & p->nr_connections, __ATOMIC_ACQUIRE );
 }
 
 
 static int write_server_sock_channel( t_base_channel* p_base_channel, const void* p_arg, const int len )
 {
   t_server_sock_channel* p = (t_server_sock_channel *)p_base_channel;
+  t_shared_buf* p_buf;
   int retcode = -1;
+  int i;
+
+  if( ! is_server_sock_channel_open( p_base_channel ) )
+    return -1;
 
-  if( is_server_sock_channel_open( p_base_channel ) ) {
-    retcode = icom_broadcast_to_all( p->handler->p_connections, (char *)p_arg, len );
-    if( retcode == 0 ) {
-      /* no error */
+  /* one buffer is shared by all connections which can't be served immediately */
+  p_buf = shared_buf_new( p_arg, len );
+  if( p_buf == NULL )
+    return -1;
+
+  pthread_mutex_lock( & p->mutex );
+  for( i = 0; i < p->nr_connections; ++i ) {
+    if( conn_send( p, & p->conns[ p->active[i] ], p_buf ) == len )
       retcode = len;
-    } else {
-      retcode = -1;
-    }
   }
+  pthread_mutex_unlock( & p->mutex );
+
+  shared_buf_unref( p_buf );
+
+  return retcode;
+}
+
+
+int write_server_sock_channel_to( t_server_sock_channel* p, long conn_id, const void* p_arg, const int len )
+{
+  t_server_sock_conn* p_conn;
+  t_shared_buf* p_buf;
+  int retcode = -1;
+
+  p_buf = shared_buf_new( p_arg, len );
+  if( p_buf == NULL )
+    return -1;
+
+  pthread_mutex_lock( & p->mutex );
+  p_conn = find_conn( p, conn_id );
+  if( p_conn ) {
+    retcode = conn_send( p, p_conn, p_buf );
+  }
+  pthread_mutex_unlock( & p->mutex );
+
+  shared_buf_unref( p_buf );
+
+  if( retcode < 0 ) {
+    tcm_error( "%s: could not write to connection %ld error!\n", __func__, conn_id );
+  }
+
+  return retcode;
+}
+
+
+int close_server_sock_channel_conn( t_server_sock_channel* p, long conn_id )
+{
+  t_server_sock_conn* p_conn;
+  int retcode = -1;
+
+  pthread_mutex_lock( & p->mutex );
+  p_conn = find_conn( p, conn_id );
+  if( p_conn ) {
+    /* the reader thread detects the shutdown and releases the connection */
+    shutdown( p_conn->fd, SHUT_RDWR );
+    retcode = 0;
+  }
+  pthread_mutex_unlock( & p->mutex );
 
   return retcode;
 }
@@ -75,9 +600,49 @@ static int release_server_sock_channel( t_base_channel* p_base_channel )
 {
   t_server_sock_channel* p = (t_server_sock_channel *)p_base_channel;
   int retcode = 0;
+  int i;
 
   if( p ) {
-    icom_kill_server_handlers( p->handler );
+    base_channel_unregister( p_base_channel );
+
+    if( p->p_read_handler ) {
+      p->terminate = 1;
+      if( write( p->wakeup_fd[1], "x", 1 ) != 1 )
+        tcm_error( "%s: could not wake up reader thread error!\n", __func__ );
+      pthread_join( p->p_read_handler, NULL );
+    }
+
+    if( p->conns ) {
+      for( i = 0; i < p->max_connections; ++i ) {
+        if( p->conns[i].fd >= 0 ) {
+          free_out_queue( & p->conns[i] );
+          close( p->conns[i].fd );
+        }
+      }
+      cul_free( p->conns );
+    }
+
+    if( p->active )
+      cul_free( p->active );
+
+    if( p->free_slots )
+      cul_free( p->free_slots );
+
+    if( p->listen_fd >= 0 )
+      close( p->listen_fd );
+
+    if( p->epoll_fd >= 0 )
+      close( p->epoll_fd );
+
+    if( p->wakeup_fd[0] >= 0 ) {
+      close( p->wakeup_fd[0] );
+      close( p->wakeup_fd[1] );
+    }
+
+    if( p->p_icom_events )
+      kill_icom_event_handler( p->p_icom_events );
+
+    pthread_mutex_destroy( & p->mutex );
     cul_free( p );
   }
 
@@ -88,8 +653,10 @@ static int release_server_sock_channel( t_base_channel* p_base_channel )
 t_server_sock_channel* init_server_sock_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* addr, int port, t_channel_cb p_read_cb )
 {
   t_server_sock_channel* p;
+  t_tcm_rt_saved rt_saved;
   t_base_channel* p_base;
   int retcode;
+  int i;
 
   p = cul_malloc( sizeof( t_server_sock_channel ) );
   if( p == NULL ) {
@@ -105,30 +672,75 @@ t_server_sock_channel* init_server_sock_channel( t_tcm_server_ctx* p_tcm_server_
   p_base->read = p_read_cb;
   p_base->write = write_server_sock_channel;
   p_base->release = release_server_sock_channel;
+  p->listen_fd = -1;
+  p->epoll_fd = -1;
+  p->wakeup_fd[0] = p->wakeup_fd[1] = -1;
+  p->max_connections = g_tcm_server_sock_max_connections;
+  p->max_out_queue = g_tcm_server_sock_max_out_queue;
+
+  if( pthread_mutex_init( & p->mutex, 0 ) != 0 ) {
+    tcm_error( "%s: could not initialize mutex error!\n", __func__ );
+    cul_free( p );
+    return NULL;
+  }
+
+  p->conns = cul_malloc( p->max_connections * sizeof( t_server_sock_conn ) );
+  p->active = cul_malloc( p->max_connections * sizeof( int ) );
+  p->free_slots = cul_malloc( p->max_connections * sizeof( int ) );
+  if( p->conns == NULL || p->active == NULL || p->free_slots == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    release_server_sock_channel( p_base );
+    return NULL;
+  }
+
+  memset( p->conns, 0, p->max_connections * sizeof( t_server_sock_conn ) );
+  for( i = 0; i < p->max_connections; ++i ) {
+    p->conns[i].fd = -1;
+    p->free_slots[i] = p->max_connections - 1 - i;
+  }
+  p->nr_free_slots = p->max_connections;
 
-  p->decl_table[0].max_connections = SERVER_SOCK_CH_MAX_CONNECTIONS;
   if( port ) { /* network address */
-    p->decl_table[0].addr.sock_family = AF_INET;
-    p->decl_table[0].addr.port = port;
+    p->addr_decl.sock_family = AF_INET;
+    p->addr_decl.port = port;
   } else { /* unix domain socket address */
-    p->decl_table[0].addr.sock_family = AF_UNIX;
+    p->addr_decl.sock_family = AF_UNIX;
   }
 
-  strncpy( p->decl_table[0].addr.address, addr, sizeof(p->decl_table[0].addr.address) );
+  strncpy( p->addr_decl.address, addr, sizeof(p->addr_decl.address) );
 
-  p->handler = icom_create_server_handlers(
-    p->decl_table,
-    1,
-    SERVER_SOCK_CH_MAX_DATA_SIZE,
-    SERVER_SOCK_CH_POOL_SIZE,
-    p_read_cb,
-    p );
+  p->listen_fd = open_listen_socket( p );
+  p->epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+  if( p->listen_fd < 0 || p->epoll_fd < 0 || pipe( p->wakeup_fd ) < 0 ||
+      add_epoll_tag( p, p->wakeup_fd[0], EPOLL_TAG_WAKEUP ) < 0 ||
+      add_epoll_tag( p, p->listen_fd, EPOLL_TAG_LISTEN ) < 0 )
+  {
+    tcm_error( "%s: could not create server socket error!\n", __func__ );
+    release_server_sock_channel( p_base );
+    return NULL;
+  }
 
-  if( p->handler == NULL ) {
-    tcm_error( "%s: could not create server handler error!\n", __func__ );
-    cul_free( p );
+  /* dispatcher and reader thread inherit the real-time settings */
+  tcm_rt_begin_spawn( t_channel_server_sock_type, & rt_saved );
+
+  p->p_icom_events = icom_create_event_handler( SERVER_SOCK_CH_MAX_DATA_SIZE, SERVER_SOCK_CH_POOL_SIZE, p_read_cb );
+  if( p->p_icom_events == NULL  ) {
+    tcm_rt_end_spawn( & rt_saved );
+    tcm_error( "%s: creation of event handler failed\n", __func__ );
+    release_server_sock_channel( p_base );
+    return NULL;
+  }
+
+  retcode = pthread_create( &p->p_read_handler, NULL, server_read_handler, p );
+  tcm_rt_end_spawn( & rt_saved );
+  if( retcode ) {
+    tcm_error( "%s: creation of read handler thread failed with error %d\n", __func__, retcode );
+    p->p_read_handler = 0;
+    release_server_sock_channel( p_base );
     return NULL;
   }
 
+  base_channel_register( p_base );
+
   return p;
 }
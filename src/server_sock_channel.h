@@ -27,8 +27,11 @@
 #ifndef TCM_SERVER_SOCK_CHANNEL_H
 #define TCM_SERVER_SOCK_CHANNEL_H
 
+#include <limits.h>
+#include <pthread.h>
 #include <intercom/server.h>
 #include <base_channel.h>
+#include <shared_buf.h>
 #include <tcm_server.h>
 
 #ifdef __cplusplus
@@ -43,18 +46,78 @@ extern "C" {
     @{
  */
 
-#define SERVER_SOCK_CH_MAX_CONNECTIONS     10           /*!< maximum allowed connections */
 #define SERVER_SOCK_CH_MAX_DATA_SIZE       256          /*!< maximum data chunk size to be read at once */
-#define SERVER_SOCK_CH_POOL_SIZE           10           /*!< number of data chunks in ring buffer */
+#define SERVER_SOCK_CH_POOL_SIZE           64           /*!< number of data chunks in ring buffer */
+#define SERVER_SOCK_CH_BACKLOG             128          /*!< passed to listen() */
+#define SERVER_SOCK_CH_MAX_EPOLL_EVENTS    64           /*!< number of descriptor events handled per epoll_wait() */
+#define SERVER_SOCK_CH_SLOT_BITS           20           /*!< connection identifier bits used for table index */
+#define SERVER_SOCK_CH_MAX_CONN_SEQ        ( LONG_MAX >> SERVER_SOCK_CH_SLOT_BITS ) /*!< sequence number wraps to 1 after this */
+#define SERVER_SOCK_CH_RESUME_MS           10           /*!< poll interval for free events while reading is stopped */
 
 /*!
- * device channel object
+ * element of a connection's output queue
+ */
+typedef struct s_server_sock_out {
+  struct s_server_sock_out*     next;                   /*!< next element or NULL */
+  t_shared_buf*                 p_buf;                  /*!< referenced data */
+  int                           offset;                 /*!< number of bytes already sent */
+} t_server_sock_out;
+
+/*!
+ * server socket connection
+ */
+typedef struct s_server_sock_conn {
+  long                          id;                     /*!< connection identifier as handed out to scheme, 0 when unused */
+  int                           fd;                     /*!< connection socket descriptor or -1 when unused */
+  int                           evicted;                /*!< set to 1 when connection is shut down for being too slow */
+  int                           throttled;              /*!< set to 1 when removed from epoll set for lack of events */
+  t_server_sock_out*            p_out_head;             /*!< first element of pending output or NULL */
+  t_server_sock_out*            p_out_tail;             /*!< last element of pending output or NULL */
+  int                           out_bytes;              /*!< number of pending output bytes */
+  int                           active_idx;             /*!< position in table of active connections */
+} t_server_sock_conn;
+
+/*!
+ * server socket channel object
+ *
+ * Accepting  connections and  reading  from them  is done  in  one  background
+ * thread which multiplexes the listening socket and all connections with epoll.
+ * Each data chunk, each new connection and each disconnect is posted as event
+ * tagged with the corresponding connection identifier, refer to
+ * server_sock_channel_evt_conn_id().
+ *
+ * Sockets  are non-blocking.  Output which can't  be  written immediately is
+ * queued per connection and flushed by  the background thread. Connections
+ * whose output queue exceeds g_tcm_server_sock_max_out_queue are evicted.
+ *
+ * Events are never overwritten. When the event pool is exhausted, the socket
+ * which could not be served is taken out of the epoll set until the processing
+ * thread has released events again, so the kernel's socket buffers and the
+ * listen backlog apply backpressure to the clients.
  */
 typedef struct s_server_sock_channel {
 
   t_base_channel                base;                   /*!< base class */
-  t_icom_server_decl            decl_table[1];          /*!< IP or UDP client socket address */
-  t_icom_server_state*          handler;                /*!< client socket handler */
+  t_icom_addr_decl              addr_decl;              /*!< IP or UDS server socket address */
+  int                           listen_fd;              /*!< listening socket descriptor */
+  int                           epoll_fd;               /*!< epoll instance */
+  int                           wakeup_fd[2];           /*!< pipe to interrupt the reader thread */
+  int                           terminate;              /*!< set to 1 to stop the reader thread */
+  pthread_t                     p_read_handler;         /*!< accept and read handler */
+  t_icom_events*                p_icom_events;          /*!< connection event handler */
+
+  pthread_mutex_t               mutex;                  /*!< protects connection table and output queues */
+  t_server_sock_conn*           conns;                  /*!< connection table */
+  int*                          active;                 /*!< table indices of open connections */
+  int*                          free_slots;             /*!< stack of unused table indices */
+  int                           nr_free_slots;          /*!< number of elements on free slot stack */
+  int                           max_connections;        /*!< size of connection table */
+  int                           max_out_queue;          /*!< maximum pending output bytes per connection */
+  int                           nr_connections;         /*!< number of open connections, accessed atomically */
+  long                          last_conn_seq;          /*!< sequence number of last handed out connection identifier */
+  int                           nr_throttled;           /*!< number of connections not read for lack of events */
+  int                           listen_throttled;       /*!< set to 1 when accepting is stopped for lack of events */
+  long                          nr_evictions;           /*!< number of connections closed for being too slow */
 
 } t_server_sock_channel;
 
@@ -70,11 +133,64 @@ typedef struct s_server_sock_channel {
  * \param port TCP port or 0 in case of UDP
  * \param p_read_cb callback handler which is invoked by the processing thread
  * \return pointer to channel instance or NULL in case of error
+ *
+ * The maximum number of connections and the output queue limit are taken from
+ * the global configuration, refer to g_tcm_server_sock_max_connections.
  */
 t_server_sock_channel* init_server_sock_channel(
   t_tcm_server_ctx* p_tcm_server_ctx, const char* addr, int port, t_channel_cb p_read_cb );
 
 
+/*!
+ * retrieve connection identifier an event has been received from
+ *
+ * \param p_evt pointer to event object passed to the channel callback
+ * \return connection identifier, always greater than zero
+ *
+ * Identifiers fit into a long on all platforms. Their sequence part wraps
+ * after SERVER_SOCK_CH_MAX_CONN_SEQ connections, i.e. after 2047 connections
+ * on 32 bit systems, hence a stale identifier may denote a new connection
+ * once that many connections have been accepted meanwhile.
+ */
+long server_sock_channel_evt_conn_id( const t_icom_evt* p_evt );
+
+
+/*!
+ * retrieve connection table index of given connection identifier
+ *
+ * Allows users of the channel to keep per connection state in plain arrays of
+ * size max_connections. Indices are reused when connections are closed.
+ *
+ * \param conn_id connection identifier
+ * \return table index in range [0, max_connections)
+ */
+int server_sock_channel_conn_index( long conn_id );
+
+
+/*!
+ * write bytes to one specific connection of a server socket channel
+ *
+ * \param p pointer to channel instance
+ * \param conn_id connection identifier
+ * \param p_arg pointer to data buffer
+ * \param len number of bytes to write
+ * \return number of written bytes or -1 when connection does not exist (anymore)
+ */
+int write_server_sock_channel_to( t_server_sock_channel* p, long conn_id, const void* p_arg, const int len );
+
+
+/*!
+ * close one specific connection of a server socket channel
+ *
+ * The disconnect event is delivered to the channel's callback as usual.
+ *
+ * \param p pointer to channel instance
+ * \param conn_id connection identifier
+ * \return 0 in case of success, -1 when connection does not exist (anymore)
+ */
+int close_server_sock_channel_conn( t_server_sock_channel* p, long conn_id );
+
+
 /*! @} */
 
 #ifdef __cplusplus
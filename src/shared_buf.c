@@ -0,0 +1,63 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <shared_buf.h>
+#include <olcutils/alloc.h>
+#include <tcm_log.h>
+
+
+t_shared_buf* shared_buf_new( const void* p_data, const int len )
+{
+  t_shared_buf* p;
+
+  p = cul_malloc( sizeof( t_shared_buf ) + len );
+  if( p == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+
+  p->refcnt = 1;
+  p->len = len;
+  memcpy( p->data, p_data, len );
+  p->data[len] = '\0';
+
+  return p;
+}
+
+
+t_shared_buf* shared_buf_ref( t_shared_buf* p )
+{
+  __atomic_add_fetch( & p->refcnt, 1, __ATOMIC_RELAXED );
+  return p;
+}
+
+
+void shared_buf_unref( t_shared_buf* p )
+{
+  if( __atomic_sub_fetch( & p->refcnt, 1, __ATOMIC_ACQ_REL ) == 0 )
+    cul_free( p );
+}
@@ -0,0 +1,90 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_SHARED_BUF_H
+#define TCM_SHARED_BUF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+    \file shared_buf.h
+    \brief reference counted data buffer
+
+    \addtogroup channels
+    @{
+ */
+
+
+/*!
+ * reference counted immutable data buffer
+ *
+ * Used when the same data is handed to several receivers e.g. when broadcasting
+ * to all connections of a server socket channel. The buffer is released when the
+ * last reference is dropped.
+ */
+typedef struct s_shared_buf {
+  int                           refcnt;                 /*!< reference counter, modified atomically */
+  int                           len;                    /*!< number of data bytes */
+  char                          data[1];                /*!< data bytes, always null terminated */
+} t_shared_buf;
+
+
+/*!
+ * create shared buffer with a copy of the given data and reference count 1
+ *
+ * \param p_data pointer to data to be copied
+ * \param len number of bytes to copy
+ * \return pointer to buffer or NULL in case of out of memory error
+ */
+t_shared_buf* shared_buf_new( const void* p_data, const int len );
+
+
+/*!
+ * increment reference counter
+ *
+ * \param p pointer to buffer
+ * \return p
+ */
+t_shared_buf* shared_buf_ref( t_shared_buf* p );
+
+
+/*!
+ * decrement reference counter and release buffer when it drops to zero
+ *
+ * \param p pointer to buffer
+ */
+void shared_buf_unref( t_shared_buf* p );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_SHARED_BUF_H */
@@ -0,0 +1,246 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <shm_channel.h>
+#include <olcutils/alloc.h>
+#include <tcm_log.h>
+#include <tcm_rt.h>
+#include <tcm_trace.h>
+
+
+/*
+ * forget client which terminated without detaching
+ */
+static void check_client( t_shm_channel* p )
+{
+  int32_t pid = __atomic_load_n( & p->p_hdr->client_pid, __ATOMIC_ACQUIRE );
+
+  if( pid && kill( pid, 0 ) && errno == ESRCH ) {
+    if( __atomic_compare_exchange_n( & p->p_hdr->client_pid, & pid, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+      tcm_error( "%s: client %d of shm channel %s died\n", __func__, pid, p->name );
+  }
+}
+
+
+static void* shm_read_handler( void* pCtx )
+{
+  t_shm_channel* p = (t_shm_channel *)pCtx;
+  t_icom_events* p_events = p->p_icom_events;
+  t_icom_evt* p_evt;
+  int len;
+
+  while( ! __atomic_load_n( & p->terminate, __ATOMIC_ACQUIRE ) )
+  {
+    if( ! tcm_shm_wait_data( & p->to_server, SHM_CH_POLL_MS ) ) {
+      check_client( p );
+      continue;
+    }
+
+    /* messages are copied straight into the event, they stay in the ring
+       while no event is free such that the client waits for space */
+    p_evt = base_channel_try_alloc_evt( p_events );
+    if( p_evt == NULL ) {
+      usleep( SHM_CH_RESUME_MS * 1000 );
+      continue;
+    }
+    p_evt->type = ICOM_EVT_CLIENT_DATA;
+    p_evt->p_user_ctx = p;
+
+    len = tcm_shm_pop( & p->to_server, p_evt->p_data, p_evt->max_data_size - 1 );
+    if( len > 0 ) {
+      tcm_trace_read_done();
+      ((char *)p_evt->p_data)[len] = '\0';
+      p_evt->data_len = len;
+      base_channel_post_evt( p_events, p_evt );
+    } else {
+      base_channel_free_evt( p_events, p_evt );
+    }
+  }
+
+  return p;
+}
+
+
+static int is_shm_channel_open( t_base_channel* p_base_channel )
+{
+  t_shm_channel* p = (t_shm_channel *)p_base_channel;
+
+  return __atomic_load_n( & p->p_hdr->client_pid, __ATOMIC_ACQUIRE ) ? 1 : 0;
+}
+
+
+static int write_shm_channel( t_base_channel* p_base_channel, const void* p_arg, const int len )
+{
+  t_shm_channel* p = (t_shm_channel *)p_base_channel;
+  int retcode;
+
+  if( ! is_shm_channel_open( p_base_channel ) ) {
+    tcm_error( "%s: no client attached to shm channel %s error!\n", __func__, p->name );
+    return -1;
+  }
+
+  if( len == 0 )
+    return 0;
+
+  pthread_mutex_lock( & p->write_mutex );
+  while( ( retcode = tcm_shm_push( & p->to_client, p_arg, len ) ) == 0 ) {
+    if( ! tcm_shm_wait_space( & p->to_client, len, SHM_CH_WRITE_TIMEOUT_MS ) ) {
+      tcm_error( "%s: client of shm channel %s does not read error!\n", __func__, p->name );
+      retcode = -1;
+      break;
+    }
+  }
+  pthread_mutex_unlock( & p->write_mutex );
+
+  if( retcode < 0 && len > TCM_SHM_MAX_MSG )
+    tcm_error( "%s: message of %d bytes exceeds maximum size of %d error!\n", __func__, len, TCM_SHM_MAX_MSG );
+
+  return retcode;
+}
+
+
+static int release_shm_channel( t_base_channel* p_base_channel )
+{
+  t_shm_channel* p = (t_shm_channel *)p_base_channel;
+  char path[sizeof( TCM_SHM_PREFIX ) + TCM_SHM_MAX_NAME];
+
+  if( p )
+  {
+    base_channel_unregister( p_base_channel );
+
+    if( p->reader_started ) {
+      __atomic_store_n( & p->terminate, 1, __ATOMIC_RELEASE );
+      tcm_shm_wakeup( & p->to_server );
+      pthread_join( p->reader, NULL );
+    }
+
+    if( p->p_icom_events )
+      kill_icom_event_handler( p->p_icom_events );
+
+    if( p->p_hdr ) {
+      munmap( p->p_hdr, p->size );
+      snprintf( path, sizeof( path ), "%s%s", TCM_SHM_PREFIX, p->name );
+      shm_unlink( path );
+    }
+
+    pthread_mutex_destroy( & p->write_mutex );
+    cul_free( p );
+  }
+
+  return 0;
+}
+
+
+t_shm_channel* init_shm_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* name, int ring_size,
+                                 t_channel_cb p_read_cb )
+{
+  char path[sizeof( TCM_SHM_PREFIX ) + TCM_SHM_MAX_NAME];
+  t_shm_channel* p;
+  t_base_channel* p_base;
+  t_tcm_rt_saved rt_saved;
+  int fd;
+
+  if( strlen( name ) >= TCM_SHM_MAX_NAME || strchr( name, '/' ) || ! *name ) {
+    tcm_error( "%s: invalid channel name %s error!\n", __func__, name );
+    return NULL;
+  }
+
+  if( ring_size < TCM_SHM_MIN_RING_SIZE || ring_size > TCM_SHM_MAX_RING_SIZE || ( ring_size & ( ring_size - 1 ) ) ) {
+    tcm_error( "%s: ring size must be a power of two between %d and %d error!\n", __func__,
+               TCM_SHM_MIN_RING_SIZE, TCM_SHM_MAX_RING_SIZE );
+    return NULL;
+  }
+
+  p = cul_malloc( sizeof( t_shm_channel ) );
+  if( p == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+  p_base = ((t_base_channel *)p);
+
+  memset( p, 0, sizeof( t_shm_channel ) );
+  p_base->p_tcm_server_ctx = p_tcm_server_ctx;
+  p_base->type = t_channel_shm_type;
+  p_base->is_open = is_shm_channel_open;
+  p_base->read = p_read_cb;
+  p_base->write = write_shm_channel;
+  p_base->release = release_shm_channel;
+  pthread_mutex_init( & p->write_mutex, NULL );
+  strcpy( p->name, name );
+
+  /* segment left over by a previous instance is replaced */
+  snprintf( path, sizeof( path ), "%s%s", TCM_SHM_PREFIX, name );
+  shm_unlink( path );
+  fd = shm_open( path, O_RDWR | O_CREAT | O_EXCL, 0660 );
+  p->size = tcm_shm_segment_size( ring_size );
+  if( fd < 0 || ftruncate( fd, p->size ) ) {
+    tcm_error( "%s: could not create shared memory %s (%s) error!\n", __func__, path, strerror( errno ) );
+    if( fd >= 0 ) {
+      close( fd );
+      shm_unlink( path );
+    }
+    release_shm_channel( p_base );
+    return NULL;
+  }
+
+  p->p_hdr = mmap( NULL, p->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  close( fd );
+  if( p->p_hdr == MAP_FAILED ) {
+    tcm_error( "%s: could not map shared memory %s error!\n", __func__, path );
+    p->p_hdr = NULL;
+    shm_unlink( path );
+    release_shm_channel( p_base );
+    return NULL;
+  }
+  tcm_shm_init( p->p_hdr, ring_size );
+  tcm_shm_view_init( p->p_hdr, TCM_SHM_TO_SERVER, ring_size, 0, & p->to_server );
+  tcm_shm_view_init( p->p_hdr, TCM_SHM_TO_CLIENT, ring_size, 1, & p->to_client );
+
+  /* local clients replace socket connections, hence are scheduled like them */
+  tcm_rt_begin_spawn( t_channel_client_sock_type, & rt_saved );
+  p->p_icom_events = icom_create_event_handler( SHM_CH_MAX_DATA_SIZE, SHM_CH_POOL_SIZE, p_read_cb );
+  if( p->p_icom_events && pthread_create( & p->reader, NULL, shm_read_handler, p ) == 0 )
+    p->reader_started = 1;
+  tcm_rt_end_spawn( & rt_saved );
+
+  if( ! p->reader_started ) {
+    tcm_error( "%s: creation of event handler or reader thread failed\n", __func__ );
+    release_shm_channel( p_base );
+    return NULL;
+  }
+
+  base_channel_register( p_base );
+
+  return p;
+}
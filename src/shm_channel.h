@@ -0,0 +1,102 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_SHM_CHANNEL_H
+#define TCM_SHM_CHANNEL_H
+
+#include <pthread.h>
+#include <intercom/events.h>
+#include <base_channel.h>
+#include <tcm_shm_ring.h>
+#include <tcm_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+    \file shm_channel.h
+    \brief channel for exchanging messages with a local process via shared memory
+
+    The channel creates the POSIX shared memory segment /tcm-<name> with one
+    ring per direction, see tcm_shm_ring.h. Local processes attach with the
+    client library declared in tcm_shm_client.h. Messages are handed over
+    without system calls as long as both sides are busy, and each message
+    is passed as one chunk to the callback. While the callback lags behind
+    and the event queue is full, messages are left in the ring, hence the
+    client blocks for space instead of messages getting lost.
+
+    \addtogroup channels
+    @{
+ */
+
+#define SHM_CH_MAX_DATA_SIZE       ( TCM_SHM_MAX_MSG + 1 ) /*!< maximum message size plus terminating zero */
+#define SHM_CH_POOL_SIZE           32                   /*!< number of messages in event queue */
+#define SHM_CH_DEFAULT_RING_SIZE   65536                /*!< default size of each ring in bytes */
+#define SHM_CH_POLL_MS             500                  /*!< interval of checking whether client is alive */
+#define SHM_CH_WRITE_TIMEOUT_MS    100                  /*!< maximum time to wait for space when writing */
+#define SHM_CH_RESUME_MS           10                   /*!< poll interval for free events while reading is stopped */
+
+/*!
+ * shared memory channel object
+ */
+typedef struct s_shm_channel {
+
+  t_base_channel                base;                   /*!< base class */
+  char                          name[TCM_SHM_MAX_NAME]; /*!< channel name */
+  t_tcm_shm_header*             p_hdr;                  /*!< mapped segment */
+  unsigned long                 size;                   /*!< size of segment */
+  t_tcm_shm_view                to_server;              /*!< private view of request ring */
+  t_tcm_shm_view                to_client;              /*!< private view of reply ring */
+  t_icom_events*                p_icom_events;          /*!< processing thread and queue */
+  pthread_t                     reader;                 /*!< thread moving messages from ring to queue */
+  int                           reader_started;         /*!< 1 when reader thread has been created */
+  int                           terminate;              /*!< set to 1 to stop reader thread */
+  pthread_mutex_t               write_mutex;            /*!< serializes producers of ring to client */
+
+} t_shm_channel;
+
+
+/*!
+ * constructor for shared memory channel
+ *
+ * \param p_tcm_server_ctx pointer to main instance object
+ * \param name channel name, shared memory segment is /tcm-<name>
+ * \param ring_size size of each ring in bytes, power of two
+ * \param p_read_cb callback handler which is invoked by the processing thread
+ * \return pointer to channel instance or NULL in case of error
+ */
+t_shm_channel* init_shm_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* name, int ring_size,
+                                 t_channel_cb p_read_cb );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_SHM_CHANNEL_H */
@@ -33,20 +33,38 @@
   (msg-begins-with "ATL" (write-channel ucm-ch (string-append "set-volume " args)) ""))
 
 
+;; identity queries are answered from the response cache once the modem
+;; replied, time to live is given in milliseconds where 0 means until invalidated
+(at-cache-rule "AT+CGMI" 0)
+(at-cache-rule "AT+CGMM" 0)
+(at-cache-rule "AT+CGMR" 0)
+(at-cache-rule "AT+CGSN" 0)
+(at-cache-rule "AT+CIMI" 600000)
+
+;; the SIM card might have been changed
+(at-cache-invalidate-on "+CPIN:" "AT+CIMI")
+
+
 ;; request from USB CDC-TCM host
-;; are handled by host-request routes and otherwise forwarded to modem channel
+;; are handled by host-request routes, answered from the response cache
+;; or otherwise forwarded to modem channel
 (define (host-tcm-request-handler s)
-  (write-channel modem-tcm-ch (route host-request-routes s)))
+  (let* ((req (route host-request-routes s))
+         (cached (at-cache-lookup req)))
+    (if cached
+        (%write-channel host-tcm-ch cached)
+        (%write-channel modem-tcm-ch req))))
 
 
 ;; requests respectively events from modem are forwarded to USB CDC-TCM host
 (define (modem-tcm-event-handler s)
-  (write-channel host-tcm-ch s))
+  (at-cache-feed s)
+  (%write-channel host-tcm-ch s))
 
 
 ;; events from alsa usecase manager are forwarded to USB CDC-TCM host
 (define (ucm-event-handler s)
-  (write-channel host-tcm-ch s))
+  (%write-channel host-tcm-ch s))
 
 
 ;; terminate tcm daemon application in a clean way to check for memory leackages
@@ -59,6 +77,13 @@
 
 (define host-tcm-ch (make-dev-channel host-tcm-dev host-tcm-request-handler))
 (define modem-tcm-ch (make-dev-channel modem-tcm-dev modem-tcm-event-handler))
+
+;; bursts of signal quality and registration reports e.g. during handover
+;; are thinned out before they reach the event handler, the latest report
+;; is forwarded at the end of each interval given in milliseconds,
+;; responses to commands such as AT+CSQ or AT+CREG? are never held back
+(dev-channel-coalesce modem-tcm-ch "+CSQ:" 'latest 1000)
+(dev-channel-coalesce modem-tcm-ch "+CREG:" 'latest 500)
 (define ucm-ch (make-client-sock-channel "127.0.0.1" ucm-port ucm-event-handler))
 
 
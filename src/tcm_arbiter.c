@@ -0,0 +1,713 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <olcutils/alloc.h>
+#include <tcm_arbiter.h>
+#include <tcm_server.h>
+#include <tcm_scheme.h>
+#include <tcm_config.h>
+#include <tcm_flightrec.h>
+#include <tcm_log.h>
+#include <utils.h>
+
+
+/*! URC prefixes known to all arbiters */
+static const char* default_urcs[] = {
+  "RING", "+CRING:", "+CLIP:", "+CCWA:", "+CREG:", "+CGREG:", "+CEREG:", "+CGEV:",
+  "+CMTI:", "+CMT:", "+CDS:", "+CBM:", "+CUSD:", "+CPIN:", "+CSSI:", "+CSSU:"
+};
+
+/*! final result codes, matched as prefix */
+static const char* final_results[] = {
+  "OK", "ERROR", "+CME ERROR", "+CMS ERROR", "NO CARRIER", "NO ANSWER", "NO DIALTONE", "BUSY", "CONNECT"
+};
+
+static const char error_response[] = "\r\nERROR\r\n";
+
+/*! created arbiters, used to validate handles passed from scheme */
+static t_tcm_arbiter* instances[TCM_ARBITER_MAX_INSTANCES];
+
+/*! timer expiring pending commands of all arbiters */
+static struct {
+  pthread_mutex_t               mutex;                  /*!< protects deadline */
+  pthread_cond_t                cond;                   /*!< signaled when an earlier deadline is set */
+  pthread_t                     thread;                 /*!< timer thread */
+  int                           started;                /*!< set to 1 when thread has been created */
+  uint64_t                      deadline_ns;            /*!< earliest timeout of pending commands, 0 when none */
+  t_tcm_scheme*                 p_scheme;               /*!< interpreter whose lock protects the arbiters */
+} timer = { PTHREAD_MUTEX_INITIALIZER };
+
+
+static uint64_t now_ns( void )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+static void send_client( t_tcm_arbiter* p, long conn_id, const char* data, int len )
+{
+  int n = write_server_sock_channel_to( p->p_clients, conn_id, data, len );
+
+  base_channel_count_tx( (t_base_channel *)p->p_clients, n );
+  tcm_flightrec_add( t_tcm_flightrec_tx, p->p_clients, data, n, 0, 0 );
+}
+
+
+static void send_modem( t_tcm_arbiter* p, const char* data, int len )
+{
+  int n = p->p_modem->write( p->p_modem, data, len );
+
+  base_channel_count_tx( p->p_modem, n );
+  tcm_flightrec_add( t_tcm_flightrec_tx, p->p_modem, data, n, 0, 0 );
+}
+
+
+/* schedules timer thread for timeout of pending command */
+static void arm_timer( t_tcm_arbiter* p )
+{
+  uint64_t deadline = p->t_pending_ns + (uint64_t)p->timeout_ms * 1000000ULL;
+
+  pthread_mutex_lock( & timer.mutex );
+  if( timer.deadline_ns == 0 || deadline < timer.deadline_ns ) {
+    timer.deadline_ns = deadline;
+    pthread_cond_signal( & timer.cond );
+  }
+  pthread_mutex_unlock( & timer.mutex );
+}
+
+
+static t_tcm_arbiter_client* find_client( t_tcm_arbiter* p, long conn_id )
+{
+  int idx = server_sock_channel_conn_index( conn_id );
+
+  if( idx < 0 || idx >= p->nr_clients || p->clients[idx].id != conn_id )
+    return NULL;
+
+  return & p->clients[idx];
+}
+
+
+static void release_client( t_tcm_arbiter_client* c )
+{
+  int i;
+
+  for( i = 0; i < c->count; ++i )
+    cul_free( c->queue[ ( c->head + i ) % TCM_ARBITER_MAX_QUEUE ].p_data );
+
+  memset( c, 0, sizeof( t_tcm_arbiter_client ) );
+}
+
+
+static int is_final_result( const char* text, int len )
+{
+  int i, n;
+
+  for( i = 0; i < sizeof( final_results ) / sizeof( final_results[0] ); ++i ) {
+    n = strlen( final_results[i] );
+    if( len >= n && ! memcmp( text, final_results[i], n ) )
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* index of first matching URC prefix or -1 */
+static int match_urc( t_tcm_arbiter* p, const char* text, int len )
+{
+  int i, n;
+
+  for( i = 0; i < p->nr_prefixes; ++i ) {
+    n = strlen( p->prefixes[i] );
+    if( len >= n && ! memcmp( text, p->prefixes[i], n ) )
+      return i;
+  }
+
+  return -1;
+}
+
+
+/* checks whether e.g. +CREG: is the response to pending command AT+CREG? */
+static int is_response_to_pending( t_tcm_arbiter* p, const char* prefix )
+{
+  int n = strlen( prefix );
+  char c;
+
+  if( prefix[n-1] == ':' )
+    --n;
+
+  if( strncasecmp( p->pending_cmd, "AT", 2 ) || strncasecmp( p->pending_cmd + 2, prefix, n ) )
+    return 0;
+
+  c = p->pending_cmd[2+n];
+  return ! isalnum( (unsigned char)c );
+}
+
+
+static void dispatch( t_tcm_arbiter* p )
+{
+  t_tcm_arbiter_client* c;
+  t_tcm_arbiter_cmd* cmd;
+  uint64_t now, delay, oldest = 0;
+  int i, k, n;
+
+  if( p->pending >= 0 )
+    return;
+
+  i = -1;
+  if( p->policy == t_tcm_arbiter_fifo ) {
+    for( k = 0; k < p->nr_clients; ++k ) {
+      c = & p->clients[k];
+      if( c->id && c->count > 0 && ( i < 0 || c->queue[c->head].seq < oldest ) ) {
+        oldest = c->queue[c->head].seq;
+        i = k;
+      }
+    }
+  } else {
+    c = & p->clients[p->cursor];
+    if( c->id && c->count > 0 && p->credits > 0 ) {
+      i = p->cursor;
+    } else {
+      /* the client at the cursor is visited last and gets new credits */
+      for( k = 1; k <= p->nr_clients; ++k ) {
+        n = ( p->cursor + k ) % p->nr_clients;
+        if( p->clients[n].id && p->clients[n].count > 0 ) {
+          p->cursor = i = n;
+          p->credits = p->clients[n].weight;
+          break;
+        }
+      }
+    }
+    if( i >= 0 )
+      --p->credits;
+  }
+
+  if( i < 0 )
+    return;
+
+  c = & p->clients[i];
+  cmd = & c->queue[c->head];
+  c->head = ( c->head + 1 ) % TCM_ARBITER_MAX_QUEUE;
+  --c->count;
+
+  now = now_ns();
+  delay = now - cmd->t_queued_ns;
+  c->delay_sum_ns += delay;
+  if( delay > c->delay_max_ns )
+    c->delay_max_ns = delay;
+  ++c->nr_commands;
+
+  p->pending = i;
+  p->pending_id = c->id;
+  p->t_pending_ns = now;
+  p->prompt = 0;
+  tcm_strlcpy( p->pending_cmd, cmd->p_data, sizeof( p->pending_cmd ) );
+
+  send_modem( p, cmd->p_data, cmd->len );
+  cul_free( cmd->p_data );
+
+  arm_timer( p );
+}
+
+
+static void complete( t_tcm_arbiter* p )
+{
+  p->pending = -1;
+  p->prompt = 0;
+  dispatch( p );
+}
+
+
+static void check_timeout( t_tcm_arbiter* p )
+{
+  t_tcm_arbiter_client* c;
+
+  if( p->pending < 0 || now_ns() - p->t_pending_ns < (uint64_t)p->timeout_ms * 1000000ULL )
+    return;
+
+  tcm_error( "%s: no final result code for %.30s error!\n", __func__, p->pending_cmd );
+  c = & p->clients[p->pending];
+  if( c->id == p->pending_id ) {
+    ++c->nr_timeouts;
+    send_client( p, c->id, error_response, sizeof( error_response ) - 1 );
+  }
+
+  /* the rest of the stale response is treated as URC */
+  complete( p );
+}
+
+
+/*
+ * expires pending commands when no modem or client data arrives, the
+ * arbiters are accessed with the interpreter locked like from the callbacks
+ */
+static void* timer_thread( void* p_arg )
+{
+  struct timespec ts;
+  uint64_t deadline;
+  int i;
+
+  pthread_mutex_lock( & timer.mutex );
+  while( 1 )
+  {
+    deadline = timer.deadline_ns;
+    if( deadline == 0 ) {
+      pthread_cond_wait( & timer.cond, & timer.mutex );
+      continue;
+    }
+
+    if( now_ns() < deadline ) {
+      ts.tv_sec = deadline / 1000000000ULL;
+      ts.tv_nsec = deadline % 1000000000ULL;
+      pthread_cond_timedwait( & timer.cond, & timer.mutex, & ts );
+      continue;
+    }
+
+    timer.deadline_ns = 0;
+    pthread_mutex_unlock( & timer.mutex );
+
+    tcm_scheme_lock( timer.p_scheme, "at-arbiter", "timeout" );
+    for( i = 0; i < TCM_ARBITER_MAX_INSTANCES; ++i ) {
+      if( instances[i] ) {
+        check_timeout( instances[i] );
+        if( instances[i]->pending >= 0 )
+          arm_timer( instances[i] );
+      }
+    }
+    tcm_scheme_unlock( timer.p_scheme );
+
+    pthread_mutex_lock( & timer.mutex );
+  }
+  pthread_mutex_unlock( & timer.mutex );
+
+  return p_arg;
+}
+
+
+/* creates timer thread with the first arbiter */
+static int start_timer( t_tcm_scheme* p_scheme )
+{
+  pthread_condattr_t attr;
+
+  if( timer.started )
+    return 0;
+
+  /* deadlines are taken from the monotonic clock */
+  pthread_condattr_init( & attr );
+  pthread_condattr_setclock( & attr, CLOCK_MONOTONIC );
+  pthread_cond_init( & timer.cond, & attr );
+  pthread_condattr_destroy( & attr );
+
+  timer.p_scheme = p_scheme;
+  if( pthread_create( & timer.thread, NULL, timer_thread, NULL ) ) {
+    tcm_error( "%s: creation of timer thread failed error!\n", __func__ );
+    pthread_cond_destroy( & timer.cond );
+    return -1;
+  }
+
+  timer.started = 1;
+  return 0;
+}
+
+
+static void enqueue( t_tcm_arbiter* p, t_tcm_arbiter_client* c, const char* data, int len )
+{
+  t_tcm_arbiter_cmd* cmd;
+
+  if( c->count >= c->quota ) {
+    ++c->nr_rejected;
+    send_client( p, c->id, error_response, sizeof( error_response ) - 1 );
+    return;
+  }
+
+  cmd = & c->queue[ ( c->head + c->count ) % TCM_ARBITER_MAX_QUEUE ];
+  cmd->p_data = cul_malloc( len + 1 );
+  if( cmd->p_data == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    send_client( p, c->id, error_response, sizeof( error_response ) - 1 );
+    return;
+  }
+
+  memcpy( cmd->p_data, data, len );
+  cmd->p_data[len] = '\0';
+  cmd->len = len;
+  cmd->seq = p->seq++;
+  cmd->t_queued_ns = now_ns();
+  ++c->count;
+}
+
+
+/* routes one modem line including its line terminators */
+static void route_line( t_tcm_arbiter* p, const char* data, int len )
+{
+  const char* text = data;
+  int text_len = len;
+  int urc, i;
+  uint32_t mask;
+
+  while( text_len > 0 && ( *text == '\r' || *text == '\n' ) ) {
+    ++text;
+    --text_len;
+  }
+  while( text_len > 0 && ( text[text_len-1] == '\r' || text[text_len-1] == '\n' ) )
+    --text_len;
+
+  urc = match_urc( p, text, text_len );
+
+  if( p->pending >= 0 && ( urc < 0 || is_response_to_pending( p, p->prefixes[urc] ) ) ) {
+    send_client( p, p->pending_id, data, len );
+    if( is_final_result( text, text_len ) )
+      complete( p );
+    return;
+  }
+
+  /* lines which are not known as URC reach clients subscribed to all URCs */
+  mask = ( urc >= 0 ) ? ( 1U << urc ) : 0xffffffffU;
+  for( i = 0; i < p->nr_clients; ++i ) {
+    if( p->clients[i].id && ( p->clients[i].subscriptions & mask ) == mask ) {
+      send_client( p, p->clients[i].id, data, len );
+      ++p->clients[i].nr_urcs;
+    }
+  }
+}
+
+
+t_tcm_arbiter* tcm_arbiter_create( t_base_channel* p_modem, t_server_sock_channel* p_clients )
+{
+  t_tcm_arbiter* p;
+  int i, slot = -1;
+
+  for( i = 0; i < TCM_ARBITER_MAX_INSTANCES; ++i ) {
+    if( instances[i] == NULL ) {
+      slot = i;
+      break;
+    }
+  }
+
+  if( slot < 0 ) {
+    tcm_error( "%s: too many arbiters error!\n", __func__ );
+    return NULL;
+  }
+
+  if( start_timer( p_modem->p_tcm_server_ctx->p_scheme ) )
+    return NULL;
+
+  p = cul_malloc( sizeof( t_tcm_arbiter ) );
+  if( p == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+
+  memset( p, 0, sizeof( t_tcm_arbiter ) );
+  p->p_modem = p_modem;
+  p->p_clients = p_clients;
+  p->policy = t_tcm_arbiter_round_robin;
+  p->default_quota = TCM_ARBITER_DEFAULT_QUOTA;
+  p->timeout_ms = TCM_ARBITER_DEFAULT_TIMEOUT_MS;
+  p->pending = -1;
+
+  p->nr_clients = g_tcm_server_sock_max_connections;
+  p->clients = cul_malloc( p->nr_clients * sizeof( t_tcm_arbiter_client ) );
+  if( p->clients == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    cul_free( p );
+    return NULL;
+  }
+  memset( p->clients, 0, p->nr_clients * sizeof( t_tcm_arbiter_client ) );
+
+  for( i = 0; i < sizeof( default_urcs ) / sizeof( default_urcs[0] ); ++i )
+    tcm_arbiter_add_urc( p, default_urcs[i] );
+
+  instances[slot] = p;
+
+  return p;
+}
+
+
+int tcm_arbiter_is_valid( const t_tcm_arbiter* p )
+{
+  int i;
+
+  for( i = 0; p && i < TCM_ARBITER_MAX_INSTANCES; ++i ) {
+    if( instances[i] == p )
+      return 1;
+  }
+
+  return 0;
+}
+
+
+void tcm_arbiter_release( t_tcm_arbiter* p )
+{
+  int i;
+
+  if( p ) {
+    for( i = 0; i < TCM_ARBITER_MAX_INSTANCES; ++i ) {
+      if( instances[i] == p )
+        instances[i] = NULL;
+    }
+
+    for( i = 0; i < p->nr_clients; ++i )
+      release_client( & p->clients[i] );
+
+    cul_free( p->clients );
+    cul_free( p );
+  }
+}
+
+
+int tcm_arbiter_configure( t_tcm_arbiter* p, t_tcm_arbiter_policy policy, int quota, int timeout_ms )
+{
+  if( quota < 1 || quota > TCM_ARBITER_MAX_QUEUE || timeout_ms <= 0 ) {
+    tcm_error( "%s: invalid quota or timeout error!\n", __func__ );
+    return -1;
+  }
+
+  p->policy = policy;
+  p->default_quota = quota;
+  p->timeout_ms = timeout_ms;
+
+  return 0;
+}
+
+
+int tcm_arbiter_set_client( t_tcm_arbiter* p, long conn_id, int weight, int quota )
+{
+  t_tcm_arbiter_client* c = find_client( p, conn_id );
+
+  if( c == NULL || weight < 1 || quota < 1 || quota > TCM_ARBITER_MAX_QUEUE ) {
+    tcm_error( "%s: unknown client or invalid weight or quota error!\n", __func__ );
+    return -1;
+  }
+
+  /* already queued commands beyond the new quota are kept */
+  c->weight = weight;
+  c->quota = quota;
+
+  return 0;
+}
+
+
+int tcm_arbiter_add_urc( t_tcm_arbiter* p, const char* prefix )
+{
+  int i, len = strlen( prefix );
+
+  for( i = 0; i < p->nr_prefixes; ++i ) {
+    if( ! strcmp( p->prefixes[i], prefix ) )
+      return i;
+  }
+
+  if( len == 0 || len >= TCM_ARBITER_MAX_PREFIX_LEN || p->nr_prefixes >= TCM_ARBITER_MAX_PREFIXES ) {
+    tcm_error( "%s: invalid URC prefix or too many prefixes error!\n", __func__ );
+    return -1;
+  }
+
+  memcpy( p->prefixes[p->nr_prefixes], prefix, len + 1 );
+
+  return p->nr_prefixes++;
+}
+
+
+int tcm_arbiter_subscribe( t_tcm_arbiter* p, long conn_id, uint32_t mask )
+{
+  t_tcm_arbiter_client* c = find_client( p, conn_id );
+
+  if( c == NULL ) {
+    tcm_error( "%s: unknown client %ld error!\n", __func__, conn_id );
+    return -1;
+  }
+
+  c->subscriptions = mask;
+
+  return 0;
+}
+
+
+void tcm_arbiter_connection( t_tcm_arbiter* p, long conn_id, int connected )
+{
+  int idx = server_sock_channel_conn_index( conn_id );
+  t_tcm_arbiter_client* c;
+
+  if( idx < 0 || idx >= p->nr_clients )
+    return;
+
+  /* a pending command of a disconnected client is completed, its response discarded */
+  c = & p->clients[idx];
+  if( connected || c->id == conn_id )
+    release_client( c );
+
+  if( connected ) {
+    c->id = conn_id;
+    c->quota = p->default_quota;
+    c->weight = 1;
+    c->subscriptions = 0xffffffffU;
+  }
+}
+
+
+int tcm_arbiter_submit( t_tcm_arbiter* p, long conn_id, const char* data, int len )
+{
+  t_tcm_arbiter_client* c;
+  int i;
+
+  check_timeout( p );
+
+  /* connect events might not be passed, clients are registered on demand */
+  c = find_client( p, conn_id );
+  if( c == NULL ) {
+    tcm_arbiter_connection( p, conn_id, 1 );
+    c = find_client( p, conn_id );
+    if( c == NULL )
+      return -1;
+  }
+
+  /* data following the prompt is terminated by ctrl-z or esc */
+  if( p->prompt && p->pending_id == conn_id ) {
+    send_modem( p, data, len );
+    for( i = 0; i < len; ++i ) {
+      if( data[i] == 0x1a || data[i] == 0x1b )
+        p->prompt = 0;
+    }
+    return c->count;
+  }
+
+  for( i = 0; i < len; ++i ) {
+    if( data[i] == '\r' || data[i] == '\n' ) {
+      if( c->line_len > 0 ) {
+        c->line[c->line_len++] = '\r';
+        enqueue( p, c, c->line, c->line_len );
+        c->line_len = 0;
+      }
+    }
+    else if( c->line_len < TCM_ARBITER_MAX_LINE - 1 ) {
+      c->line[c->line_len++] = data[i];
+    }
+  }
+
+  dispatch( p );
+
+  return c->count;
+}
+
+
+void tcm_arbiter_feed( t_tcm_arbiter* p, const char* data, int len )
+{
+  int i, start = 0, content = 0;
+
+  check_timeout( p );
+
+  for( i = 0; i < p->line_len; ++i ) {
+    if( p->line[i] != '\r' && p->line[i] != '\n' )
+      content = 1;
+  }
+
+  for( i = 0; i < len; ++i ) {
+    char ch = data[i];
+
+    if( ch != '\r' && ch != '\n' ) {
+      content = 1;
+      continue;
+    }
+
+    if( ! content )
+      continue; /* leading line terminators belong to the next line */
+
+    /* line is complete, the line feed following a carriage return is included */
+    if( ch == '\r' && i + 1 < len && data[i+1] == '\n' )
+      ++i;
+
+    if( p->line_len + i + 1 - start <= TCM_ARBITER_MAX_LINE ) {
+      memcpy( p->line + p->line_len, data + start, i + 1 - start );
+      route_line( p, p->line, p->line_len + i + 1 - start );
+    } else {
+      /* overlong lines are passed in two parts */
+      if( p->line_len > 0 )
+        route_line( p, p->line, p->line_len );
+      route_line( p, data + start, i + 1 - start );
+    }
+
+    p->line_len = 0;
+    start = i + 1;
+    content = 0;
+  }
+
+  if( start < len ) {
+    if( p->line_len + len - start > TCM_ARBITER_MAX_LINE ) {
+      /* overlong partial lines are passed in parts */
+      if( p->line_len > 0 )
+        route_line( p, p->line, p->line_len );
+      p->line_len = 0;
+      if( len - start > TCM_ARBITER_MAX_LINE ) {
+        route_line( p, data + start, len - start );
+        start = len;
+      }
+    }
+    memcpy( p->line + p->line_len, data + start, len - start );
+    p->line_len += len - start;
+  }
+
+  /* the sms prompt is not terminated */
+  if( p->pending >= 0 && p->line_len >= 2 && ! memcmp( p->line + p->line_len - 2, "> ", 2 ) ) {
+    send_client( p, p->pending_id, p->line, p->line_len );
+    p->line_len = 0;
+    p->prompt = 1;
+  }
+}
+
+
+int tcm_arbiter_stats( t_tcm_arbiter* p, t_tcm_arbiter_stats* p_stats, int max )
+{
+  t_tcm_arbiter_client* c;
+  int i, n = 0;
+
+  for( i = 0; i < p->nr_clients && n < max; ++i ) {
+    c = & p->clients[i];
+    if( c->id == 0 )
+      continue;
+
+    p_stats[n].id = c->id;
+    p_stats[n].queued = c->count;
+    p_stats[n].nr_commands = c->nr_commands;
+    p_stats[n].nr_rejected = c->nr_rejected;
+    p_stats[n].nr_timeouts = c->nr_timeouts;
+    p_stats[n].nr_urcs = c->nr_urcs;
+    p_stats[n].delay_avg_ms = c->nr_commands ? (double)c->delay_sum_ns / c->nr_commands / 1e6 : 0.0;
+    p_stats[n].delay_max_ms = (double)c->delay_max_ns / 1e6;
+    ++n;
+  }
+
+  return n;
+}
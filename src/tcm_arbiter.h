@@ -0,0 +1,272 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_ARBITER_H
+#define TCM_ARBITER_H
+
+#include <stdint.h>
+#include <base_channel.h>
+#include <server_sock_channel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_arbiter.h
+    \brief arbitration of several AT clients sharing one modem channel
+
+    Clients connected to a server socket channel send AT commands which are
+    queued per client and written to the modem one at a time. Each line
+    received from the modem while a command is pending is routed back to the
+    issuing client until the final result code arrives. Lines starting with
+    a known URC prefix are fanned out to all clients subscribed to them,
+    unless the prefix matches the pending command, e.g. +CREG: in response
+    to AT+CREG?. While no command is pending all lines are considered URCs.
+    The SMS prompt "> " is passed to the issuing client whose following data
+    is written to the modem immediately.
+
+    The next command is either taken from the client which queued the oldest
+    command (fifo) or from the clients in turn where each client may send as
+    many commands in a row as its weight is (round robin). Commands beyond a
+    client's quota are answered with ERROR immediately.
+
+    All functions are invoked from the channel callbacks with the scheme
+    interpreter locked. A command without final result code is answered
+    with ERROR when its timeout expires, by a timer thread shared by all
+    arbiters which locks the interpreter as well.
+
+    \addtogroup channels
+    @{
+ */
+
+#define TCM_ARBITER_MAX_INSTANCES      8                /*!< maximum number of arbiters */
+#define TCM_ARBITER_MAX_QUEUE          32               /*!< maximum queued commands per client */
+#define TCM_ARBITER_MAX_LINE           1024             /*!< maximum length of command or response line */
+#define TCM_ARBITER_MAX_PREFIXES       32               /*!< maximum number of URC prefixes */
+#define TCM_ARBITER_MAX_PREFIX_LEN     16               /*!< maximum length of URC prefix */
+#define TCM_ARBITER_DEFAULT_QUOTA      8                /*!< default maximum queued commands per client */
+#define TCM_ARBITER_DEFAULT_TIMEOUT_MS 180000           /*!< default timeout of pending command */
+
+
+/*! arbitration policy */
+typedef enum {
+  t_tcm_arbiter_fifo,                                   /*!< oldest queued command first */
+  t_tcm_arbiter_round_robin                             /*!< clients in turn, weight commands each */
+} t_tcm_arbiter_policy;
+
+
+/*! queued command */
+typedef struct s_tcm_arbiter_cmd {
+  char*                         p_data;                 /*!< command including line terminator */
+  int                           len;                    /*!< length of command */
+  uint64_t                      seq;                    /*!< arrival order */
+  uint64_t                      t_queued_ns;            /*!< time of arrival */
+} t_tcm_arbiter_cmd;
+
+
+/*! per client state */
+typedef struct s_tcm_arbiter_client {
+  long                          id;                     /*!< connection identifier, 0 when unused */
+  t_tcm_arbiter_cmd             queue[TCM_ARBITER_MAX_QUEUE]; /*!< command ring */
+  int                           head;                   /*!< index of oldest command */
+  int                           count;                  /*!< number of queued commands */
+  int                           quota;                  /*!< maximum number of queued commands */
+  int                           weight;                 /*!< commands in a row for round robin */
+  uint32_t                      subscriptions;          /*!< bit mask of subscribed URC prefixes */
+  char                          line[TCM_ARBITER_MAX_LINE]; /*!< partially received command */
+  int                           line_len;               /*!< length of partially received command */
+  long                          nr_commands;            /*!< commands written to modem */
+  long                          nr_rejected;            /*!< commands rejected for exceeded quota */
+  long                          nr_timeouts;            /*!< commands without final result code */
+  long                          nr_urcs;                /*!< URCs forwarded */
+  uint64_t                      delay_sum_ns;           /*!< sum of queueing delays */
+  uint64_t                      delay_max_ns;           /*!< maximum queueing delay */
+} t_tcm_arbiter_client;
+
+
+/*! arbiter object */
+typedef struct s_tcm_arbiter {
+  t_base_channel*               p_modem;                /*!< modem channel */
+  t_server_sock_channel*        p_clients;              /*!< channel of clients */
+  t_tcm_arbiter_policy          policy;                 /*!< arbitration policy */
+  int                           default_quota;          /*!< quota of newly connected clients */
+  int                           timeout_ms;             /*!< timeout of pending command */
+  t_tcm_arbiter_client*         clients;                /*!< clients indexed by connection table index */
+  int                           nr_clients;             /*!< size of client table */
+  int                           cursor;                 /*!< round robin position */
+  int                           credits;                /*!< remaining commands of client at cursor */
+  int                           pending;                /*!< client index of pending command, -1 when idle */
+  long                          pending_id;             /*!< connection identifier of pending command */
+  uint64_t                      t_pending_ns;           /*!< time the pending command was written */
+  char                          pending_cmd[64];        /*!< start of pending command */
+  int                           prompt;                 /*!< set to 1 while pending command awaits data */
+  uint64_t                      seq;                    /*!< arrival counter */
+  char                          prefixes[TCM_ARBITER_MAX_PREFIXES][TCM_ARBITER_MAX_PREFIX_LEN]; /*!< URC prefixes */
+  int                           nr_prefixes;            /*!< number of URC prefixes */
+  char                          line[TCM_ARBITER_MAX_LINE]; /*!< partially received modem line */
+  int                           line_len;               /*!< length of partially received modem line */
+} t_tcm_arbiter;
+
+
+/*!
+ * statistics of one client
+ */
+typedef struct s_tcm_arbiter_stats {
+  long                          id;                     /*!< connection identifier */
+  int                           queued;                 /*!< currently queued commands */
+  long                          nr_commands;            /*!< commands written to modem */
+  long                          nr_rejected;            /*!< commands rejected for exceeded quota */
+  long                          nr_timeouts;            /*!< commands without final result code */
+  long                          nr_urcs;                /*!< URCs forwarded */
+  double                        delay_avg_ms;           /*!< average queueing delay */
+  double                        delay_max_ms;           /*!< maximum queueing delay */
+} t_tcm_arbiter_stats;
+
+
+/*!
+ * create arbiter
+ *
+ * \param p_modem channel to modem
+ * \param p_clients server socket channel of clients
+ * \return pointer to arbiter object or NULL in case of error
+ */
+t_tcm_arbiter* tcm_arbiter_create( t_base_channel* p_modem, t_server_sock_channel* p_clients );
+
+
+/*!
+ * check whether arbiter exists
+ *
+ * \param p pointer to arbiter object
+ * \return 1 when arbiter has been created and not yet been released, otherwise 0
+ */
+int tcm_arbiter_is_valid( const t_tcm_arbiter* p );
+
+
+/*!
+ * release arbiter, the channels are not closed
+ *
+ * \param p pointer to arbiter object
+ */
+void tcm_arbiter_release( t_tcm_arbiter* p );
+
+
+/*!
+ * set arbitration policy, default quota and timeout
+ *
+ * \param p pointer to arbiter object
+ * \param policy arbitration policy
+ * \param quota maximum queued commands of newly connected clients
+ * \param timeout_ms timeout of pending command
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_arbiter_configure( t_tcm_arbiter* p, t_tcm_arbiter_policy policy, int quota, int timeout_ms );
+
+
+/*!
+ * set weight and quota of client
+ *
+ * \param p pointer to arbiter object
+ * \param conn_id connection identifier
+ * \param weight commands in a row for round robin
+ * \param quota maximum number of queued commands
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_arbiter_set_client( t_tcm_arbiter* p, long conn_id, int weight, int quota );
+
+
+/*!
+ * add URC prefix, e.g. "+CMTI:" or "RING"
+ *
+ * \param p pointer to arbiter object
+ * \param prefix URC prefix
+ * \return index of prefix or negative error code
+ */
+int tcm_arbiter_add_urc( t_tcm_arbiter* p, const char* prefix );
+
+
+/*!
+ * set URC subscriptions of client, newly connected clients are subscribed to all URCs
+ *
+ * \param p pointer to arbiter object
+ * \param conn_id connection identifier
+ * \param mask bit mask of prefix indices as returned by tcm_arbiter_add_urc()
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_arbiter_subscribe( t_tcm_arbiter* p, long conn_id, uint32_t mask );
+
+
+/*!
+ * register connect or disconnect of client
+ *
+ * \param p pointer to arbiter object
+ * \param conn_id connection identifier
+ * \param connected 1 for connect, 0 for disconnect
+ */
+void tcm_arbiter_connection( t_tcm_arbiter* p, long conn_id, int connected );
+
+
+/*!
+ * process data received from client
+ *
+ * \param p pointer to arbiter object
+ * \param conn_id connection identifier
+ * \param data received data
+ * \param len length of data
+ * \return number of queued commands or -1 in case of error
+ */
+int tcm_arbiter_submit( t_tcm_arbiter* p, long conn_id, const char* data, int len );
+
+
+/*!
+ * process data received from modem
+ *
+ * \param p pointer to arbiter object
+ * \param data received data
+ * \param len length of data
+ */
+void tcm_arbiter_feed( t_tcm_arbiter* p, const char* data, int len );
+
+
+/*!
+ * retrieve statistics of connected clients
+ *
+ * \param p pointer to arbiter object
+ * \param p_stats array for statistics
+ * \param max size of array
+ * \return number of returned entries
+ */
+int tcm_arbiter_stats( t_tcm_arbiter* p, t_tcm_arbiter_stats* p_stats, int max );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_ARBITER_H */
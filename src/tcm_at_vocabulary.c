@@ -0,0 +1,97 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include <tcm_at_vocabulary.h>
+
+/* generated by at_vocabulary.awk */
+#include "tcm_at_vocabulary_table.h"
+
+
+/* must be kept in sync with function hash in at_vocabulary.awk */
+static uint32_t hash( const char* s, int len, uint32_t seed )
+{
+  uint32_t h = 2166136261u + seed;
+  int i;
+
+  for( i = 0; i < len; ++i )
+    h = ( h + (uint32_t)toupper( (unsigned char)s[i] ) ) * 16777619u;
+
+  h += h >> 16;
+  h *= 73244475u;
+  h += h >> 16;
+
+  return h;
+}
+
+
+const t_tcm_at_word* tcm_at_vocabulary_lookup( const char* name, int len )
+{
+  const t_tcm_at_word* p_word;
+  uint32_t bucket;
+  int id;
+
+  if( len <= 0 )
+    return NULL;
+
+  bucket = hash( name, len, 0 ) % TCM_AT_VOCABULARY_BUCKETS;
+  id = slots[ hash( name, len, seeds[bucket] ) % TCM_AT_VOCABULARY_SLOTS ];
+  if( id == 0 )
+    return NULL;
+
+  p_word = & vocabulary[id];
+  if( (int)strlen( p_word->name ) != len || strncasecmp( p_word->name, name, len ) != 0 )
+    return NULL;
+
+  return p_word;
+}
+
+
+int tcm_at_vocabulary_id( const char* name, int len )
+{
+  const t_tcm_at_word* p_word = tcm_at_vocabulary_lookup( name, len );
+  return p_word ? p_word->id : 0;
+}
+
+
+const t_tcm_at_word* tcm_at_vocabulary_by_id( int id )
+{
+  if( id < 1 || id > TCM_AT_VOCABULARY_SIZE )
+    return NULL;
+
+  return & vocabulary[id];
+}
+
+
+int tcm_at_vocabulary_size( void )
+{
+  return TCM_AT_VOCABULARY_SIZE;
+}
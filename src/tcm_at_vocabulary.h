@@ -0,0 +1,118 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_AT_VOCABULARY_H
+#define TCM_AT_VOCABULARY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_at_vocabulary.h
+    \brief dictionary of known AT command names and result codes
+
+    The names of AT commands, unsolicited result codes (URC) and final result
+    codes of 3GPP TS 27.007 and 27.005 are mapped to a numeric identifier,
+    a category and a default priority. The table is generated at build time
+    from at_vocabulary.def and an optional vendor specific file which can be
+    given to configure with --with-at-vocabulary=FILE. Since a perfect hash
+    function is used, a lookup takes two hash computations and one string
+    comparison and does not allocate memory.
+
+    Identifiers are small integers starting with 1 which remain stable as
+    long as new names are appended to the vocabulary. They can be used as
+    keys of tables instead of the names. The tokenizer tcm_hayes provides
+    the identifier of each command and result.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_AT_COMMAND                 1                /*!< name of command */
+#define TCM_AT_URC                     2                /*!< prefix of unsolicited result code */
+#define TCM_AT_FINAL                   4                /*!< final result code */
+
+#define TCM_AT_PRIO_BACKGROUND         0                /*!< e.g. identity queries */
+#define TCM_AT_PRIO_NORMAL             1                /*!< most commands */
+#define TCM_AT_PRIO_HIGH               2                /*!< e.g. network state and final result codes */
+#define TCM_AT_PRIO_URGENT             3                /*!< e.g. incoming calls */
+
+
+/*! entry of vocabulary */
+typedef struct s_tcm_at_word {
+  const char*                   name;                   /*!< upper case name */
+  int                           id;                     /*!< identifier, 0 for unknown names */
+  int                           categories;             /*!< bit mask of TCM_AT_COMMAND, TCM_AT_URC and TCM_AT_FINAL */
+  int                           priority;               /*!< default priority from TCM_AT_PRIO_BACKGROUND to TCM_AT_PRIO_URGENT */
+} t_tcm_at_word;
+
+
+/*!
+ * look up name in vocabulary
+ *
+ * \param name command name or result code, e.g. "+CREG" or "NO CARRIER", case insensitive
+ * \param len length of name
+ * \return pointer to entry or NULL when the name is unknown
+ */
+const t_tcm_at_word* tcm_at_vocabulary_lookup( const char* name, int len );
+
+
+/*!
+ * look up identifier of name in vocabulary
+ *
+ * \param name command name or result code, case insensitive
+ * \param len length of name
+ * \return identifier or 0 when the name is unknown
+ */
+int tcm_at_vocabulary_id( const char* name, int len );
+
+
+/*!
+ * retrieve vocabulary entry by identifier
+ *
+ * \param id identifier
+ * \return pointer to entry or NULL when the identifier is out of range
+ */
+const t_tcm_at_word* tcm_at_vocabulary_by_id( int id );
+
+
+/*!
+ * number of names in vocabulary
+ *
+ * \return highest valid identifier
+ */
+int tcm_at_vocabulary_size( void );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_AT_VOCABULARY_H */
@@ -0,0 +1,439 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <tcm_atcache.h>
+#include <tcm_log.h>
+
+
+/*! cacheable command with its cached response */
+typedef struct {
+  char                          command[TCM_ATCACHE_MAX_COMMAND_LEN]; /*!< normalized command */
+  int                           ttl_ms;                 /*!< time to live, 0 for until invalidated */
+  int                           valid;                  /*!< set to 1 when response is cached */
+  uint64_t                      stored_ns;              /*!< time when response has been stored */
+  int                           len;                    /*!< length of cached response */
+  char                          response[TCM_ATCACHE_MAX_RESPONSE]; /*!< cached response */
+  long                          hits;                   /*!< requests answered from the cache */
+  long                          misses;                 /*!< requests forwarded to the modem */
+  long                          stores;                 /*!< responses stored in the cache */
+  long                          invalidations;          /*!< responses flushed by invalidation rules */
+} t_rule;
+
+
+/*! invalidation rule */
+typedef struct {
+  char                          prefix[TCM_ATCACHE_MAX_PREFIX_LEN]; /*!< start of triggering modem message */
+  int                           prefix_len;             /*!< length of prefix */
+  char                          command[TCM_ATCACHE_MAX_COMMAND_LEN]; /*!< command to flush, empty for all */
+} t_invalidation;
+
+
+/*! cache state, rules are few hence they are searched linearly */
+static struct {
+  pthread_mutex_t               mutex;                  /*!< access protection */
+  t_rule                        rules[TCM_ATCACHE_MAX_RULES]; /*!< cacheable commands */
+  int                           nr_rules;               /*!< number of cacheable commands */
+  t_invalidation                invalidations[TCM_ATCACHE_MAX_INVALIDATIONS]; /*!< invalidation rules */
+  int                           nr_invalidations;       /*!< number of invalidation rules */
+  int                           capture;                /*!< rule of captured response or -1 */
+  uint64_t                      capture_ns;             /*!< start time of capture */
+  int                           capture_len;            /*!< length of captured response */
+  char                          capture_buf[TCM_ATCACHE_MAX_RESPONSE]; /*!< captured response */
+  char                          capture_prefix[TCM_ATCACHE_MAX_COMMAND_LEN]; /*!< prefix of information lines */
+  int                           line_len;               /*!< length of incomplete line */
+  char                          line[TCM_ATCACHE_MAX_RESPONSE]; /*!< incomplete line including empty lines before */
+} cache = { .mutex = PTHREAD_MUTEX_INITIALIZER, .capture = -1 };
+
+
+static uint64_t now_ns( void )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+/* strip white space and line terminators, upper case outside of quotes */
+static int normalize( const char* s, int len, char* dst )
+{
+  int i = 0, n = 0, quoted = 0;
+
+  while( len > 0 && ( isspace( (unsigned char)s[len-1] ) || s[len-1] == '\0' ) )
+    --len;
+  while( i < len && isspace( (unsigned char)s[i] ) )
+    ++i;
+
+  for( ; i < len; ++i ) {
+    if( n >= TCM_ATCACHE_MAX_COMMAND_LEN - 1 )
+      return -1;
+    if( s[i] == '"' )
+      quoted = ! quoted;
+    dst[n++] = quoted ? s[i] : toupper( (unsigned char)s[i] );
+  }
+  dst[n] = '\0';
+
+  return n;
+}
+
+
+static int find_rule( const char* command )
+{
+  int i;
+
+  for( i = 0; i < cache.nr_rules; ++i ) {
+    if( ! strcmp( cache.rules[i].command, command ) )
+      return i;
+  }
+
+  return -1;
+}
+
+
+/* must be called with mutex held, command NULL or empty flushes all */
+static int flush( const char* command, int invalidation )
+{
+  t_rule* r;
+  int i, n = 0;
+
+  for( i = 0; i < cache.nr_rules; ++i ) {
+    r = & cache.rules[i];
+    if( command && command[0] && strcmp( r->command, command ) )
+      continue;
+
+    if( r->valid ) {
+      r->valid = 0;
+      ++n;
+      if( invalidation )
+        ++r->invalidations;
+    }
+
+    /* a response in flight might be stale as well */
+    if( cache.capture == i )
+      cache.capture = -1;
+  }
+
+  return n;
+}
+
+
+/* must be called with mutex held, checks each line of the message */
+static void apply_invalidations( const char* data, int len )
+{
+  const t_invalidation* inv;
+  int pos = 0, i;
+
+  while( pos < len ) {
+    while( pos < len && ( data[pos] == '\r' || data[pos] == '\n' ) )
+      ++pos;
+
+    for( i = 0; i < cache.nr_invalidations; ++i ) {
+      inv = & cache.invalidations[i];
+      if( len - pos >= inv->prefix_len && ! memcmp( data + pos, inv->prefix, inv->prefix_len ) ) {
+        tcm_message( "%s: flush %s triggered by %s\n", __func__,
+                     inv->command[0] ? inv->command : "all responses", inv->prefix );
+        flush( inv->command, 1 );
+      }
+    }
+
+    while( pos < len && data[pos] != '\r' && data[pos] != '\n' )
+      ++pos;
+  }
+}
+
+
+/* 1 for OK, -1 for error result codes, 0 for any other line */
+static int final_result( const char* buf, int len )
+{
+  static const char* errors[] = { "ERROR", "+CME ERROR", "+CMS ERROR", "NO CARRIER" };
+  int i;
+
+  if( len == 2 && ! memcmp( buf, "OK", 2 ) )
+    return 1;
+  for( i = 0; i < sizeof( errors ) / sizeof( errors[0] ); ++i ) {
+    if( len >= strlen( errors[i] ) && ! memcmp( buf, errors[i], strlen( errors[i] ) ) )
+      return -1;
+  }
+
+  return 0;
+}
+
+
+/* prefix of information lines for extended commands, e.g. "+CSQ:" for AT+CSQ, otherwise empty */
+static void info_prefix( const char* command, char* dst )
+{
+  int n = 0;
+
+  if( ! strncmp( command, "AT", 2 ) && command[2] && strchr( "+^*%$", command[2] ) ) {
+    for( command += 2; *command && ! strchr( "=?;", *command ); ++command )
+      dst[n++] = *command;
+    dst[n++] = ':';
+  }
+  dst[n] = '\0';
+}
+
+
+/* 1 when line belongs to the captured response, 0 for unsolicited messages */
+static int is_response_line( const t_rule* r, const char* line, int len )
+{
+  char cmd[TCM_ATCACHE_MAX_COMMAND_LEN];
+  int i, n;
+
+  /* command echo */
+  if( normalize( line, len, cmd ) >= 0 && ! strcmp( cmd, r->command ) )
+    return 1;
+
+  if( final_result( line, len ) )
+    return 1;
+
+  /* prefixed lines must match the command, e.g. +CREG: is not part of AT+CSQ's response */
+  if( len > 0 && strchr( "+^*%$", line[0] ) ) {
+    for( i = 1; i < len && ( isalnum( (unsigned char)line[i] ) || line[i] == '_' ); ++i )
+      ;
+    if( i < len && line[i] == ':' ) {
+      n = strlen( cache.capture_prefix );
+      return( n == i + 1 && ! memcmp( line, cache.capture_prefix, n ) );
+    }
+  }
+
+  /* unprefixed information text, e.g. response to AT+CGSN, except for ring indication */
+  return !( len == 4 && ! memcmp( line, "RING", 4 ) );
+}
+
+
+/* must be called with mutex held for each complete line, returns 0 while capture is pending */
+static int capture_line( void )
+{
+  t_rule* r = & cache.rules[cache.capture];
+  const char* line = cache.line;
+  int len = cache.line_len, result;
+
+  /* empty lines in front are kept together with the line they precede */
+  while( len > 0 && ( *line == '\r' || *line == '\n' ) ) {
+    ++line;
+    --len;
+  }
+  while( len > 0 && ( line[len-1] == '\r' || line[len-1] == '\n' ) )
+    --len;
+  if( len == 0 )
+    return 0;
+
+  result = final_result( line, len );
+  if( is_response_line( r, line, len ) ) {
+    if( cache.capture_len + cache.line_len > TCM_ATCACHE_MAX_RESPONSE )
+      return -1;
+    memcpy( cache.capture_buf + cache.capture_len, cache.line, cache.line_len );
+    cache.capture_len += cache.line_len;
+  }
+  cache.line_len = 0;
+
+  if( result > 0 ) {
+    memcpy( r->response, cache.capture_buf, cache.capture_len );
+    r->len = cache.capture_len;
+    r->stored_ns = now_ns();
+    r->valid = 1;
+    ++r->stores;
+  }
+
+  return result;
+}
+
+
+int tcm_atcache_set_rule( const char* command, int ttl_ms )
+{
+  char cmd[TCM_ATCACHE_MAX_COMMAND_LEN];
+  t_rule* r;
+  int i;
+
+  if( normalize( command, strlen( command ), cmd ) <= 0 || ttl_ms < 0 ) {
+    tcm_error( "%s: invalid command or time to live error!\n", __func__ );
+    return -1;
+  }
+
+  pthread_mutex_lock( & cache.mutex );
+  i = find_rule( cmd );
+  if( i < 0 ) {
+    if( cache.nr_rules >= TCM_ATCACHE_MAX_RULES ) {
+      pthread_mutex_unlock( & cache.mutex );
+      tcm_error( "%s: too many cacheable commands error!\n", __func__ );
+      return -1;
+    }
+    i = cache.nr_rules++;
+    r = & cache.rules[i];
+    memset( r, 0, sizeof( t_rule ) );
+    strcpy( r->command, cmd );
+  }
+  cache.rules[i].ttl_ms = ttl_ms;
+  pthread_mutex_unlock( & cache.mutex );
+
+  return 0;
+}
+
+
+int tcm_atcache_add_invalidation( const char* prefix, const char* command )
+{
+  t_invalidation* inv;
+  char cmd[TCM_ATCACHE_MAX_COMMAND_LEN] = "";
+  int len = strlen( prefix );
+
+  if( len == 0 || len >= TCM_ATCACHE_MAX_PREFIX_LEN ||
+      ( command && normalize( command, strlen( command ), cmd ) <= 0 ) ) {
+    tcm_error( "%s: invalid prefix or command error!\n", __func__ );
+    return -1;
+  }
+
+  pthread_mutex_lock( & cache.mutex );
+  if( cache.nr_invalidations >= TCM_ATCACHE_MAX_INVALIDATIONS ) {
+    pthread_mutex_unlock( & cache.mutex );
+    tcm_error( "%s: too many invalidation rules error!\n", __func__ );
+    return -1;
+  }
+  inv = & cache.invalidations[cache.nr_invalidations++];
+  memcpy( inv->prefix, prefix, len + 1 );
+  inv->prefix_len = len;
+  strcpy( inv->command, cmd );
+  pthread_mutex_unlock( & cache.mutex );
+
+  return 0;
+}
+
+
+int tcm_atcache_lookup( const char* request, int len, char* p_buf, int size )
+{
+  char cmd[TCM_ATCACHE_MAX_COMMAND_LEN];
+  uint64_t now;
+  t_rule* r;
+  int i, n;
+
+  /* empty lines do not reach the modem's command parser */
+  n = normalize( request, len, cmd );
+  if( n == 0 )
+    return -1;
+
+  pthread_mutex_lock( & cache.mutex );
+  i = ( n > 0 ) ? find_rule( cmd ) : -1;
+  if( i < 0 ) {
+    cache.capture = -1;
+    pthread_mutex_unlock( & cache.mutex );
+    return -1;
+  }
+
+  r = & cache.rules[i];
+  now = now_ns();
+  if( r->valid && r->ttl_ms > 0 && now - r->stored_ns >= (uint64_t)r->ttl_ms * 1000000ULL )
+    r->valid = 0;
+
+  if( r->valid && r->len < size ) {
+    memcpy( p_buf, r->response, r->len );
+    p_buf[r->len] = '\0';
+    ++r->hits;
+    pthread_mutex_unlock( & cache.mutex );
+    return r->len;
+  }
+
+  ++r->misses;
+  cache.capture = i;
+  cache.capture_ns = now;
+  cache.capture_len = 0;
+  cache.line_len = 0;
+  info_prefix( cmd, cache.capture_prefix );
+  pthread_mutex_unlock( & cache.mutex );
+
+  return -1;
+}
+
+
+void tcm_atcache_feed( const char* data, int len )
+{
+  int i;
+
+  pthread_mutex_lock( & cache.mutex );
+  apply_invalidations( data, len );
+
+  if( cache.capture >= 0 &&
+      now_ns() - cache.capture_ns >= TCM_ATCACHE_CAPTURE_TIMEOUT_MS * 1000000ULL )
+    cache.capture = -1;
+
+  /* messages may be split or merged arbitrarily, hence response is collected line by line */
+  for( i = 0; i < len && cache.capture >= 0; ++i ) {
+    if( cache.line_len >= TCM_ATCACHE_MAX_RESPONSE ) {
+      cache.capture = -1;
+      break;
+    }
+    cache.line[cache.line_len++] = data[i];
+    if( data[i] == '\n' && capture_line() )
+      cache.capture = -1;
+  }
+  pthread_mutex_unlock( & cache.mutex );
+}
+
+
+int tcm_atcache_flush( const char* command )
+{
+  char cmd[TCM_ATCACHE_MAX_COMMAND_LEN] = "";
+  int n;
+
+  if( command && normalize( command, strlen( command ), cmd ) < 0 )
+    return 0;
+
+  pthread_mutex_lock( & cache.mutex );
+  n = flush( cmd, 0 );
+  pthread_mutex_unlock( & cache.mutex );
+
+  return n;
+}
+
+
+int tcm_atcache_stats( t_tcm_atcache_stats* p_stats, int max )
+{
+  const t_rule* r;
+  uint64_t now = now_ns();
+  int i, n;
+
+  pthread_mutex_lock( & cache.mutex );
+  n = ( cache.nr_rules < max ) ? cache.nr_rules : max;
+  for( i = 0; i < n; ++i ) {
+    r = & cache.rules[i];
+    strcpy( p_stats[i].command, r->command );
+    p_stats[i].ttl_ms = r->ttl_ms;
+    p_stats[i].hits = r->hits;
+    p_stats[i].misses = r->misses;
+    p_stats[i].stores = r->stores;
+    p_stats[i].invalidations = r->invalidations;
+    p_stats[i].cached = r->valid &&
+      ( r->ttl_ms == 0 || now - r->stored_ns < (uint64_t)r->ttl_ms * 1000000ULL );
+  }
+  pthread_mutex_unlock( & cache.mutex );
+
+  return n;
+}
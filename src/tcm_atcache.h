@@ -0,0 +1,159 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_ATCACHE_H
+#define TCM_ATCACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_atcache.h
+    \brief response cache for idempotent AT queries
+
+    Identity and other static queries such as AT+CGMI or AT+CGSN are answered
+    from the cache once the modem's response has been seen. Commands are
+    cacheable when a rule with a time to live has been defined for them.
+    Requests are normalized before lookup, i.e. leading white space and
+    trailing line terminators are removed and characters outside of quotes
+    are converted to upper case.
+
+    On a cache miss the modem's response is captured until its final result
+    code. Only the echo, information lines carrying the command's prefix,
+    e.g. "+CSQ:" for AT+CSQ, unprefixed information text and the final
+    result code are kept, unsolicited messages such as +CREG: or RING which
+    arrive in between are not part of the cached response. Only responses
+    terminated with OK are stored. Since the AT
+    interface processes one command after the other, a capture is abandoned
+    when another command is forwarded before the final result code arrived.
+
+    Invalidation rules flush cached responses when a message from the modem
+    starts with a given prefix, e.g. when the SIM card has been changed.
+
+    All functions are thread safe, they are usually invoked by the channel
+    handlers of the host and modem channel.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_ATCACHE_MAX_RULES          32               /*!< maximum number of cacheable commands */
+#define TCM_ATCACHE_MAX_INVALIDATIONS  32               /*!< maximum number of invalidation rules */
+#define TCM_ATCACHE_MAX_COMMAND_LEN    64               /*!< maximum length of normalized command */
+#define TCM_ATCACHE_MAX_PREFIX_LEN     32               /*!< maximum length of invalidation prefix */
+#define TCM_ATCACHE_MAX_RESPONSE       512              /*!< maximum length of cached response */
+#define TCM_ATCACHE_CAPTURE_TIMEOUT_MS 5000             /*!< abandon capture without final result code */
+
+
+/*!
+ * statistics of one cacheable command
+ */
+typedef struct s_tcm_atcache_stats {
+  char                          command[TCM_ATCACHE_MAX_COMMAND_LEN]; /*!< normalized command */
+  int                           ttl_ms;                 /*!< time to live, 0 for until invalidated */
+  long                          hits;                   /*!< requests answered from the cache */
+  long                          misses;                 /*!< requests forwarded to the modem */
+  long                          stores;                 /*!< responses stored in the cache */
+  long                          invalidations;          /*!< cached responses flushed by invalidation rules */
+  int                           cached;                 /*!< set to 1 when a valid response is cached */
+} t_tcm_atcache_stats;
+
+
+/*!
+ * define or change cacheable command
+ *
+ * \param command AT command, normalized before use
+ * \param ttl_ms time to live in milliseconds, 0 for until invalidated
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_atcache_set_rule( const char* command, int ttl_ms );
+
+
+/*!
+ * add invalidation rule
+ *
+ * \param prefix start of modem message which triggers invalidation
+ * \param command command to flush or NULL to flush all cached responses
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_atcache_add_invalidation( const char* prefix, const char* command );
+
+
+/*!
+ * look up request from host
+ *
+ * In case of a miss for a cacheable command the capture of the modem's
+ * response is started. Any other request abandons a pending capture.
+ *
+ * \param request request string as received from host
+ * \param len length of request
+ * \param p_buf buffer for cached response
+ * \param size size of buffer
+ * \return length of cached response or -1 when not cached
+ */
+int tcm_atcache_lookup( const char* request, int len, char* p_buf, int size );
+
+
+/*!
+ * process message from modem
+ *
+ * Applies invalidation rules and collects the response lines of a pending
+ * capture, unsolicited messages are skipped.
+ *
+ * \param data message as received from modem
+ * \param len length of message
+ */
+void tcm_atcache_feed( const char* data, int len );
+
+
+/*!
+ * flush cached responses
+ *
+ * \param command command to flush or NULL for all commands
+ * \return number of flushed responses
+ */
+int tcm_atcache_flush( const char* command );
+
+
+/*!
+ * retrieve statistics of all cacheable commands
+ *
+ * \param p_stats array for statistics
+ * \param max size of array
+ * \return number of returned entries
+ */
+int tcm_atcache_stats( t_tcm_atcache_stats* p_stats, int max );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_ATCACHE_H */
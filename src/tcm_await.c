@@ -0,0 +1,382 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* memmem() */
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <tcm_await.h>
+#include <tcm_pattern.h>
+#include <olcutils/alloc.h>
+#include <tcm_log.h>
+
+
+/*! states of a slot */
+typedef enum {
+  t_await_free,                                         /*!< in free list */
+  t_await_pending,                                      /*!< waiting for reply, in channel and wheel list */
+  t_await_fired                                         /*!< answered, expired or cancelled, waiting for tcm_await_done() */
+} t_await_state;
+
+
+/*! pending request */
+typedef struct s_tcm_await {
+  t_await_state                 state;                  /*!< state of slot */
+  t_base_channel*               p_channel;              /*!< channel the reply is expected from */
+  struct s_tcm_await*           p_ch_next;              /*!< next request of same channel, circular */
+  struct s_tcm_await*           p_ch_prev;              /*!< previous request of same channel, circular */
+  struct s_tcm_await*           p_tm_next;              /*!< next request in wheel slot respectively free list */
+  struct s_tcm_await*           p_tm_prev;              /*!< previous request in wheel slot */
+  long                          expiry;                 /*!< tick when request expires */
+  char                          match[TCM_AWAIT_MAX_MATCH]; /*!< string contained in reply */
+  int                           match_len;              /*!< length of string, 0 when pattern is used */
+  void*                         p_pattern;              /*!< own copy of compiled pattern or NULL */
+} t_tcm_await;
+
+
+static struct {
+  pthread_mutex_t               mutex;                  /*!< protects everything below */
+  pthread_cond_t                cond;                   /*!< wakes up timer thread */
+  pthread_t                     timer;                  /*!< timer thread */
+  int                           started;                /*!< 1 when timer thread is running */
+  t_tcm_await_expire_cb         cb;                     /*!< expire callback */
+  void*                         p_ctx;                  /*!< context of expire callback */
+
+  t_tcm_await                   slots[TCM_AWAIT_MAX_PENDING]; /*!< all requests */
+  t_tcm_await*                  p_free;                 /*!< free list, linked by p_tm_next */
+  int                           nr_used;                /*!< slots handed out to callers */
+  t_tcm_await*                  wheel[TCM_AWAIT_WHEEL_SLOTS]; /*!< pending requests by expiry tick */
+  long                          tick;                   /*!< next tick to be processed */
+
+  t_tcm_await_stats             stats;                  /*!< statistics */
+} awaits = { PTHREAD_MUTEX_INITIALIZER };
+
+
+static long now_tick( void )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return ( now.tv_sec * 1000L + now.tv_nsec / 1000000L ) / TCM_AWAIT_TICK_MS;
+}
+
+
+/*
+ * take request out of channel and wheel list, caller holds mutex
+ */
+static void unlink_request( t_tcm_await* p )
+{
+  t_base_channel* p_channel = p->p_channel;
+  t_tcm_await** pp_slot = & awaits.wheel[ p->expiry % TCM_AWAIT_WHEEL_SLOTS ];
+
+  if( p->p_ch_next == p )
+    p_channel->p_awaits = NULL;
+  else {
+    p->p_ch_prev->p_ch_next = p->p_ch_next;
+    p->p_ch_next->p_ch_prev = p->p_ch_prev;
+    if( p_channel->p_awaits == p )
+      p_channel->p_awaits = p->p_ch_next;
+  }
+
+  if( p->p_tm_prev )
+    p->p_tm_prev->p_tm_next = p->p_tm_next;
+  else
+    *pp_slot = p->p_tm_next;
+  if( p->p_tm_next )
+    p->p_tm_next->p_tm_prev = p->p_tm_prev;
+
+  if( p->p_pattern ) {
+    cul_free( p->p_pattern );
+    p->p_pattern = NULL;
+  }
+
+  p->p_channel = NULL;
+  p->state = t_await_fired;
+  --awaits.stats.nr_pending;
+}
+
+
+/*
+ * return slot to free list, caller holds mutex
+ */
+static void free_request( t_tcm_await* p )
+{
+  p->state = t_await_free;
+  p->p_tm_next = awaits.p_free;
+  awaits.p_free = p;
+  --awaits.nr_used;
+}
+
+
+static void* timer_thread( void* p_arg )
+{
+  int expired[TCM_AWAIT_MAX_BATCH];
+  struct timespec ts;
+  t_tcm_await *p, *p_next;
+  int i, n;
+  long now;
+
+  pthread_mutex_lock( & awaits.mutex );
+
+  while( 1 ) {
+    while( awaits.stats.nr_pending == 0 )
+      pthread_cond_wait( & awaits.cond, & awaits.mutex );
+
+    /* collect expired requests of all ticks passed since last run */
+    n = 0;
+    now = now_tick();
+    while( awaits.tick <= now && n < TCM_AWAIT_MAX_BATCH ) {
+      for( p = awaits.wheel[ awaits.tick % TCM_AWAIT_WHEEL_SLOTS ]; p && n < TCM_AWAIT_MAX_BATCH; p = p_next ) {
+        p_next = p->p_tm_next;
+        /* requests with timeouts beyond one revolution stay for later rounds */
+        if( p->expiry <= awaits.tick ) {
+          unlink_request( p );
+          ++awaits.stats.nr_expired;
+          expired[n++] = p - awaits.slots;
+        }
+      }
+      if( n < TCM_AWAIT_MAX_BATCH )
+        ++awaits.tick;
+    }
+
+    if( n ) {
+      pthread_mutex_unlock( & awaits.mutex );
+      for( i = 0; i < n; ++i )
+        awaits.cb( awaits.p_ctx, expired[i] );
+      pthread_mutex_lock( & awaits.mutex );
+      continue;
+    }
+
+    /* sleep until next tick is due */
+    ts.tv_sec = ( awaits.tick * TCM_AWAIT_TICK_MS ) / 1000;
+    ts.tv_nsec = ( ( awaits.tick * TCM_AWAIT_TICK_MS ) % 1000 ) * 1000000L;
+    pthread_cond_timedwait( & awaits.cond, & awaits.mutex, & ts );
+  }
+
+  pthread_mutex_unlock( & awaits.mutex );
+
+  return p_arg;
+}
+
+
+int tcm_await_start( t_tcm_await_expire_cb cb, void* p_ctx )
+{
+  pthread_condattr_t attr;
+  int i, retcode = 0;
+
+  pthread_mutex_lock( & awaits.mutex );
+
+  if( ! awaits.started ) {
+    awaits.cb = cb;
+    awaits.p_ctx = p_ctx;
+    for( i = TCM_AWAIT_MAX_PENDING - 1; i >= 0; --i ) {
+      awaits.slots[i].p_tm_next = awaits.p_free;
+      awaits.p_free = & awaits.slots[i];
+    }
+
+    /* wakeups are scheduled on the monotonic clock the ticks are derived from */
+    pthread_condattr_init( & attr );
+    pthread_condattr_setclock( & attr, CLOCK_MONOTONIC );
+    pthread_cond_init( & awaits.cond, & attr );
+    pthread_condattr_destroy( & attr );
+
+    if( pthread_create( & awaits.timer, NULL, timer_thread, NULL ) ) {
+      tcm_error( "%s: creation of timer thread failed error!\n", __func__ );
+      pthread_cond_destroy( & awaits.cond );
+      awaits.p_free = NULL;
+      retcode = -1;
+    } else {
+      awaits.started = 1;
+    }
+  }
+
+  pthread_mutex_unlock( & awaits.mutex );
+
+  return retcode;
+}
+
+
+int tcm_await_add( t_base_channel* p_channel, const char* match, const void* p_pattern, int timeout_ms )
+{
+  t_tcm_await* p;
+  t_tcm_await** pp_slot;
+  void* p_copy = NULL;
+  long now;
+
+  if( match && ( ! *match || strlen( match ) >= TCM_AWAIT_MAX_MATCH ) ) {
+    tcm_error( "%s: string to match must have 1 to %d characters error!\n", __func__, TCM_AWAIT_MAX_MATCH - 1 );
+    return -1;
+  }
+
+  if( timeout_ms <= 0 ) {
+    tcm_error( "%s: timeout must be positive error!\n", __func__ );
+    return -1;
+  }
+
+  /* each request matches with its own copy since patterns hold scratch memory */
+  if( p_pattern ) {
+    p_copy = cul_malloc( tcm_pattern_size( p_pattern ) );
+    if( p_copy == NULL ) {
+      tcm_error( "%s: out of memory error!\n", __func__ );
+      return -1;
+    }
+    memcpy( p_copy, p_pattern, tcm_pattern_size( p_pattern ) );
+  }
+
+  pthread_mutex_lock( & awaits.mutex );
+
+  p = awaits.p_free;
+  if( ! awaits.started || p == NULL ) {
+    pthread_mutex_unlock( & awaits.mutex );
+    tcm_error( "%s: maximum number of %d pending requests exceeded error!\n", __func__, TCM_AWAIT_MAX_PENDING );
+    if( p_copy )
+      cul_free( p_copy );
+    return -1;
+  }
+  awaits.p_free = p->p_tm_next;
+  ++awaits.nr_used;
+
+  p->state = t_await_pending;
+  p->p_channel = p_channel;
+  p->p_pattern = p_copy;
+  p->match_len = 0;
+  if( match ) {
+    strcpy( p->match, match );
+    p->match_len = strlen( match );
+  }
+
+  /* the wheel restarts from the current tick after being idle */
+  now = now_tick();
+  if( awaits.stats.nr_pending++ == 0 )
+    awaits.tick = now;
+  p->expiry = now + ( timeout_ms + TCM_AWAIT_TICK_MS - 1 ) / TCM_AWAIT_TICK_MS;
+
+  pp_slot = & awaits.wheel[ p->expiry % TCM_AWAIT_WHEEL_SLOTS ];
+  p->p_tm_prev = NULL;
+  p->p_tm_next = *pp_slot;
+  if( *pp_slot )
+    (*pp_slot)->p_tm_prev = p;
+  *pp_slot = p;
+
+  /* appended at the end of the circular list of the channel */
+  if( p_channel->p_awaits == NULL ) {
+    p->p_ch_next = p->p_ch_prev = p;
+    p_channel->p_awaits = p;
+  } else {
+    p->p_ch_next = p_channel->p_awaits;
+    p->p_ch_prev = p_channel->p_awaits->p_ch_prev;
+    p->p_ch_prev->p_ch_next = p;
+    p_channel->p_awaits->p_ch_prev = p;
+  }
+
+  pthread_cond_signal( & awaits.cond );
+  pthread_mutex_unlock( & awaits.mutex );
+
+  return p - awaits.slots;
+}
+
+
+int tcm_await_match( t_base_channel* p_channel, const char* data, int len )
+{
+  t_tcm_await *p, *p_first;
+  int slot = -1;
+
+  /* channels without pending requests are not delayed */
+  if( __atomic_load_n( & p_channel->p_awaits, __ATOMIC_RELAXED ) == NULL )
+    return -1;
+
+  pthread_mutex_lock( & awaits.mutex );
+
+  p = p_first = p_channel->p_awaits;
+  while( p ) {
+    if( p->p_pattern ? tcm_pattern_match( p->p_pattern, data, len, NULL, 0 )
+                     : memmem( data, len, p->match, p->match_len ) != NULL ) {
+      unlink_request( p );
+      ++awaits.stats.nr_replied;
+      slot = p - awaits.slots;
+      break;
+    }
+
+    p = p->p_ch_next;
+    if( p == p_first )
+      break;
+  }
+
+  pthread_mutex_unlock( & awaits.mutex );
+
+  return slot;
+}
+
+
+void tcm_await_cancel( int slot )
+{
+  t_tcm_await* p = & awaits.slots[slot];
+
+  pthread_mutex_lock( & awaits.mutex );
+  if( p->state == t_await_pending ) {
+    unlink_request( p );
+    ++awaits.stats.nr_cancelled;
+    free_request( p );
+  }
+  pthread_mutex_unlock( & awaits.mutex );
+}
+
+
+void tcm_await_cancel_channel( t_base_channel* p_channel )
+{
+  t_tcm_await* p;
+
+  pthread_mutex_lock( & awaits.mutex );
+  while( ( p = p_channel->p_awaits ) != NULL ) {
+    unlink_request( p );
+    ++awaits.stats.nr_cancelled;
+    free_request( p );
+  }
+  pthread_mutex_unlock( & awaits.mutex );
+}
+
+
+void tcm_await_done( int slot )
+{
+  t_tcm_await* p = & awaits.slots[slot];
+
+  pthread_mutex_lock( & awaits.mutex );
+  if( p->state == t_await_fired )
+    free_request( p );
+  pthread_mutex_unlock( & awaits.mutex );
+}
+
+
+void tcm_await_stats( t_tcm_await_stats* p_stats )
+{
+  pthread_mutex_lock( & awaits.mutex );
+  *p_stats = awaits.stats;
+  pthread_mutex_unlock( & awaits.mutex );
+}
@@ -0,0 +1,156 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_AWAIT_H
+#define TCM_AWAIT_H
+
+#include <base_channel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+    \file tcm_await.h
+    \brief replies awaited on channels with timeout
+
+    A request written to a channel registers the reply it waits for: either
+    a string contained in the reply or a compiled pattern, see
+    tcm_pattern.h. Received data is matched against the pending requests of
+    its channel in the order they have been registered, before the callback
+    of the channel is invoked. Requests which have not been answered in time
+    expire on a hashed timer wheel which a timer thread advances in ticks of
+    TCM_AWAIT_TICK_MS, adding, answering and expiring a request takes
+    constant time.
+
+    Each pending request occupies a slot which is handed to the caller. A
+    slot of an answered or expired request stays reserved until
+    tcm_await_done() is called, hence state kept per slot by the caller is
+    not reused before the reply or timeout has been processed.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_AWAIT_MAX_PENDING      8192                 /*!< maximum number of pending requests */
+#define TCM_AWAIT_WHEEL_SLOTS      512                  /*!< slots of timer wheel */
+#define TCM_AWAIT_TICK_MS          10                   /*!< resolution of timeouts */
+#define TCM_AWAIT_MAX_MATCH        64                   /*!< maximum length of matched string */
+#define TCM_AWAIT_MAX_BATCH        64                   /*!< expired requests reported at once */
+
+
+/*!
+ * invoked from the timer thread for each expired request
+ *
+ * \param p_ctx context given to tcm_await_start()
+ * \param slot slot of expired request, to be freed with tcm_await_done()
+ */
+typedef void (*t_tcm_await_expire_cb)( void* p_ctx, int slot );
+
+
+/*!
+ * statistics of awaited replies
+ */
+typedef struct s_tcm_await_stats {
+  int                           nr_pending;             /*!< requests waiting for reply */
+  long                          nr_replied;             /*!< requests answered */
+  long                          nr_expired;             /*!< requests timed out */
+  long                          nr_cancelled;           /*!< requests dropped, e.g. when the channel is closed */
+} t_tcm_await_stats;
+
+
+/*!
+ * start timer thread, subsequent invocations have no effect
+ *
+ * \param cb function invoked for each expired request
+ * \param p_ctx context passed to cb
+ * \return 0 in case of success, otherwise -1
+ */
+int tcm_await_start( t_tcm_await_expire_cb cb, void* p_ctx );
+
+
+/*!
+ * register awaited reply
+ *
+ * \param p channel the reply is expected from
+ * \param match string contained in reply or NULL when pattern is given
+ * \param p_pattern compiled pattern, copied, or NULL when string is given
+ * \param timeout_ms maximum time to wait for the reply
+ * \return slot of request or -1 in case of error
+ */
+int tcm_await_add( t_base_channel* p, const char* match, const void* p_pattern, int timeout_ms );
+
+
+/*!
+ * match received data against pending requests of channel
+ *
+ * \param p channel data has been received from
+ * \param data received data
+ * \param len length of received data
+ * \return slot of oldest matching request, to be freed with tcm_await_done(), or -1
+ */
+int tcm_await_match( t_base_channel* p, const char* data, int len );
+
+
+/*!
+ * drop pending request e.g. when writing the request failed
+ *
+ * \param slot slot of request
+ */
+void tcm_await_cancel( int slot );
+
+
+/*!
+ * drop all pending requests of channel, invoked when the channel is released
+ *
+ * \param p channel
+ */
+void tcm_await_cancel_channel( t_base_channel* p );
+
+
+/*!
+ * free slot after the reply or timeout has been processed
+ *
+ * \param slot slot returned by tcm_await_match() or passed to the expire callback
+ */
+void tcm_await_done( int slot );
+
+
+/*!
+ * retrieve statistics
+ *
+ * \param p_stats pointer where statistics are written to
+ */
+void tcm_await_stats( t_tcm_await_stats* p_stats );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_AWAIT_H */
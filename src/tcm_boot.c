@@ -0,0 +1,193 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <tcm_boot.h>
+#include <tcm_log.h>
+
+
+/*! timeline state, written rarely during startup only */
+static struct {
+  pthread_mutex_t               mutex;                  /*!< access protection */
+  struct timespec               t0;                     /*!< daemon start */
+  double                        since_power_on_ms;      /*!< boot time clock at daemon start */
+  t_tcm_boot_phase              phases[TCM_BOOT_MAX_PHASES]; /*!< recorded phases */
+  int                           nr_phases;              /*!< number of recorded phases */
+  double                        last_ms;                /*!< end of previous phase */
+  int                           init_done;              /*!< daemon initialization completed */
+  int                           channel_live;           /*!< first channel has been opened */
+  int                           reported;               /*!< timeline has been written */
+} boot = { PTHREAD_MUTEX_INITIALIZER };
+
+
+static double elapsed_ms( const struct timespec* p_t0 )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return ( now.tv_sec - p_t0->tv_sec ) * 1e3 + ( now.tv_nsec - p_t0->tv_nsec ) * 1e-6;
+}
+
+
+void tcm_boot_init( void )
+{
+  struct timespec up;
+
+  clock_gettime( CLOCK_MONOTONIC, & boot.t0 );
+
+  /* unlike the monotonic clock the boot time clock includes suspend */
+#ifdef CLOCK_BOOTTIME
+  if( clock_gettime( CLOCK_BOOTTIME, & up ) == 0 )
+    boot.since_power_on_ms = up.tv_sec * 1e3 + up.tv_nsec * 1e-6;
+#endif
+}
+
+
+static void add_phase( const char* name )
+{
+  t_tcm_boot_phase* p_phase;
+  double now = tcm_boot_elapsed_ms();
+
+  if( boot.nr_phases >= TCM_BOOT_MAX_PHASES )
+    return;
+
+  p_phase = & boot.phases[boot.nr_phases++];
+  strncpy( p_phase->name, name, sizeof( p_phase->name ) - 1 );
+  p_phase->name[sizeof( p_phase->name ) - 1] = '\0';
+  p_phase->duration_ms = now - boot.last_ms;
+  p_phase->end_ms = now;
+  boot.last_ms = now;
+}
+
+
+void tcm_boot_mark( const char* fmt, ... )
+{
+  char name[TCM_BOOT_MAX_NAME_LEN];
+  va_list args;
+
+  va_start( args, fmt );
+  vsnprintf( name, sizeof( name ), fmt, args );
+  va_end( args );
+
+  pthread_mutex_lock( & boot.mutex );
+  add_phase( name );
+  pthread_mutex_unlock( & boot.mutex );
+}
+
+
+/* caller holds the mutex */
+static void report( void )
+{
+  char line[2048];
+  int i, len;
+
+  if( boot.reported )
+    return;
+  boot.reported = 1;
+
+  len = snprintf( line, sizeof( line ), "boot-timeline since-power-on=%.3f", boot.since_power_on_ms );
+  for( i = 0; i < boot.nr_phases && len < sizeof( line ); ++i ) {
+    len += snprintf( line + len, sizeof( line ) - len, " %s=%.3f@%.3f",
+                     boot.phases[i].name, boot.phases[i].duration_ms, boot.phases[i].end_ms );
+  }
+
+  tcm_message( "%s\n", line );
+}
+
+
+void tcm_boot_init_done( void )
+{
+  pthread_mutex_lock( & boot.mutex );
+  add_phase( "init-done" );
+  boot.init_done = 1;
+  if( boot.channel_live )
+    report();
+  pthread_mutex_unlock( & boot.mutex );
+}
+
+
+int tcm_boot_channel_live( const char* name )
+{
+  char phase[TCM_BOOT_MAX_NAME_LEN];
+  int first = 0;
+
+  pthread_mutex_lock( & boot.mutex );
+  if( ! boot.channel_live ) {
+    snprintf( phase, sizeof( phase ), "channel-live:%s", name );
+    add_phase( phase );
+    boot.channel_live = 1;
+    first = 1;
+    if( boot.init_done )
+      report();
+  }
+  pthread_mutex_unlock( & boot.mutex );
+
+  return first;
+}
+
+
+int tcm_boot_channel_is_live( void )
+{
+  int live;
+
+  pthread_mutex_lock( & boot.mutex );
+  live = boot.channel_live;
+  pthread_mutex_unlock( & boot.mutex );
+
+  return live;
+}
+
+
+void tcm_boot_report( void )
+{
+  pthread_mutex_lock( & boot.mutex );
+  report();
+  pthread_mutex_unlock( & boot.mutex );
+}
+
+
+int tcm_boot_phases( t_tcm_boot_phase* p_phases, int max )
+{
+  int n;
+
+  pthread_mutex_lock( & boot.mutex );
+  n = ( boot.nr_phases < max ) ? boot.nr_phases : max;
+  memcpy( p_phases, boot.phases, n * sizeof( t_tcm_boot_phase ) );
+  pthread_mutex_unlock( & boot.mutex );
+
+  return n;
+}
+
+
+double tcm_boot_elapsed_ms( void )
+{
+  return elapsed_ms( & boot.t0 );
+}
@@ -0,0 +1,139 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_BOOT_H
+#define TCM_BOOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_boot.h
+    \brief startup timeline
+
+    Each startup phase is marked when it is completed. Timestamps are taken
+    from the monotonic clock and refer to the start of the daemon. When the
+    daemon's initialization is done and the first device channel has been
+    opened, the complete timeline is written as one log line:
+
+    \verbatim
+    boot-timeline since-power-on=4210.118 config=0.412@0.412 ... channel-live:/dev/ttyUSB0=12.345@160.223
+    \endverbatim
+
+    All values are given in milliseconds, each phase as duration@end.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_BOOT_MAX_PHASES        64                   /*!< maximum number of recorded phases */
+#define TCM_BOOT_MAX_NAME_LEN      48                   /*!< maximum length of phase name */
+
+
+/*!
+ * recorded startup phase
+ */
+typedef struct s_tcm_boot_phase {
+  char                          name[TCM_BOOT_MAX_NAME_LEN]; /*!< phase name */
+  double                        duration_ms;            /*!< time since previous phase */
+  double                        end_ms;                 /*!< time since daemon start */
+} t_tcm_boot_phase;
+
+
+/*!
+ * start the timeline, to be invoked first thing in the daemon
+ */
+void tcm_boot_init( void );
+
+
+/*!
+ * mark the end of a startup phase
+ *
+ * \param fmt format string for phase name as used in clib e.g. printf
+ */
+void tcm_boot_mark( const char* fmt, ... );
+
+
+/*!
+ * mark the end of the daemon's initialization
+ *
+ * The timeline is reported when the first channel is already live.
+ */
+void tcm_boot_init_done( void );
+
+
+/*!
+ * mark first successful open of a device channel
+ *
+ * The timeline is reported when the daemon's initialization is done.
+ *
+ * \param name name of the channel
+ * \return 1 when this is the first live channel, otherwise 0
+ */
+int tcm_boot_channel_live( const char* name );
+
+
+/*!
+ * check whether a device channel has been opened
+ *
+ * \return 1 when the first channel is live, otherwise 0
+ */
+int tcm_boot_channel_is_live( void );
+
+
+/*!
+ * write the timeline to the log if not yet done
+ */
+void tcm_boot_report( void );
+
+
+/*!
+ * retrieve recorded startup phases
+ *
+ * \param p_phases array where phases are written to
+ * \param max maximum number of array elements
+ * \return number of phases written
+ */
+int tcm_boot_phases( t_tcm_boot_phase* p_phases, int max );
+
+
+/*!
+ * milliseconds elapsed since daemon start
+ *
+ * \return elapsed time
+ */
+double tcm_boot_elapsed_ms( void );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_BOOT_H */
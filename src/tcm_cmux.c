@@ -0,0 +1,335 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <tcm_cmux.h>
+
+
+/*! CRC-8 with reversed polynomial x^8 + x^2 + x + 1 */
+static const uint8_t crc_table[256] = {
+  0x00, 0x91, 0xE3, 0x72, 0x07, 0x96, 0xE4, 0x75, 0x0E, 0x9F, 0xED, 0x7C,
+  0x09, 0x98, 0xEA, 0x7B, 0x1C, 0x8D, 0xFF, 0x6E, 0x1B, 0x8A, 0xF8, 0x69,
+  0x12, 0x83, 0xF1, 0x60, 0x15, 0x84, 0xF6, 0x67, 0x38, 0xA9, 0xDB, 0x4A,
+  0x3F, 0xAE, 0xDC, 0x4D, 0x36, 0xA7, 0xD5, 0x44, 0x31, 0xA0, 0xD2, 0x43,
+  0x24, 0xB5, 0xC7, 0x56, 0x23, 0xB2, 0xC0, 0x51, 0x2A, 0xBB, 0xC9, 0x58,
+  0x2D, 0xBC, 0xCE, 0x5F, 0x70, 0xE1, 0x93, 0x02, 0x77, 0xE6, 0x94, 0x05,
+  0x7E, 0xEF, 0x9D, 0x0C, 0x79, 0xE8, 0x9A, 0x0B, 0x6C, 0xFD, 0x8F, 0x1E,
+  0x6B, 0xFA, 0x88, 0x19, 0x62, 0xF3, 0x81, 0x10, 0x65, 0xF4, 0x86, 0x17,
+  0x48, 0xD9, 0xAB, 0x3A, 0x4F, 0xDE, 0xAC, 0x3D, 0x46, 0xD7, 0xA5, 0x34,
+  0x41, 0xD0, 0xA2, 0x33, 0x54, 0xC5, 0xB7, 0x26, 0x53, 0xC2, 0xB0, 0x21,
+  0x5A, 0xCB, 0xB9, 0x28, 0x5D, 0xCC, 0xBE, 0x2F, 0xE0, 0x71, 0x03, 0x92,
+  0xE7, 0x76, 0x04, 0x95, 0xEE, 0x7F, 0x0D, 0x9C, 0xE9, 0x78, 0x0A, 0x9B,
+  0xFC, 0x6D, 0x1F, 0x8E, 0xFB, 0x6A, 0x18, 0x89, 0xF2, 0x63, 0x11, 0x80,
+  0xF5, 0x64, 0x16, 0x87, 0xD8, 0x49, 0x3B, 0xAA, 0xDF, 0x4E, 0x3C, 0xAD,
+  0xD6, 0x47, 0x35, 0xA4, 0xD1, 0x40, 0x32, 0xA3, 0xC4, 0x55, 0x27, 0xB6,
+  0xC3, 0x52, 0x20, 0xB1, 0xCA, 0x5B, 0x29, 0xB8, 0xCD, 0x5C, 0x2E, 0xBF,
+  0x90, 0x01, 0x73, 0xE2, 0x97, 0x06, 0x74, 0xE5, 0x9E, 0x0F, 0x7D, 0xEC,
+  0x99, 0x08, 0x7A, 0xEB, 0x8C, 0x1D, 0x6F, 0xFE, 0x8B, 0x1A, 0x68, 0xF9,
+  0x82, 0x13, 0x61, 0xF0, 0x85, 0x14, 0x66, 0xF7, 0xA8, 0x39, 0x4B, 0xDA,
+  0xAF, 0x3E, 0x4C, 0xDD, 0xA6, 0x37, 0x45, 0xD4, 0xA1, 0x30, 0x42, 0xD3,
+  0xB4, 0x25, 0x57, 0xC6, 0xB3, 0x22, 0x50, 0xC1, 0xBA, 0x2B, 0x59, 0xC8,
+  0xBD, 0x2C, 0x5E, 0xCF
+};
+
+
+/*! states of basic option decoder */
+enum {
+  st_hunt,                                              /*!< waiting for opening flag */
+  st_addr,                                              /*!< address or further flags */
+  st_ctrl,                                              /*!< control field */
+  st_len1,                                              /*!< first length octet */
+  st_len2,                                              /*!< second length octet */
+  st_info,                                              /*!< information field */
+  st_fcs,                                               /*!< frame check sequence */
+  st_end,                                               /*!< closing flag */
+  st_frame                                              /*!< advanced option: within frame */
+};
+
+
+static uint8_t crc( uint8_t fcs, const uint8_t* p, int len )
+{
+  while( len-- > 0 )
+    fcs = crc_table[ fcs ^ *p++ ];
+
+  return fcs;
+}
+
+
+uint8_t tcm_cmux_fcs( const uint8_t* p, int len )
+{
+  return 0xFF - crc( 0xFF, p, len );
+}
+
+
+/* appends byte with transparency escape of advanced option */
+static int put_escaped( uint8_t* p_out, int pos, uint8_t c )
+{
+  if( c == TCM_CMUX_ADVANCED_FLAG || c == TCM_CMUX_ESCAPE ) {
+    p_out[pos++] = TCM_CMUX_ESCAPE;
+    c ^= 0x20;
+  }
+  p_out[pos++] = c;
+
+  return pos;
+}
+
+
+int tcm_cmux_encode( t_tcm_cmux_mode mode, int dlci, int cr, int ctrl, const uint8_t* p_info, int len,
+                     uint8_t* p_out, int size )
+{
+  uint8_t hdr[4];
+  int hdr_len = 0, pos = 0, i;
+  uint8_t fcs;
+
+  if( size < TCM_CMUX_MAX_FRAME( len ) )
+    return -1;
+
+  hdr[hdr_len++] = ( dlci << 2 ) | ( cr ? 0x02 : 0 ) | 0x01;
+  hdr[hdr_len++] = ctrl;
+
+  if( mode == t_tcm_cmux_basic ) {
+    if( len < 128 ) {
+      hdr[hdr_len++] = ( len << 1 ) | 0x01;
+    } else {
+      hdr[hdr_len++] = ( len & 0x7F ) << 1;
+      hdr[hdr_len++] = len >> 7;
+    }
+  }
+
+  /* information field is covered for UI frames only */
+  fcs = crc( 0xFF, hdr, hdr_len );
+  if( ( ctrl & ~TCM_CMUX_PF ) == TCM_CMUX_UI )
+    fcs = crc( fcs, p_info, len );
+  fcs = 0xFF - fcs;
+
+  if( mode == t_tcm_cmux_basic ) {
+    p_out[pos++] = TCM_CMUX_BASIC_FLAG;
+    memcpy( p_out + pos, hdr, hdr_len );
+    pos += hdr_len;
+    if( len > 0 )
+      memcpy( p_out + pos, p_info, len );
+    pos += len;
+    p_out[pos++] = fcs;
+    p_out[pos++] = TCM_CMUX_BASIC_FLAG;
+  } else {
+    p_out[pos++] = TCM_CMUX_ADVANCED_FLAG;
+    for( i = 0; i < hdr_len; ++i )
+      pos = put_escaped( p_out, pos, hdr[i] );
+    for( i = 0; i < len; ++i )
+      pos = put_escaped( p_out, pos, p_info[i] );
+    pos = put_escaped( p_out, pos, fcs );
+    p_out[pos++] = TCM_CMUX_ADVANCED_FLAG;
+  }
+
+  return pos;
+}
+
+
+int tcm_cmux_encode_ctrl( int type, int cr, const uint8_t* p_value, int len, uint8_t* p_out )
+{
+  int pos = 0;
+
+  p_out[pos++] = type | ( cr ? 0x02 : 0 ) | 0x01;
+  p_out[pos++] = ( len << 1 ) | 0x01;
+  if( len > 0 )
+    memcpy( p_out + pos, p_value, len );
+
+  return pos + len;
+}
+
+
+void tcm_cmux_decoder_init( t_tcm_cmux_decoder* p, t_tcm_cmux_mode mode, int max_info )
+{
+  memset( p, 0, sizeof( t_tcm_cmux_decoder ) );
+  p->mode = mode;
+  p->max_info = ( max_info > 0 && max_info <= TCM_CMUX_MAX_INFO ) ? max_info : TCM_CMUX_MAX_INFO;
+  p->state = st_hunt;
+}
+
+
+/* validates frame in buffer, hdr_len octets of header are followed by info and fcs */
+static int deliver( t_tcm_cmux_decoder* p, int hdr_len, t_tcm_cmux_frame_cb cb, void* p_ctx )
+{
+  t_tcm_cmux_frame frame;
+  int info_len = p->pos - hdr_len - 1;
+  uint8_t fcs;
+
+  if( info_len < 0 || ! ( p->buf[0] & 0x01 ) ) {
+    ++p->nr_errors;
+    return 0;
+  }
+
+  frame.dlci = p->buf[0] >> 2;
+  frame.cr = ( p->buf[0] >> 1 ) & 0x01;
+  frame.ctrl = p->buf[1] & ~TCM_CMUX_PF;
+  frame.pf = ( p->buf[1] & TCM_CMUX_PF ) ? 1 : 0;
+  frame.p_info = p->buf + hdr_len;
+  frame.len = info_len;
+
+  fcs = crc( 0xFF, p->buf, hdr_len );
+  if( frame.ctrl == TCM_CMUX_UI )
+    fcs = crc( fcs, frame.p_info, info_len );
+  fcs = crc( fcs, p->buf + p->pos - 1, 1 );
+
+  /* remainder of a valid frame */
+  if( fcs != 0xCF ) {
+    ++p->nr_errors;
+    return 0;
+  }
+
+  ++p->nr_frames;
+  cb( p_ctx, & frame );
+
+  return 1;
+}
+
+
+static int decode_basic( t_tcm_cmux_decoder* p, uint8_t c, t_tcm_cmux_frame_cb cb, void* p_ctx )
+{
+  int n = 0;
+
+  switch( p->state ) {
+  case st_hunt:
+    if( c == TCM_CMUX_BASIC_FLAG )
+      p->state = st_addr;
+    break;
+
+  case st_addr:
+    /* flags between frames are skipped */
+    if( c != TCM_CMUX_BASIC_FLAG ) {
+      p->pos = 0;
+      p->buf[p->pos++] = c;
+      p->state = st_ctrl;
+    }
+    break;
+
+  case st_ctrl:
+    p->buf[p->pos++] = c;
+    p->state = st_len1;
+    break;
+
+  case st_len1:
+    p->buf[p->pos++] = c;
+    p->len = c >> 1;
+    p->state = ( c & 0x01 ) ? st_info : st_len2;
+    break;
+
+  case st_len2:
+    p->buf[p->pos++] = c;
+    p->len |= c << 7;
+    p->state = st_info;
+    break;
+
+  case st_info:
+    p->buf[p->pos++] = c;
+    break;
+
+  case st_fcs:
+    p->buf[p->pos++] = c;
+    p->state = st_end;
+    break;
+
+  case st_end:
+    if( c == TCM_CMUX_BASIC_FLAG ) {
+      n = deliver( p, p->pos - p->len - 1, cb, p_ctx );
+      p->state = st_addr;
+    } else {
+      ++p->nr_errors;
+      p->state = st_hunt;
+    }
+    break;
+  }
+
+  /* information field complete or oversized */
+  if( p->state == st_info ) {
+    if( p->len > p->max_info ) {
+      ++p->nr_errors;
+      p->state = st_hunt;
+    } else if( p->pos == ( ( p->buf[2] & 0x01 ) ? 3 : 4 ) + p->len ) {
+      p->state = st_fcs;
+    }
+  }
+
+  return n;
+}
+
+
+static int decode_advanced( t_tcm_cmux_decoder* p, uint8_t c, t_tcm_cmux_frame_cb cb, void* p_ctx )
+{
+  int n = 0;
+
+  if( c == TCM_CMUX_ADVANCED_FLAG ) {
+    /* empty frames between consecutive flags are ignored */
+    if( p->state == st_frame && p->pos > 0 )
+      n = deliver( p, 2, cb, p_ctx );
+    p->state = st_frame;
+    p->pos = 0;
+    p->escaped = 0;
+    return n;
+  }
+
+  if( p->state != st_frame )
+    return 0;
+
+  if( c == TCM_CMUX_ESCAPE ) {
+    p->escaped = 1;
+    return 0;
+  }
+
+  if( p->escaped ) {
+    c ^= 0x20;
+    p->escaped = 0;
+  }
+
+  if( p->pos >= p->max_info + 3 ) {
+    ++p->nr_errors;
+    p->state = st_hunt;
+    return 0;
+  }
+
+  p->buf[p->pos++] = c;
+
+  return 0;
+}
+
+
+int tcm_cmux_decode( t_tcm_cmux_decoder* p, const uint8_t* data, int len,
+                     t_tcm_cmux_frame_cb cb, void* p_ctx )
+{
+  int i, n = 0;
+
+  if( p->mode == t_tcm_cmux_basic ) {
+    for( i = 0; i < len; ++i )
+      n += decode_basic( p, data[i], cb, p_ctx );
+  } else {
+    for( i = 0; i < len; ++i )
+      n += decode_advanced( p, data[i], cb, p_ctx );
+  }
+
+  return n;
+}
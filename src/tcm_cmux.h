@@ -0,0 +1,195 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_CMUX_H
+#define TCM_CMUX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_cmux.h
+    \brief frame encoding and decoding of the 3GPP TS 27.010 multiplexer
+
+    Frames are encoded and decoded in basic option, i.e. framed by 0xF9 with
+    a length field, as well as in advanced option, i.e. HDLC framed by 0x7E
+    with transparency escapes. The frame check sequence is computed with a
+    table driven CRC-8 according to TS 27.010 section 5.2.1.6.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_CMUX_MAX_INFO          2048                 /*!< maximum size of information field */
+#define TCM_CMUX_MAX_DLCI          63                   /*!< highest data link connection identifier */
+#define TCM_CMUX_MAX_FRAME( n )    ( 2 * ( (n) + 6 ) )  /*!< buffer size for encoding frame with n bytes information */
+
+#define TCM_CMUX_BASIC_FLAG        0xF9                 /*!< frame delimiter of basic option */
+#define TCM_CMUX_ADVANCED_FLAG     0x7E                 /*!< frame delimiter of advanced option */
+#define TCM_CMUX_ESCAPE            0x7D                 /*!< control escape of advanced option */
+
+#define TCM_CMUX_SABM              0x2F                 /*!< set asynchronous balanced mode */
+#define TCM_CMUX_UA                0x63                 /*!< unnumbered acknowledgement */
+#define TCM_CMUX_DM                0x0F                 /*!< disconnected mode */
+#define TCM_CMUX_DISC              0x43                 /*!< disconnect */
+#define TCM_CMUX_UIH               0xEF                 /*!< unnumbered information with header check */
+#define TCM_CMUX_UI                0x03                 /*!< unnumbered information */
+#define TCM_CMUX_PF                0x10                 /*!< poll / final bit of control field */
+
+#define TCM_CMUX_CTRL_PN           0x80                 /*!< parameter negotiation */
+#define TCM_CMUX_CTRL_PSC          0x40                 /*!< power saving control */
+#define TCM_CMUX_CTRL_CLD          0xC0                 /*!< multiplexer close down */
+#define TCM_CMUX_CTRL_TEST         0x20                 /*!< test command */
+#define TCM_CMUX_CTRL_FCON         0xA0                 /*!< flow control on */
+#define TCM_CMUX_CTRL_FCOFF        0x60                 /*!< flow control off */
+#define TCM_CMUX_CTRL_MSC          0xE0                 /*!< modem status command */
+#define TCM_CMUX_CTRL_NSC          0x10                 /*!< non supported command response */
+
+#define TCM_CMUX_MSC_FC            0x02                 /*!< flow control bit of V.24 signals */
+#define TCM_CMUX_MSC_RTC           0x04                 /*!< ready to communicate */
+#define TCM_CMUX_MSC_RTR           0x08                 /*!< ready to receive */
+#define TCM_CMUX_MSC_DV            0x80                 /*!< data valid */
+
+
+/*! frame option */
+typedef enum {
+  t_tcm_cmux_basic,                                     /*!< basic option */
+  t_tcm_cmux_advanced                                   /*!< advanced option without error recovery */
+} t_tcm_cmux_mode;
+
+
+/*! decoded frame */
+typedef struct s_tcm_cmux_frame {
+  int                           dlci;                   /*!< data link connection identifier */
+  int                           cr;                     /*!< command / response bit */
+  int                           ctrl;                   /*!< frame type without poll / final bit */
+  int                           pf;                     /*!< poll / final bit */
+  const uint8_t*                p_info;                 /*!< information field */
+  int                           len;                    /*!< length of information field */
+} t_tcm_cmux_frame;
+
+
+/*!
+ * callback for decoded frames
+ *
+ * \param p_ctx user context of decoder
+ * \param p_frame decoded frame, valid within callback only
+ */
+typedef void (*t_tcm_cmux_frame_cb)( void* p_ctx, const t_tcm_cmux_frame* p_frame );
+
+
+/*! decoder state */
+typedef struct s_tcm_cmux_decoder {
+  t_tcm_cmux_mode               mode;                   /*!< frame option */
+  int                           max_info;               /*!< maximum size of information field */
+  int                           state;                  /*!< parser state */
+  int                           escaped;                /*!< advanced option: next byte is escaped */
+  int                           len;                    /*!< basic option: length of information field */
+  int                           pos;                    /*!< bytes in buffer */
+  uint8_t                       buf[TCM_CMUX_MAX_INFO + 8]; /*!< frame without flags */
+  long                          nr_frames;              /*!< valid frames */
+  long                          nr_errors;              /*!< discarded frames */
+} t_tcm_cmux_decoder;
+
+
+/*!
+ * compute frame check sequence
+ *
+ * \param p data covered by the frame check sequence
+ * \param len length of data
+ * \return frame check sequence
+ */
+uint8_t tcm_cmux_fcs( const uint8_t* p, int len );
+
+
+/*!
+ * encode frame
+ *
+ * \param mode frame option
+ * \param dlci data link connection identifier
+ * \param cr command / response bit
+ * \param ctrl frame type, optionally with poll / final bit
+ * \param p_info information field or NULL
+ * \param len length of information field
+ * \param p_out buffer for frame
+ * \param size size of buffer, TCM_CMUX_MAX_FRAME( len ) is always sufficient
+ * \return length of frame or -1 when the buffer is too small
+ */
+int tcm_cmux_encode( t_tcm_cmux_mode mode, int dlci, int cr, int ctrl, const uint8_t* p_info, int len,
+                     uint8_t* p_out, int size );
+
+
+/*!
+ * encode message of the control channel
+ *
+ * \param type message type e.g. TCM_CMUX_CTRL_MSC
+ * \param cr 1 for command, 0 for response
+ * \param p_value value octets
+ * \param len number of value octets
+ * \param p_out buffer for message, len + 4 bytes are sufficient
+ * \return length of message
+ */
+int tcm_cmux_encode_ctrl( int type, int cr, const uint8_t* p_value, int len, uint8_t* p_out );
+
+
+/*!
+ * initialize decoder
+ *
+ * \param p decoder
+ * \param mode frame option
+ * \param max_info maximum size of information field, at most TCM_CMUX_MAX_INFO
+ */
+void tcm_cmux_decoder_init( t_tcm_cmux_decoder* p, t_tcm_cmux_mode mode, int max_info );
+
+
+/*!
+ * decode received bytes
+ *
+ * Frames with invalid frame check sequence or oversized information field
+ * are discarded, the decoder resynchronizes on the next flag.
+ *
+ * \param p decoder
+ * \param data received bytes
+ * \param len number of received bytes
+ * \param cb callback for each valid frame
+ * \param p_ctx user context for callback
+ * \return number of valid frames
+ */
+int tcm_cmux_decode( t_tcm_cmux_decoder* p, const uint8_t* data, int len,
+                     t_tcm_cmux_frame_cb cb, void* p_ctx );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_CMUX_H */
@@ -0,0 +1,521 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <olcutils/alloc.h>
+#include <tcm_coalesce.h>
+#include <tcm_log.h>
+
+
+/*! rule with state of its current window */
+typedef struct {
+  char                          prefix[TCM_COALESCE_MAX_PREFIX_LEN]; /*!< start of coalesced lines */
+  int                           prefix_len;             /*!< length of prefix */
+  t_tcm_coalesce_policy         policy;                 /*!< policy, off for removed rules with held line */
+  int                           interval_ms;            /*!< length of window */
+  int                           limit;                  /*!< lines passed per window */
+  uint64_t                      window_end_ns;          /*!< end of current window, 0 when there is none */
+  int                           nr_window;              /*!< lines passed in current window */
+  int                           held_len;               /*!< length of held line, 0 when there is none */
+  char                          held[TCM_COALESCE_MAX_LINE]; /*!< line released at the end of the window */
+  long                          passed;                 /*!< lines passed immediately */
+  long                          suppressed;             /*!< lines not passed immediately */
+  long                          released;               /*!< held lines released */
+} t_rule;
+
+
+struct s_tcm_coalesce {
+  pthread_mutex_t               mutex;                  /*!< access protection */
+  t_rule                        rules[TCM_COALESCE_MAX_RULES]; /*!< rules, searched linearly */
+  int                           nr_rules;               /*!< number of rules */
+  int                           max_prefix_len;         /*!< length of longest prefix */
+  char                          line[TCM_COALESCE_MAX_LINE]; /*!< incomplete line with preceding blank lines */
+  int                           line_len;               /*!< length of incomplete line */
+  int                           blank_len;              /*!< length of blank lines at start of line */
+  uint64_t                      line_ns;                /*!< time when holding of line started */
+  int                           passing;                /*!< 1 while the rest of the current line is passed */
+  uint64_t                      command_ns;             /*!< time when outstanding command was sent, 0 when there is none */
+  long*                         p_nr_suppressed;        /*!< counter of owner or NULL */
+};
+
+
+/*! output buffer */
+typedef struct {
+  char*                         p_buf;                  /*!< start of buffer */
+  int                           len;                    /*!< used length */
+  int                           size;                   /*!< size of buffer */
+} t_out;
+
+
+static uint64_t now_ns( void )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+static void out_append( t_out* o, const char* data, int len )
+{
+  if( len > o->size - o->len ) {
+    tcm_error( "%s: output buffer exceeded, %d bytes dropped error!\n", __func__, len - ( o->size - o->len ) );
+    len = o->size - o->len;
+  }
+  memcpy( o->p_buf + o->len, data, len );
+  o->len += len;
+}
+
+
+static void update_max_prefix_len( t_tcm_coalesce* p )
+{
+  int i;
+
+  p->max_prefix_len = 0;
+  for( i = 0; i < p->nr_rules; ++i )
+    if( p->rules[i].policy != t_tcm_coalesce_off && p->rules[i].prefix_len > p->max_prefix_len )
+      p->max_prefix_len = p->rules[i].prefix_len;
+}
+
+
+/* rule whose prefix starts s, NULL if there is none */
+static t_rule* match( t_tcm_coalesce* p, const char* s, int len )
+{
+  t_rule* r;
+  int i;
+
+  for( i = 0; i < p->nr_rules; ++i ) {
+    r = & p->rules[i];
+    if( r->policy != t_tcm_coalesce_off && len >= r->prefix_len && ! memcmp( s, r->prefix, r->prefix_len ) )
+      return r;
+  }
+
+  return NULL;
+}
+
+
+/* returns 1 while a command is waiting for its final result code */
+static int command_pending( t_tcm_coalesce* p, uint64_t now )
+{
+  if( p->command_ns && now >= p->command_ns + TCM_COALESCE_COMMAND_TIMEOUT_MS * 1000000ULL )
+    p->command_ns = 0;
+
+  return p->command_ns != 0;
+}
+
+
+/* returns 1 for final result codes which complete a command */
+static int is_final_result( const char* s, int len )
+{
+  static const char* codes[] = { "OK", "ERROR", "+CME ERROR", "+CMS ERROR", "NO CARRIER",
+                                 "CONNECT", "BUSY", "NO ANSWER", "NO DIALTONE" };
+  int i, n;
+
+  while( len > 0 && ( s[len-1] == '\r' || s[len-1] == '\n' ) )
+    --len;
+
+  for( i = 0; i < sizeof( codes ) / sizeof( codes[0] ); ++i ) {
+    n = strlen( codes[i] );
+    if( len >= n && ! memcmp( s, codes[i], n ) && ( len == n || s[n] == ':' || s[n] == ' ' ) )
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* returns 1 when the start s of an incomplete line may still become a command echo */
+static int may_be_echo( const char* s, int len )
+{
+  return ! strncasecmp( s, "AT", ( len < 2 ) ? len : 2 );
+}
+
+
+/* returns 1 when the start s of an incomplete line may still become a matching line */
+static int may_match( t_tcm_coalesce* p, const char* s, int len )
+{
+  t_rule* r;
+  int i;
+
+  /* echoes and responses to commands are never coalesced, hence they must be recognized */
+  if( p->command_ns || may_be_echo( s, len ) )
+    return 1;
+
+  for( i = 0; i < p->nr_rules; ++i ) {
+    r = & p->rules[i];
+    if( r->policy != t_tcm_coalesce_off &&
+        ! memcmp( s, r->prefix, ( len < r->prefix_len ) ? len : r->prefix_len ) )
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/* pass held part of current line, the rest of a started line follows without holding */
+static void flush_line( t_tcm_coalesce* p, t_out* o )
+{
+  out_append( o, p->line, p->line_len );
+  p->passing = ( p->line_len > p->blank_len );
+  p->line_len = p->blank_len = 0;
+}
+
+
+static void apply_rule( t_tcm_coalesce* p, t_rule* r, const char* line, int len, uint64_t now, t_out* o )
+{
+  if( r->window_end_ns == 0 ) {
+    r->window_end_ns = now + (uint64_t)r->interval_ms * 1000000ULL;
+    r->nr_window = 0;
+  }
+
+  if( r->nr_window < r->limit ) {
+    out_append( o, line, len );
+    ++r->nr_window;
+    ++r->passed;
+  } else {
+    ++r->suppressed;
+    if( p->p_nr_suppressed )
+      __atomic_add_fetch( p->p_nr_suppressed, 1, __ATOMIC_RELAXED );
+    if( r->policy != t_tcm_coalesce_first ) {
+      memcpy( r->held, line, len );
+      r->held_len = len;
+    }
+  }
+}
+
+
+static void expire( t_tcm_coalesce* p, uint64_t now, t_out* o )
+{
+  t_rule* r;
+  int i, removed = 0;
+
+  for( i = 0; i < p->nr_rules; ++i ) {
+    r = & p->rules[i];
+    if( r->window_end_ns && now >= r->window_end_ns ) {
+      if( r->held_len ) {
+        out_append( o, r->held, r->held_len );
+        r->held_len = 0;
+        ++r->released;
+        /* the released line opens the next window */
+        r->window_end_ns = now + (uint64_t)r->interval_ms * 1000000ULL;
+        r->nr_window = 1;
+      } else {
+        r->window_end_ns = 0;
+      }
+    }
+  }
+
+  /* drop removed rules when their last held line has been released */
+  for( i = 0; i < p->nr_rules; ++i ) {
+    r = & p->rules[i];
+    if( r->policy == t_tcm_coalesce_off && r->held_len == 0 ) {
+      memmove( r, r + 1, ( p->nr_rules - i - 1 ) * sizeof( t_rule ) );
+      --p->nr_rules;
+      --i;
+      removed = 1;
+    }
+  }
+  if( removed )
+    update_max_prefix_len( p );
+
+  if( p->line_len && now >= p->line_ns + TCM_COALESCE_HOLD_MS * 1000000ULL )
+    flush_line( p, o );
+}
+
+
+t_tcm_coalesce* tcm_coalesce_create( long* p_nr_suppressed )
+{
+  t_tcm_coalesce* p;
+
+  p = cul_malloc( sizeof( t_tcm_coalesce ) );
+  if( p == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+
+  memset( p, 0, sizeof( t_tcm_coalesce ) );
+  pthread_mutex_init( & p->mutex, NULL );
+  p->p_nr_suppressed = p_nr_suppressed;
+
+  return p;
+}
+
+
+void tcm_coalesce_release( t_tcm_coalesce* p )
+{
+  if( p ) {
+    pthread_mutex_destroy( & p->mutex );
+    cul_free( p );
+  }
+}
+
+
+int tcm_coalesce_set_rule( t_tcm_coalesce* p, const char* prefix, t_tcm_coalesce_policy policy,
+                           int interval_ms, int limit )
+{
+  t_rule* r = NULL;
+  int i, len = strlen( prefix );
+
+  if( len == 0 || len >= TCM_COALESCE_MAX_PREFIX_LEN ) {
+    tcm_error( "%s: prefix must have between 1 and %d characters error!\n", __func__,
+               TCM_COALESCE_MAX_PREFIX_LEN - 1 );
+    return -1;
+  }
+
+  if( policy != t_tcm_coalesce_off && interval_ms <= 0 ) {
+    tcm_error( "%s: interval must be positive error!\n", __func__ );
+    return -1;
+  }
+
+  if( policy == t_tcm_coalesce_count && limit < 1 ) {
+    tcm_error( "%s: count must be positive error!\n", __func__ );
+    return -1;
+  }
+
+  pthread_mutex_lock( & p->mutex );
+
+  for( i = 0; i < p->nr_rules; ++i ) {
+    if( ! strcmp( p->rules[i].prefix, prefix ) ) {
+      r = & p->rules[i];
+      break;
+    }
+  }
+
+  if( r == NULL ) {
+    if( policy == t_tcm_coalesce_off ) {
+      pthread_mutex_unlock( & p->mutex );
+      return 0;
+    }
+    if( p->nr_rules >= TCM_COALESCE_MAX_RULES ) {
+      pthread_mutex_unlock( & p->mutex );
+      tcm_error( "%s: maximum number of %d rules exceeded error!\n", __func__, TCM_COALESCE_MAX_RULES );
+      return -1;
+    }
+    r = & p->rules[p->nr_rules++];
+    memset( r, 0, sizeof( t_rule ) );
+    strcpy( r->prefix, prefix );
+    r->prefix_len = len;
+  }
+
+  r->policy = policy;
+  if( policy == t_tcm_coalesce_off ) {
+    /* held line is released by the next expiry, the rule is dropped then */
+    if( r->held_len )
+      r->window_end_ns = now_ns();
+  } else {
+    r->interval_ms = interval_ms;
+    r->limit = ( policy == t_tcm_coalesce_count ) ? limit : 1;
+  }
+  update_max_prefix_len( p );
+
+  pthread_mutex_unlock( & p->mutex );
+
+  return 0;
+}
+
+
+int tcm_coalesce_active( t_tcm_coalesce* p )
+{
+  int active;
+
+  pthread_mutex_lock( & p->mutex );
+  active = ( p->nr_rules > 0 || p->line_len > 0 || p->passing );
+  pthread_mutex_unlock( & p->mutex );
+
+  return active;
+}
+
+
+int tcm_coalesce_filter( t_tcm_coalesce* p, const char* data, int len, char* p_out, int size )
+{
+  t_out o = { p_out, 0, size };
+  uint64_t now = now_ns();
+  const char* line;
+  t_rule* r;
+  int i, start, n;
+  char c;
+
+  pthread_mutex_lock( & p->mutex );
+
+  expire( p, now, & o );
+
+  for( i = 0; i < len; ++i ) {
+    c = data[i];
+
+    /* rest of a line which cannot match is copied in one go */
+    if( p->passing ) {
+      start = i;
+      while( i < len && data[i] != '\n' )
+        ++i;
+      if( i < len ) {
+        p->passing = 0;
+        ++i;
+      }
+      out_append( & o, data + start, i - start );
+      --i;
+      continue;
+    }
+
+    if( p->line_len == 0 )
+      p->line_ns = now;
+
+    if( p->line_len == TCM_COALESCE_MAX_LINE ) {
+      flush_line( p, & o );
+      --i;
+      continue;
+    }
+
+    p->line[p->line_len++] = c;
+
+    if( p->line_len - 1 == p->blank_len && ( c == '\r' || c == '\n' ) ) {
+      /* blank lines are held until it is clear whether the next line is suppressed */
+      p->blank_len = p->line_len;
+    } else if( c == '\n' ) {
+      line = p->line + p->blank_len;
+      n = p->line_len - p->blank_len;
+
+      /* lines from the echo up to the final result code are responses, not URCs */
+      if( may_be_echo( line, n ) && n > 2 )
+        p->command_ns = now;
+      r = command_pending( p, now ) ? NULL : match( p, line, n );
+      if( p->command_ns && is_final_result( line, n ) )
+        p->command_ns = 0;
+
+      if( r )
+        apply_rule( p, r, p->line, p->line_len, now, & o );
+      else
+        out_append( & o, p->line, p->line_len );
+      p->line_len = p->blank_len = 0;
+    } else if( p->line_len - p->blank_len <= p->max_prefix_len &&
+               ! may_match( p, p->line + p->blank_len, p->line_len - p->blank_len ) ) {
+      flush_line( p, & o );
+    }
+  }
+
+  pthread_mutex_unlock( & p->mutex );
+
+  return o.len;
+}
+
+
+int tcm_coalesce_expire( t_tcm_coalesce* p, char* p_out, int size )
+{
+  t_out o = { p_out, 0, size };
+
+  pthread_mutex_lock( & p->mutex );
+  expire( p, now_ns(), & o );
+  pthread_mutex_unlock( & p->mutex );
+
+  return o.len;
+}
+
+
+int tcm_coalesce_timeout_ms( t_tcm_coalesce* p )
+{
+  uint64_t now = now_ns(), next = 0, t;
+  int i;
+
+  pthread_mutex_lock( & p->mutex );
+
+  for( i = 0; i < p->nr_rules; ++i ) {
+    t = p->rules[i].window_end_ns;
+    if( t && ( next == 0 || t < next ) )
+      next = t;
+  }
+
+  if( p->line_len ) {
+    t = p->line_ns + TCM_COALESCE_HOLD_MS * 1000000ULL;
+    if( next == 0 || t < next )
+      next = t;
+  }
+
+  pthread_mutex_unlock( & p->mutex );
+
+  if( next == 0 )
+    return -1;
+
+  /* rounded up to avoid waking up before the deadline */
+  return ( next > now ) ? (int)( ( next - now + 999999ULL ) / 1000000ULL ) : 0;
+}
+
+
+void tcm_coalesce_reset( t_tcm_coalesce* p )
+{
+  int i;
+
+  pthread_mutex_lock( & p->mutex );
+
+  for( i = 0; i < p->nr_rules; ++i ) {
+    p->rules[i].held_len = 0;
+    p->rules[i].window_end_ns = 0;
+  }
+  p->line_len = p->blank_len = 0;
+  p->passing = 0;
+  p->command_ns = 0;
+
+  pthread_mutex_unlock( & p->mutex );
+}
+
+
+void tcm_coalesce_command( t_tcm_coalesce* p )
+{
+  pthread_mutex_lock( & p->mutex );
+  p->command_ns = now_ns();
+  pthread_mutex_unlock( & p->mutex );
+}
+
+
+int tcm_coalesce_stats( t_tcm_coalesce* p, t_tcm_coalesce_stats* p_stats, int max )
+{
+  t_rule* r;
+  int i, n = 0;
+
+  pthread_mutex_lock( & p->mutex );
+
+  for( i = 0; i < p->nr_rules && n < max; ++i ) {
+    r = & p->rules[i];
+    if( r->policy == t_tcm_coalesce_off )
+      continue;
+    strcpy( p_stats[n].prefix, r->prefix );
+    p_stats[n].policy = r->policy;
+    p_stats[n].interval_ms = r->interval_ms;
+    p_stats[n].limit = r->limit;
+    p_stats[n].passed = r->passed;
+    p_stats[n].suppressed = r->suppressed;
+    p_stats[n].released = r->released;
+    ++n;
+  }
+
+  pthread_mutex_unlock( & p->mutex );
+
+  return n;
+}
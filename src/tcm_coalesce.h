@@ -0,0 +1,220 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_COALESCE_H
+#define TCM_COALESCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_coalesce.h
+    \brief coalescing of unsolicited result code bursts
+
+    Modems may emit URCs such as +CSQ, +CREG or +CGEV in bursts of dozens per
+    second e.g. during handover. The coalescing stage sits in the reader of
+    device channels and passes only a limited number of lines starting with
+    a configured prefix per time window, the others are suppressed before
+    any callback is invoked. The following policies are supported:
+
+    - latest: the first line is passed immediately, the last line received
+      within the window is released when the window ends. Hence the host
+      always sees the current state.
+    - first: the first line is passed, all others within the window are
+      dropped.
+    - count: up to a given number of lines are passed per window, the last
+      of the excess lines is released when the window ends.
+
+    The data stream is split into lines. Lines not matching any rule are
+    passed unchanged and without delay, only incomplete lines which may still
+    turn out to be matching are held back for at most TCM_COALESCE_HOLD_MS.
+    Blank lines preceding a suppressed line are suppressed as well.
+
+    Rules apply to unsolicited messages only. Lines from a command echo or a
+    command sent with tcm_coalesce_command() up to the final result code are
+    passed unchanged, e.g. the response +CSQ: to AT+CSQ is never held back.
+    A command without recognized final result code is considered completed
+    after TCM_COALESCE_COMMAND_TIMEOUT_MS.
+
+    All functions are thread safe.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_COALESCE_MAX_RULES         16               /*!< maximum number of rules per channel */
+#define TCM_COALESCE_MAX_PREFIX_LEN    32               /*!< maximum length of prefix */
+#define TCM_COALESCE_MAX_LINE          256              /*!< longer lines are never coalesced */
+#define TCM_COALESCE_HOLD_MS           50               /*!< maximum delay of incomplete lines */
+#define TCM_COALESCE_COMMAND_TIMEOUT_MS 30000           /*!< coalescing resumes without final result code */
+
+/*! required size of output buffer for processing len bytes */
+#define TCM_COALESCE_OUT_SIZE( len )   ( (len) + ( TCM_COALESCE_MAX_RULES + 1 ) * TCM_COALESCE_MAX_LINE )
+
+
+/*! policy of rule */
+typedef enum {
+  t_tcm_coalesce_off,                                   /*!< remove rule */
+  t_tcm_coalesce_latest,                                /*!< latest wins */
+  t_tcm_coalesce_first,                                 /*!< first wins */
+  t_tcm_coalesce_count                                  /*!< count within window */
+} t_tcm_coalesce_policy;
+
+
+/*! statistics of one rule */
+typedef struct s_tcm_coalesce_stats {
+  char                          prefix[TCM_COALESCE_MAX_PREFIX_LEN]; /*!< start of coalesced lines */
+  t_tcm_coalesce_policy         policy;                 /*!< policy */
+  int                           interval_ms;            /*!< length of window */
+  int                           limit;                  /*!< lines passed per window */
+  long                          passed;                 /*!< lines passed immediately */
+  long                          suppressed;             /*!< lines not passed immediately */
+  long                          released;               /*!< suppressed lines released at the end of a window */
+} t_tcm_coalesce_stats;
+
+
+struct s_tcm_coalesce;
+
+/*! coalescing stage, opaque */
+typedef struct s_tcm_coalesce t_tcm_coalesce;
+
+
+/*!
+ * create coalescing stage without rules
+ *
+ * \param p_nr_suppressed counter which is incremented atomically for each suppressed line or NULL
+ * \return pointer to instance or NULL in case of error
+ */
+t_tcm_coalesce* tcm_coalesce_create( long* p_nr_suppressed );
+
+
+/*!
+ * release coalescing stage
+ *
+ * \param p pointer to instance
+ */
+void tcm_coalesce_release( t_tcm_coalesce* p );
+
+
+/*!
+ * define, change or remove rule
+ *
+ * Held lines of removed rules are released when their window ends.
+ *
+ * \param p pointer to instance
+ * \param prefix start of coalesced lines, e.g. "+CSQ:"
+ * \param policy policy or t_tcm_coalesce_off to remove the rule
+ * \param interval_ms length of window in milliseconds
+ * \param limit lines passed per window for policy count, ignored otherwise
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_coalesce_set_rule( t_tcm_coalesce* p, const char* prefix, t_tcm_coalesce_policy policy,
+                           int interval_ms, int limit );
+
+
+/*!
+ * check whether data has to be passed through the coalescing stage
+ *
+ * \param p pointer to instance
+ * \return 1 when rules are defined or lines are held, otherwise 0
+ */
+int tcm_coalesce_active( t_tcm_coalesce* p );
+
+
+/*!
+ * process data received from device
+ *
+ * Lines released from expired windows are written before the new data.
+ * Data exceeding the buffer size is dropped.
+ *
+ * \param p pointer to instance
+ * \param data received data
+ * \param len length of received data
+ * \param p_out buffer for data to be passed on
+ * \param size size of buffer, at least TCM_COALESCE_OUT_SIZE( len )
+ * \return length of data to be passed on
+ */
+int tcm_coalesce_filter( t_tcm_coalesce* p, const char* data, int len, char* p_out, int size );
+
+
+/*!
+ * release held lines whose time has come
+ *
+ * \param p pointer to instance
+ * \param p_out buffer for released data
+ * \param size size of buffer, at least TCM_COALESCE_OUT_SIZE( 0 )
+ * \return length of released data
+ */
+int tcm_coalesce_expire( t_tcm_coalesce* p, char* p_out, int size );
+
+
+/*!
+ * time until tcm_coalesce_expire() needs to be invoked
+ *
+ * \param p pointer to instance
+ * \return time in milliseconds or -1 when nothing is held
+ */
+int tcm_coalesce_timeout_ms( t_tcm_coalesce* p );
+
+
+/*!
+ * drop held lines, e.g. when the device has been closed
+ *
+ * \param p pointer to instance
+ */
+void tcm_coalesce_reset( t_tcm_coalesce* p );
+
+
+/*!
+ * notify that a command has been sent to the device
+ *
+ * Lines are passed unchanged until the final result code arrives.
+ *
+ * \param p pointer to instance
+ */
+void tcm_coalesce_command( t_tcm_coalesce* p );
+
+
+/*!
+ * retrieve statistics of all rules
+ *
+ * \param p pointer to instance
+ * \param p_stats array for statistics
+ * \param max size of array
+ * \return number of returned entries
+ */
+int tcm_coalesce_stats( t_tcm_coalesce* p, t_tcm_coalesce_stats* p_stats, int max );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_COALESCE_H */
@@ -32,6 +32,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <pwd.h>
+#include <sched.h>
 #include <tcm_config.h>
 #include <tcm_log.h>
 #include <olcutils/alloc.h>
@@ -40,6 +41,30 @@
 
 char g_tcm_scheme_ip_address[TCM_MAX_ADDR_LEN] = { "0.0.0.0" };
 int  g_tcm_scheme_ip_port = 37147;
+int  g_tcm_scheme_max_connections = 10;
+int  g_tcm_server_sock_max_connections = 1024;
+int  g_tcm_server_sock_max_out_queue = 65536;
+char g_tcm_scheme_rpc_socket[TCM_MAX_ADDR_LEN] = { "" };
+char g_tcm_scheme_image_file[TCM_MAX_PATH] = { SCHEMEIMAGEDIR "/tcm.img" };
+int  g_tcm_scheme_lazy_init = 0;
+int  g_tcm_scheme_budget_ms = 2000;
+int  g_tcm_scheme_budget_abort = 0;
+char g_tcm_flightrec_file[TCM_MAX_PATH] = { "/tmp/tcm-flightrec.log" };
+int  g_tcm_trace_slow_us = 20000;
+char g_tcm_metrics_address[TCM_MAX_ADDR_LEN] = { "" };
+int  g_tcm_metrics_port = 9187;
+int  g_tcm_rt_mlock = 0;
+int  g_tcm_rt_policy = SCHED_FIFO;
+int  g_tcm_rt_stack_size = 262144;
+int  g_tcm_rt_priority[TCM_RT_NR_CLASSES] = { 0, 0, 0 };
+char g_tcm_rt_cpus[TCM_RT_NR_CLASSES][TCM_RT_MAX_CPUS_LEN] = { "", "", "" };
+
+/*! configuration key prefixes of channel classes, indexed by t_channel_type */
+static const char* rt_class_keys[TCM_RT_NR_CLASSES] = {
+  "realtime-dev",
+  "realtime-client-sock",
+  "realtime-server-sock"
+};
 
 
 static void* free_string_val( void* p )
@@ -79,6 +104,9 @@ int tcm_init_config(void)
   char* p_conf_data;
   int conf_data_len;
   FILE* fp;
+  char policy[16];
+  char key[64];
+  int i;
 
   int retcode = 0;
 
@@ -141,6 +169,153 @@ int tcm_init_config(void)
       }
     }
 
+    ln = hm_find( params, cstring_hash( "scheme-server-max-connections" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_scheme_max_connections, 1, 65535 ) ) {
+        tcm_message("%s: overwrite default number of REPL connections with %d\n", __func__, g_tcm_scheme_max_connections );
+      } else {
+        tcm_error("%s: could not parse REPL connections argument error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "scheme-rpc-socket" ) );
+    if( ln ) {
+      string_tmp_cstring_from( ln->val, g_tcm_scheme_rpc_socket, sizeof( g_tcm_scheme_rpc_socket ) );
+      tcm_message("%s: overwrite default RPC socket with %s\n", __func__, g_tcm_scheme_rpc_socket );
+    }
+
+    ln = hm_find( params, cstring_hash( "scheme-image-file" ) );
+    if( ln ) {
+      string_tmp_cstring_from( ln->val, g_tcm_scheme_image_file, sizeof( g_tcm_scheme_image_file ) );
+      tcm_message("%s: overwrite default scheme image file with %s\n", __func__, g_tcm_scheme_image_file );
+    }
+
+    ln = hm_find( params, cstring_hash( "scheme-lazy-init" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_scheme_lazy_init, 0, 1 ) ) {
+        tcm_message("%s: overwrite default lazy initialization with %d\n", __func__, g_tcm_scheme_lazy_init );
+      } else {
+        tcm_error("%s: could not parse lazy initialization argument error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "scheme-callback-budget-ms" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_scheme_budget_ms, 0, INT_MAX ) ) {
+        tcm_message("%s: overwrite default callback budget with %d ms\n", __func__, g_tcm_scheme_budget_ms );
+      } else {
+        tcm_error("%s: could not parse callback budget argument error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "scheme-callback-abort" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_scheme_budget_abort, 0, 1 ) ) {
+        tcm_message("%s: overwrite default callback abort with %d\n", __func__, g_tcm_scheme_budget_abort );
+      } else {
+        tcm_error("%s: could not parse callback abort argument error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "flight-recorder-file" ) );
+    if( ln ) {
+      string_tmp_cstring_from( ln->val, g_tcm_flightrec_file, sizeof( g_tcm_flightrec_file ) );
+      tcm_message("%s: overwrite default flight recorder file with %s\n", __func__, g_tcm_flightrec_file );
+    }
+
+    ln = hm_find( params, cstring_hash( "trace-slow-threshold-us" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_trace_slow_us, 0, INT_MAX ) ) {
+        tcm_message("%s: overwrite default slow trace threshold with %d us\n", __func__, g_tcm_trace_slow_us );
+      } else {
+        tcm_error("%s: could not parse slow trace threshold argument error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "metrics-address" ) );
+    if( ln ) {
+      string_tmp_cstring_from( ln->val, g_tcm_metrics_address, sizeof( g_tcm_metrics_address ) );
+      tcm_message("%s: overwrite default metrics address with %s\n", __func__, g_tcm_metrics_address );
+    }
+
+    ln = hm_find( params, cstring_hash( "metrics-port" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_metrics_port, 0, 65535 ) ) {
+        tcm_message("%s: overwrite default metrics port with %d\n", __func__, g_tcm_metrics_port );
+      } else {
+        tcm_error("%s: could not parse metrics port argument error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "server-sock-max-connections" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_server_sock_max_connections, 1, 1000000 ) ) {
+        tcm_message("%s: overwrite default number of server socket connections with %d\n", __func__, g_tcm_server_sock_max_connections );
+      } else {
+        tcm_error("%s: could not parse server socket connections argument error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "server-sock-max-out-queue" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_server_sock_max_out_queue, 256, INT_MAX ) ) {
+        tcm_message("%s: overwrite default server socket output queue size with %d\n", __func__, g_tcm_server_sock_max_out_queue );
+      } else {
+        tcm_error("%s: could not parse server socket output queue size argument error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "realtime-mlock" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_rt_mlock, 0, 1 ) ) {
+        tcm_message("%s: overwrite default memory locking with %d\n", __func__, g_tcm_rt_mlock );
+      } else {
+        tcm_error("%s: could not parse memory locking argument error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "realtime-policy" ) );
+    if( ln ) {
+      string_tmp_cstring_from( ln->val, policy, sizeof( policy ) );
+      if( ! strcmp( policy, "fifo" ) ) {
+        g_tcm_rt_policy = SCHED_FIFO;
+        tcm_message("%s: overwrite default real-time policy with %s\n", __func__, policy );
+      } else if( ! strcmp( policy, "rr" ) ) {
+        g_tcm_rt_policy = SCHED_RR;
+        tcm_message("%s: overwrite default real-time policy with %s\n", __func__, policy );
+      } else {
+        tcm_error("%s: real-time policy must be fifo or rr error!\n", __func__ );
+      }
+    }
+
+    ln = hm_find( params, cstring_hash( "realtime-stack-size" ) );
+    if( ln ) {
+      if( ! string2int( ln->val, & g_tcm_rt_stack_size, 0, INT_MAX ) ) {
+        tcm_message("%s: overwrite default real-time thread stack size with %d\n", __func__, g_tcm_rt_stack_size );
+      } else {
+        tcm_error("%s: could not parse real-time thread stack size argument error!\n", __func__ );
+      }
+    }
+
+    for( i = 0; i < TCM_RT_NR_CLASSES; ++i ) {
+      snprintf( key, sizeof( key ), "%s-priority", rt_class_keys[i] );
+      ln = hm_find( params, cstring_hash( key ) );
+      if( ln ) {
+        if( ! string2int( ln->val, & g_tcm_rt_priority[i], 0, 99 ) ) {
+          tcm_message("%s: overwrite default %s with %d\n", __func__, key, g_tcm_rt_priority[i] );
+        } else {
+          tcm_error("%s: could not parse %s argument error!\n", __func__, key );
+        }
+      }
+
+      snprintf( key, sizeof( key ), "%s-cpus", rt_class_keys[i] );
+      ln = hm_find( params, cstring_hash( key ) );
+      if( ln ) {
+        string_tmp_cstring_from( ln->val, g_tcm_rt_cpus[i], sizeof( g_tcm_rt_cpus[i] ) );
+        tcm_message("%s: overwrite default %s with %s\n", __func__, key, g_tcm_rt_cpus[i] );
+      }
+    }
+
     string_release( s );
     hm_free_deep( params, 0, free_string_val );
 
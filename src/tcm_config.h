@@ -48,6 +48,12 @@ extern "C" {
 #define TCM_MAX_ADDR_LEN      108
 
 
+/*! number of channel classes for real-time settings, refer to t_channel_type */
+#define TCM_RT_NR_CLASSES     3
+
+/*! maximum length of cpu list string */
+#define TCM_RT_MAX_CPUS_LEN   64
+
 /*! maximum size of configuration file */
 #define TCM_MAX_CONF_SIZE     4096
 
@@ -64,6 +70,111 @@ extern char g_tcm_scheme_ip_address[TCM_MAX_ADDR_LEN];
 extern int  g_tcm_scheme_ip_port;
 
 
+/*!
+ * maximum number of simultaneous REPL connections
+ */
+extern int  g_tcm_scheme_max_connections;
+
+
+/*!
+ * unix domain socket of the framed RPC endpoint, empty string disables RPC
+ */
+extern char g_tcm_scheme_rpc_socket[TCM_MAX_ADDR_LEN];
+
+
+/*!
+ * image file of the scheme initialization files, empty string disables image
+ */
+extern char g_tcm_scheme_image_file[TCM_MAX_PATH];
+
+
+/*!
+ * defer repl, rpc endpoint and deferred scheme thunks until first channel is live when set to 1
+ */
+extern int  g_tcm_scheme_lazy_init;
+
+
+/*!
+ * maximum time in milliseconds a callback may hold the interpreter, 0 disables the watchdog
+ */
+extern int  g_tcm_scheme_budget_ms;
+
+
+/*!
+ * kill hung system commands of callbacks exceeding their budget when set to 1
+ */
+extern int  g_tcm_scheme_budget_abort;
+
+
+/*!
+ * file the flight recorder is dumped to
+ */
+extern char g_tcm_flightrec_file[TCM_MAX_PATH];
+
+
+/*!
+ * messages with a higher latency in microseconds are kept as slow trace, 0 disables
+ */
+extern int  g_tcm_trace_slow_us;
+
+
+/*!
+ * IP address or unix domain socket path of metrics endpoint, empty disables
+ */
+extern char g_tcm_metrics_address[TCM_MAX_ADDR_LEN];
+
+
+/*!
+ * TCP port of metrics endpoint, 0 when address refers to a unix domain socket
+ */
+extern int  g_tcm_metrics_port;
+
+
+/*!
+ * maximum number of simultaneous connections per server socket channel
+ */
+extern int  g_tcm_server_sock_max_connections;
+
+
+/*!
+ * maximum number of bytes queued for output per server socket connection
+ *
+ * Connections which do not consume their data fast enough and exceed this
+ * limit are closed.
+ */
+extern int  g_tcm_server_sock_max_out_queue;
+
+
+/*!
+ * lock all memory in real-time mode when set to 1
+ */
+extern int  g_tcm_rt_mlock;
+
+
+/*!
+ * real-time scheduling policy, SCHED_FIFO or SCHED_RR
+ */
+extern int  g_tcm_rt_policy;
+
+
+/*!
+ * default thread stack size in bytes when memory is locked, 0 for system default
+ */
+extern int  g_tcm_rt_stack_size;
+
+
+/*!
+ * real-time priority of channel threads per class, 0 for no real-time scheduling
+ */
+extern int  g_tcm_rt_priority[TCM_RT_NR_CLASSES];
+
+
+/*!
+ * cpu list like "0,2-3" of channel threads per class, empty for no affinity
+ */
+extern char g_tcm_rt_cpus[TCM_RT_NR_CLASSES][TCM_RT_MAX_CPUS_LEN];
+
+
 /*!
  * initialize configuration data
  */
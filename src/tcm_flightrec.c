@@ -0,0 +1,261 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <tcm_flightrec.h>
+#include <tcm_config.h>
+#include <tcm_log.h>
+
+
+/*! ring of recorded events */
+static struct {
+  uint64_t                      head;                   /*!< sequence number of next event */
+  t_tcm_flightrec_entry         ring[TCM_FLIGHTREC_SIZE]; /*!< recorded events */
+  char                          filename[TCM_MAX_PATH]; /*!< dump file */
+} rec;
+
+
+static const char* kind_names[] = { "rx", "tx", "cb", "connect", "disconnect" };
+
+
+uint64_t tcm_flightrec_now_ns( void )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+void tcm_flightrec_add( t_tcm_flightrec_kind kind, const void* channel, const char* data, int len,
+                        int depth, int duration_us )
+{
+  uint64_t seq = __atomic_fetch_add( & rec.head, 1, __ATOMIC_RELAXED );
+  t_tcm_flightrec_entry* e = & rec.ring[seq & ( TCM_FLIGHTREC_SIZE - 1 )];
+  int n = ( len < TCM_FLIGHTREC_PREFIX_LEN ) ? len : TCM_FLIGHTREC_PREFIX_LEN;
+
+  /* mark entry as being written before its content is changed */
+  __atomic_store_n( & e->seq, 0, __ATOMIC_RELAXED );
+  __atomic_thread_fence( __ATOMIC_RELEASE );
+
+  e->t_ns = tcm_flightrec_now_ns();
+  e->channel = (uint64_t)(unsigned long)channel;
+  e->kind = kind;
+  e->len = len;
+  e->depth = depth;
+  e->duration_us = duration_us;
+  if( data && n > 0 )
+    memcpy( e->prefix, data, n );
+  else
+    n = 0;
+  if( n < TCM_FLIGHTREC_PREFIX_LEN )
+    e->prefix[n] = '\0';
+
+  __atomic_store_n( & e->seq, seq + 1, __ATOMIC_RELEASE );
+}
+
+
+/*
+ * output helpers, only async-signal-safe functions are used from here on
+ */
+
+typedef struct {
+  int                           fd;                     /*!< output file descriptor */
+  char                          buf[512];               /*!< line buffer */
+  int                           len;                    /*!< used bytes in buffer */
+} t_out;
+
+
+static void out_flush( t_out* o )
+{
+  int pos = 0, n;
+
+  while( pos < o->len ) {
+    n = write( o->fd, o->buf + pos, o->len - pos );
+    if( n <= 0 )
+      break;
+    pos += n;
+  }
+  o->len = 0;
+}
+
+
+static void out_char( t_out* o, char c )
+{
+  if( o->len == sizeof( o->buf ) )
+    out_flush( o );
+  o->buf[o->len++] = c;
+}
+
+
+static void out_str( t_out* o, const char* s )
+{
+  while( *s )
+    out_char( o, *s++ );
+}
+
+
+static void out_uint( t_out* o, uint64_t x, int base, int min_digits )
+{
+  char digits[24];
+  int n = 0;
+
+  do {
+    digits[n++] = "0123456789abcdef"[x % base];
+    x /= base;
+  } while( x || n < min_digits );
+
+  while( n > 0 )
+    out_char( o, digits[--n] );
+}
+
+
+static void out_entry( t_out* o, const t_tcm_flightrec_entry* e, uint64_t t_now )
+{
+  uint64_t age_us = ( t_now > e->t_ns ) ? ( t_now - e->t_ns ) / 1000 : 0;
+  int i, n;
+
+  out_uint( o, e->seq - 1, 10, 1 );
+  out_str( o, " -" );
+  out_uint( o, age_us / 1000000, 10, 1 );
+  out_char( o, '.' );
+  out_uint( o, age_us % 1000000, 10, 6 );
+  out_str( o, "s " );
+  out_str( o, e->kind < sizeof( kind_names ) / sizeof( kind_names[0] ) ? kind_names[e->kind] : "?" );
+  out_str( o, " ch=0x" );
+  out_uint( o, e->channel, 16, 1 );
+  out_str( o, " len=" );
+  out_uint( o, e->len, 10, 1 );
+  out_str( o, " depth=" );
+  out_uint( o, e->depth, 10, 1 );
+  out_str( o, " cb=" );
+  out_uint( o, e->duration_us, 10, 1 );
+  out_str( o, "us \"" );
+
+  n = ( e->len < TCM_FLIGHTREC_PREFIX_LEN ) ? e->len : TCM_FLIGHTREC_PREFIX_LEN;
+  for( i = 0; i < n && e->prefix[i]; ++i ) {
+    if( e->prefix[i] == '\r' )
+      out_str( o, "\\r" );
+    else if( e->prefix[i] == '\n' )
+      out_str( o, "\\n" );
+    else if( e->prefix[i] < ' ' || e->prefix[i] > '~' || e->prefix[i] == '"' )
+      out_char( o, '.' );
+    else
+      out_char( o, e->prefix[i] );
+  }
+  out_str( o, "\"\n" );
+}
+
+
+int tcm_flightrec_write( int fd )
+{
+  t_out o;
+  t_tcm_flightrec_entry e;
+  uint64_t head, seq, t_now;
+  int nr_entries = 0;
+
+  o.fd = fd;
+  o.len = 0;
+
+  head = __atomic_load_n( & rec.head, __ATOMIC_ACQUIRE );
+  t_now = tcm_flightrec_now_ns();
+  seq = ( head > TCM_FLIGHTREC_SIZE ) ? head - TCM_FLIGHTREC_SIZE : 0;
+
+  out_str( & o, "flight recorder: " );
+  out_uint( & o, head, 10, 1 );
+  out_str( & o, " events recorded, times relative to dump\n" );
+
+  for( ; seq < head; ++seq ) {
+    const t_tcm_flightrec_entry* p = & rec.ring[seq & ( TCM_FLIGHTREC_SIZE - 1 )];
+
+    /* skip entries being written or already overwritten */
+    if( __atomic_load_n( & p->seq, __ATOMIC_ACQUIRE ) != seq + 1 )
+      continue;
+    memcpy( & e, p, sizeof( e ) );
+    __atomic_thread_fence( __ATOMIC_ACQUIRE );
+    if( __atomic_load_n( & p->seq, __ATOMIC_RELAXED ) != seq + 1 )
+      continue;
+
+    out_entry( & o, & e, t_now );
+    ++nr_entries;
+  }
+
+  out_flush( & o );
+
+  return nr_entries;
+}
+
+
+int tcm_flightrec_dump( const char* filename )
+{
+  int fd, nr_entries;
+
+  if( filename == NULL )
+    filename = rec.filename;
+
+  fd = open( filename, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if( fd < 0 )
+    return -1;
+
+  nr_entries = tcm_flightrec_write( fd );
+  close( fd );
+
+  return nr_entries;
+}
+
+
+static void dump_handler( int sig_num )
+{
+  int saved_errno = errno;
+
+  tcm_flightrec_dump( NULL );
+  errno = saved_errno;
+}
+
+
+void tcm_flightrec_init( const char* filename )
+{
+  struct sigaction sa;
+
+  strncpy( rec.filename, filename, sizeof( rec.filename ) - 1 );
+
+  /* restart interrupted reads of channel threads */
+  memset( & sa, 0, sizeof( sa ) );
+  sa.sa_handler = dump_handler;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset( & sa.sa_mask );
+  if( sigaction( SIGUSR1, & sa, NULL ) )
+    tcm_error( "%s: could not register SIGUSR1 error!\n", __func__ );
+  else
+    tcm_message( "%s: send SIGUSR1 to dump flight recorder to %s\n", __func__, rec.filename );
+}
@@ -0,0 +1,136 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_FLIGHTREC_H
+#define TCM_FLIGHTREC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_flightrec.h
+    \brief flight recorder of recent channel events
+
+    The  flight recorder  is a  fixed size  ring of  the last  channel events. It is
+    always on. Recording an event costs one atomic increment, one monotonic clock
+    reading and a copy of the payload prefix. No lock is taken. The ring is written
+    to a file with async-signal-safe functions only. This happens on SIGSEGV and
+    SIGABRT, on SIGUSR1 and on demand from scheme.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_FLIGHTREC_SIZE         1024                 /*!< number of recorded events, power of two */
+#define TCM_FLIGHTREC_PREFIX_LEN   32                   /*!< number of recorded payload bytes */
+
+
+/*!
+ * kind of recorded event
+ */
+typedef enum {
+  t_tcm_flightrec_rx,                                   /*!< data received and queued */
+  t_tcm_flightrec_tx,                                   /*!< data written to channel */
+  t_tcm_flightrec_cb,                                   /*!< data callback evaluated */
+  t_tcm_flightrec_connect,                              /*!< connection established */
+  t_tcm_flightrec_disconnect                            /*!< connection closed */
+} t_tcm_flightrec_kind;
+
+
+/*!
+ * recorded event
+ */
+typedef struct s_tcm_flightrec_entry {
+  uint64_t                      seq;                    /*!< sequence number + 1, 0 while written */
+  uint64_t                      t_ns;                   /*!< monotonic time stamp in nanoseconds */
+  uint64_t                      channel;                /*!< channel identifier as used in scheme */
+  uint32_t                      kind;                   /*!< t_tcm_flightrec_kind */
+  uint32_t                      len;                    /*!< payload length */
+  uint32_t                      depth;                  /*!< queued events of the channel */
+  uint32_t                      duration_us;            /*!< callback duration in microseconds */
+  char                          prefix[TCM_FLIGHTREC_PREFIX_LEN]; /*!< first bytes of payload */
+} t_tcm_flightrec_entry;
+
+
+/*!
+ * prepare flight recorder dumps and install SIGUSR1 handler
+ *
+ * \param filename file where the ring is dumped to
+ */
+void tcm_flightrec_init( const char* filename );
+
+
+/*!
+ * record event, safe to be invoked from any thread
+ *
+ * \param kind kind of event
+ * \param channel channel object
+ * \param data payload or NULL
+ * \param len payload length
+ * \param depth number of queued events of the channel
+ * \param duration_us callback duration in microseconds
+ */
+void tcm_flightrec_add( t_tcm_flightrec_kind kind, const void* channel, const char* data, int len,
+                        int depth, int duration_us );
+
+
+/*!
+ * write recorded events to file descriptor, async-signal-safe
+ *
+ * \param fd file descriptor
+ * \return number of events written
+ */
+int tcm_flightrec_write( int fd );
+
+
+/*!
+ * write recorded events to file, async-signal-safe
+ *
+ * \param filename file name or NULL for the configured file
+ * \return number of events written or -1 in case of error
+ */
+int tcm_flightrec_dump( const char* filename );
+
+
+/*!
+ * monotonic time in nanoseconds
+ *
+ * \return current time
+ */
+uint64_t tcm_flightrec_now_ns( void );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_FLIGHTREC_H */
@@ -0,0 +1,358 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <tcm_hayes.h>
+#include <tcm_at_vocabulary.h>
+
+
+/*! characters starting extended commands, vendors use others than + */
+static const char extended_prefixes[] = "+#$%^*!";
+
+
+typedef struct {
+  const char*                   s;                      /*!< parsed line */
+  int                           pos;                    /*!< parse position */
+  int                           len;                    /*!< length without line terminators */
+  t_tcm_at_param*               p_params;               /*!< parameter array */
+  int                           nr_params;              /*!< used parameters */
+  int                           max_params;             /*!< size of parameter array */
+} t_parser;
+
+
+static void skip_spaces( t_parser* p )
+{
+  while( p->pos < p->len && p->s[p->pos] == ' ' )
+    ++p->pos;
+}
+
+
+static int add_param( t_parser* p, t_tcm_at_param_type type, int start, int len )
+{
+  t_tcm_at_param* param;
+
+  if( p->nr_params >= p->max_params )
+    return -1;
+
+  param = & p->p_params[p->nr_params++];
+  param->type = type;
+  param->start = start;
+  param->len = len;
+  param->number = 0;
+
+  return 0;
+}
+
+
+/* parses a decimal number of at most 18 digits, returns 0 when there is none */
+static int parse_number( t_parser* p, int* p_end, long* p_value )
+{
+  int i = p->pos, neg = 0, digits = 0;
+  long value = 0;
+
+  if( i < p->len && ( p->s[i] == '-' || p->s[i] == '+' ) )
+    neg = ( p->s[i++] == '-' );
+
+  while( i < p->len && isdigit( (unsigned char)p->s[i] ) && digits < 18 ) {
+    value = 10 * value + ( p->s[i++] - '0' );
+    ++digits;
+  }
+
+  if( digits == 0 )
+    return 0;
+
+  *p_end = i;
+  *p_value = neg ? -value : value;
+  return 1;
+}
+
+
+/*
+ * comma separated parameters up to end of line or up to semicolon when
+ * requested, a trailing comma denotes a trailing empty parameter
+ */
+static int parse_params( t_parser* p, int stop_at_semicolon, int* p_count )
+{
+  int start, end, first = p->nr_params, after_comma = 0;
+  long value;
+  char c;
+
+  while( 1 ) {
+    skip_spaces( p );
+    start = p->pos;
+    c = ( p->pos < p->len ) ? p->s[p->pos] : '\0';
+
+    if( c == '\0' || c == ',' || ( stop_at_semicolon && c == ';' ) ) {
+      /* nothing at all after = does not count as parameter */
+      if( c != ',' && p->nr_params == first && ! after_comma )
+        break;
+      if( add_param( p, t_tcm_at_empty, start, 0 ) < 0 )
+        return -1;
+    }
+    else if( c == '"' ) {
+      end = start + 1;
+      while( end < p->len && p->s[end] != '"' )
+        ++end;
+      if( end >= p->len || add_param( p, t_tcm_at_string, start + 1, end - start - 1 ) < 0 )
+        return -1;
+      p->pos = end + 1;
+    }
+    else {
+      end = start;
+      while( end < p->len && p->s[end] != ',' && ! ( stop_at_semicolon && p->s[end] == ';' ) )
+        ++end;
+      while( end > start && p->s[end-1] == ' ' )
+        --end;
+
+      if( parse_number( p, & p->pos, & value ) && p->pos == end ) {
+        if( add_param( p, t_tcm_at_number, start, end - start ) < 0 )
+          return -1;
+        p->p_params[p->nr_params-1].number = value;
+      } else if( add_param( p, t_tcm_at_token, start, end - start ) < 0 ) {
+        return -1;
+      }
+      p->pos = end;
+    }
+
+    skip_spaces( p );
+    if( p->pos < p->len && p->s[p->pos] == ',' ) {
+      ++p->pos;
+      after_comma = 1;
+      continue;
+    }
+    break;
+  }
+
+  *p_count = p->nr_params - first;
+  return 0;
+}
+
+
+static void set_name( t_tcm_at_cmd* p_cmd, const char* s, int len )
+{
+  int i;
+
+  if( len >= TCM_AT_MAX_NAME )
+    len = TCM_AT_MAX_NAME - 1;
+
+  for( i = 0; i < len; ++i )
+    p_cmd->name[i] = toupper( (unsigned char)s[i] );
+  p_cmd->name[len] = '\0';
+  p_cmd->id = tcm_at_vocabulary_id( p_cmd->name, len );
+}
+
+
+/* form suffix =?, ? or = following the name */
+static t_tcm_at_form parse_form( t_parser* p )
+{
+  if( p->pos + 1 < p->len && p->s[p->pos] == '=' && p->s[p->pos+1] == '?' ) {
+    p->pos += 2;
+    return t_tcm_at_test;
+  }
+  if( p->pos < p->len && p->s[p->pos] == '?' ) {
+    ++p->pos;
+    return t_tcm_at_query;
+  }
+  if( p->pos < p->len && p->s[p->pos] == '=' ) {
+    ++p->pos;
+    return t_tcm_at_set;
+  }
+  return t_tcm_at_execute;
+}
+
+
+static int parse_one( t_parser* p, t_tcm_at_cmd* p_cmd )
+{
+  const char* s = p->s;
+  int start = p->pos, end;
+  long value;
+  char c = toupper( (unsigned char)s[p->pos] );
+
+  p_cmd->first_param = p->nr_params;
+  p_cmd->nr_params = 0;
+  p_cmd->extended = 0;
+
+  if( strchr( extended_prefixes, c ) ) {
+    /* extended command, terminated by semicolon */
+    ++p->pos;
+    while( p->pos < p->len && ( isalnum( (unsigned char)s[p->pos] ) || strchr( "!%-./_", s[p->pos] ) ) )
+      ++p->pos;
+    set_name( p_cmd, s + start, p->pos - start );
+    p_cmd->extended = 1;
+    p_cmd->form = parse_form( p );
+    if( p_cmd->form == t_tcm_at_set && parse_params( p, 1, & p_cmd->nr_params ) < 0 )
+      return -1;
+    skip_spaces( p );
+    if( p->pos < p->len && s[p->pos] != ';' )
+      return -1;
+    return 0;
+  }
+
+  if( c == 'D' ) {
+    /* dial string extends to the end of the line or up to and including the semicolon of voice calls */
+    ++p->pos;
+    end = p->pos;
+    while( end < p->len && s[end] != ';' )
+      ++end;
+    if( end < p->len )
+      ++end;
+    set_name( p_cmd, "D", 1 );
+    p_cmd->form = t_tcm_at_execute;
+    if( end > p->pos ) {
+      if( add_param( p, t_tcm_at_token, p->pos, end - p->pos ) < 0 )
+        return -1;
+      p_cmd->nr_params = 1;
+    }
+    p->pos = end;
+    return 0;
+  }
+
+  if( c == 'S' && p->pos + 1 < p->len && isdigit( (unsigned char)s[p->pos+1] ) ) {
+    /* s-register, e.g. S0=1 or S0? */
+    ++p->pos;
+    while( p->pos < p->len && isdigit( (unsigned char)s[p->pos] ) )
+      ++p->pos;
+    set_name( p_cmd, s + start, p->pos - start );
+    p_cmd->form = parse_form( p );
+    if( p_cmd->form == t_tcm_at_set ) {
+      skip_spaces( p );
+      if( ! parse_number( p, & end, & value ) || add_param( p, t_tcm_at_number, p->pos, end - p->pos ) < 0 )
+        return -1;
+      p->p_params[p->nr_params-1].number = value;
+      p->pos = end;
+      p_cmd->nr_params = 1;
+    }
+    return 0;
+  }
+
+  if( c == '&' || isalpha( (unsigned char)c ) ) {
+    /* basic command with optional numeric value, e.g. E0, &F or &D2 */
+    p->pos += ( c == '&' ) ? 2 : 1;
+    if( p->pos > p->len || ( c == '&' && ! isalpha( (unsigned char)s[p->pos-1] ) ) )
+      return -1;
+    set_name( p_cmd, s + start, p->pos - start );
+    p_cmd->form = parse_form( p );
+    if( p_cmd->form == t_tcm_at_set )
+      return -1;
+    if( p_cmd->form == t_tcm_at_execute && parse_number( p, & end, & value ) ) {
+      if( add_param( p, t_tcm_at_number, p->pos, end - p->pos ) < 0 )
+        return -1;
+      p->p_params[p->nr_params-1].number = value;
+      p->pos = end;
+      p_cmd->nr_params = 1;
+    }
+    return 0;
+  }
+
+  return -1;
+}
+
+
+static int trim( const char* s, int len, int* p_start )
+{
+  int start = 0;
+
+  while( start < len && ( s[start] == '\r' || s[start] == '\n' || s[start] == ' ' ) )
+    ++start;
+  while( len > start && ( s[len-1] == '\r' || s[len-1] == '\n' || s[len-1] == ' ' || s[len-1] == '\0' ) )
+    --len;
+
+  *p_start = start;
+  return len;
+}
+
+
+int tcm_at_parse_command( const char* s, int len, t_tcm_at_cmd* p_cmds, int max_cmds,
+                          t_tcm_at_param* p_params, int max_params )
+{
+  t_parser p;
+  int n = 0;
+
+  p.s = s;
+  p.len = trim( s, len, & p.pos );
+  p.p_params = p_params;
+  p.nr_params = 0;
+  p.max_params = max_params;
+
+  if( p.len - p.pos < 2 || toupper( (unsigned char)s[p.pos] ) != 'A' || toupper( (unsigned char)s[p.pos+1] ) != 'T' )
+    return -1;
+  p.pos += 2;
+
+  while( 1 ) {
+    skip_spaces( & p );
+    if( p.pos >= p.len )
+      break;
+
+    if( s[p.pos] == ';' ) {
+      ++p.pos;
+      continue;
+    }
+
+    if( n >= max_cmds || parse_one( & p, & p_cmds[n] ) < 0 )
+      return -1;
+    ++n;
+  }
+
+  return n;
+}
+
+
+int tcm_at_parse_result( const char* s, int len, t_tcm_at_cmd* p_result,
+                         t_tcm_at_param* p_params, int max_params )
+{
+  const char* colon;
+  t_parser p;
+
+  p.s = s;
+  p.len = trim( s, len, & p.pos );
+  p.p_params = p_params;
+  p.nr_params = 0;
+  p.max_params = max_params;
+
+  p_result->form = t_tcm_at_result;
+  p_result->first_param = 0;
+  p_result->nr_params = 0;
+  p_result->extended = 0;
+
+  colon = memchr( s + p.pos, ':', p.len - p.pos );
+  if( p.pos < p.len && strchr( extended_prefixes, s[p.pos] ) && colon ) {
+    set_name( p_result, s + p.pos, colon - ( s + p.pos ) );
+    p_result->extended = 1;
+    p.pos = colon - s + 1;
+    skip_spaces( & p );
+    if( p.pos < p.len && parse_params( & p, 0, & p_result->nr_params ) < 0 )
+      return -1;
+    if( p.pos < p.len )
+      return -1;
+  } else {
+    set_name( p_result, s + p.pos, p.len - p.pos );
+  }
+
+  return 0;
+}
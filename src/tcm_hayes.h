@@ -0,0 +1,133 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_HAYES_H
+#define TCM_HAYES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_hayes.h
+    \brief tokenizer for Hayes AT command lines and result lines
+
+    A command line such as AT+CREG=2;+CGREG?;E0S0=1 is split in one pass into
+    its basic and extended commands. Command names are converted to upper
+    case, e.g. "+CREG", "E", "&F", "S0" or "D". Parameters are given as
+    offsets into the parsed line, hence no memory is allocated.
+
+    Result lines such as +CREG: 0,1 are split into their prefix "+CREG" and
+    parameters, other result lines like OK are returned as name only.
+
+    Each command and result carries the identifier of its name in the
+    vocabulary of tcm_at_vocabulary.h which allows to dispatch on integers.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_AT_MAX_NAME            32                   /*!< maximum length of command name */
+#define TCM_AT_MAX_COMMANDS        16                   /*!< maximum number of commands per line */
+#define TCM_AT_MAX_PARAMS          64                   /*!< maximum number of parameters per line */
+
+
+/*! form of command */
+typedef enum {
+  t_tcm_at_execute,                                     /*!< e.g. ATD123, AT+CGMI, ATE0 */
+  t_tcm_at_set,                                         /*!< e.g. AT+CREG=2, ATS0=1 */
+  t_tcm_at_query,                                       /*!< e.g. AT+CREG?, ATS0? */
+  t_tcm_at_test,                                        /*!< e.g. AT+CREG=? */
+  t_tcm_at_result                                       /*!< result line */
+} t_tcm_at_form;
+
+
+/*! type of parameter */
+typedef enum {
+  t_tcm_at_empty,                                       /*!< omitted parameter */
+  t_tcm_at_number,                                      /*!< decimal number */
+  t_tcm_at_string,                                      /*!< quoted string, offsets exclude the quotes */
+  t_tcm_at_token                                        /*!< unquoted text, e.g. dial string including ; of voice calls */
+} t_tcm_at_param_type;
+
+
+/*! parameter */
+typedef struct s_tcm_at_param {
+  t_tcm_at_param_type           type;                   /*!< type of parameter */
+  int                           start;                  /*!< offset in line */
+  int                           len;                    /*!< length in line */
+  long                          number;                 /*!< value of number */
+} t_tcm_at_param;
+
+
+/*! command or result */
+typedef struct s_tcm_at_cmd {
+  char                          name[TCM_AT_MAX_NAME];  /*!< upper case command name or result prefix */
+  int                           id;                     /*!< identifier in tcm_at_vocabulary, 0 for unknown names */
+  int                           extended;               /*!< 1 for extended commands and prefixed results */
+  t_tcm_at_form                 form;                   /*!< form of command */
+  int                           first_param;            /*!< index of first parameter */
+  int                           nr_params;              /*!< number of parameters */
+} t_tcm_at_cmd;
+
+
+/*!
+ * split command line into commands
+ *
+ * \param s command line, must start with AT, trailing line terminators are ignored
+ * \param len length of command line
+ * \param p_cmds array for commands
+ * \param max_cmds size of command array
+ * \param p_params array for parameters of all commands
+ * \param max_params size of parameter array
+ * \return number of commands or -1 in case of syntax error or exceeded limits
+ */
+int tcm_at_parse_command( const char* s, int len, t_tcm_at_cmd* p_cmds, int max_cmds,
+                          t_tcm_at_param* p_params, int max_params );
+
+
+/*!
+ * split result line into prefix and parameters
+ *
+ * \param s result line, surrounding line terminators are ignored
+ * \param len length of result line
+ * \param p_result pointer to result
+ * \param p_params array for parameters
+ * \param max_params size of parameter array
+ * \return 0 in case of success or -1 in case of syntax error or exceeded limits
+ */
+int tcm_at_parse_result( const char* s, int len, t_tcm_at_cmd* p_result,
+                         t_tcm_at_param* p_params, int max_params );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_HAYES_H */
@@ -0,0 +1,676 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <olcutils/alloc.h>
+#include <tcm_image.h>
+#include <tcm_scheme_api.h>
+#include <tcm_log.h>
+#include <tcm_boot.h>
+#include <revision.h>
+#include <common.h>
+
+
+#define IMAGE_BYTE_ORDER           0x01020304           /* detects images of other architectures */
+
+/* value type tags */
+enum {
+  img_nil, img_false, img_true, img_integer, img_real, img_char, img_string, img_symbol, img_list, img_vector
+};
+
+/*! image file header */
+typedef struct {
+  char                          magic[8];               /*!< TCM_IMAGE_MAGIC */
+  uint32_t                      format;                 /*!< TCM_IMAGE_FORMAT */
+  uint32_t                      byte_order;             /*!< IMAGE_BYTE_ORDER in native representation */
+  uint32_t                      word_size;              /*!< sizeof( long ) */
+  uint32_t                      nr_sources;             /*!< number of source descriptors */
+  uint32_t                      nr_forms;               /*!< number of top-level forms */
+  uint32_t                      data_len;               /*!< size of form data in bytes */
+  char                          revision[64];           /*!< daemon revision */
+} t_image_header;
+
+/*! source file descriptor */
+typedef struct {
+  char                          path[TCM_MAX_PATH];     /*!< file name */
+  int64_t                       mtime;                  /*!< modification time in seconds */
+  int64_t                       mtime_nsec;             /*!< nanoseconds part of modification time */
+  int64_t                       size;                   /*!< file size in bytes */
+  int32_t                       level;                  /*!< 0 for top-level files, otherwise load nesting level */
+} t_image_source;
+
+/*! source files the interpreter has been initialized from */
+static char loaded_sources[TCM_IMAGE_MAX_SOURCES][TCM_MAX_PATH];
+static int nr_loaded_sources;
+
+/*! recording state */
+typedef struct {
+  char*                         p_buf;                  /*!< form data */
+  uint32_t                      len;                    /*!< number of bytes in p_buf */
+  uint32_t                      size;                   /*!< allocated size of p_buf */
+  uint32_t                      nr_forms;               /*!< number of recorded forms */
+  int                           nr_sources;             /*!< number of source files */
+  t_image_source                sources[TCM_IMAGE_MAX_SOURCES]; /*!< source files */
+  int                           errors;                 /*!< image is not written when set */
+} t_image_writer;
+
+/*! replay state */
+typedef struct {
+  const char*                   p;                      /*!< form data */
+  uint32_t                      len;                    /*!< size of form data */
+  uint32_t                      pos;                    /*!< read position */
+} t_image_reader;
+
+
+static void add_loaded_source( const char* path )
+{
+  if( nr_loaded_sources < TCM_IMAGE_MAX_SOURCES ) {
+    /* paths read from images need not be terminated */
+    snprintf( loaded_sources[nr_loaded_sources], TCM_MAX_PATH, "%.*s", TCM_MAX_PATH - 1, path );
+    ++nr_loaded_sources;
+  }
+}
+
+
+static int stat_source( const char* path, int level, t_image_source* p_src )
+{
+  struct stat st;
+
+  if( stat( path, & st ) )
+    return -1;
+
+  memset( p_src, 0, sizeof( t_image_source ) );
+  strncpy( p_src->path, path, sizeof( p_src->path ) - 1 );
+  p_src->mtime = st.st_mtim.tv_sec;
+  p_src->mtime_nsec = st.st_mtim.tv_nsec;
+  p_src->size = st.st_size;
+  p_src->level = level;
+
+  return 0;
+}
+
+
+/*
+ * recording
+ */
+
+static void put_data( t_image_writer* w, const void* p_data, uint32_t n )
+{
+  char* p_buf;
+  uint32_t size;
+
+  if( w->errors )
+    return;
+
+  if( w->len + n > w->size ) {
+    size = w->size ? 2 * w->size : 65536;
+    while( size < w->len + n )
+      size *= 2;
+    p_buf = cul_malloc( size );
+    if( p_buf == NULL ) {
+      tcm_error( "%s: out of memory error!\n", __func__ );
+      w->errors = -1;
+      return;
+    }
+    if( w->p_buf ) {
+      memcpy( p_buf, w->p_buf, w->len );
+      cul_free( w->p_buf );
+    }
+    w->p_buf = p_buf;
+    w->size = size;
+  }
+
+  memcpy( w->p_buf + w->len, p_data, n );
+  w->len += n;
+}
+
+static void put_tag( t_image_writer* w, uint8_t tag )
+{
+  put_data( w, & tag, 1 );
+}
+
+static void put_u32( t_image_writer* w, uint32_t val )
+{
+  put_data( w, & val, sizeof( val ) );
+}
+
+static void put_string( t_image_writer* w, uint8_t tag, const char* str )
+{
+  uint32_t n = strlen( str );
+
+  put_tag( w, tag );
+  put_u32( w, n );
+  put_data( w, str, n );
+}
+
+/* forms are data returned by the reader, anything else can't be recorded */
+static void encode_form( scheme* sc, t_image_writer* w, pointer x )
+{
+  int64_t ival;
+  double rval;
+  uint32_t i, n;
+  pointer l;
+
+  if( x == sc->NIL ) {
+    put_tag( w, img_nil );
+  }
+  else if( x == sc->F ) {
+    put_tag( w, img_false );
+  }
+  else if( x == sc->T ) {
+    put_tag( w, img_true );
+  }
+  else if( is_real( x ) ) {
+    rval = rvalue( x );
+    put_tag( w, img_real );
+    put_data( w, & rval, sizeof( rval ) );
+  }
+  else if( is_number( x ) ) {
+    ival = ivalue( x );
+    put_tag( w, img_integer );
+    put_data( w, & ival, sizeof( ival ) );
+  }
+  else if( is_character( x ) ) {
+    put_tag( w, img_char );
+    put_u32( w, charvalue( x ) );
+  }
+  else if( is_string( x ) ) {
+    put_string( w, img_string, string_value( x ) );
+  }
+  else if( is_symbol( x ) ) {
+    put_string( w, img_symbol, symname( x ) );
+  }
+  else if( is_vector( x ) ) {
+    n = vector_length( x );
+    put_tag( w, img_vector );
+    put_u32( w, n );
+    for( i = 0; i < n; ++i )
+      encode_form( sc, w, vector_elem( x, i ) );
+  }
+  else if( is_pair( x ) ) {
+    /* list elements followed by the tail which is () for proper lists */
+    for( n = 0, l = x; is_pair( l ); l = pair_cdr( l ) )
+      ++n;
+    put_tag( w, img_list );
+    put_u32( w, n );
+    for( l = x; is_pair( l ); l = pair_cdr( l ) )
+      encode_form( sc, w, pair_car( l ) );
+    encode_form( sc, w, l );
+  }
+  else {
+    tcm_error( "%s: form can't be recorded error!\n", __func__ );
+    w->errors = -1;
+  }
+}
+
+
+/*
+ * read and evaluate scheme file form by form, recording each form
+ */
+static int record_file( t_tcm_scheme* p, t_image_writer* w, const char* path, int level )
+{
+  scheme* sc = & p->sc;
+  pointer saved_inport = sc->inport;
+  pointer frame, form, arg;
+  FILE* fp;
+  int errors = 0;
+
+  fp = fopen( path, "r" );
+  if( fp == NULL ) {
+    tcm_error( "%s: could not open %s error!\n", __func__, path );
+    return -1;
+  }
+
+  tcm_message( "initialized scheme with init file %s\n", path );
+  add_loaded_source( path );
+
+  if( w->nr_sources < TCM_IMAGE_MAX_SOURCES ) {
+    stat_source( path, level, & w->sources[w->nr_sources++] );
+  } else {
+    tcm_error( "%s: too many source files for image\n", __func__ );
+    w->errors = -1;
+  }
+
+  /* previous input port and current form are protected from gc */
+  tcm_scheme_protect( p, saved_inport );
+  frame = tcm_scheme_protect( p, sc->NIL );
+  scheme_set_input_port_file( sc, fp );
+
+  while( 1 )
+  {
+    sc->retcode = 0;
+    form = scheme_apply0( sc, "read" );
+    if( sc->retcode ) {
+      tcm_error( "%s: read error in %s\n", __func__, path );
+      errors = -1;
+      break;
+    }
+    if( form == sc->EOF_OBJ )
+      break;
+
+    set_car( frame, form );
+
+    /* files loaded at top-level are inlined */
+    if( is_pair( form ) && is_symbol( pair_car( form ) ) && ! strcmp( symname( pair_car( form ) ), "load" ) &&
+        is_pair( pair_cdr( form ) ) && pair_cdr( pair_cdr( form ) ) == sc->NIL )
+    {
+      arg = scheme_eval( sc, pair_car( pair_cdr( form ) ) );
+      if( ! sc->retcode && is_string( arg ) ) {
+        if( record_file( p, w, string_value( arg ), level + 1 ) )
+          errors = -1;
+        continue;
+      }
+    }
+
+    encode_form( sc, w, form );
+    ++w->nr_forms;
+
+    scheme_eval( sc, form );
+    if( sc->retcode ) {
+      tcm_message( "Errors encountered reading %s\n", path );
+      errors = -1;
+    }
+  }
+
+  sc->inport = saved_inport;
+  tcm_scheme_unprotect( p );
+  tcm_scheme_unprotect( p );
+  fclose( fp );
+
+  return errors;
+}
+
+static int write_image( t_image_writer* w, const char* image_file )
+{
+  t_image_header hdr;
+  char tmp_file[TCM_MAX_PATH + 8];
+  FILE* fp;
+  int errors = 0;
+
+  memset( & hdr, 0, sizeof( hdr ) );
+  strncpy( hdr.magic, TCM_IMAGE_MAGIC, sizeof( hdr.magic ) );
+  hdr.format = TCM_IMAGE_FORMAT;
+  hdr.byte_order = IMAGE_BYTE_ORDER;
+  hdr.word_size = sizeof( long );
+  hdr.nr_sources = w->nr_sources;
+  hdr.nr_forms = w->nr_forms;
+  hdr.data_len = w->len;
+  strncpy( hdr.revision, g_tcm_revision, sizeof( hdr.revision ) - 1 );
+
+  /* written to temporary file first to never leave a partial image behind */
+  snprintf( tmp_file, sizeof( tmp_file ), "%s.tmp", image_file );
+  fp = fopen( tmp_file, "w" );
+  if( fp == NULL ) {
+    tcm_error( "%s: could not create %s error!\n", __func__, tmp_file );
+    return -1;
+  }
+
+  if( fwrite( & hdr, sizeof( hdr ), 1, fp ) != 1 ||
+      fwrite( w->sources, sizeof( t_image_source ), w->nr_sources, fp ) != w->nr_sources ||
+      ( w->len && fwrite( w->p_buf, w->len, 1, fp ) != 1 ) )
+    errors = -1;
+
+  if( fclose( fp ) )
+    errors = -1;
+
+  if( ! errors && rename( tmp_file, image_file ) )
+    errors = -1;
+
+  if( errors ) {
+    tcm_error( "%s: could not write %s error!\n", __func__, image_file );
+    unlink( tmp_file );
+  }
+
+  return errors;
+}
+
+
+/*
+ * replay
+ */
+
+static int get_data( t_image_reader* r, void* p_data, uint32_t n )
+{
+  if( n > r->len - r->pos )
+    return -1;
+
+  memcpy( p_data, r->p + r->pos, n );
+  r->pos += n;
+  return 0;
+}
+
+/* bounds check of one value in advance of decoding */
+static int validate_form( t_image_reader* r, int depth )
+{
+  uint8_t tag;
+  uint32_t i, n;
+
+  if( depth > 10000 || get_data( r, & tag, 1 ) )
+    return -1;
+
+  switch( tag )
+  {
+  case img_nil:
+  case img_false:
+  case img_true:
+    return 0;
+  case img_integer:
+  case img_real:
+    return( 8 > r->len - r->pos ? -1 : ( r->pos += 8, 0 ) );
+  case img_char:
+    return( 4 > r->len - r->pos ? -1 : ( r->pos += 4, 0 ) );
+  case img_string:
+  case img_symbol:
+    if( get_data( r, & n, sizeof( n ) ) || n > r->len - r->pos )
+      return -1;
+    r->pos += n;
+    return 0;
+  case img_vector:
+  case img_list:
+    if( get_data( r, & n, sizeof( n ) ) )
+      return -1;
+    for( i = 0; i < n; ++i ) {
+      if( validate_form( r, depth + 1 ) )
+        return -1;
+    }
+    return( tag == img_list ? validate_form( r, depth + 1 ) : 0 );
+  default:
+    return -1;
+  }
+}
+
+static pointer decode_form( t_tcm_scheme* p, t_image_reader* r )
+{
+  scheme* sc = & p->sc;
+  uint8_t tag;
+  uint32_t i, n, cval;
+  int64_t ival;
+  double rval;
+  char symbuf[256];
+  pointer x, frame, tail = NULL, cell;
+
+  /* the image has been validated before, short reads just must not go astray */
+  if( get_data( r, & tag, 1 ) )
+    return sc->F;
+
+  switch( tag )
+  {
+  case img_false:
+    return sc->F;
+  case img_true:
+    return sc->T;
+  case img_integer:
+    if( get_data( r, & ival, sizeof( ival ) ) )
+      return sc->F;
+    return mk_integer( sc, (long) ival );
+  case img_real:
+    if( get_data( r, & rval, sizeof( rval ) ) )
+      return sc->F;
+    return mk_real( sc, rval );
+  case img_char:
+    if( get_data( r, & cval, sizeof( cval ) ) )
+      return sc->F;
+    return mk_character( sc, (int) cval );
+  case img_string:
+    if( get_data( r, & n, sizeof( n ) ) || n > r->len - r->pos )
+      return sc->F;
+    x = mk_counted_string( sc, r->p + r->pos, n );
+    r->pos += n;
+    return x;
+  case img_symbol:
+    if( get_data( r, & n, sizeof( n ) ) || n > r->len - r->pos )
+      return sc->F;
+    i = ( n < sizeof( symbuf ) ) ? n : sizeof( symbuf ) - 1;
+    memcpy( symbuf, r->p + r->pos, i );
+    symbuf[i] = '\0';
+    r->pos += n;
+    return mk_symbol( sc, symbuf );
+  case img_vector:
+    if( get_data( r, & n, sizeof( n ) ) )
+      return sc->F;
+    frame = tcm_scheme_protect( p, mk_vector( sc, n ) );
+    for( i = 0; i < n; ++i )
+      set_vector_elem( pair_car( frame ), i, decode_form( p, r ) );
+    x = pair_car( frame );
+    tcm_scheme_unprotect( p );
+    return x;
+  case img_list:
+    /* elements are appended to the protected head of the list */
+    if( get_data( r, & n, sizeof( n ) ) )
+      return sc->F;
+    frame = tcm_scheme_protect( p, sc->NIL );
+    for( i = 0; i < n; ++i ) {
+      cell = cons( sc, decode_form( p, r ), sc->NIL );
+      if( tail )
+        set_cdr( tail, cell );
+      else
+        set_car( frame, cell );
+      tail = cell;
+    }
+    x = decode_form( p, r );
+    if( tail )
+      set_cdr( tail, x );
+    x = pair_car( frame );
+    tcm_scheme_unprotect( p );
+    return x;
+  default:
+    return sc->NIL;
+  }
+}
+
+
+/*
+ * check whether image matches daemon revision and sources
+ * returns pointer to form data or NULL when image is stale
+ */
+static const char* check_image( const char* p_img, size_t img_len, const char** files, int nr_files )
+{
+  const t_image_header* p_hdr = (const t_image_header *) p_img;
+  const t_image_source* p_sources;
+  t_image_source src;
+  int i, top = 0;
+
+  if( img_len < sizeof( t_image_header ) ||
+      strncmp( p_hdr->magic, TCM_IMAGE_MAGIC, sizeof( p_hdr->magic ) ) ||
+      p_hdr->format != TCM_IMAGE_FORMAT || p_hdr->byte_order != IMAGE_BYTE_ORDER ||
+      p_hdr->word_size != sizeof( long ) || p_hdr->nr_sources > TCM_IMAGE_MAX_SOURCES ||
+      img_len != sizeof( t_image_header ) + p_hdr->nr_sources * sizeof( t_image_source ) + p_hdr->data_len )
+  {
+    tcm_message( "%s: image format does not match\n", __func__ );
+    return NULL;
+  }
+
+  if( strncmp( p_hdr->revision, g_tcm_revision, sizeof( p_hdr->revision ) ) ) {
+    tcm_message( "%s: image has been created by revision %.64s\n", __func__, p_hdr->revision );
+    return NULL;
+  }
+
+  p_sources = (const t_image_source *)( p_img + sizeof( t_image_header ) );
+  for( i = 0; i < p_hdr->nr_sources; ++i ) {
+    if( p_sources[i].level == 0 ) {
+      if( top >= nr_files || strncmp( p_sources[i].path, files[top], sizeof( p_sources[i].path ) ) ) {
+        tcm_message( "%s: image has been created from other files\n", __func__ );
+        return NULL;
+      }
+      ++top;
+    }
+
+    if( stat_source( p_sources[i].path, p_sources[i].level, & src ) ||
+        src.mtime != p_sources[i].mtime || src.mtime_nsec != p_sources[i].mtime_nsec ||
+        src.size != p_sources[i].size )
+    {
+      tcm_message( "%s: source %.256s has changed\n", __func__, p_sources[i].path );
+      return NULL;
+    }
+  }
+
+  if( top != nr_files ) {
+    tcm_message( "%s: image has been created from other files\n", __func__ );
+    return NULL;
+  }
+
+  return( (const char *)( p_sources + p_hdr->nr_sources ) );
+}
+
+
+/*
+ * evaluate forms of up to date image
+ * returns 0 in case of success, 1 when image is stale or invalid
+ * and -1 when evaluation errors occurred
+ */
+static int replay_image( t_tcm_scheme* p, const char* image_file, const char** files, int nr_files )
+{
+  scheme* sc = & p->sc;
+  const t_image_header* p_hdr;
+  const t_image_source* p_sources;
+  t_image_reader r;
+  struct stat st;
+  char* p_img;
+  pointer frame;
+  uint32_t i;
+  int fd, errors = 0;
+
+  fd = open( image_file, O_RDONLY );
+  if( fd < 0 )
+    return 1;
+
+  if( fstat( fd, & st ) || st.st_size < sizeof( t_image_header ) ) {
+    close( fd );
+    return 1;
+  }
+
+  p_img = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if( p_img == MAP_FAILED ) {
+    tcm_error( "%s: could not map %s error!\n", __func__, image_file );
+    return 1;
+  }
+
+  p_hdr = (const t_image_header *) p_img;
+  r.p = check_image( p_img, st.st_size, files, nr_files );
+  if( r.p == NULL ) {
+    munmap( p_img, st.st_size );
+    return 1;
+  }
+  r.len = p_hdr->data_len;
+
+  /* nothing is evaluated unless the whole image is intact */
+  for( r.pos = 0, i = 0; i < p_hdr->nr_forms; ++i ) {
+    if( validate_form( & r, 0 ) ) {
+      tcm_error( "%s: image %s is corrupted\n", __func__, image_file );
+      munmap( p_img, st.st_size );
+      return 1;
+    }
+  }
+
+  p_sources = (const t_image_source *)( p_img + sizeof( t_image_header ) );
+  for( i = 0; i < p_hdr->nr_sources; ++i )
+    add_loaded_source( p_sources[i].path );
+
+  for( r.pos = 0, i = 0; i < p_hdr->nr_forms; ++i ) {
+    frame = tcm_scheme_protect( p, decode_form( p, & r ) );
+    scheme_eval( sc, pair_car( frame ) );
+    tcm_scheme_unprotect( p );
+    if( sc->retcode ) {
+      tcm_message( "%s: errors encountered evaluating form %d of image %s\n", __func__, i, image_file );
+      errors = -1;
+    }
+  }
+
+  tcm_message( "initialized scheme with image %s (%d forms)\n", image_file, p_hdr->nr_forms );
+  munmap( p_img, st.st_size );
+
+  return errors;
+}
+
+
+static const char* basename_of( const char* filename )
+{
+  const char* p = strrchr( filename, '/' );
+
+  return p ? p + 1 : filename;
+}
+
+
+int tcm_image_load_files( t_tcm_scheme* p, const char* image_file, const char** files, int nr_files )
+{
+  t_image_writer* w;
+  int i, retcode, errors = 0;
+
+  nr_loaded_sources = 0;
+
+  if( image_file[0] ) {
+    retcode = replay_image( p, image_file, files, nr_files );
+    if( retcode <= 0 ) {
+      tcm_boot_mark( "image" );
+      return retcode;
+    }
+  }
+
+  w = cul_malloc( sizeof( t_image_writer ) );
+  if( w == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return -1;
+  }
+  memset( w, 0, sizeof( t_image_writer ) );
+
+  for( i = 0; i < nr_files; ++i ) {
+    if( record_file( p, w, files[i], 0 ) )
+      errors = -1;
+    tcm_boot_mark( "source:%s", basename_of( files[i] ) );
+  }
+
+  /* images are created only from sources without errors */
+  if( image_file[0] && ! errors && ! w->errors ) {
+    if( ! write_image( w, image_file ) )
+      tcm_message( "%s: image %s with %d forms written\n", __func__, image_file, w->nr_forms );
+  }
+
+  if( w->p_buf )
+    cul_free( w->p_buf );
+  cul_free( w );
+
+  return errors;
+}
+
+
+int tcm_image_sources( const char** p_paths, int max )
+{
+  int i;
+
+  for( i = 0; i < nr_loaded_sources && i < max; ++i )
+    p_paths[i] = loaded_sources[i];
+
+  return i;
+}
@@ -0,0 +1,94 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_IMAGE_H
+#define TCM_IMAGE_H
+
+#include <tcm_scheme.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_image.h
+    \brief image of the scheme initialization files for fast startup
+
+    Reading the scheme library  from source is dominated by  the text reader of
+    the interpreter. When the sources are read, each top-level form is recorded
+    in binary representation in addition to being evaluated. The forms are
+    written to an image file together with the daemon revision and the path,
+    modification time and size of each source file.
+
+    On next startup the  image is mapped into memory,  the forms are converted
+    directly into  interpreter objects and evaluated in  the same order. Files
+    loaded by top-level (load ...) forms are inlined into the image. Channels
+    are not part of the image, they are created by evaluating the recorded
+    forms as before. When any  source file has been changed,  replaced or is
+    missing, the image is considered stale and the sources are read again.
+
+    \addtogroup scheme
+    @{
+ */
+
+#define TCM_IMAGE_MAGIC            "TCMIMG"             /*!< file identifier */
+#define TCM_IMAGE_FORMAT           1                    /*!< format version, increment on any change */
+#define TCM_IMAGE_MAX_SOURCES      32                   /*!< maximum number of source files per image */
+
+
+/*!
+ * evaluate scheme initialization files, use image if up to date
+ *
+ * \param p pointer to the scheme object
+ * \param image_file file name of the image, empty string to disable image
+ * \param files array of source file names in order of evaluation
+ * \param nr_files number of source files
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_image_load_files( t_tcm_scheme* p, const char* image_file, const char** files, int nr_files );
+
+
+/*!
+ * source files the interpreter has been initialized from
+ *
+ * Files loaded by top-level (load ...) forms are included, independent of
+ * whether the image or the sources have been evaluated.
+ *
+ * \param p_paths array the file names are written to
+ * \param max maximum number of file names to write
+ * \return number of file names
+ */
+int tcm_image_sources( const char** p_paths, int max );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_IMAGE_H */
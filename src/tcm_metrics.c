@@ -0,0 +1,526 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <olcutils/alloc.h>
+#include <tcm_metrics.h>
+#include <tcm_scheme.h>
+#include <tcm_watchdog.h>
+#include <tcm_trace.h>
+#include <tcm_boot.h>
+#include <tcm_atcache.h>
+#include <tcm_log.h>
+#include <base_channel.h>
+
+
+/*! label values of channel types, indexed by t_channel_type */
+static const char* channel_type_names[] = { "dev", "client_sock", "server_sock", "cmux", "shm", "local" };
+
+
+static void out( t_tcm_metrics* p, const char* fmt, ... )
+{
+  va_list args;
+  int n, left = TCM_METRICS_MAX_RESPONSE - p->len;
+
+  if( left <= 1 )
+    return;
+
+  va_start( args, fmt );
+  n = vsnprintf( p->p_buf + p->len, left, fmt, args );
+  va_end( args );
+
+  /* truncated output is cut back to the last complete line */
+  if( n < 0 || n >= left ) {
+    while( p->len > 0 && p->p_buf[p->len - 1] != '\n' )
+      --p->len;
+    p->p_buf[p->len] = '\0';
+    return;
+  }
+
+  p->len += n;
+}
+
+
+static const char* escape_label( const char* s, char* buf, int size )
+{
+  int i = 0;
+
+  for( ; *s && i < size - 2; ++s ) {
+    if( *s == '\\' || *s == '"' ) {
+      buf[i++] = '\\';
+      buf[i++] = *s;
+    }
+    else if( *s == '\n' ) {
+      buf[i++] = '\\';
+      buf[i++] = 'n';
+    }
+    else {
+      buf[i++] = *s;
+    }
+  }
+  buf[i] = '\0';
+
+  return buf;
+}
+
+
+static void header( t_tcm_metrics* p, const char* name, const char* type, const char* help )
+{
+  out( p, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type );
+}
+
+
+static void channel_metrics( t_tcm_metrics* p, t_base_channel_stats* s, int n )
+{
+  char name[2 * sizeof(s->name)];
+  int i, j;
+
+  static const struct {
+    const char* name;
+    const char* type;
+    const char* help;
+  } families[] = {
+    { "tcm_channel_rx_messages_total", "counter", "Messages received by channel." },
+    { "tcm_channel_rx_bytes_total", "counter", "Bytes received by channel." },
+    { "tcm_channel_tx_messages_total", "counter", "Writes issued to channel." },
+    { "tcm_channel_tx_bytes_total", "counter", "Bytes written to channel." },
+    { "tcm_channel_queue_depth", "gauge", "Events waiting for their callback." },
+    { "tcm_channel_overflows_total", "counter", "Events dropped on queue overflow." },
+    { "tcm_channel_opens_total", "counter", "Successful (re)opens of device channels." },
+    { "tcm_channel_connections", "gauge", "Open connections of server socket channels." },
+    { "tcm_channel_evictions_total", "counter", "Connections closed for being too slow." },
+    { "tcm_channel_suppressed_total", "counter", "Lines suppressed by URC coalescing of device channels." }
+  };
+
+  for( j = 0; j < sizeof( families ) / sizeof( families[0] ); ++j ) {
+    header( p, families[j].name, families[j].type, families[j].help );
+
+    for( i = 0; i < n; ++i ) {
+      long val;
+
+      switch( j ) {
+      case 0: val = s[i].nr_rx; break;
+      case 1: val = s[i].rx_bytes; break;
+      case 2: val = s[i].nr_tx; break;
+      case 3: val = s[i].tx_bytes; break;
+      case 4: val = s[i].depth; break;
+      case 5: val = s[i].nr_overflows; break;
+      case 6: val = s[i].nr_opens; break;
+      case 7: val = s[i].nr_connections; break;
+      case 8: val = s[i].nr_evictions; break;
+      default: val = s[i].nr_suppressed; break;
+      }
+
+      /* connection related families exist for server sockets only */
+      if( ( j == 7 || j == 8 ) && s[i].type != t_channel_server_sock_type )
+        continue;
+
+      /* coalescing is done by device channels only */
+      if( j == 9 && s[i].type != t_channel_dev_type )
+        continue;
+
+      out( p, "%s{channel=\"%s\",type=\"%s\"} %ld\n", families[j].name,
+           escape_label( s[i].name, name, sizeof( name ) ),
+           channel_type_names[ s[i].type ], val );
+    }
+  }
+}
+
+
+static void latency_metrics( t_tcm_metrics* p )
+{
+  t_tcm_trace_hist hists[t_tcm_trace_nr_stages];
+  const char* name = "tcm_message_latency_seconds";
+  uint64_t cumulative;
+  int i, j;
+
+  tcm_trace_histograms( hists, 0 );
+
+  header( p, name, "histogram", "Latency of received messages per pipeline stage." );
+  for( i = 0; i < t_tcm_trace_nr_stages; ++i ) {
+    const char* stage = g_tcm_trace_stage_names[i];
+
+    /* the last bucket collects everything beyond and is reported as +Inf */
+    cumulative = 0;
+    for( j = 0; j < TCM_TRACE_NR_BUCKETS - 1; ++j ) {
+      cumulative += hists[i].buckets[j];
+      out( p, "%s_bucket{stage=\"%s\",le=\"%g\"} %llu\n", name, stage,
+           (double)( 1ULL << j ) / 1e6, (unsigned long long)cumulative );
+    }
+    cumulative += hists[i].buckets[j];
+
+    /* count is derived from the buckets to keep them consistent */
+    out( p, "%s_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n", name, stage, (unsigned long long)cumulative );
+    out( p, "%s_sum{stage=\"%s\"} %.6f\n", name, stage, (double)hists[i].sum_us / 1e6 );
+    out( p, "%s_count{stage=\"%s\"} %llu\n", name, stage, (unsigned long long)cumulative );
+  }
+}
+
+
+static void interpreter_metrics( t_tcm_metrics* p )
+{
+  t_tcm_scheme* p_scheme = p->p_tcm_server_ctx->p_scheme;
+  t_tcm_watchdog_stats stats[TCM_WATCHDOG_MAX_HOLDERS];
+  char owner[2 * TCM_WATCHDOG_MAX_NAME_LEN], handler[2 * TCM_WATCHDOG_MAX_NAME_LEN];
+  int i, n;
+
+  if( p_scheme == NULL )
+    return;
+
+  n = tcm_watchdog_stats( p_scheme->p_watchdog, stats, TCM_WATCHDOG_MAX_HOLDERS, 0 );
+
+  header( p, "tcm_interpreter_hold_seconds_max", "gauge", "Longest interpreter hold time per handler." );
+  for( i = 0; i < n; ++i )
+    out( p, "tcm_interpreter_hold_seconds_max{channel=\"%s\",handler=\"%s\"} %.6f\n",
+         escape_label( stats[i].owner, owner, sizeof( owner ) ),
+         escape_label( stats[i].handler, handler, sizeof( handler ) ),
+         stats[i].max_ms / 1e3 );
+
+  header( p, "tcm_interpreter_hold_seconds_total", "counter", "Accumulated interpreter hold time per handler." );
+  for( i = 0; i < n; ++i )
+    out( p, "tcm_interpreter_hold_seconds_total{channel=\"%s\",handler=\"%s\"} %.6f\n",
+         escape_label( stats[i].owner, owner, sizeof( owner ) ),
+         escape_label( stats[i].handler, handler, sizeof( handler ) ),
+         stats[i].total_ms / 1e3 );
+
+  header( p, "tcm_interpreter_evaluations_total", "counter", "Evaluations per handler." );
+  for( i = 0; i < n; ++i )
+    out( p, "tcm_interpreter_evaluations_total{channel=\"%s\",handler=\"%s\"} %ld\n",
+         escape_label( stats[i].owner, owner, sizeof( owner ) ),
+         escape_label( stats[i].handler, handler, sizeof( handler ) ),
+         stats[i].count );
+
+  header( p, "tcm_interpreter_budget_overruns_total", "counter", "Evaluations exceeding the callback budget per handler." );
+  for( i = 0; i < n; ++i )
+    out( p, "tcm_interpreter_budget_overruns_total{channel=\"%s\",handler=\"%s\"} %ld\n",
+         escape_label( stats[i].owner, owner, sizeof( owner ) ),
+         escape_label( stats[i].handler, handler, sizeof( handler ) ),
+         stats[i].nr_overruns );
+
+  /* heap figures are published by tcm_scheme_unlock() after each evaluation */
+  header( p, "tcm_scheme_evaluations_total", "counter", "Evaluations of the scheme interpreter." );
+  out( p, "tcm_scheme_evaluations_total %ld\n", __atomic_load_n( & p_scheme->nr_evaluations, __ATOMIC_RELAXED ) );
+  header( p, "tcm_scheme_free_cells", "gauge", "Free cells of the scheme heap after the last evaluation." );
+  out( p, "tcm_scheme_free_cells %ld\n", __atomic_load_n( & p_scheme->free_cells, __ATOMIC_RELAXED ) );
+  header( p, "tcm_scheme_cell_segments", "gauge", "Allocated cell segments of the scheme heap." );
+  out( p, "tcm_scheme_cell_segments %ld\n", __atomic_load_n( & p_scheme->nr_cell_segments, __ATOMIC_RELAXED ) );
+#ifdef CELL_SEGSIZE
+  header( p, "tcm_scheme_cells", "gauge", "Total cells of the scheme heap." );
+  out( p, "tcm_scheme_cells %ld\n", __atomic_load_n( & p_scheme->nr_cell_segments, __ATOMIC_RELAXED ) * (long)CELL_SEGSIZE );
+#endif
+}
+
+
+static void atcache_metrics( t_tcm_metrics* p )
+{
+  t_tcm_atcache_stats stats[TCM_ATCACHE_MAX_RULES];
+  char command[2 * TCM_ATCACHE_MAX_COMMAND_LEN];
+  int i, j, n;
+
+  static const struct {
+    const char* name;
+    const char* help;
+  } families[] = {
+    { "tcm_atcache_hits_total", "AT requests answered from the response cache." },
+    { "tcm_atcache_misses_total", "Cacheable AT requests forwarded to the modem." },
+    { "tcm_atcache_stores_total", "AT responses stored in the response cache." },
+    { "tcm_atcache_invalidations_total", "Cached AT responses flushed by invalidation rules." }
+  };
+
+  n = tcm_atcache_stats( stats, TCM_ATCACHE_MAX_RULES );
+  if( n == 0 )
+    return;
+
+  for( j = 0; j < sizeof( families ) / sizeof( families[0] ); ++j ) {
+    header( p, families[j].name, "counter", families[j].help );
+
+    for( i = 0; i < n; ++i ) {
+      long val;
+
+      switch( j ) {
+      case 0: val = stats[i].hits; break;
+      case 1: val = stats[i].misses; break;
+      case 2: val = stats[i].stores; break;
+      default: val = stats[i].invalidations; break;
+      }
+
+      out( p, "%s{command=\"%s\"} %ld\n", families[j].name,
+           escape_label( stats[i].command, command, sizeof( command ) ), val );
+    }
+  }
+}
+
+
+static void process_metrics( t_tcm_metrics* p )
+{
+  cul_allocstat_t allocstat = get_allocstat();
+
+  header( p, "tcm_allocations", "gauge", "Open allocations of cutillib functions." );
+  out( p, "tcm_allocations %ld\n", allocstat.nr_allocs );
+  header( p, "tcm_allocations_failed_total", "counter", "Failed allocations of cutillib functions." );
+  out( p, "tcm_allocations_failed_total %ld\n", allocstat.nr_allocs_failed );
+  header( p, "tcm_allocated_bytes", "gauge", "Memory allocated by cutillib functions." );
+  out( p, "tcm_allocated_bytes %ld\n", allocstat.mem_allocated );
+  header( p, "tcm_allocated_bytes_max", "gauge", "Maximum memory allocated by cutillib functions." );
+  out( p, "tcm_allocated_bytes_max %ld\n", allocstat.max_allocated );
+
+  header( p, "tcm_uptime_seconds", "gauge", "Time since daemon start." );
+  out( p, "tcm_uptime_seconds %.3f\n", tcm_boot_elapsed_ms() / 1e3 );
+}
+
+
+static void collect( t_tcm_metrics* p )
+{
+  t_base_channel_stats* p_stats = p->p_stats;
+  int n;
+
+  p->len = 0;
+  p->p_buf[0] = '\0';
+
+  /* the registry lock is held for the snapshot only */
+  n = base_channel_snapshot( p_stats, BASE_CHANNEL_MAX_REGISTERED );
+
+  channel_metrics( p, p_stats, n );
+  latency_metrics( p );
+  interpreter_metrics( p );
+  atcache_metrics( p );
+  process_metrics( p );
+}
+
+
+static int send_all( int fd, const char* p_buf, int len )
+{
+  int n;
+
+  while( len > 0 ) {
+    /* SIGPIPE would terminate the daemon when the client has gone */
+    n = send( fd, p_buf, len, MSG_NOSIGNAL );
+    if( n < 0 ) {
+      if( errno == EINTR )
+        continue;
+      return -1;
+    }
+    p_buf += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+
+static void serve( t_tcm_metrics* p, int fd )
+{
+  char req[TCM_METRICS_MAX_REQUEST + 1];
+  char head[256];
+  struct timeval tv = { 1, 0 };
+  int n, len = 0;
+
+  setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, & tv, sizeof( tv ) );
+  setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, & tv, sizeof( tv ) );
+
+  /* the request itself is not evaluated, every path returns the metrics */
+  while( len < TCM_METRICS_MAX_REQUEST ) {
+    n = recv( fd, req + len, TCM_METRICS_MAX_REQUEST - len, 0 );
+    if( n < 0 && errno == EINTR )
+      continue;
+    if( n <= 0 )
+      return;
+    len += n;
+    req[len] = '\0';
+    if( strstr( req, "\r\n\r\n" ) || strstr( req, "\n\n" ) )
+      break;
+  }
+
+  if( strncmp( req, "GET ", 4 ) ) {
+    n = snprintf( head, sizeof( head ),
+                  "HTTP/1.0 405 Method Not Allowed\r\nAllow: GET\r\nContent-Length: 0\r\nConnection: close\r\n\r\n" );
+    send_all( fd, head, n );
+    return;
+  }
+
+  collect( p );
+
+  n = snprintf( head, sizeof( head ),
+                "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                "Content-Length: %d\r\n"
+                "Connection: close\r\n\r\n", p->len );
+
+  if( send_all( fd, head, n ) || send_all( fd, p->p_buf, p->len ) )
+    tcm_error( "%s: could not send metrics error!\n", __func__ );
+}
+
+
+static void* metrics_thread( void* p_arg )
+{
+  t_tcm_metrics* p = (t_tcm_metrics *)p_arg;
+  int fd;
+
+  while( ! p->terminate ) {
+    fd = accept( p->listen_fd, NULL, NULL );
+    if( fd < 0 ) {
+      if( p->terminate )
+        break;
+      if( errno == EINTR || errno == ECONNABORTED )
+        continue;
+      tcm_error( "%s: accept failed with error %s!\n", __func__, strerror( errno ) );
+      sleep( 1 );
+      continue;
+    }
+
+    serve( p, fd );
+    close( fd );
+  }
+
+  return NULL;
+}
+
+
+static int open_listen_socket( const char* address, int port )
+{
+  struct sockaddr_in in_addr;
+  struct sockaddr_un un_addr;
+  int fd, one = 1;
+
+  if( port ) {
+    memset( & in_addr, 0, sizeof( in_addr ) );
+    in_addr.sin_family = AF_INET;
+    in_addr.sin_port = htons( port );
+    if( inet_pton( AF_INET, address, & in_addr.sin_addr ) != 1 ) {
+      tcm_error( "%s: invalid address %s error!\n", __func__, address );
+      return -1;
+    }
+
+    fd = socket( AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( fd < 0 )
+      return -1;
+    setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, & one, sizeof( one ) );
+    if( bind( fd, (struct sockaddr *) & in_addr, sizeof( in_addr ) ) < 0 ) {
+      close( fd );
+      return -1;
+    }
+  }
+  else {
+    if( strlen( address ) >= sizeof( un_addr.sun_path ) ) {
+      tcm_error( "%s: socket path %s too long error!\n", __func__, address );
+      return -1;
+    }
+    memset( & un_addr, 0, sizeof( un_addr ) );
+    un_addr.sun_family = AF_UNIX;
+    strcpy( un_addr.sun_path, address );
+
+    fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( fd < 0 )
+      return -1;
+    unlink( address );
+    if( bind( fd, (struct sockaddr *) & un_addr, sizeof( un_addr ) ) < 0 ) {
+      close( fd );
+      return -1;
+    }
+  }
+
+  if( listen( fd, 8 ) < 0 ) {
+    close( fd );
+    return -1;
+  }
+
+  return fd;
+}
+
+
+void tcm_release_metrics( t_tcm_metrics* p )
+{
+  if( p ) {
+    if( p->listen_fd >= 0 ) {
+      if( p->thread_started ) {
+        p->terminate = 1;
+        /* wakes up the thread blocking in accept() */
+        shutdown( p->listen_fd, SHUT_RDWR );
+        pthread_join( p->thread, NULL );
+      }
+      close( p->listen_fd );
+    }
+
+    if( p->p_stats )
+      cul_free( p->p_stats );
+    if( p->p_buf )
+      cul_free( p->p_buf );
+    cul_free( p );
+  }
+}
+
+
+t_tcm_metrics* tcm_init_metrics( t_tcm_server_ctx* p_tcm_server_ctx, const char* address, int port )
+{
+  t_tcm_metrics* p;
+
+  p = cul_malloc( sizeof( t_tcm_metrics ) );
+  if( p == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+
+  memset( p, 0, sizeof( t_tcm_metrics ) );
+  p->p_tcm_server_ctx = p_tcm_server_ctx;
+  p->listen_fd = -1;
+
+  /* buffers are allocated once, requests do not allocate memory */
+  p->p_buf = cul_malloc( TCM_METRICS_MAX_RESPONSE );
+  p->p_stats = cul_malloc( BASE_CHANNEL_MAX_REGISTERED * sizeof( t_base_channel_stats ) );
+  if( p->p_buf == NULL || p->p_stats == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    tcm_release_metrics( p );
+    return NULL;
+  }
+
+  p->listen_fd = open_listen_socket( address, port );
+  if( p->listen_fd < 0 ) {
+    tcm_error( "%s: could not listen at %s:%d error!\n", __func__, address, port );
+    tcm_release_metrics( p );
+    return NULL;
+  }
+
+  if( pthread_create( & p->thread, NULL, metrics_thread, p ) ) {
+    tcm_error( "%s: could not create metrics thread error!\n", __func__ );
+    tcm_release_metrics( p );
+    return NULL;
+  }
+  p->thread_started = 1;
+
+  tcm_message( "%s: metrics endpoint listening at %s:%d\n", __func__, address, port );
+
+  return p;
+}
@@ -0,0 +1,102 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_METRICS_H
+#define TCM_METRICS_H
+
+#include <pthread.h>
+#include <tcm_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_metrics.h
+    \brief metrics exporter in Prometheus text format
+
+    The exporter answers each HTTP GET request on a TCP or unix domain socket
+    with the current metrics in Prometheus text exposition format:
+
+    \verbatim
+    curl http://127.0.0.1:9187/metrics
+    curl --unix-socket /tmp/tcm-metrics.sock http://localhost/metrics
+    \endverbatim
+
+    Requests are served one after the other by a thread of its own. All values
+    are read from counters which are updated atomically or from snapshots, the
+    interpreter's mutex is never taken.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_METRICS_MAX_RESPONSE   262144               /*!< maximum size of response */
+#define TCM_METRICS_MAX_REQUEST    4096                 /*!< maximum size of request header */
+
+
+/*!
+ * metrics exporter state
+ */
+typedef struct s_tcm_metrics {
+  t_tcm_server_ctx*             p_tcm_server_ctx;       /*!< back reference to server context */
+  int                           listen_fd;              /*!< listening socket */
+  pthread_t                     thread;                 /*!< exporter thread */
+  int                           thread_started;         /*!< set to 1 when thread has been created */
+  int                           terminate;              /*!< set to 1 to stop the exporter thread */
+  struct s_base_channel_stats*  p_stats;                /*!< channel snapshot buffer */
+  char*                         p_buf;                  /*!< response buffer */
+  int                           len;                    /*!< used bytes of response buffer */
+} t_tcm_metrics;
+
+
+/*!
+ * create metrics exporter
+ *
+ * \param p_tcm_server_ctx pointer to main instance object
+ * \param address IP address or file name of unix domain socket
+ * \param port TCP port or 0 for unix domain socket
+ * \return pointer to exporter object or NULL in case of error
+ */
+t_tcm_metrics* tcm_init_metrics( t_tcm_server_ctx* p_tcm_server_ctx, const char* address, int port );
+
+
+/*!
+ * stop and release metrics exporter
+ *
+ * \param p pointer to exporter object
+ */
+void tcm_release_metrics( t_tcm_metrics* p );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_METRICS_H */
@@ -0,0 +1,946 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <olcutils/alloc.h>
+#include <tcm_pattern.h>
+
+
+#define PATTERN_MAGIC       0x7463706eU                 /* "tcpn" */
+#define MAX_NODES           ( 2 * TCM_PATTERN_MAX_LEN + 8 )
+#define MAX_INSTR           ( 4 * TCM_PATTERN_MAX_LEN + 8 )
+#define NR_CAPS             ( 2 * ( TCM_PATTERN_MAX_GROUPS + 1 ) )
+
+/*! syntax tree node types */
+enum { N_SET, N_ANY, N_CAT, N_ALT, N_STAR, N_PLUS, N_QUEST, N_GROUP, N_BOL, N_EOL, N_EMPTY };
+
+/*! instruction codes */
+enum { I_SET, I_MATCH, I_SPLIT, I_JMP, I_SAVE, I_BOL, I_EOL };
+
+/*! accept flags of automaton states */
+enum { ACC = 1, ACC_EOL = 2, DEAD = 4 };
+
+
+typedef struct {
+  uint32_t                      bits[8];                /*!< member bytes */
+} t_set;
+
+typedef struct {
+  int                           type;                   /*!< node type */
+  int                           l, r;                   /*!< children or set index respectively group number */
+} t_node;
+
+typedef struct {
+  uint8_t                       op;                     /*!< instruction code */
+  int16_t                       x, y;                   /*!< branch targets, set index or capture slot */
+} t_instr;
+
+
+/*! compiled pattern, all sections follow in one memory block */
+typedef struct {
+  uint32_t                      magic;                  /*!< PATTERN_MAGIC */
+  int                           size;                   /*!< size of whole block */
+  int                           nr_instr;               /*!< number of instructions */
+  int                           nr_caps;                /*!< 2 * number of captures */
+  int                           nr_sets;                /*!< number of character classes */
+  int                           nr_states;              /*!< automaton states, 0 when not available */
+  int                           nr_bclasses;            /*!< number of byte equivalence classes */
+  uint32_t                      gen;                    /*!< generation counter of thread lists */
+  int                           instr_off;              /*!< offset of t_instr[nr_instr] */
+  int                           sets_off;               /*!< offset of t_set[nr_sets] */
+  int                           trans_off;              /*!< offset of int16_t[nr_states][nr_bclasses] */
+  int                           accept_off;             /*!< offset of uint8_t[nr_states] */
+  int                           mark_off;               /*!< offset of uint32_t[nr_instr] */
+  int                           list_off;               /*!< offset of two thread lists */
+  uint8_t                       bclass[256];            /*!< byte equivalence class */
+} t_pattern;
+
+
+/*! parser and compiler state, only used during compilation */
+typedef struct {
+  const char*                   s;                      /*!< pattern source */
+  int                           pos;                    /*!< parse position */
+  int                           flags;                  /*!< compile flags */
+  const char*                   err;                    /*!< error message */
+  t_node                        nodes[MAX_NODES];       /*!< syntax tree */
+  int                           nr_nodes;               /*!< used nodes */
+  t_set                         sets[TCM_PATTERN_MAX_SETS]; /*!< character classes */
+  int                           nr_sets;                /*!< used character classes */
+  int                           nr_groups;              /*!< capture groups */
+  t_instr                       instr[MAX_INSTR];       /*!< program */
+  int                           nr_instr;               /*!< used instructions */
+  int                           no_dfa;                 /*!< set when automaton can't represent pattern */
+} t_compiler;
+
+
+/* --- character classes --- */
+
+static void set_add( t_compiler* c, t_set* set, int ch )
+{
+  set->bits[ch >> 5] |= 1U << ( ch & 31 );
+
+  if( ( c->flags & TCM_PATTERN_NOCASE ) && isalpha( ch ) ) {
+    ch = isupper( ch ) ? tolower( ch ) : toupper( ch );
+    set->bits[ch >> 5] |= 1U << ( ch & 31 );
+  }
+}
+
+static int set_has( const t_set* set, int ch )
+{
+  return ( set->bits[ch >> 5] >> ( ch & 31 ) ) & 1;
+}
+
+static void set_negate( t_set* set )
+{
+  int i;
+
+  for( i = 0; i < 8; ++i )
+    set->bits[i] = ~set->bits[i];
+}
+
+/* adds class of escape letter d, w, s or their negation, returns 0 for other letters */
+static int set_add_escape( t_compiler* c, t_set* set, int esc )
+{
+  t_set tmp;
+  int ch;
+
+  memset( & tmp, 0, sizeof( tmp ) );
+  for( ch = 0; ch < 256; ++ch ) {
+    if( ( tolower( esc ) == 'd' && isdigit( ch ) ) ||
+        ( tolower( esc ) == 'w' && ( isalnum( ch ) || ch == '_' ) ) ||
+        ( tolower( esc ) == 's' && isspace( ch ) ) )
+      set_add( c, & tmp, ch );
+  }
+
+  if( tolower( esc ) != 'd' && tolower( esc ) != 'w' && tolower( esc ) != 's' )
+    return 0;
+
+  if( isupper( esc ) )
+    set_negate( & tmp );
+
+  for( ch = 0; ch < 8; ++ch )
+    set->bits[ch] |= tmp.bits[ch];
+
+  return 1;
+}
+
+/* deduplicates character class, returns its index or -1 */
+static int intern_set( t_compiler* c, const t_set* set )
+{
+  int i;
+
+  for( i = 0; i < c->nr_sets; ++i ) {
+    if( ! memcmp( & c->sets[i], set, sizeof( t_set ) ) )
+      return i;
+  }
+
+  if( c->nr_sets >= TCM_PATTERN_MAX_SETS ) {
+    c->err = "too many character classes";
+    return -1;
+  }
+
+  c->sets[c->nr_sets] = *set;
+  return c->nr_sets++;
+}
+
+
+/* --- parser --- */
+
+static int node( t_compiler* c, int type, int l, int r )
+{
+  if( c->nr_nodes >= MAX_NODES ) {
+    c->err = "pattern too complex";
+    return -1;
+  }
+
+  c->nodes[c->nr_nodes].type = type;
+  c->nodes[c->nr_nodes].l = l;
+  c->nodes[c->nr_nodes].r = r;
+  return c->nr_nodes++;
+}
+
+static int set_node( t_compiler* c, const t_set* set )
+{
+  int idx = intern_set( c, set );
+
+  return ( idx < 0 ) ? -1 : node( c, N_SET, idx, 0 );
+}
+
+static int char_node( t_compiler* c, int ch )
+{
+  t_set set;
+
+  memset( & set, 0, sizeof( set ) );
+  set_add( c, & set, ch );
+  return set_node( c, & set );
+}
+
+static int any_node( t_compiler* c )
+{
+  t_set set;
+
+  memset( & set, 0xff, sizeof( set ) );
+  set.bits['\r' >> 5] &= ~( 1U << ( '\r' & 31 ) );
+  set.bits['\n' >> 5] &= ~( 1U << ( '\n' & 31 ) );
+  return set_node( c, & set );
+}
+
+/* parses [...] with position behind the opening bracket */
+static int parse_class( t_compiler* c, int negation_char )
+{
+  const char* s = c->s;
+  int negate = 0, first = 1, ch, hi;
+  t_set set;
+
+  memset( & set, 0, sizeof( set ) );
+
+  if( s[c->pos] == negation_char ) {
+    negate = 1;
+    ++c->pos;
+  }
+
+  while( s[c->pos] && ( s[c->pos] != ']' || first ) ) {
+    first = 0;
+    ch = (unsigned char) s[c->pos++];
+
+    if( ch == '\\' && s[c->pos] ) {
+      ch = (unsigned char) s[c->pos++];
+      if( ! ( c->flags & TCM_PATTERN_GLOB ) && set_add_escape( c, & set, ch ) )
+        continue;
+    }
+
+    if( s[c->pos] == '-' && s[c->pos+1] && s[c->pos+1] != ']' ) {
+      hi = (unsigned char) s[c->pos+1];
+      c->pos += 2;
+      if( hi < ch ) {
+        c->err = "invalid range in character class";
+        return -1;
+      }
+      for( ; ch <= hi; ++ch )
+        set_add( c, & set, ch );
+    } else {
+      set_add( c, & set, ch );
+    }
+  }
+
+  if( s[c->pos] != ']' ) {
+    c->err = "missing ]";
+    return -1;
+  }
+  ++c->pos;
+
+  if( negate )
+    set_negate( & set );
+
+  return set_node( c, & set );
+}
+
+static int parse_alt( t_compiler* c );
+
+static int parse_atom( t_compiler* c )
+{
+  const char* s = c->s;
+  int ch = (unsigned char) s[c->pos++];
+  int n, group;
+  t_set set;
+
+  switch( ch ) {
+  case '(':
+    if( c->nr_groups >= TCM_PATTERN_MAX_GROUPS ) {
+      c->err = "too many groups";
+      return -1;
+    }
+    group = ++c->nr_groups;
+    n = parse_alt( c );
+    if( n < 0 )
+      return -1;
+    if( s[c->pos] != ')' ) {
+      c->err = "missing )";
+      return -1;
+    }
+    ++c->pos;
+    return node( c, N_GROUP, n, group );
+
+  case '[':
+    return parse_class( c, '^' );
+
+  case '.':
+    return any_node( c );
+
+  case '^':
+    return node( c, N_BOL, 0, 0 );
+
+  case '$':
+    return node( c, N_EOL, 0, 0 );
+
+  case '\\':
+    ch = (unsigned char) s[c->pos];
+    if( ch == '\0' ) {
+      c->err = "trailing backslash";
+      return -1;
+    }
+    ++c->pos;
+    memset( & set, 0, sizeof( set ) );
+    if( set_add_escape( c, & set, ch ) )
+      return set_node( c, & set );
+    if( ch == 'r' || ch == 'n' || ch == 't' )
+      ch = ( ch == 'r' ) ? '\r' : ( ch == 'n' ) ? '\n' : '\t';
+    return char_node( c, ch );
+
+  case '*': case '+': case '?':
+    c->err = "repetition without operand";
+    return -1;
+
+  default:
+    return char_node( c, ch );
+  }
+}
+
+static int parse_repeat( t_compiler* c )
+{
+  int n = parse_atom( c );
+  int ch;
+
+  while( n >= 0 && ( ch = c->s[c->pos] ) && strchr( "*+?", ch ) ) {
+    ++c->pos;
+    n = node( c, ch == '*' ? N_STAR : ch == '+' ? N_PLUS : N_QUEST, n, 0 );
+  }
+
+  return n;
+}
+
+static int parse_cat( t_compiler* c )
+{
+  int n = -1, r;
+
+  while( c->s[c->pos] && c->s[c->pos] != '|' && c->s[c->pos] != ')' ) {
+    r = parse_repeat( c );
+    if( r < 0 )
+      return -1;
+    n = ( n < 0 ) ? r : node( c, N_CAT, n, r );
+    if( n < 0 )
+      return -1;
+  }
+
+  return ( n < 0 ) ? node( c, N_EMPTY, 0, 0 ) : n;
+}
+
+static int parse_alt( t_compiler* c )
+{
+  int n = parse_cat( c );
+
+  while( n >= 0 && c->s[c->pos] == '|' ) {
+    ++c->pos;
+    n = node( c, N_ALT, n, parse_cat( c ) );
+    if( n >= 0 && c->nodes[n].r < 0 )
+      return -1;
+  }
+
+  return n;
+}
+
+static int parse_glob( t_compiler* c )
+{
+  const char* s = c->s;
+  int n, r, ch;
+
+  n = node( c, N_BOL, 0, 0 );
+  while( n >= 0 && s[c->pos] ) {
+    ch = (unsigned char) s[c->pos++];
+    if( ch == '*' )
+      r = node( c, N_STAR, any_node( c ), 0 );
+    else if( ch == '?' )
+      r = any_node( c );
+    else if( ch == '[' )
+      r = parse_class( c, '!' );
+    else if( ch == '\\' && s[c->pos] )
+      r = char_node( c, (unsigned char) s[c->pos++] );
+    else
+      r = char_node( c, ch );
+    n = ( r < 0 ) ? -1 : node( c, N_CAT, n, r );
+  }
+
+  return ( n < 0 ) ? -1 : node( c, N_CAT, n, node( c, N_EOL, 0, 0 ) );
+}
+
+
+/* --- code generation --- */
+
+static int emit( t_compiler* c, int op, int x, int y )
+{
+  if( c->nr_instr >= MAX_INSTR ) {
+    c->err = "pattern too complex";
+    return -1;
+  }
+
+  c->instr[c->nr_instr].op = op;
+  c->instr[c->nr_instr].x = x;
+  c->instr[c->nr_instr].y = y;
+  return c->nr_instr++;
+}
+
+static int gen( t_compiler* c, int n )
+{
+  const t_node* p;
+  int l1, l2;
+
+  if( n < 0 )
+    return -1;
+
+  p = & c->nodes[n];
+  switch( p->type ) {
+  case N_SET:
+    return emit( c, I_SET, p->l, 0 );
+
+  case N_CAT:
+    return ( gen( c, p->l ) < 0 || gen( c, p->r ) < 0 ) ? -1 : 0;
+
+  case N_ALT:
+    if( ( l1 = emit( c, I_SPLIT, 0, 0 ) ) < 0 || gen( c, p->l ) < 0 || ( l2 = emit( c, I_JMP, 0, 0 ) ) < 0 )
+      return -1;
+    c->instr[l1].x = l1 + 1;
+    c->instr[l1].y = c->nr_instr;
+    if( gen( c, p->r ) < 0 )
+      return -1;
+    c->instr[l2].x = c->nr_instr;
+    return 0;
+
+  case N_STAR:
+    if( ( l1 = emit( c, I_SPLIT, 0, 0 ) ) < 0 || gen( c, p->l ) < 0 || emit( c, I_JMP, l1, 0 ) < 0 )
+      return -1;
+    c->instr[l1].x = l1 + 1;
+    c->instr[l1].y = c->nr_instr;
+    return 0;
+
+  case N_PLUS:
+    l1 = c->nr_instr;
+    if( gen( c, p->l ) < 0 || emit( c, I_SPLIT, l1, c->nr_instr + 1 ) < 0 )
+      return -1;
+    return 0;
+
+  case N_QUEST:
+    if( ( l1 = emit( c, I_SPLIT, 0, 0 ) ) < 0 || gen( c, p->l ) < 0 )
+      return -1;
+    c->instr[l1].x = l1 + 1;
+    c->instr[l1].y = c->nr_instr;
+    return 0;
+
+  case N_GROUP:
+    if( emit( c, I_SAVE, 2 * p->r, 0 ) < 0 || gen( c, p->l ) < 0 || emit( c, I_SAVE, 2 * p->r + 1, 0 ) < 0 )
+      return -1;
+    return 0;
+
+  case N_BOL:
+    return emit( c, I_BOL, 0, 0 );
+
+  case N_EOL:
+    return emit( c, I_EOL, 0, 0 );
+
+  default:
+    return 0;
+  }
+}
+
+
+/* --- deterministic automaton --- */
+
+/*
+ * epsilon closure of seed instructions, the resulting set holds I_SET and
+ * I_MATCH instructions in ascending order, returns accept flags
+ */
+static int closure( t_compiler* c, const int* seeds, int nr_seeds, int at_start,
+                    int* p_set, int* p_nr, uint8_t* p_mark, int* p_stack )
+{
+  int sp = 0, flags = 0, i, j, pc, after_eol;
+
+  memset( p_mark, 0, c->nr_instr );
+  *p_nr = 0;
+
+  /* stack entries carry the instruction and whether an EOL assertion has been passed */
+  for( i = nr_seeds - 1; i >= 0; --i )
+    p_stack[sp++] = seeds[i] << 1;
+
+  while( sp > 0 ) {
+    pc = p_stack[--sp];
+    after_eol = pc & 1;
+    pc >>= 1;
+
+    if( p_mark[pc] & ( 1 << after_eol ) )
+      continue;
+    p_mark[pc] |= 1 << after_eol;
+
+    switch( c->instr[pc].op ) {
+    case I_SET:
+      if( after_eol )
+        c->no_dfa = 1; /* input after the end is handled by the instruction program only */
+      else
+        p_set[(*p_nr)++] = pc;
+      break;
+    case I_MATCH:
+      if( after_eol )
+        flags |= ACC_EOL;
+      else {
+        flags |= ACC;
+        p_set[(*p_nr)++] = pc;
+      }
+      break;
+    case I_JMP:
+      p_stack[sp++] = ( c->instr[pc].x << 1 ) | after_eol;
+      break;
+    case I_SPLIT:
+      p_stack[sp++] = ( c->instr[pc].y << 1 ) | after_eol;
+      p_stack[sp++] = ( c->instr[pc].x << 1 ) | after_eol;
+      break;
+    case I_SAVE:
+      p_stack[sp++] = ( ( pc + 1 ) << 1 ) | after_eol;
+      break;
+    case I_BOL:
+      if( at_start )
+        p_stack[sp++] = ( ( pc + 1 ) << 1 ) | after_eol;
+      break;
+    case I_EOL:
+      p_stack[sp++] = ( ( pc + 1 ) << 1 ) | 1;
+      break;
+    }
+  }
+
+  /* insertion sort, sets are small */
+  for( i = 1; i < *p_nr; ++i ) {
+    pc = p_set[i];
+    for( j = i; j > 0 && p_set[j-1] > pc; --j )
+      p_set[j] = p_set[j-1];
+    p_set[j] = pc;
+  }
+
+  return flags;
+}
+
+
+/* computes byte equivalence classes by refining with each character class */
+static int byte_classes( t_compiler* c, uint8_t* bclass )
+{
+  int map[256], next[512], ch, i, n = 1, m;
+
+  memset( map, 0, sizeof( map ) );
+  for( i = 0; i < c->nr_sets; ++i ) {
+    for( ch = 0; ch < 512; ++ch )
+      next[ch] = -1;
+    m = 0;
+    for( ch = 0; ch < 256; ++ch ) {
+      int key = map[ch] * 2 + set_has( & c->sets[i], ch );
+      if( next[key] < 0 )
+        next[key] = m++;
+      map[ch] = next[key];
+    }
+    n = m;
+  }
+
+  for( ch = 0; ch < 256; ++ch )
+    bclass[ch] = map[ch];
+
+  return n;
+}
+
+
+/*
+ * subset construction, returns number of states or 0 when the automaton
+ * is too large, trans and accept must provide room for TCM_PATTERN_MAX_STATES
+ */
+static int build_dfa( t_compiler* c, const uint8_t* bclass, int nr_bclasses, int16_t* trans, uint8_t* accept )
+{
+  int max_set = c->nr_instr;
+  int *sets, *sizes, *tmp, *seeds, *stack;
+  uint8_t* mark;
+  int nr_states = 0, s, b, ch, i, n, nr_seeds, flags, found, zero = 0;
+  int retval = 0;
+
+  sets = cul_malloc( TCM_PATTERN_MAX_STATES * max_set * sizeof( int ) );
+  sizes = cul_malloc( TCM_PATTERN_MAX_STATES * sizeof( int ) );
+  tmp = cul_malloc( max_set * sizeof( int ) );
+  seeds = cul_malloc( ( max_set + 1 ) * sizeof( int ) );
+  stack = cul_malloc( ( 6 * max_set + 8 ) * sizeof( int ) );
+  mark = cul_malloc( max_set );
+  if( ! sets || ! sizes || ! tmp || ! seeds || ! stack || ! mark )
+    goto out;
+
+  accept[0] = closure( c, & zero, 1, 1, sets, & sizes[0], mark, stack );
+  nr_states = 1;
+
+  for( s = 0; s < nr_states && ! c->no_dfa; ++s ) {
+    for( b = 0; b < nr_bclasses; ++b ) {
+      for( ch = 0; bclass[ch] != b; ++ch )
+        ;
+
+      /* the search restarts at each position, hence instruction 0 is always seeded */
+      nr_seeds = 0;
+      for( i = 0; i < sizes[s]; ++i ) {
+        const t_instr* p = & c->instr[ sets[s * max_set + i] ];
+        if( p->op == I_SET && set_has( & c->sets[p->x], ch ) )
+          seeds[nr_seeds++] = sets[s * max_set + i] + 1;
+      }
+      seeds[nr_seeds++] = 0;
+
+      flags = closure( c, seeds, nr_seeds, 0, tmp, & n, mark, stack );
+
+      for( found = 0; found < nr_states; ++found ) {
+        if( sizes[found] == n && accept[found] == flags && ! memcmp( & sets[found * max_set], tmp, n * sizeof( int ) ) )
+          break;
+      }
+
+      if( found == nr_states ) {
+        if( nr_states >= TCM_PATTERN_MAX_STATES )
+          goto out;
+        memcpy( & sets[nr_states * max_set], tmp, n * sizeof( int ) );
+        sizes[nr_states] = n;
+        accept[nr_states] = flags;
+        ++nr_states;
+      }
+
+      trans[s * nr_bclasses + b] = found;
+    }
+  }
+
+  if( ! c->no_dfa ) {
+    /* states without instructions can't reach a match anymore */
+    for( s = 0; s < nr_states; ++s ) {
+      if( sizes[s] == 0 && accept[s] == 0 )
+        accept[s] = DEAD;
+    }
+    retval = nr_states;
+  }
+
+out:
+  if( sets ) cul_free( sets );
+  if( sizes ) cul_free( sizes );
+  if( tmp ) cul_free( tmp );
+  if( seeds ) cul_free( seeds );
+  if( stack ) cul_free( stack );
+  if( mark ) cul_free( mark );
+
+  return retval;
+}
+
+
+static int align8( int n )
+{
+  return ( n + 7 ) & ~7;
+}
+
+
+void* tcm_pattern_compile( const char* src, int flags, int* p_size, char* p_err, int err_size )
+{
+  t_compiler* c;
+  t_pattern* p = NULL;
+  int16_t* trans = NULL;
+  uint8_t accept[TCM_PATTERN_MAX_STATES];
+  uint8_t bclass[256];
+  int root, nr_bclasses, nr_states = 0, size, list_size;
+
+  if( strlen( src ) > TCM_PATTERN_MAX_LEN ) {
+    snprintf( p_err, err_size, "pattern too long" );
+    return NULL;
+  }
+
+  c = cul_malloc( sizeof( t_compiler ) );
+  if( c == NULL ) {
+    snprintf( p_err, err_size, "out of memory" );
+    return NULL;
+  }
+  memset( c, 0, sizeof( t_compiler ) );
+  c->s = src;
+  c->flags = flags;
+
+  if( flags & TCM_PATTERN_GLOB ) {
+    root = parse_glob( c );
+  } else {
+    root = parse_alt( c );
+    if( root >= 0 && src[c->pos] ) {
+      c->err = "unbalanced )";
+      root = -1;
+    }
+  }
+
+  /* program: save 0, pattern, save 1, match */
+  if( root < 0 || emit( c, I_SAVE, 0, 0 ) < 0 || gen( c, root ) < 0 ||
+      emit( c, I_SAVE, 1, 0 ) < 0 || emit( c, I_MATCH, 0, 0 ) < 0 ) {
+    snprintf( p_err, err_size, "%s at position %d", c->err ? c->err : "syntax error", c->pos );
+    cul_free( c );
+    return NULL;
+  }
+
+  nr_bclasses = byte_classes( c, bclass );
+  trans = cul_malloc( TCM_PATTERN_MAX_STATES * nr_bclasses * sizeof( int16_t ) );
+  if( trans )
+    nr_states = build_dfa( c, bclass, nr_bclasses, trans, accept );
+
+  list_size = c->nr_instr * ( 1 + 2 * ( c->nr_groups + 1 ) ) * sizeof( int );
+  size = align8( sizeof( t_pattern ) );
+  size += align8( c->nr_instr * sizeof( t_instr ) );
+  size += align8( c->nr_sets * sizeof( t_set ) );
+  size += align8( nr_states * nr_bclasses * sizeof( int16_t ) );
+  size += align8( nr_states );
+  size += align8( c->nr_instr * sizeof( uint32_t ) );
+  size += 2 * align8( list_size ) + align8( NR_CAPS * sizeof( int ) );
+
+  p = cul_malloc( size );
+  if( p == NULL ) {
+    snprintf( p_err, err_size, "out of memory" );
+  } else {
+    memset( p, 0, size );
+    p->magic = PATTERN_MAGIC;
+    p->size = size;
+    p->nr_instr = c->nr_instr;
+    p->nr_caps = 2 * ( c->nr_groups + 1 );
+    p->nr_sets = c->nr_sets;
+    p->nr_states = nr_states;
+    p->nr_bclasses = nr_bclasses;
+    memcpy( p->bclass, bclass, sizeof( bclass ) );
+
+    p->instr_off = align8( sizeof( t_pattern ) );
+    p->sets_off = p->instr_off + align8( c->nr_instr * sizeof( t_instr ) );
+    p->trans_off = p->sets_off + align8( c->nr_sets * sizeof( t_set ) );
+    p->accept_off = p->trans_off + align8( nr_states * nr_bclasses * sizeof( int16_t ) );
+    p->mark_off = p->accept_off + align8( nr_states );
+    p->list_off = p->mark_off + align8( c->nr_instr * sizeof( uint32_t ) );
+
+    memcpy( (char *)p + p->instr_off, c->instr, c->nr_instr * sizeof( t_instr ) );
+    memcpy( (char *)p + p->sets_off, c->sets, c->nr_sets * sizeof( t_set ) );
+    if( nr_states ) {
+      memcpy( (char *)p + p->trans_off, trans, nr_states * nr_bclasses * sizeof( int16_t ) );
+      memcpy( (char *)p + p->accept_off, accept, nr_states );
+    }
+    *p_size = size;
+  }
+
+  if( trans )
+    cul_free( trans );
+  cul_free( c );
+
+  return p;
+}
+
+
+int tcm_pattern_is_valid( const void* p )
+{
+  return p && ((const t_pattern *)p)->magic == PATTERN_MAGIC;
+}
+
+
+int tcm_pattern_nr_captures( const void* p )
+{
+  return ((const t_pattern *)p)->nr_caps / 2;
+}
+
+
+int tcm_pattern_size( const void* p )
+{
+  return ((const t_pattern *)p)->size;
+}
+
+
+/* --- matching --- */
+
+/*! thread list of the instruction program matcher */
+typedef struct {
+  int                           n;                      /*!< number of threads */
+  int*                          pcs;                    /*!< instruction of each thread */
+  int*                          caps;                   /*!< capture offsets of each thread */
+} t_list;
+
+/*! matcher state */
+typedef struct {
+  t_pattern*                    p;                      /*!< compiled pattern */
+  const t_instr*                instr;                  /*!< program */
+  uint32_t*                     mark;                   /*!< generation an instruction has been added in */
+  const char*                   s;                      /*!< message */
+  int                           eol;                    /*!< start of trailing line terminators */
+} t_vm;
+
+
+static void add_thread( t_vm* vm, t_list* l, uint32_t gen, int pc, int* caps, int pos )
+{
+  const t_instr* in = & vm->instr[pc];
+  int old;
+
+  if( vm->mark[pc] == gen )
+    return;
+  vm->mark[pc] = gen;
+
+  switch( in->op ) {
+  case I_JMP:
+    add_thread( vm, l, gen, in->x, caps, pos );
+    break;
+  case I_SPLIT:
+    add_thread( vm, l, gen, in->x, caps, pos );
+    add_thread( vm, l, gen, in->y, caps, pos );
+    break;
+  case I_SAVE:
+    old = caps[in->x];
+    caps[in->x] = pos;
+    add_thread( vm, l, gen, pc + 1, caps, pos );
+    caps[in->x] = old;
+    break;
+  case I_BOL:
+    if( pos == 0 )
+      add_thread( vm, l, gen, pc + 1, caps, pos );
+    break;
+  case I_EOL:
+    if( pos >= vm->eol )
+      add_thread( vm, l, gen, pc + 1, caps, pos );
+    break;
+  default:
+    l->pcs[l->n] = pc;
+    memcpy( l->caps + l->n * vm->p->nr_caps, caps, vm->p->nr_caps * sizeof( int ) );
+    ++l->n;
+    break;
+  }
+}
+
+
+static int match_vm( t_pattern* p, const char* s, int len, int eol, int* p_caps, int nr_caps )
+{
+  const t_set* sets = (const t_set *)( (char *)p + p->sets_off );
+  int list_size = p->nr_instr * ( 1 + p->nr_caps );
+  int* base = (int *)( (char *)p + p->list_off );
+  int* caps = (int *)( (char *)p + p->list_off + 2 * align8( list_size * sizeof( int ) ) );
+  t_list lists[2], *clist, *nlist, *tmp;
+  uint32_t cgen, ngen;
+  int matched = 0, pos, i, pc;
+  t_vm vm;
+
+  vm.p = p;
+  vm.instr = (const t_instr *)( (char *)p + p->instr_off );
+  vm.mark = (uint32_t *)( (char *)p + p->mark_off );
+  vm.s = s;
+  vm.eol = eol;
+
+  lists[0].pcs = base;
+  lists[0].caps = base + p->nr_instr;
+  lists[1].pcs = (int *)( (char *)base + align8( list_size * sizeof( int ) ) );
+  lists[1].caps = lists[1].pcs + p->nr_instr;
+  clist = & lists[0];
+  nlist = & lists[1];
+  clist->n = 0;
+
+  /* generation 0 marks unused instructions, hence it is skipped on wrap around */
+  if( p->gen > 0xfffffff0U ) {
+    memset( vm.mark, 0, p->nr_instr * sizeof( uint32_t ) );
+    p->gen = 0;
+  }
+  cgen = ++p->gen;
+
+  for( pos = 0; ; ++pos ) {
+    /* restarting the search at each position has lowest priority */
+    if( ! matched ) {
+      for( i = 0; i < p->nr_caps; ++i )
+        caps[i] = -1;
+      add_thread( & vm, clist, cgen, 0, caps, pos );
+    }
+
+    if( clist->n == 0 )
+      break;
+
+    ngen = ++p->gen;
+    nlist->n = 0;
+    for( i = 0; i < clist->n; ++i ) {
+      pc = clist->pcs[i];
+      if( vm.instr[pc].op == I_MATCH ) {
+        matched = 1;
+        if( p_caps )
+          memcpy( p_caps, clist->caps + i * p->nr_caps, 2 * nr_caps * sizeof( int ) );
+        break; /* threads of lower priority are cut off */
+      }
+      if( pos < len && set_has( & sets[ vm.instr[pc].x ], (unsigned char) s[pos] ) )
+        add_thread( & vm, nlist, ngen, pc + 1, clist->caps + i * p->nr_caps, pos + 1 );
+    }
+
+    if( pos >= len )
+      break;
+
+    tmp = clist;
+    clist = nlist;
+    nlist = tmp;
+    cgen = ngen;
+  }
+
+  return matched;
+}
+
+
+static int match_dfa( const t_pattern* p, const char* s, int len, int eol )
+{
+  const int16_t* trans = (const int16_t *)( (const char *)p + p->trans_off );
+  const uint8_t* accept = (const uint8_t *)( (const char *)p + p->accept_off );
+  int state = 0, pos;
+
+  for( pos = 0; ; ++pos ) {
+    if( accept[state] ) {
+      if( accept[state] & ACC )
+        return 1;
+      if( ( accept[state] & ACC_EOL ) && pos >= eol )
+        return 1;
+      if( accept[state] & DEAD )
+        return 0;
+    }
+
+    if( pos >= len )
+      return 0;
+
+    state = trans[ state * p->nr_bclasses + p->bclass[ (unsigned char) s[pos] ] ];
+  }
+}
+
+
+int tcm_pattern_match( void* p_pattern, const char* s, int len, int* p_caps, int nr_caps )
+{
+  t_pattern* p = (t_pattern *)p_pattern;
+  int eol = len, i;
+
+  while( eol > 0 && ( s[eol-1] == '\r' || s[eol-1] == '\n' ) )
+    --eol;
+
+  if( nr_caps > p->nr_caps / 2 )
+    nr_caps = p->nr_caps / 2;
+
+  if( p_caps == NULL || nr_caps <= 0 ) {
+    if( p->nr_states )
+      return match_dfa( p, s, len, eol );
+    return match_vm( p, s, len, eol, NULL, 0 );
+  }
+
+  for( i = 0; i < 2 * nr_caps; ++i )
+    p_caps[i] = -1;
+
+  /* most messages do not match, the automaton rejects them faster */
+  if( p->nr_states && ! match_dfa( p, s, len, eol ) )
+    return 0;
+
+  return match_vm( p, s, len, eol, p_caps, nr_caps );
+}
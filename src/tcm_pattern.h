@@ -0,0 +1,142 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_PATTERN_H
+#define TCM_PATTERN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_pattern.h
+    \brief compiled regular expressions and glob patterns
+
+    Supported regular expression syntax:
+
+    \verbatim
+    c          literal character, \c escapes meta characters
+    .          any character except carriage return and line feed
+    [a-z0-9]   character class, [^...] for negation
+    \d \w \s   digit, word and white space character, upper case for negation
+    ^  $       start of message, end of message or start of its line terminators
+    *  +  ?    repetition, always greedy
+    (x|y)      grouping and alternation, groups are captured
+    \endverbatim
+
+    Glob patterns match the whole message apart from its line terminators
+    where * matches any sequence, ? any single character and [...] a
+    character class, [!...] for negation.
+
+    A pattern is compiled into an instruction program for capture extraction
+    and, as long as the number of states stays small, into a deterministic
+    automaton for matching without captures. Both run in linear time of the
+    message length and do not allocate memory. The compiled pattern is one
+    contiguous block which includes the scratch memory of the matcher, hence
+    it must not be used by several threads at the same time.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_PATTERN_MAX_LEN        256                  /*!< maximum length of pattern source */
+#define TCM_PATTERN_MAX_GROUPS     9                    /*!< maximum number of capture groups */
+#define TCM_PATTERN_MAX_SETS       64                   /*!< maximum number of distinct character classes */
+#define TCM_PATTERN_MAX_STATES     256                  /*!< maximum number of automaton states */
+
+/*! compile flags */
+#define TCM_PATTERN_GLOB           0x01                 /*!< glob instead of regular expression */
+#define TCM_PATTERN_NOCASE         0x02                 /*!< ignore case of letters */
+
+
+/*!
+ * compile pattern
+ *
+ * \param src pattern source
+ * \param flags bitwise or of compile flags
+ * \param p_size pointer to returned size of compiled pattern
+ * \param p_err buffer for error message
+ * \param err_size size of error message buffer
+ * \return compiled pattern allocated with cul_malloc() or NULL in case of error
+ */
+void* tcm_pattern_compile( const char* src, int flags, int* p_size, char* p_err, int err_size );
+
+
+/*!
+ * check whether memory block holds a compiled pattern
+ *
+ * \param p pointer to memory block
+ * \return 1 for compiled patterns, otherwise 0
+ */
+int tcm_pattern_is_valid( const void* p );
+
+
+/*!
+ * number of capture groups including the whole match
+ *
+ * \param p pointer to compiled pattern
+ * \return number of captures
+ */
+int tcm_pattern_nr_captures( const void* p );
+
+
+/*!
+ * size of compiled pattern
+ *
+ * The block holds no pointers, hence a copy made with memcpy() can be used
+ * in place of the original e.g. by another thread.
+ *
+ * \param p pointer to compiled pattern
+ * \return size in bytes
+ */
+int tcm_pattern_size( const void* p );
+
+
+/*!
+ * match message against pattern
+ *
+ * The leftmost match is searched for. When captures are requested, start and
+ * end offset of each capture are written to p_caps, -1 for captures which did
+ * not participate in the match.
+ *
+ * \param p pointer to compiled pattern
+ * \param s message
+ * \param len length of message
+ * \param p_caps array for 2 * nr_caps offsets or NULL
+ * \param nr_caps number of requested captures
+ * \return 1 when message matches, otherwise 0
+ */
+int tcm_pattern_match( void* p, const char* s, int len, int* p_caps, int nr_caps );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_PATTERN_H */
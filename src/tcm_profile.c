@@ -0,0 +1,802 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <olcutils/alloc.h>
+#include <tcm_profile.h>
+#include <tcm_image.h>
+#include <tcm_watchdog.h>
+#include <tcm_log.h>
+
+
+#define MAX_WALK_FRAMES            1024                 /* dump stack frames inspected per sample */
+#define MAX_PROCEDURES             ( 65535 - TCM_PROFILE_MAX_ROOTS ) /* procedure ids are 16 bit */
+#define MAX_SOURCE_FILES           32                   /* source files searched for definitions */
+
+
+/*!
+ * frame of the interpreter's dump stack
+ *
+ * Mirrors struct dump_stack_frame of tinyscheme's scheme.c which is not
+ * exported. Only the code pointer is used and never dereferenced.
+ */
+typedef struct {
+  int                           op;                     /*!< opcode to continue with */
+  pointer                       args;                   /*!< saved arguments */
+  pointer                       envir;                  /*!< saved environment */
+  pointer                       code;                   /*!< saved code */
+} t_dump_frame;
+
+/*! cell index entry */
+typedef struct {
+  pointer                       cell;                   /*!< cons cell of a procedure's code, NULL if unused */
+  int                           proc;                   /*!< procedure the cell belongs to */
+} t_cell_slot;
+
+/*! procedure or channel/handler */
+typedef struct {
+  char                          name[TCM_PROFILE_MAX_NAME_LEN]; /*!< procedure name */
+  char                          location[TCM_PROFILE_MAX_LOCATION]; /*!< file:line of definition */
+} t_proc;
+
+/*! aggregated call stack */
+typedef struct {
+  uint32_t                      hash;                   /*!< hash over ids */
+  int                           depth;                  /*!< number of ids */
+  long                          count;                  /*!< number of samples, 0 for unused entries */
+  uint16_t                      ids[TCM_PROFILE_MAX_DEPTH + 1]; /*!< channel/handler followed by procedures, outermost first */
+} t_stack;
+
+/*! call tree node used for reports */
+typedef struct {
+  int                           id;                     /*!< procedure */
+  long                          samples;                /*!< samples within this call path */
+  int                           child;                  /*!< first child or -1 */
+  int                           sibling;                /*!< next sibling or -1 */
+  int                           emitted;                /*!< node has been reported */
+} t_trie_node;
+
+
+/*! profiler state, written by the holder of the interpreter only */
+static struct {
+  t_tcm_scheme*                 p_scheme;               /*!< profiled interpreter */
+  t_cell_slot*                  p_index;                /*!< cell index, open addressing */
+  unsigned long                 index_size;             /*!< number of index slots, power of two */
+  unsigned long                 nr_cells;               /*!< number of used index slots */
+  t_proc*                       p_procs;                /*!< procedures followed by channels/handlers */
+  int                           nr_procs;               /*!< number of indexed procedures */
+  int                           max_procs;              /*!< allocated number of procedures */
+  int                           nr_roots;               /*!< number of used channel/handler entries */
+  int                           locations_resolved;     /*!< source locations have been searched */
+  t_stack*                      p_stacks;               /*!< call stack table, open addressing */
+  int                           nr_stacks;              /*!< number of used call stack entries */
+  long                          nr_samples;             /*!< recorded samples */
+  long                          nr_idle;                /*!< periods without interpreter holder, accessed atomically */
+  long                          nr_dropped;             /*!< samples lost for lack of table space */
+  int                           hz;                     /*!< sampling rate */
+  pthread_t                     thread;                 /*!< sampler thread */
+  int                           thread_started;         /*!< sampler thread is running */
+  int                           terminate;              /*!< stops sampler thread, accessed atomically */
+  volatile sig_atomic_t         sampling;               /*!< signal handler records samples */
+  volatile sig_atomic_t         busy;                   /*!< report in progress, samples are skipped */
+} prof;
+
+static int handler_installed;
+
+
+/*
+ * cell index
+ */
+
+static unsigned long hash_cell( pointer cell )
+{
+  uint64_t h = (uintptr_t) cell;
+
+  h ^= h >> 17;
+  h *= 0x9e3779b97f4a7c15ULL;
+  h ^= h >> 29;
+
+  return (unsigned long) h;
+}
+
+
+static int index_lookup( pointer cell )
+{
+  unsigned long mask = prof.index_size - 1;
+  unsigned long i = hash_cell( cell ) & mask;
+
+  while( prof.p_index[i].cell ) {
+    if( prof.p_index[i].cell == cell )
+      return prof.p_index[i].proc;
+    i = ( i + 1 ) & mask;
+  }
+
+  return -1;
+}
+
+
+static int index_resize( unsigned long size )
+{
+  t_cell_slot* p_old = prof.p_index;
+  unsigned long old_size = prof.index_size;
+  unsigned long i, j;
+
+  prof.p_index = cul_malloc( size * sizeof( t_cell_slot ) );
+  if( prof.p_index == NULL ) {
+    prof.p_index = p_old;
+    return -1;
+  }
+  memset( prof.p_index, 0, size * sizeof( t_cell_slot ) );
+  prof.index_size = size;
+
+  for( i = 0; i < old_size; ++i ) {
+    if( p_old[i].cell ) {
+      j = hash_cell( p_old[i].cell ) & ( size - 1 );
+      while( prof.p_index[j].cell )
+        j = ( j + 1 ) & ( size - 1 );
+      prof.p_index[j] = p_old[i];
+    }
+  }
+
+  if( p_old )
+    cul_free( p_old );
+
+  return 0;
+}
+
+
+/* returns 1 when the cell has been added, 0 when it is known and -1 on error */
+static int index_insert( pointer cell, int proc )
+{
+  unsigned long i;
+
+  if( 2 * ( prof.nr_cells + 1 ) > prof.index_size ) {
+    if( index_resize( prof.index_size ? 2 * prof.index_size : 65536 ) )
+      return -1;
+  }
+
+  i = hash_cell( cell ) & ( prof.index_size - 1 );
+  while( prof.p_index[i].cell ) {
+    if( prof.p_index[i].cell == cell )
+      return 0;
+    i = ( i + 1 ) & ( prof.index_size - 1 );
+  }
+
+  prof.p_index[i].cell = cell;
+  prof.p_index[i].proc = proc;
+  ++prof.nr_cells;
+
+  return 1;
+}
+
+
+/* cells shared with procedures indexed before stay attributed to these */
+static int index_code( pointer x, int proc )
+{
+  int retcode;
+
+  while( is_pair( x ) ) {
+    retcode = index_insert( x, proc );
+    if( retcode <= 0 )
+      return retcode;
+    if( index_code( pair_car( x ), proc ) )
+      return -1;
+    x = pair_cdr( x );
+  }
+
+  return 0;
+}
+
+
+static int add_proc( const char* name )
+{
+  t_proc* p_procs;
+  int max;
+
+  if( prof.nr_procs >= prof.max_procs ) {
+    max = prof.max_procs ? 2 * prof.max_procs : 256;
+    p_procs = cul_malloc( ( max + TCM_PROFILE_MAX_ROOTS ) * sizeof( t_proc ) );
+    if( p_procs == NULL )
+      return -1;
+    if( prof.p_procs ) {
+      memcpy( p_procs, prof.p_procs, prof.nr_procs * sizeof( t_proc ) );
+      cul_free( prof.p_procs );
+    }
+    prof.p_procs = p_procs;
+    prof.max_procs = max;
+  }
+
+  memset( & prof.p_procs[prof.nr_procs], 0, sizeof( t_proc ) );
+  strncpy( prof.p_procs[prof.nr_procs].name, name, TCM_PROFILE_MAX_NAME_LEN - 1 );
+
+  return prof.nr_procs++;
+}
+
+
+/*
+ * index the code of all closures bound in the global environment,
+ * the global frame is a hash table vector of (symbol . value) lists
+ */
+static int index_procedures( t_tcm_scheme* p )
+{
+  scheme* sc = & p->sc;
+  pointer frame = pair_car( sc->global_env );
+  pointer slots, slot;
+  long i, n;
+  int proc;
+
+  n = is_vector( frame ) ? vector_length( frame ) : 1;
+  for( i = 0; i < n; ++i ) {
+    slots = is_vector( frame ) ? vector_elem( frame, i ) : frame;
+    for( ; is_pair( slots ); slots = pair_cdr( slots ) ) {
+      slot = pair_car( slots );
+      if( ! is_pair( slot ) || ! is_symbol( pair_car( slot ) ) || ! is_closure( pair_cdr( slot ) ) )
+        continue;
+
+      if( prof.nr_procs >= MAX_PROCEDURES ) {
+        tcm_error( "%s: too many procedures, remaining ones are not profiled\n", __func__ );
+        return 0;
+      }
+
+      proc = add_proc( symname( pair_car( slot ) ) );
+      if( proc < 0 ||
+          index_insert( pair_cdr( slot ), proc ) < 0 ||
+          index_code( closure_code( pair_cdr( slot ) ), proc ) )
+      {
+        tcm_error( "%s: out of memory error!\n", __func__ );
+        return -1;
+      }
+    }
+  }
+
+  /* tables must exist even without any procedure */
+  if( prof.p_index == NULL && index_resize( 64 ) )
+    return -1;
+  if( prof.p_procs == NULL && add_proc( "" ) == 0 )
+    prof.nr_procs = 0;
+
+  return( prof.p_procs ? 0 : -1 );
+}
+
+
+/*
+ * sampling, runs in signal context on the thread holding the interpreter
+ */
+
+static int intern_root( t_tcm_watchdog* w )
+{
+  char name[TCM_PROFILE_MAX_NAME_LEN];
+  t_proc* p_roots = & prof.p_procs[prof.nr_procs];
+  int i = 0, j;
+
+  if( w == NULL )
+    return prof.nr_procs + TCM_PROFILE_MAX_ROOTS - 1;
+
+  for( j = 0; w->owner[j] && i < sizeof( name ) - 2; ++j )
+    name[i++] = w->owner[j];
+  name[i++] = '/';
+  for( j = 0; w->handler[j] && i < sizeof( name ) - 1; ++j )
+    name[i++] = w->handler[j];
+  name[i] = '\0';
+
+  for( i = 0; i < prof.nr_roots; ++i )
+    if( ! strcmp( p_roots[i].name, name ) )
+      return prof.nr_procs + i;
+
+  /* the last entry collects all channels/handlers beyond the table size */
+  if( prof.nr_roots == TCM_PROFILE_MAX_ROOTS - 1 )
+    return prof.nr_procs + prof.nr_roots;
+
+  memcpy( p_roots[prof.nr_roots].name, name, sizeof( name ) );
+  p_roots[prof.nr_roots].location[0] = '\0';
+
+  return prof.nr_procs + prof.nr_roots++;
+}
+
+
+static void record_sample( t_tcm_scheme* p )
+{
+  scheme* sc = & p->sc;
+  const t_dump_frame* p_frames = (const t_dump_frame *) sc->dump_base;
+  long nr_frames = (long)(intptr_t) sc->dump;
+  uint16_t rev[TCM_PROFILE_MAX_DEPTH];
+  uint16_t ids[TCM_PROFILE_MAX_DEPTH + 1];
+  t_stack* s;
+  uint32_t h = 2166136261u;
+  long i, last;
+  int id, n = 0, depth, probe;
+
+  /* innermost first, the dump stack is an array unless built with USE_SCHEME_STACK */
+  id = index_lookup( sc->code );
+  if( id >= 0 )
+    rev[n++] = id;
+
+  if( p_frames && nr_frames > 0 && nr_frames <= sc->dump_size ) {
+    last = ( nr_frames > MAX_WALK_FRAMES ) ? nr_frames - MAX_WALK_FRAMES : 0;
+    for( i = nr_frames - 1; i >= last && n < TCM_PROFILE_MAX_DEPTH; --i ) {
+      id = index_lookup( p_frames[i].code );
+      if( id >= 0 && ( n == 0 || rev[n - 1] != id ) )
+        rev[n++] = id;
+    }
+  }
+
+  ids[0] = intern_root( p->p_watchdog );
+  for( depth = 1; n > 0; ++depth )
+    ids[depth] = rev[--n];
+
+  for( i = 0; i < depth; ++i )
+    h = ( h ^ ids[i] ) * 16777619u;
+
+  for( probe = 0; probe < TCM_PROFILE_MAX_STACKS; ++probe ) {
+    s = & prof.p_stacks[ ( h + probe ) & ( TCM_PROFILE_MAX_STACKS - 1 ) ];
+
+    if( s->count == 0 ) {
+      /* probe sequences are kept short by limiting the load */
+      if( 4 * ( prof.nr_stacks + 1 ) > 3 * TCM_PROFILE_MAX_STACKS )
+        break;
+      s->hash = h;
+      s->depth = depth;
+      memcpy( s->ids, ids, depth * sizeof( uint16_t ) );
+      s->count = 1;
+      ++prof.nr_stacks;
+      ++prof.nr_samples;
+      return;
+    }
+
+    if( s->hash == h && s->depth == depth && ! memcmp( s->ids, ids, depth * sizeof( uint16_t ) ) ) {
+      ++s->count;
+      ++prof.nr_samples;
+      return;
+    }
+  }
+
+  ++prof.nr_dropped;
+}
+
+
+static void sample_handler( int sig )
+{
+  t_tcm_scheme* p = prof.p_scheme;
+  int saved_errno = errno;
+
+  /* the signal may arrive after the interpreter has been released */
+  if( prof.sampling && ! prof.busy && p &&
+      __atomic_load_n( & p->holding, __ATOMIC_ACQUIRE ) && pthread_equal( p->holder, pthread_self() ) )
+    record_sample( p );
+
+  errno = saved_errno;
+}
+
+
+static void* sampler_thread( void* p_arg )
+{
+  t_tcm_scheme* p = (t_tcm_scheme *) p_arg;
+  long period_ns = 1000000000L / prof.hz;
+  struct timespec next, now;
+
+  clock_gettime( CLOCK_MONOTONIC, & next );
+
+  while( ! __atomic_load_n( & prof.terminate, __ATOMIC_RELAXED ) ) {
+    next.tv_nsec += period_ns;
+    while( next.tv_nsec >= 1000000000L ) {
+      next.tv_nsec -= 1000000000L;
+      ++next.tv_sec;
+    }
+
+    /* periods missed are skipped rather than caught up */
+    clock_gettime( CLOCK_MONOTONIC, & now );
+    if( now.tv_sec > next.tv_sec + 1 )
+      next = now;
+
+    while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, & next, NULL ) == EINTR )
+      ;
+
+    if( __atomic_load_n( & p->holding, __ATOMIC_ACQUIRE ) )
+      pthread_kill( p->holder, SIGPROF );
+    else
+      __atomic_add_fetch( & prof.nr_idle, 1, __ATOMIC_RELAXED );
+  }
+
+  return NULL;
+}
+
+
+/*
+ * control
+ */
+
+void tcm_profile_stop( void )
+{
+  prof.sampling = 0;
+
+  if( prof.thread_started ) {
+    __atomic_store_n( & prof.terminate, 1, __ATOMIC_RELAXED );
+    pthread_join( prof.thread, NULL );
+    prof.thread_started = 0;
+  }
+}
+
+
+void tcm_profile_release( void )
+{
+  tcm_profile_stop();
+
+  if( prof.p_index )
+    cul_free( prof.p_index );
+  if( prof.p_procs )
+    cul_free( prof.p_procs );
+  if( prof.p_stacks )
+    cul_free( prof.p_stacks );
+
+  memset( & prof, 0, sizeof( prof ) );
+}
+
+
+int tcm_profile_start( t_tcm_scheme* p, int hz )
+{
+  struct sigaction sa;
+
+  tcm_profile_release();
+
+  prof.p_scheme = p;
+  prof.hz = hz;
+
+  prof.p_stacks = cul_malloc( TCM_PROFILE_MAX_STACKS * sizeof( t_stack ) );
+  if( prof.p_stacks == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    tcm_profile_release();
+    return -1;
+  }
+  memset( prof.p_stacks, 0, TCM_PROFILE_MAX_STACKS * sizeof( t_stack ) );
+
+  if( index_procedures( p ) ) {
+    tcm_profile_release();
+    return -1;
+  }
+
+  /* entry collecting channels/handlers beyond the table size */
+  memset( & prof.p_procs[prof.nr_procs + TCM_PROFILE_MAX_ROOTS - 1], 0, sizeof( t_proc ) );
+  strcpy( prof.p_procs[prof.nr_procs + TCM_PROFILE_MAX_ROOTS - 1].name, "[other]" );
+
+  if( ! handler_installed ) {
+    memset( & sa, 0, sizeof( sa ) );
+    sa.sa_handler = sample_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset( & sa.sa_mask );
+    if( sigaction( SIGPROF, & sa, NULL ) ) {
+      tcm_error( "%s: could not install signal handler error!\n", __func__ );
+      tcm_profile_release();
+      return -1;
+    }
+    handler_installed = 1;
+  }
+
+  prof.sampling = 1;
+  if( pthread_create( & prof.thread, NULL, sampler_thread, p ) ) {
+    tcm_error( "%s: could not create sampler thread error!\n", __func__ );
+    tcm_profile_release();
+    return -1;
+  }
+  prof.thread_started = 1;
+
+  tcm_message( "%s: profiling %d procedures at %d Hz\n", __func__, prof.nr_procs, hz );
+
+  return 0;
+}
+
+
+void tcm_profile_summary( t_tcm_profile_summary* p_summary )
+{
+  memset( p_summary, 0, sizeof( t_tcm_profile_summary ) );
+  p_summary->running = prof.thread_started;
+  p_summary->hz = prof.hz;
+  p_summary->nr_samples = prof.nr_samples;
+  p_summary->nr_idle = __atomic_load_n( & prof.nr_idle, __ATOMIC_RELAXED );
+  p_summary->nr_dropped = prof.nr_dropped;
+  p_summary->nr_procedures = prof.nr_procs;
+}
+
+
+/*
+ * reports
+ */
+
+static void begin_report( void )
+{
+  prof.busy = 1;
+  __atomic_signal_fence( __ATOMIC_SEQ_CST );
+}
+
+
+static void end_report( void )
+{
+  __atomic_signal_fence( __ATOMIC_SEQ_CST );
+  prof.busy = 0;
+}
+
+
+static int lookup_proc( const char* name, int len )
+{
+  int i;
+
+  for( i = 0; i < prof.nr_procs; ++i )
+    if( ! strncmp( prof.p_procs[i].name, name, len ) && prof.p_procs[i].name[len] == '\0' )
+      return i;
+
+  return -1;
+}
+
+
+/*
+ * search the source files for top-level definitions of the form
+ * (define (name ...) ...), (define name ...) or (define-xyz name ...)
+ */
+static void resolve_locations( void )
+{
+  const char* paths[MAX_SOURCE_FILES];
+  const char *basename, *s, *name;
+  char line[1024];
+  FILE* fp;
+  int i, nr_paths, line_nr, len, proc;
+
+  if( prof.locations_resolved )
+    return;
+  prof.locations_resolved = 1;
+
+  nr_paths = tcm_image_sources( paths, MAX_SOURCE_FILES );
+  for( i = 0; i < nr_paths; ++i ) {
+    fp = fopen( paths[i], "r" );
+    if( fp == NULL )
+      continue;
+
+    basename = strrchr( paths[i], '/' );
+    basename = basename ? basename + 1 : paths[i];
+
+    for( line_nr = 1; fgets( line, sizeof( line ), fp ); ++line_nr ) {
+      if( strncmp( line, "(define", 7 ) )
+        continue;
+
+      for( s = line + 7; *s && *s != ' ' && *s != '\t'; ++s )
+        ;
+      while( *s == ' ' || *s == '\t' )
+        ++s;
+      if( *s == '(' )
+        ++s;
+
+      for( name = s; *s && ! strchr( " \t\r\n()", *s ); ++s )
+        ;
+      len = s - name;
+      if( len == 0 )
+        continue;
+
+      proc = lookup_proc( name, len );
+      if( proc >= 0 && prof.p_procs[proc].location[0] == '\0' )
+        snprintf( prof.p_procs[proc].location, TCM_PROFILE_MAX_LOCATION, "%s:%d", basename, line_nr );
+    }
+
+    fclose( fp );
+  }
+}
+
+
+static int compare_entries( const void* p1, const void* p2 )
+{
+  const t_tcm_profile_entry* e1 = (const t_tcm_profile_entry *) p1;
+  const t_tcm_profile_entry* e2 = (const t_tcm_profile_entry *) p2;
+
+  if( e1->self != e2->self )
+    return( e1->self < e2->self ? 1 : -1 );
+  if( e1->total != e2->total )
+    return( e1->total < e2->total ? 1 : -1 );
+  return strcmp( e1->name, e2->name );
+}
+
+
+int tcm_profile_flat( t_tcm_profile_entry* p_entries, int max )
+{
+  t_tcm_profile_entry* p_all;
+  const t_stack* s;
+  int nr_ids = prof.nr_procs + TCM_PROFILE_MAX_ROOTS;
+  int i, j, k, n = 0;
+
+  if( prof.p_stacks == NULL )
+    return 0;
+
+  p_all = cul_malloc( nr_ids * sizeof( t_tcm_profile_entry ) );
+  if( p_all == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return -1;
+  }
+  memset( p_all, 0, nr_ids * sizeof( t_tcm_profile_entry ) );
+
+  begin_report();
+  resolve_locations();
+
+  for( i = 0; i < TCM_PROFILE_MAX_STACKS; ++i ) {
+    s = & prof.p_stacks[i];
+    if( s->count == 0 )
+      continue;
+
+    p_all[ s->ids[s->depth - 1] ].self += s->count;
+
+    /* procedures occurring more than once in a stack are counted once */
+    for( j = 0; j < s->depth; ++j ) {
+      for( k = 0; k < j && s->ids[k] != s->ids[j]; ++k )
+        ;
+      if( k == j )
+        p_all[ s->ids[j] ].total += s->count;
+    }
+  }
+
+  for( i = 0; i < nr_ids; ++i ) {
+    if( p_all[i].total ) {
+      strcpy( p_all[i].name, prof.p_procs[i].name );
+      strcpy( p_all[i].location, prof.p_procs[i].location );
+      p_all[n++] = p_all[i];
+    }
+  }
+
+  end_report();
+
+  qsort( p_all, n, sizeof( t_tcm_profile_entry ), compare_entries );
+  if( n > max )
+    n = max;
+  memcpy( p_entries, p_all, n * sizeof( t_tcm_profile_entry ) );
+  cul_free( p_all );
+
+  return n;
+}
+
+
+static void emit_nodes( t_trie_node* t, int parent, int depth, t_tcm_profile_node* p_nodes, int* p_n, int max )
+{
+  t_tcm_profile_node* p_node;
+  int c, best;
+
+  /* children are emitted in order of decreasing samples */
+  while( *p_n < max ) {
+    best = -1;
+    for( c = t[parent].child; c >= 0; c = t[c].sibling )
+      if( ! t[c].emitted && ( best < 0 || t[c].samples > t[best].samples ) )
+        best = c;
+    if( best < 0 )
+      return;
+
+    t[best].emitted = 1;
+    p_node = & p_nodes[(*p_n)++];
+    strcpy( p_node->name, prof.p_procs[ t[best].id ].name );
+    strcpy( p_node->location, prof.p_procs[ t[best].id ].location );
+    p_node->samples = t[best].samples;
+    p_node->depth = depth;
+
+    emit_nodes( t, best, depth + 1, p_nodes, p_n, max );
+  }
+}
+
+
+int tcm_profile_tree( t_tcm_profile_node* p_nodes, int max )
+{
+  t_trie_node* t;
+  const t_stack* s;
+  int i, j, c, cur, nr_nodes = 1, n = 0;
+
+  if( prof.p_stacks == NULL )
+    return 0;
+
+  t = cul_malloc( ( prof.nr_stacks * ( TCM_PROFILE_MAX_DEPTH + 1 ) + 1 ) * sizeof( t_trie_node ) );
+  if( t == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return -1;
+  }
+  memset( & t[0], 0, sizeof( t_trie_node ) );
+  t[0].child = t[0].sibling = -1;
+
+  begin_report();
+  resolve_locations();
+
+  for( i = 0; i < TCM_PROFILE_MAX_STACKS; ++i ) {
+    s = & prof.p_stacks[i];
+    if( s->count == 0 )
+      continue;
+
+    for( cur = 0, j = 0; j < s->depth; ++j ) {
+      for( c = t[cur].child; c >= 0 && t[c].id != s->ids[j]; c = t[c].sibling )
+        ;
+      if( c < 0 ) {
+        c = nr_nodes++;
+        t[c].id = s->ids[j];
+        t[c].samples = 0;
+        t[c].child = -1;
+        t[c].sibling = t[cur].child;
+        t[c].emitted = 0;
+        t[cur].child = c;
+      }
+      t[c].samples += s->count;
+      cur = c;
+    }
+  }
+
+  emit_nodes( t, 0, 0, p_nodes, & n, max );
+
+  end_report();
+  cul_free( t );
+
+  return n;
+}
+
+
+static void write_frame_name( FILE* fp, const char* name )
+{
+  /* blanks and semicolons separate frames and counts */
+  for( ; *name; ++name )
+    fputc( ( *name == ' ' || *name == ';' ) ? '_' : *name, fp );
+}
+
+
+int tcm_profile_write_collapsed( const char* filename )
+{
+  const t_stack* s;
+  FILE* fp;
+  int i, j, n = 0;
+
+  fp = fopen( filename, "w" );
+  if( fp == NULL ) {
+    tcm_error( "%s: could not open %s error!\n", __func__, filename );
+    return -1;
+  }
+
+  begin_report();
+
+  for( i = 0; prof.p_stacks && i < TCM_PROFILE_MAX_STACKS; ++i ) {
+    s = & prof.p_stacks[i];
+    if( s->count == 0 )
+      continue;
+
+    for( j = 0; j < s->depth; ++j ) {
+      if( j )
+        fputc( ';', fp );
+      write_frame_name( fp, prof.p_procs[ s->ids[j] ].name );
+    }
+    fprintf( fp, " %ld\n", s->count );
+    ++n;
+  }
+
+  end_report();
+
+  if( fclose( fp ) ) {
+    tcm_error( "%s: could not write %s error!\n", __func__, filename );
+    return -1;
+  }
+
+  return n;
+}
@@ -0,0 +1,185 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_PROFILE_H
+#define TCM_PROFILE_H
+
+#include <tcm_scheme.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_profile.h
+    \brief sampling profiler for scheme procedures
+
+    While the profiler is running, a sampler thread interrupts the thread
+    holding the interpreter with SIGPROF at the given rate. The signal handler
+    maps the expression under evaluation and the code pointers of the
+    interpreter's dump stack to the global procedures whose bodies contain
+    them. This works without dereferencing any interpreter object since the
+    cells of all procedures are indexed when the profiler is started.
+    Procedures defined later, e.g. via the REPL, are covered when the profiler
+    is started again.
+
+    Each sample is accounted to its call stack rooted at the channel and
+    handler holding the interpreter. Anonymous closures are attributed to the
+    procedure they have been created in, channel callbacks to the global
+    symbol they are bound to. Recursive calls are folded into one frame.
+    Samples are taken in wall-clock time, hence a handler blocking the
+    interpreter e.g. in a system command is visible as well.
+
+    \addtogroup scheme
+    @{
+ */
+
+#define TCM_PROFILE_DEFAULT_HZ     100                  /*!< default sampling rate */
+#define TCM_PROFILE_MAX_HZ         10000                /*!< maximum sampling rate */
+#define TCM_PROFILE_MAX_DEPTH      48                   /*!< maximum recorded frames per sample, innermost are kept */
+#define TCM_PROFILE_MAX_STACKS     4096                 /*!< maximum number of distinct call stacks, power of two */
+#define TCM_PROFILE_MAX_ROOTS      64                   /*!< maximum number of distinct channels and handlers */
+#define TCM_PROFILE_MAX_NAME_LEN   64                   /*!< maximum length of procedure name */
+#define TCM_PROFILE_MAX_LOCATION   80                   /*!< maximum length of source location */
+
+
+/*!
+ * profiler state
+ */
+typedef struct s_tcm_profile_summary {
+  int                           running;                /*!< set to 1 while samples are taken */
+  int                           hz;                     /*!< sampling rate */
+  long                          nr_samples;             /*!< samples taken while the interpreter was held */
+  long                          nr_idle;                /*!< sampling periods without interpreter holder */
+  long                          nr_dropped;             /*!< samples lost for lack of stack table space */
+  int                           nr_procedures;          /*!< number of indexed procedures */
+} t_tcm_profile_summary;
+
+
+/*!
+ * flat profile entry of one procedure
+ */
+typedef struct s_tcm_profile_entry {
+  char                          name[TCM_PROFILE_MAX_NAME_LEN]; /*!< procedure or channel/handler name */
+  char                          location[TCM_PROFILE_MAX_LOCATION]; /*!< file:line of definition or empty */
+  long                          self;                   /*!< samples with procedure on top of stack */
+  long                          total;                  /*!< samples with procedure anywhere on stack */
+} t_tcm_profile_entry;
+
+
+/*!
+ * call tree node, trees are given in pre-order
+ */
+typedef struct s_tcm_profile_node {
+  char                          name[TCM_PROFILE_MAX_NAME_LEN]; /*!< procedure or channel/handler name */
+  char                          location[TCM_PROFILE_MAX_LOCATION]; /*!< file:line of definition or empty */
+  long                          samples;                /*!< samples within this call path */
+  int                           depth;                  /*!< nesting level, 0 for channel/handler */
+} t_tcm_profile_node;
+
+
+/*!
+ * index procedures and start sampling, previous samples are discarded
+ *
+ * Must be called with the interpreter locked via tcm_scheme_lock().
+ *
+ * \param p pointer to the scheme object
+ * \param hz sampling rate per second
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_profile_start( t_tcm_scheme* p, int hz );
+
+
+/*!
+ * stop sampling, samples are kept for evaluation
+ *
+ * Must be called with the interpreter locked via tcm_scheme_lock().
+ */
+void tcm_profile_stop( void );
+
+
+/*!
+ * stop sampling and release all profiler data
+ *
+ * Must be called with the interpreter mutex held.
+ */
+void tcm_profile_release( void );
+
+
+/*!
+ * retrieve profiler state
+ *
+ * \param p_summary pointer to summary object to fill
+ */
+void tcm_profile_summary( t_tcm_profile_summary* p_summary );
+
+
+/*!
+ * flat profile sorted by self samples
+ *
+ * Must be called with the interpreter locked via tcm_scheme_lock().
+ *
+ * \param p_entries array the entries are written to
+ * \param max maximum number of entries to write
+ * \return number of entries
+ */
+int tcm_profile_flat( t_tcm_profile_entry* p_entries, int max );
+
+
+/*!
+ * call tree profile in pre-order, siblings sorted by samples
+ *
+ * Must be called with the interpreter locked via tcm_scheme_lock().
+ *
+ * \param p_nodes array the nodes are written to
+ * \param max maximum number of nodes to write
+ * \return number of nodes
+ */
+int tcm_profile_tree( t_tcm_profile_node* p_nodes, int max );
+
+
+/*!
+ * write samples as collapsed stacks for flame graph generators
+ *
+ * Each line lists the frames from the channel/handler down to the innermost
+ * procedure separated by semicolons, followed by the number of samples.
+ *
+ * Must be called with the interpreter locked via tcm_scheme_lock().
+ *
+ * \param filename file to write
+ * \return number of written stacks or -1 in case of error
+ */
+int tcm_profile_write_collapsed( const char* filename );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_PROFILE_H */
@@ -0,0 +1,614 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <olcutils/alloc.h>
+#include <tcm_rpc.h>
+#include <tcm_scheme.h>
+#include <tcm_scheme_api.h>
+#include <tcm_config.h>
+#include <tcm_log.h>
+
+
+/*! bounds checked reader for request payloads */
+typedef struct {
+  const unsigned char*          p;                      /*!< payload */
+  int                           len;                    /*!< payload length */
+  int                           pos;                    /*!< read position */
+} t_rpc_reader;
+
+/*! bounded writer for response payloads */
+typedef struct {
+  char                          buf[TCM_RPC_MAX_FRAME_SIZE + 4]; /*!< length prefix and payload */
+  int                           len;                    /*!< number of bytes written including prefix */
+  int                           overflow;               /*!< set to 1 when data did not fit */
+} t_rpc_writer;
+
+
+static int get_bytes( t_rpc_reader* r, int n, uint64_t* p_val )
+{
+  uint64_t val = 0;
+
+  if( r->pos + n > r->len )
+    return -1;
+
+  while( n-- )
+    val = ( val << 8 ) | r->p[r->pos++];
+
+  *p_val = val;
+  return 0;
+}
+
+/*
+ * advance read position, n may be taken from the payload and is thus checked
+ * against the remaining bytes before it is added
+ */
+static int skip_bytes( t_rpc_reader* r, uint64_t n )
+{
+  if( n > (uint64_t)( r->len - r->pos ) )
+    return -1;
+
+  r->pos += (int) n;
+  return 0;
+}
+
+static void put_bytes( t_rpc_writer* w, int n, uint64_t val )
+{
+  if( w->len + n > sizeof( w->buf ) ) {
+    w->overflow = 1;
+    return;
+  }
+
+  while( n-- )
+    w->buf[w->len++] = (char)( val >> ( 8 * n ) );
+}
+
+static void put_data( t_rpc_writer* w, const char* p_data, int n )
+{
+  if( w->len + n > sizeof( w->buf ) ) {
+    w->overflow = 1;
+    return;
+  }
+
+  memcpy( w->buf + w->len, p_data, n );
+  w->len += n;
+}
+
+
+/*
+ * validate value and count the number of values including all nested ones
+ * returns -1 for malformed data
+ */
+static int count_values( t_rpc_reader* r, int depth )
+{
+  uint64_t type, n, i;
+  int count = 1, sub;
+
+  if( depth > TCM_RPC_MAX_DEPTH || get_bytes( r, 1, & type ) )
+    return -1;
+
+  switch( type )
+  {
+  case t_tcm_rpc_nil:
+  case t_tcm_rpc_false:
+  case t_tcm_rpc_true:
+    break;
+  case t_tcm_rpc_integer:
+  case t_tcm_rpc_real:
+    if( skip_bytes( r, 8 ) )
+      return -1;
+    break;
+  case t_tcm_rpc_char:
+    if( skip_bytes( r, 1 ) )
+      return -1;
+    break;
+  case t_tcm_rpc_string:
+    if( get_bytes( r, 4, & n ) || skip_bytes( r, n ) )
+      return -1;
+    break;
+  case t_tcm_rpc_symbol:
+    if( get_bytes( r, 2, & n ) || n == 0 || skip_bytes( r, n ) )
+      return -1;
+    break;
+  case t_tcm_rpc_list:
+  case t_tcm_rpc_vector:
+    /* each element takes at least one byte */
+    if( get_bytes( r, 4, & n ) || n > (uint64_t)( r->len - r->pos ) )
+      return -1;
+    for( i = 0; i < n; ++i ) {
+      if( ( sub = count_values( r, depth + 1 ) ) < 0 )
+        return -1;
+      count += sub;
+    }
+    break;
+  default:
+    return -1;
+  }
+
+  return count;
+}
+
+
+/*
+ * decode previously validated value into scheme object, returns NULL for malformed data
+ *
+ * Each decoded object is stored in the gc rooted vector v at its pre-order
+ * index. Lists and vectors are stored before their elements are decoded and
+ * extended respectively filled in place so that all intermediate objects are
+ * reachable whenever the interpreter allocates new cells.
+ */
+static pointer decode_value( scheme* sc, t_rpc_reader* r, pointer v, int* p_idx )
+{
+  int idx = (*p_idx)++;
+  uint64_t type, n, i;
+  pointer retval, elem, tail = NULL;
+  double real;
+  char symbuf[256];
+
+  if( get_bytes( r, 1, & type ) )
+    return NULL;
+
+  switch( type )
+  {
+  case t_tcm_rpc_false:
+    retval = sc->F;
+    break;
+  case t_tcm_rpc_true:
+    retval = sc->T;
+    break;
+  case t_tcm_rpc_integer:
+    if( get_bytes( r, 8, & n ) )
+      return NULL;
+    retval = mk_integer( sc, (long)(int64_t) n );
+    break;
+  case t_tcm_rpc_real:
+    if( get_bytes( r, 8, & n ) )
+      return NULL;
+    memcpy( & real, & n, sizeof( real ) );
+    retval = mk_real( sc, real );
+    break;
+  case t_tcm_rpc_char:
+    if( get_bytes( r, 1, & n ) )
+      return NULL;
+    retval = mk_character( sc, (int) n );
+    break;
+  case t_tcm_rpc_string:
+    if( get_bytes( r, 4, & n ) || n > (uint64_t)( r->len - r->pos ) )
+      return NULL;
+    retval = mk_counted_string( sc, (const char *) r->p + r->pos, (int) n );
+    r->pos += (int) n;
+    break;
+  case t_tcm_rpc_symbol:
+    if( get_bytes( r, 2, & n ) || n > (uint64_t)( r->len - r->pos ) )
+      return NULL;
+    i = ( n < sizeof( symbuf ) ) ? n : sizeof( symbuf ) - 1;
+    memcpy( symbuf, r->p + r->pos, i );
+    symbuf[i] = '\0';
+    retval = mk_symbol( sc, symbuf );
+    r->pos += (int) n;
+    break;
+  case t_tcm_rpc_vector:
+    if( get_bytes( r, 4, & n ) || n > (uint64_t)( r->len - r->pos ) )
+      return NULL;
+    retval = mk_vector( sc, (int) n );
+    set_vector_elem( v, idx, retval );
+    for( i = 0; i < n; ++i ) {
+      if( ( elem = decode_value( sc, r, v, p_idx ) ) == NULL )
+        return NULL;
+      set_vector_elem( retval, (int) i, elem );
+    }
+    break;
+  case t_tcm_rpc_list:
+    if( get_bytes( r, 4, & n ) || n > (uint64_t)( r->len - r->pos ) )
+      return NULL;
+    retval = sc->NIL;
+    for( i = 0; i < n; ++i ) {
+      if( ( elem = decode_value( sc, r, v, p_idx ) ) == NULL )
+        return NULL;
+      elem = cons( sc, elem, sc->NIL );
+      if( tail ) {
+        set_cdr( tail, elem );
+      } else {
+        retval = elem;
+        set_vector_elem( v, idx, retval );
+      }
+      tail = elem;
+    }
+    break;
+  default:
+    retval = sc->NIL;
+    break;
+  }
+
+  set_vector_elem( v, idx, retval );
+  return retval;
+}
+
+
+/*
+ * encode scheme object, no interpreter memory is allocated
+ * returns -1 when object can't be represented
+ */
+static int encode_value( scheme* sc, t_rpc_writer* w, pointer x, int depth )
+{
+  pointer l;
+  double real;
+  uint64_t bits;
+  long i, n;
+  const char* str;
+
+  if( depth > TCM_RPC_MAX_DEPTH )
+    return -1;
+
+  if( x == sc->NIL ) {
+    put_bytes( w, 1, t_tcm_rpc_nil );
+  }
+  else if( x == sc->F ) {
+    put_bytes( w, 1, t_tcm_rpc_false );
+  }
+  else if( x == sc->T ) {
+    put_bytes( w, 1, t_tcm_rpc_true );
+  }
+  else if( is_real( x ) ) {
+    real = rvalue( x );
+    memcpy( & bits, & real, sizeof( bits ) );
+    put_bytes( w, 1, t_tcm_rpc_real );
+    put_bytes( w, 8, bits );
+  }
+  else if( is_number( x ) ) {
+    put_bytes( w, 1, t_tcm_rpc_integer );
+    put_bytes( w, 8, (uint64_t) ivalue( x ) );
+  }
+  else if( is_string( x ) ) {
+    str = string_value( x );
+    n = strlength( x );
+    put_bytes( w, 1, t_tcm_rpc_string );
+    put_bytes( w, 4, n );
+    put_data( w, str, n );
+  }
+  else if( is_symbol( x ) ) {
+    str = symname( x );
+    n = strlen( str );
+    put_bytes( w, 1, t_tcm_rpc_symbol );
+    put_bytes( w, 2, n );
+    put_data( w, str, n );
+  }
+  else if( is_character( x ) ) {
+    put_bytes( w, 1, t_tcm_rpc_char );
+    put_bytes( w, 1, charvalue( x ) );
+  }
+  else if( is_vector( x ) ) {
+    n = vector_length( x );
+    put_bytes( w, 1, t_tcm_rpc_vector );
+    put_bytes( w, 4, n );
+    for( i = 0; i < n && ! w->overflow; ++i ) {
+      if( encode_value( sc, w, vector_elem( x, i ), depth + 1 ) )
+        return -1;
+    }
+  }
+  else if( is_pair( x ) ) {
+    n = list_length( sc, x );
+    if( n < 0 )
+      return -1; /* improper or circular list */
+    put_bytes( w, 1, t_tcm_rpc_list );
+    put_bytes( w, 4, n );
+    for( l = x; l != sc->NIL && ! w->overflow; l = pair_cdr( l ) ) {
+      if( encode_value( sc, w, pair_car( l ), depth + 1 ) )
+        return -1;
+    }
+  }
+  else {
+    return -1;
+  }
+
+  return( w->overflow ? -1 : 0 );
+}
+
+
+static void start_response( t_rpc_writer* w, uint32_t req_id, int error )
+{
+  w->len = 0;
+  w->overflow = 0;
+  put_bytes( w, 4, 0 ); /* length, set by finish_response() */
+  put_bytes( w, 4, req_id );
+  put_bytes( w, 4, (uint32_t) error );
+}
+
+static void finish_response( t_rpc_writer* w )
+{
+  int len = w->len - 4;
+
+  w->buf[0] = (char)( len >> 24 );
+  w->buf[1] = (char)( len >> 16 );
+  w->buf[2] = (char)( len >> 8 );
+  w->buf[3] = (char)( len );
+}
+
+static void error_response( t_rpc_writer* w, uint32_t req_id, int error, const char* msg )
+{
+  int n = strlen( msg );
+
+  start_response( w, req_id, error );
+  put_bytes( w, 1, t_tcm_rpc_string );
+  put_bytes( w, 4, n );
+  put_data( w, msg, n );
+  finish_response( w );
+}
+
+
+/*
+ * evaluate one request frame and write the response
+ */
+static void process_frame( t_tcm_rpc* p, const char* p_frame, int len, t_rpc_writer* w )
+{
+  t_tcm_scheme* p_scheme = p->p_tcm_server_ctx->p_scheme;
+  scheme* sc = (scheme *) p_scheme;
+  t_rpc_reader r = { (const unsigned char *) p_frame, len, 0 };
+  t_rpc_reader r_count;
+  uint64_t req_id = 0, name_len, argc, i;
+  int nr_values = 0, n, idx = 0;
+  char name[256];
+  pointer proc, v, args, tail, result;
+
+  if( get_bytes( & r, 4, & req_id ) || get_bytes( & r, 1, & name_len ) ||
+      r.pos + name_len > len || name_len == 0 )
+  {
+    error_response( w, req_id, t_tcm_rpc_err_frame, "malformed request" );
+    return;
+  }
+
+  memcpy( name, p_frame + r.pos, name_len );
+  name[name_len] = '\0';
+  r.pos += name_len;
+
+  /* validate arguments before touching the interpreter */
+  if( get_bytes( & r, 2, & argc ) ) {
+    error_response( w, req_id, t_tcm_rpc_err_frame, "malformed request" );
+    return;
+  }
+  r_count = r;
+  for( i = 0; i < argc; ++i ) {
+    if( ( n = count_values( & r_count, 0 ) ) < 0 ) {
+      error_response( w, req_id, t_tcm_rpc_err_frame, "malformed argument" );
+      return;
+    }
+    nr_values += n;
+  }
+
+  tcm_scheme_lock( p_scheme, "rpc", name );
+
+  proc = tcm_scheme_lookup_locked( p_scheme, name );
+  if( proc == NULL ) {
+    error_response( w, req_id, t_tcm_rpc_err_unknown_proc, "unknown procedure" );
+  }
+  else {
+    set_car( p->p_root, proc );
+
+    v = nr_values ? mk_vector( sc, nr_values ) : sc->NIL;
+    set_cdr( p->p_root, v );
+
+    args = tail = sc->NIL;
+    for( i = 0; i < argc; ++i ) {
+      pointer cell = decode_value( sc, & r, v, & idx );
+      if( cell == NULL )
+        break;
+      cell = cons( sc, cell, sc->NIL );
+      if( tail == sc->NIL ) {
+        args = cell;
+        set_car( p->p_root, cons( sc, proc, args ) ); /* keep args reachable */
+      } else {
+        set_cdr( tail, cell );
+      }
+      tail = cell;
+    }
+
+    if( i < argc ) {
+      error_response( w, req_id, t_tcm_rpc_err_frame, "malformed argument" );
+    }
+    else if( tcm_scheme_call_locked( p_scheme, proc, args, & result ) ) {
+      error_response( w, req_id, t_tcm_rpc_err_eval, "evaluation error" );
+    } else {
+      start_response( w, req_id, t_tcm_rpc_ok );
+      if( encode_value( sc, w, result, 0 ) ) {
+        error_response( w, req_id, t_tcm_rpc_err_result, "result can't be encoded" );
+      } else {
+        finish_response( w );
+      }
+    }
+
+    set_car( p->p_root, sc->NIL );
+    set_cdr( p->p_root, sc->NIL );
+  }
+
+  tcm_scheme_unlock( p_scheme );
+}
+
+
+static void rx_data( t_tcm_rpc* p, t_tcm_rpc_conn* p_conn, const char* p_data, int len )
+{
+  t_server_sock_channel* p_channel = p->p_channel;
+  t_rpc_writer* w;
+  char* p_buf;
+  int frame_len, pos = 0;
+
+  if( p_conn->len + len > p_conn->size ) {
+    p_buf = cul_malloc( p_conn->len + len );
+    if( p_buf == NULL ) {
+      tcm_error( "%s: out of memory error!\n", __func__ );
+      close_server_sock_channel_conn( p_channel, p_conn->id );
+      return;
+    }
+    memcpy( p_buf, p_conn->p_buf, p_conn->len );
+    if( p_conn->p_buf )
+      cul_free( p_conn->p_buf );
+    p_conn->p_buf = p_buf;
+    p_conn->size = p_conn->len + len;
+  }
+
+  memcpy( p_conn->p_buf + p_conn->len, p_data, len );
+  p_conn->len += len;
+
+  w = cul_malloc( sizeof( t_rpc_writer ) );
+  if( w == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return;
+  }
+
+  /* process all complete frames, requests may be pipelined */
+  while( p_conn->len - pos >= 4 )
+  {
+    frame_len = ( (unsigned char)p_conn->p_buf[pos] << 24 ) | ( (unsigned char)p_conn->p_buf[pos+1] << 16 ) |
+      ( (unsigned char)p_conn->p_buf[pos+2] << 8 ) | (unsigned char)p_conn->p_buf[pos+3];
+
+    if( frame_len < 0 || frame_len > TCM_RPC_MAX_FRAME_SIZE ) {
+      tcm_error( "%s: frame size %d exceeds limit, close connection %ld\n", __func__, frame_len, p_conn->id );
+      error_response( w, 0, t_tcm_rpc_err_frame, "frame too large" );
+      write_server_sock_channel_to( p_channel, p_conn->id, w->buf, w->len );
+      close_server_sock_channel_conn( p_channel, p_conn->id );
+      pos = p_conn->len;
+      break;
+    }
+
+    if( p_conn->len - pos - 4 < frame_len )
+      break; /* incomplete */
+
+    process_frame( p, p_conn->p_buf + pos + 4, frame_len, w );
+    write_server_sock_channel_to( p_channel, p_conn->id, w->buf, w->len );
+    pos += 4 + frame_len;
+  }
+
+  memmove( p_conn->p_buf, p_conn->p_buf + pos, p_conn->len - pos );
+  p_conn->len -= pos;
+
+  cul_free( w );
+}
+
+
+static void release_conn( t_tcm_rpc_conn* p_conn )
+{
+  if( p_conn->p_buf )
+    cul_free( p_conn->p_buf );
+
+  memset( p_conn, 0, sizeof( t_tcm_rpc_conn ) );
+}
+
+
+static int rpc_evt_cb( t_icom_evt* p_evt )
+{
+  t_base_channel* p_base = (t_base_channel *)p_evt->p_user_ctx;
+  t_tcm_rpc* p = (t_tcm_rpc *)p_base->p_user_data;
+  long conn_id = server_sock_channel_evt_conn_id( p_evt );
+  int idx = server_sock_channel_conn_index( conn_id );
+  t_tcm_rpc_conn* p_conn;
+
+  base_channel_dispatched( p_base );
+
+  if( p == NULL || idx >= p->nr_conns )
+    return 0; /* endpoint not yet fully set up */
+
+  p_conn = & p->conns[ idx ];
+
+  if( p_evt->type == ICOM_EVT_SERVER_CON ) {
+    release_conn( p_conn );
+    p_conn->id = conn_id;
+  }
+  else if( p_evt->type == ICOM_EVT_SERVER_DIS ) {
+    release_conn( p_conn );
+  }
+  else if( p_evt->type == ICOM_EVT_SERVER_DATA && p_conn->id == conn_id ) {
+    rx_data( p, p_conn, p_evt->p_data, p_evt->data_len );
+  }
+
+  return 0;
+}
+
+
+void tcm_release_rpc( t_tcm_rpc* p )
+{
+  int i;
+
+  if( p ) {
+    if( p->p_channel )
+      ((t_base_channel *)p->p_channel)->release( (t_base_channel *)p->p_channel );
+
+    if( p->conns ) {
+      for( i = 0; i < p->nr_conns; ++i )
+        release_conn( & p->conns[i] );
+      cul_free( p->conns );
+    }
+
+    cul_free( p );
+  }
+}
+
+
+t_tcm_rpc* tcm_init_rpc( t_tcm_server_ctx* p_tcm_server_ctx, const char* path )
+{
+  t_tcm_scheme* p_scheme = p_tcm_server_ctx->p_scheme;
+  scheme* sc = (scheme *) p_scheme;
+  t_tcm_rpc* p;
+  pointer root_symbol;
+
+  p = cul_malloc( sizeof( t_tcm_rpc ) );
+  if( p == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+
+  memset( p, 0, sizeof( t_tcm_rpc ) );
+  p->p_tcm_server_ctx = p_tcm_server_ctx;
+
+  /* gc root is created once and bound to a global symbol */
+  pthread_mutex_lock( & p_scheme->mutex );
+  root_symbol = mk_symbol( sc, "*tcm-rpc-root*" );
+  p->p_root = cons( sc, sc->NIL, sc->NIL );
+  scheme_define( sc, sc->global_env, root_symbol, p->p_root );
+  pthread_mutex_unlock( & p_scheme->mutex );
+
+  /* receive state must exist before the first connection is accepted */
+  p->nr_conns = g_tcm_server_sock_max_connections;
+  p->conns = cul_malloc( p->nr_conns * sizeof( t_tcm_rpc_conn ) );
+  if( p->conns == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    tcm_release_rpc( p );
+    return NULL;
+  }
+  memset( p->conns, 0, p->nr_conns * sizeof( t_tcm_rpc_conn ) );
+
+  p->p_channel = init_server_sock_channel( p_tcm_server_ctx, path, 0, rpc_evt_cb );
+  if( p->p_channel == NULL ) {
+    tcm_error( "%s: could not create rpc server socket %s error!\n", __func__, path );
+    tcm_release_rpc( p );
+    return NULL;
+  }
+  ((t_base_channel *)p->p_channel)->p_user_data = p;
+
+  return p;
+}
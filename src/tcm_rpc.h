@@ -0,0 +1,148 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_RPC_H
+#define TCM_RPC_H
+
+#include <server_sock_channel.h>
+#include <tcm_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_rpc.h
+    \brief framed remote procedure call endpoint for machine clients
+
+    The endpoint listens on a  unix domain socket and invokes globally defined
+    scheme procedures on behalf of its clients. In contrast to the text REPL no
+    greeting, prompt or output is generated and arguments and results are never
+    printed or parsed as text.
+
+    All integers are transferred in network byte order. Each request and each
+    response is preceded by its length:
+
+    \verbatim
+    frame    := length:u32 payload
+    request  := request-id:u32 name-len:u8 name argc:u16 value*
+    response := request-id:u32 error:i32 value
+
+    value    := 0x00                       empty list
+              | 0x01 | 0x02                #f respectively #t
+              | 0x03 i64                   integer
+              | 0x04 f64                   real as IEEE 754 bit pattern
+              | 0x05 len:u32 byte*         string
+              | 0x06 len:u16 byte*         symbol
+              | 0x07 count:u32 value*      list
+              | 0x08 count:u32 value*      vector
+              | 0x09 u8                    character
+    \endverbatim
+
+    A client may send any number of requests without waiting for the responses
+    (pipelining). Responses are sent in the order of the requests. In case of an
+    error the value of the response is a string describing the error.
+
+    \addtogroup scheme
+    @{
+ */
+
+#define TCM_RPC_MAX_FRAME_SIZE     65536                /*!< maximum payload size of requests and responses */
+#define TCM_RPC_MAX_DEPTH          32                   /*!< maximum nesting level of lists and vectors */
+
+/*! rpc value type tags */
+typedef enum {
+  t_tcm_rpc_nil = 0,                                    /*!< empty list */
+  t_tcm_rpc_false = 1,                                  /*!< boolean false */
+  t_tcm_rpc_true = 2,                                   /*!< boolean true */
+  t_tcm_rpc_integer = 3,                                /*!< 64 bit integer */
+  t_tcm_rpc_real = 4,                                   /*!< double precision real */
+  t_tcm_rpc_string = 5,                                 /*!< string */
+  t_tcm_rpc_symbol = 6,                                 /*!< symbol */
+  t_tcm_rpc_list = 7,                                   /*!< proper list */
+  t_tcm_rpc_vector = 8,                                 /*!< vector */
+  t_tcm_rpc_char = 9                                    /*!< character */
+} t_tcm_rpc_type;
+
+/*! rpc response error codes */
+typedef enum {
+  t_tcm_rpc_ok = 0,                                     /*!< success, value holds result */
+  t_tcm_rpc_err_frame = -1,                             /*!< malformed request frame */
+  t_tcm_rpc_err_unknown_proc = -2,                      /*!< procedure not defined */
+  t_tcm_rpc_err_eval = -3,                              /*!< evaluation error */
+  t_tcm_rpc_err_result = -4                             /*!< result can't be encoded */
+} t_tcm_rpc_error;
+
+
+/*!
+ * per connection receive state
+ */
+typedef struct s_tcm_rpc_conn {
+  long                          id;                     /*!< connection identifier, 0 when unused */
+  char*                         p_buf;                  /*!< reassembly buffer */
+  int                           len;                    /*!< number of received bytes in buffer */
+  int                           size;                   /*!< allocated size of buffer */
+} t_tcm_rpc_conn;
+
+
+/*!
+ * rpc endpoint object
+ */
+typedef struct s_tcm_rpc {
+  t_tcm_server_ctx*             p_tcm_server_ctx;       /*!< back reference to server context */
+  t_server_sock_channel*        p_channel;              /*!< server socket channel for transport */
+  t_tcm_rpc_conn*               conns;                  /*!< receive state indexed by connection table index */
+  int                           nr_conns;               /*!< size of receive state table */
+  pointer                       p_root;                 /*!< pair rooting decoded arguments against gc */
+} t_tcm_rpc;
+
+
+/*!
+ * create rpc endpoint
+ *
+ * \param p_tcm_server_ctx pointer to main instance object, scheme interpreter must be initialized
+ * \param path file name of unix domain socket to listen at
+ * \return pointer to endpoint object or NULL in case of error
+ */
+t_tcm_rpc* tcm_init_rpc( t_tcm_server_ctx* p_tcm_server_ctx, const char* path );
+
+
+/*!
+ * release rpc endpoint
+ *
+ * \param p pointer to endpoint object to be released
+ */
+void tcm_release_rpc( t_tcm_rpc* p );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_RPC_H */
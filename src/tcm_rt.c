@@ -0,0 +1,286 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <malloc.h>
+#include <sys/mman.h>
+
+#include <tcm_rt.h>
+#include <tcm_config.h>
+#include <tcm_log.h>
+
+
+/*! thread names of channel classes, indexed by t_channel_type */
+static const char* rt_thread_names[TCM_RT_NR_CLASSES] = {
+  "tcm-dev",
+  "tcm-client-sock",
+  "tcm-server-sock"
+};
+
+/*! parsed cpu sets of channel classes */
+static cpu_set_t rt_cpus[TCM_RT_NR_CLASSES];
+static int rt_has_cpus[TCM_RT_NR_CLASSES];
+
+
+/*
+ * parse cpu list like "0,2-3" into cpu set
+ * returns number of cpus or -1 in case of a syntax error
+ */
+static int parse_cpu_list( const char* s, cpu_set_t* p_set )
+{
+  char* end;
+  long from, to, cpu;
+  int n = 0;
+
+  CPU_ZERO( p_set );
+
+  while( *s ) {
+    from = strtol( s, & end, 10 );
+    if( end == s || from < 0 || from >= CPU_SETSIZE )
+      return -1;
+    to = from;
+    s = end;
+    if( *s == '-' ) {
+      ++s;
+      to = strtol( s, & end, 10 );
+      if( end == s || to < from || to >= CPU_SETSIZE )
+        return -1;
+      s = end;
+    }
+    for( cpu = from; cpu <= to; ++cpu, ++n )
+      CPU_SET( cpu, p_set );
+    if( *s == ',' )
+      ++s;
+    else if( *s )
+      return -1;
+  }
+
+  return n;
+}
+
+
+/*
+ * touch stack pages in advance to avoid page faults later on
+ */
+static void prefault_stack( void )
+{
+  volatile char buf[64 * 1024];
+  int i;
+
+  for( i = 0; i < sizeof( buf ); i += 4096 )
+    buf[i] = 0;
+}
+
+
+int tcm_rt_init( void )
+{
+  pthread_attr_t attr;
+  int i, errors = 0;
+
+  for( i = 0; i < TCM_RT_NR_CLASSES; ++i ) {
+    rt_has_cpus[i] = 0;
+    if( g_tcm_rt_cpus[i][0] ) {
+      if( parse_cpu_list( g_tcm_rt_cpus[i], & rt_cpus[i] ) > 0 ) {
+        rt_has_cpus[i] = 1;
+      } else {
+        tcm_error( "%s: invalid cpu list %s for %s threads error!\n", __func__, g_tcm_rt_cpus[i], rt_thread_names[i] );
+        errors = -1;
+      }
+    }
+  }
+
+  if( ! g_tcm_rt_mlock )
+    return errors;
+
+  /*
+   * Memory released by free() shall never be given back to the system,
+   * otherwise it would be faulted in again on next allocation.
+   */
+  mallopt( M_TRIM_THRESHOLD, -1 );
+  mallopt( M_MMAP_MAX, 0 );
+
+  /* each thread stack is locked entirely, use moderate default size */
+  if( g_tcm_rt_stack_size ) {
+    pthread_attr_init( & attr );
+    if( pthread_attr_setstacksize( & attr, g_tcm_rt_stack_size ) ||
+        pthread_setattr_default_np( & attr ) )
+      tcm_error( "%s: could not set default thread stack size to %d\n", __func__, g_tcm_rt_stack_size );
+    pthread_attr_destroy( & attr );
+  }
+
+  /*
+   * MCL_FUTURE populates all mappings created later on such as event pools,
+   * the scheme cell segments and thread stacks when they are allocated.
+   */
+  if( mlockall( MCL_CURRENT | MCL_FUTURE ) ) {
+    tcm_error( "%s: could not lock memory (%s) error!\n", __func__, strerror( errno ) );
+    return -1;
+  }
+
+  prefault_stack();
+  tcm_message( "%s: memory locked\n", __func__ );
+
+  return errors;
+}
+
+
+void tcm_rt_begin_spawn( t_channel_type type, t_tcm_rt_saved* p_saved )
+{
+  pthread_t self = pthread_self();
+  struct sched_param param;
+  int prio = g_tcm_rt_priority[type];
+
+  memset( p_saved, 0, sizeof( t_tcm_rt_saved ) );
+
+  if( ! prio && ! rt_has_cpus[type] )
+    return;
+
+  if( pthread_getschedparam( self, & p_saved->policy, & p_saved->param ) ||
+      pthread_getaffinity_np( self, sizeof( p_saved->cpus ), & p_saved->cpus ) )
+    return;
+
+  pthread_getname_np( self, p_saved->name, sizeof( p_saved->name ) );
+  p_saved->active = 1;
+
+  pthread_setname_np( self, rt_thread_names[type] );
+
+  if( prio ) {
+    param.sched_priority = prio;
+    if( pthread_setschedparam( self, g_tcm_rt_policy, & param ) )
+      tcm_error( "%s: could not set real-time priority %d for %s threads\n", __func__, prio, rt_thread_names[type] );
+  }
+
+  if( rt_has_cpus[type] ) {
+    if( pthread_setaffinity_np( self, sizeof( rt_cpus[type] ), & rt_cpus[type] ) )
+      tcm_error( "%s: could not set cpu affinity %s for %s threads\n", __func__, g_tcm_rt_cpus[type], rt_thread_names[type] );
+  }
+}
+
+
+void tcm_rt_end_spawn( const t_tcm_rt_saved* p_saved )
+{
+  pthread_t self = pthread_self();
+
+  if( ! p_saved->active )
+    return;
+
+  pthread_setschedparam( self, p_saved->policy, & p_saved->param );
+  pthread_setaffinity_np( self, sizeof( p_saved->cpus ), & p_saved->cpus );
+  pthread_setname_np( self, p_saved->name );
+}
+
+
+/*
+ * read statistics of given thread from procfs
+ * returns 0 in case of success
+ */
+static int read_thread_stats( int tid, t_tcm_rt_thread_stats* p )
+{
+  char path[64], line[512];
+  char *p_name, *p_fields;
+  unsigned long minflt, majflt;
+  long prio;
+  unsigned int policy;
+  FILE* fp;
+  int n;
+
+  memset( p, 0, sizeof( t_tcm_rt_thread_stats ) );
+  p->tid = tid;
+
+  snprintf( path, sizeof( path ), "/proc/self/task/%d/stat", tid );
+  fp = fopen( path, "r" );
+  if( fp == NULL )
+    return -1;
+  n = fread( line, 1, sizeof( line ) - 1, fp );
+  fclose( fp );
+  line[n > 0 ? n : 0] = '\0';
+
+  /* thread name is enclosed in parenthesis and may contain spaces */
+  p_name = strchr( line, '(' );
+  p_fields = strrchr( line, ')' );
+  if( p_name == NULL || p_fields == NULL )
+    return -1;
+  n = p_fields - p_name - 1;
+  if( n >= sizeof( p->name ) )
+    n = sizeof( p->name ) - 1;
+  memcpy( p->name, p_name + 1, n );
+
+  /* fields 10 (minflt), 12 (majflt), 40 (rt_priority) and 41 (policy), refer to proc(5) */
+  if( sscanf( p_fields + 2,
+              "%*c %*d %*d %*d %*d %*d %*u %lu %*u %lu %*u %*u %*u %*d %*d %*d %*d %*d %*d %*u %*u %*d "
+              "%*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %*d %ld %u",
+              & minflt, & majflt, & prio, & policy ) != 4 )
+    return -1;
+
+  p->minflt = minflt;
+  p->majflt = majflt;
+  p->priority = prio;
+  p->policy = policy;
+
+  snprintf( path, sizeof( path ), "/proc/self/task/%d/status", tid );
+  fp = fopen( path, "r" );
+  if( fp == NULL )
+    return -1;
+  while( fgets( line, sizeof( line ), fp ) ) {
+    if( sscanf( line, "voluntary_ctxt_switches: %lu", & p->voluntary_switches ) == 1 )
+      continue;
+    sscanf( line, "nonvoluntary_ctxt_switches: %lu", & p->involuntary_switches );
+  }
+  fclose( fp );
+
+  return 0;
+}
+
+
+int tcm_rt_thread_stats( t_tcm_rt_thread_stats* p_stats, int max )
+{
+  DIR* dir;
+  struct dirent* p_ent;
+  int tid, n = 0;
+
+  dir = opendir( "/proc/self/task" );
+  if( dir == NULL ) {
+    tcm_error( "%s: could not open /proc/self/task error!\n", __func__ );
+    return -1;
+  }
+
+  while( n < max && ( p_ent = readdir( dir ) ) != NULL ) {
+    tid = atoi( p_ent->d_name );
+    if( tid > 0 && ! read_thread_stats( tid, & p_stats[n] ) )
+      ++n;
+  }
+
+  closedir( dir );
+  return n;
+}
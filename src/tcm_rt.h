@@ -0,0 +1,134 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_RT_H
+#define TCM_RT_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <base_channel.h>
+#include <tcm_config.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_rt.h
+    \brief real-time mode: memory locking, scheduling policy and cpu affinity
+
+    When enabled within the configuration file, all memory of the daemon is
+    locked and all threads of a channel class,  namely the channel's reader and
+    the dispatcher invoking the scheme callback, run with a real-time scheduling
+    policy and priority on the configured cpus.
+
+    Threads are mostly created by libintercom. They are covered by applying the
+    settings of the class temporarily to the thread which creates the channel.
+    Newly created threads inherit the scheduling policy, the cpu affinity and
+    the thread name of their creator.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_RT_MAX_THREADS         128                  /*!< maximum number of threads reported */
+
+
+/*!
+ * scheduling state of the creating thread saved by tcm_rt_begin_spawn()
+ */
+typedef struct s_tcm_rt_saved {
+  int                           active;                 /*!< 1 when state has been changed */
+  int                           policy;                 /*!< previous scheduling policy */
+  struct sched_param            param;                  /*!< previous scheduling parameters */
+  cpu_set_t                     cpus;                   /*!< previous cpu affinity */
+  char                          name[16];               /*!< previous thread name */
+} t_tcm_rt_saved;
+
+
+/*!
+ * per thread statistics
+ */
+typedef struct s_tcm_rt_thread_stats {
+  int                           tid;                    /*!< kernel thread identifier */
+  char                          name[16];               /*!< thread name */
+  int                           policy;                 /*!< scheduling policy */
+  int                           priority;               /*!< real-time priority, 0 for SCHED_OTHER */
+  unsigned long                 minflt;                 /*!< minor page faults */
+  unsigned long                 majflt;                 /*!< major page faults */
+  unsigned long                 voluntary_switches;     /*!< voluntary context switches */
+  unsigned long                 involuntary_switches;   /*!< involuntary context switches */
+} t_tcm_rt_thread_stats;
+
+
+/*!
+ * lock memory and set up allocator when real-time mode is configured
+ *
+ * Shall be invoked after tcm_init_config() but before any channel and the
+ * scheme interpreter have been created.
+ *
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_rt_init( void );
+
+
+/*!
+ * apply real-time settings of channel class to the calling thread
+ *
+ * Threads created until tcm_rt_end_spawn() is called inherit the settings.
+ *
+ * \param type channel class
+ * \param p_saved pointer where the previous settings are stored
+ */
+void tcm_rt_begin_spawn( t_channel_type type, t_tcm_rt_saved* p_saved );
+
+
+/*!
+ * restore settings of the calling thread changed by tcm_rt_begin_spawn()
+ *
+ * \param p_saved pointer to previous settings
+ */
+void tcm_rt_end_spawn( const t_tcm_rt_saved* p_saved );
+
+
+/*!
+ * retrieve page fault and context switch statistics of all threads
+ *
+ * \param p_stats array where statistics are written to
+ * \param max maximum number of array elements
+ * \return number of threads written or negative error code
+ */
+int tcm_rt_thread_stats( t_tcm_rt_thread_stats* p_stats, int max );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_RT_H */
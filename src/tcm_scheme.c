@@ -39,8 +39,15 @@
 #include <tinyscheme/dynload.h>
 #include <tcm_scheme.h>
 #include <tcm_scheme_ext.h>
+#include <tcm_scheme_api.h>
+#include <tcm_rpc.h>
+#include <tcm_profile.h>
+#include <tcm_image.h>
 #include <tcm_config.h>
+#include <tcm_rt.h>
 #include <tcm_log.h>
+#include <tcm_boot.h>
+#include <tcm_watchdog.h>
 #include <fmemopen.h>
 
 #define PORT       "37147" /* Port to listen on */
@@ -102,24 +109,17 @@ static pointer func1(scheme *sc, pointer args)
 }
 
 
-static int read_init_file( scheme* sc, const char* filename )
-{
-  FILE* fp;
+static const char* init_file_locations[] = { INIT_FILE1, INIT_FILE2, INIT_FILE3, NULL };
+static const char* tcm_init_file_locations[] = { TCM_INIT_FILE1, TCM_INIT_FILE2, TCM_INIT_FILE3, NULL };
 
-  fp = fopen( filename, "r" );
-  if( fp != NULL )
-  {
-    tcm_message( "initialized scheme with init file %s\n", filename );
-
-    scheme_load_named_file( sc, fp, filename );
-    if( sc->retcode!=0 ) {
-      tcm_message( "Errors encountered reading %s\n", filename );
-    }
-    fclose( fp );
-    return sc->retcode;
+static const char* find_init_file( const char** locations )
+{
+  for( ; *locations; ++locations ) {
+    if( access( *locations, R_OK ) == 0 )
+      return *locations;
   }
-  else
-    return -1;
+
+  return NULL;
 }
 
 
@@ -134,16 +134,48 @@ static void init_ff( scheme* sc )
 void tcm_release_scheme( t_tcm_scheme* p )
 {
   if( p ) {
+    if( p->p_rpc )
+      tcm_release_rpc( p->p_rpc );
+
     if( p->p_repl_server )
       icom_kill_server_handlers( p->p_repl_server );
 
+    /* no sample is taken while the mutex is held without tcm_scheme_lock() */
+    pthread_mutex_lock( & p->mutex );
+    tcm_profile_release();
+    pthread_mutex_unlock( & p->mutex );
+
     scheme_deinit( & p->sc );
+    tcm_scheme_release_api( p );
+    tcm_watchdog_release( p->p_watchdog );
     pthread_mutex_destroy( &p->mutex );
     cul_free( p );
   }
 }
 
 
+void tcm_scheme_lock( t_tcm_scheme* p, const char* owner, const char* handler )
+{
+  pthread_mutex_lock( & p->mutex );
+  p->holder = pthread_self();
+  __atomic_store_n( & p->holding, 1, __ATOMIC_RELEASE );
+  tcm_watchdog_enter( p->p_watchdog, owner, handler );
+}
+
+
+void tcm_scheme_unlock( t_tcm_scheme* p )
+{
+  /* heap snapshot for readers which must not take the mutex */
+  __atomic_store_n( & p->free_cells, p->sc.fcells, __ATOMIC_RELAXED );
+  __atomic_store_n( & p->nr_cell_segments, p->sc.last_cell_seg + 1, __ATOMIC_RELAXED );
+  __atomic_add_fetch( & p->nr_evaluations, 1, __ATOMIC_RELAXED );
+
+  tcm_watchdog_leave( p->p_watchdog );
+  __atomic_store_n( & p->holding, 0, __ATOMIC_RELEASE );
+  pthread_mutex_unlock( & p->mutex );
+}
+
+
 static int icom_evt_socket( t_icom_evt* p_evt )
 {
   return ((struct s_sock_server *)(p_evt->p_source))->fd;
@@ -171,7 +203,7 @@ static int repl_evt_cb( t_icom_evt* p_evt )
     p_evt->p_data[p_evt->max_data_size - 1] = '\0'; /* enfore null termination */
     tcm_message( "received repl request: %s\n", p_evt->p_data );
 
-    pthread_mutex_lock( & p->mutex );
+    tcm_scheme_lock( p, "repl", "eval" );
     /* set standard input and output ports */
     socket = icom_evt_socket( p_evt );
     p->sc.interactive_repl=1;
@@ -185,7 +217,7 @@ static int repl_evt_cb( t_icom_evt* p_evt )
     p->sc.interactive_repl=0;
     fclose( fdout );
     fclose( fdin );
-    pthread_mutex_unlock( & p->mutex );
+    tcm_scheme_unlock( p );
   }
 
   if( errors ) {
@@ -204,7 +236,7 @@ int tcm_load_scheme_file( t_tcm_scheme* p, const char* filename )
   fp = fopen( filename, "r" );
 
   if( fp != NULL ) {
-    pthread_mutex_lock( & p->mutex );
+    tcm_scheme_lock( p, "load", filename );
 
     scheme_load_named_file( & p->sc, fp, filename );
     if( p->sc.retcode!=0 ) {
@@ -212,7 +244,7 @@ int tcm_load_scheme_file( t_tcm_scheme* p, const char* filename )
     }
     errors =  p->sc.retcode;
 
-    pthread_mutex_unlock( & p->mutex );
+    tcm_scheme_unlock( p );
 
     fclose( fp );
   }
@@ -231,7 +263,7 @@ int tcm_load_scheme_desc( t_tcm_scheme* p, FILE *fdin, FILE *fdout )
 
   tcm_message( "%s ... \n", __func__ );
 
-  pthread_mutex_lock( & p->mutex );
+  tcm_scheme_lock( p, "repl", "eval" );
   p->sc.interactive_repl=1;
   scheme_set_input_port_file( &p->sc, fdin );
   scheme_set_output_port_file( &p->sc, fdout );
@@ -239,7 +271,7 @@ int tcm_load_scheme_desc( t_tcm_scheme* p, FILE *fdin, FILE *fdout )
   errors = p->sc.retcode;
   fflush( fdout );
   p->sc.interactive_repl=0;
-  pthread_mutex_unlock( & p->mutex );
+  tcm_scheme_unlock( p );
 
   return errors;
 }
@@ -249,20 +281,20 @@ int tcm_load_scheme_string( t_tcm_scheme* p, char* string, t_tcm_scheme_ret_val*
 {
   int errors = 0;
   long scheme_errors;
-  FILE *fdin, *fdout;
+  FILE *fdin;
+  pointer saved_outport;
 
-  pthread_mutex_lock( & p->mutex );
+  tcm_scheme_lock( p, "load", "string" );
 
   p->sc.interactive_repl=0;
   fdin = fmemopen( string, strlen(string), "r" );
-  fdout = fopen( "/dev/null", "w" );
   scheme_set_input_port_file( &p->sc, fdin );
-  scheme_set_output_port_file( &p->sc, fdout );
+  saved_outport = p->sc.outport;
+  p->sc.outport = p->p_null_port;
   scheme_load_named_file( &p->sc, fdin, 0);
   errors = p->sc.retcode;
-  fflush( fdout );
+  p->sc.outport = saved_outport;
   p->sc.interactive_repl=0;
-  fclose( fdout );
   fclose( fdin );
 
   if( p->sc.value == p->sc.T )
@@ -304,7 +336,7 @@ int tcm_load_scheme_string( t_tcm_scheme* p, char* string, t_tcm_scheme_ret_val*
       p_ret->t = t_tcm_scheme_string;
     }
   } /* scheme function returns integer */
-  pthread_mutex_unlock( & p->mutex );
+  tcm_scheme_unlock( p );
 
   tcm_message("%s: -> return code: %d, return value: %ld\n", __func__, errors, scheme_errors );
 
@@ -315,16 +347,123 @@ int tcm_load_scheme_string( t_tcm_scheme* p, char* string, t_tcm_scheme_ret_val*
 }
 
 
-t_tcm_scheme* tcm_init_scheme( t_tcm_server_ctx* p_tcm_server_ctx )
+static void start_servers( t_tcm_scheme* p )
 {
-  t_tcm_scheme* p;
   t_icom_server_decl decl_table[1];
   const int decl_table_len = sizeof(decl_table) / sizeof( t_icom_server_decl );
+  t_tcm_rt_saved rt_saved;
 
   decl_table[0].addr.sock_family = AF_INET;
   strncpy( decl_table[0].addr.address, g_tcm_scheme_ip_address, sizeof(decl_table[0].addr.address) );
   decl_table[0].addr.port = g_tcm_scheme_ip_port;
-  decl_table[0].max_connections = 10;
+  decl_table[0].max_connections = g_tcm_scheme_max_connections;
+
+  if( g_tcm_scheme_ip_port ) {
+    /* the repl is served like any other server socket */
+    tcm_rt_begin_spawn( t_channel_server_sock_type, & rt_saved );
+    p->p_repl_server = icom_create_server_handlers( decl_table, decl_table_len, 4096, 10, repl_evt_cb, p );
+    tcm_rt_end_spawn( & rt_saved );
+    if( p->p_repl_server == NULL ) {
+      tcm_error( "%s: could not create repl server error!\n", __func__ );
+    } else {
+      tcm_message( "%s: repl listenting to address %d\n", __func__, g_tcm_scheme_ip_port );
+    }
+    tcm_boot_mark( "repl" );
+  }
+
+  if( strlen( g_tcm_scheme_rpc_socket ) ) {
+    p->p_rpc = tcm_init_rpc( p->p_tcm_server_ctx, g_tcm_scheme_rpc_socket );
+    if( p->p_rpc == NULL ) {
+      tcm_error( "%s: could not create rpc endpoint error!\n", __func__ );
+    } else {
+      tcm_message( "%s: rpc listening to socket %s\n", __func__, g_tcm_scheme_rpc_socket );
+    }
+    tcm_boot_mark( "rpc" );
+  }
+}
+
+
+/* starts the servers and evaluates the deferred thunks in registration order */
+static void run_deferred( t_tcm_scheme* p )
+{
+  pointer frame, x, result;
+  int nr_thunks = 0;
+
+  start_servers( p );
+
+  tcm_scheme_lock( p, "deferred-init", "thunks" );
+  frame = tcm_scheme_protect( p, p->p_deferred );
+  p->p_deferred = p->sc.NIL;
+  scheme_define( & p->sc, p->sc.global_env, mk_symbol( & p->sc, "*tcm-deferred-thunks*" ), p->sc.NIL );
+
+  for( x = pair_car( frame ); x != p->sc.NIL; x = pair_cdr( x ) ) {
+    if( tcm_scheme_call_locked( p, pair_car( x ), p->sc.NIL, & result ) )
+      tcm_error( "%s: evaluation of deferred thunk error!\n", __func__ );
+    ++nr_thunks;
+  }
+
+  tcm_scheme_unprotect( p );
+  tcm_scheme_unlock( p );
+
+  tcm_boot_mark( "deferred-init" );
+  tcm_message( "%s: %d deferred thunks evaluated\n", __func__, nr_thunks );
+}
+
+
+static void* deferred_handler( void* p_ctx )
+{
+  run_deferred( (t_tcm_scheme *)p_ctx );
+  return NULL;
+}
+
+
+/* claims the deferred initialization, returns 1 when the caller has to run it */
+static int claim_deferred( t_tcm_scheme* p )
+{
+  int expected = t_tcm_scheme_lazy_waiting;
+
+  return __atomic_compare_exchange_n( & p->lazy_state, & expected, t_tcm_scheme_lazy_started,
+                                      0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+}
+
+
+void tcm_scheme_channel_live( t_tcm_scheme* p )
+{
+  pthread_t thread;
+  pthread_attr_t attr;
+
+  if( ! claim_deferred( p ) )
+    return;
+
+  /* do not delay the channel's reader thread */
+  pthread_attr_init( & attr );
+  pthread_attr_setdetachstate( & attr, PTHREAD_CREATE_DETACHED );
+  if( pthread_create( & thread, & attr, deferred_handler, p ) ) {
+    tcm_error( "%s: could not create deferred initialization thread error!\n", __func__ );
+    run_deferred( p );
+  }
+  pthread_attr_destroy( & attr );
+}
+
+
+void tcm_scheme_lazy_timeout( t_tcm_scheme* p )
+{
+  if( tcm_boot_elapsed_ms() < 1000.0 * TCM_SCHEME_LAZY_INIT_TIMEOUT_S )
+    return;
+
+  if( claim_deferred( p ) ) {
+    tcm_message( "%s: no channel live within %d seconds, start deferred initialization\n",
+                 __func__, TCM_SCHEME_LAZY_INIT_TIMEOUT_S );
+    run_deferred( p );
+  }
+}
+
+
+t_tcm_scheme* tcm_init_scheme( t_tcm_server_ctx* p_tcm_server_ctx )
+{
+  t_tcm_scheme* p;
+  const char* init_files[2];
+  int nr_init_files = 0;
 
   p = cul_malloc( sizeof( t_tcm_scheme ) );
 
@@ -333,7 +472,7 @@ t_tcm_scheme* tcm_init_scheme( t_tcm_server_ctx* p_tcm_server_ctx )
     return NULL;
   }
 
-  memset( p, sizeof( t_tcm_scheme ), 0 );
+  memset( p, 0, sizeof( t_tcm_scheme ) );
   p->p_tcm_server_ctx = p_tcm_server_ctx;
 
   if( pthread_mutex_init( &p->mutex, 0 ) != 0 ) {
@@ -342,37 +481,61 @@ t_tcm_scheme* tcm_init_scheme( t_tcm_server_ctx* p_tcm_server_ctx )
     return NULL;
   }
 
+  /* evaluations are still possible without watchdog */
+  p->p_watchdog = tcm_watchdog_init( g_tcm_scheme_budget_ms, g_tcm_scheme_budget_abort );
+
   /* intialize the scheme object */
   if( !scheme_init(&p->sc) ) {
     tcm_error( "%s: could not initialize scheme interpreter!\n", __func__ );
+    tcm_watchdog_release( p->p_watchdog );
+    pthread_mutex_destroy( &p->mutex );
+    cul_free( p );
+    return NULL;
+  }
+
+  if( tcm_scheme_init_api( p ) ) {
+    tcm_error( "%s: could not initialize typed interface!\n", __func__ );
+    scheme_deinit( &p->sc );
+    tcm_watchdog_release( p->p_watchdog );
     pthread_mutex_destroy( &p->mutex );
     cul_free( p );
     return NULL;
   }
 
+  /* deferred thunks are kept reachable by the garbage collector through this binding */
+  p->p_deferred = p->sc.NIL;
+  scheme_define( & p->sc, p->sc.global_env, mk_symbol( & p->sc, "*tcm-deferred-thunks*" ), p->sc.NIL );
+
   /* initialize tcm specific add on functions */
   init_ff( &p->sc );
   init_tcm_ff( &p->sc );
+  tcm_boot_mark( "scheme-init" );
 
-  /* read scheme initialization file, try various locations */
-  if( read_init_file( &p->sc, INIT_FILE1 ) )
-    if( read_init_file( &p->sc, INIT_FILE2 ) )
-      if( read_init_file( &p->sc, INIT_FILE3 ) )
-        tcm_message( "%s: no init file read!\n", __func__ );
-
-  /* read tcm scheme function initialization file */
-  if( read_init_file( &p->sc, TCM_INIT_FILE1 ) )
-    if( read_init_file( &p->sc, TCM_INIT_FILE2 ) )
-      if( read_init_file( &p->sc, TCM_INIT_FILE3 ) )
-        tcm_message( "%s: no tcm init file read!\n", __func__ );
+  /* scheme initialization file and tcm scheme function initialization file, try various locations */
+  if( ( init_files[nr_init_files] = find_init_file( init_file_locations ) ) != NULL )
+    ++nr_init_files;
+  else
+    tcm_message( "%s: no init file read!\n", __func__ );
 
-  if( g_tcm_scheme_ip_port ) {
-    p->p_repl_server = icom_create_server_handlers( decl_table, decl_table_len, 4096, 10, repl_evt_cb, p );
-    if( p->p_repl_server == NULL ) {
-      tcm_error( "%s: could not create repl server error!\n", __func__ );
-    } else {
-      tcm_message( "%s: repl listenting to address %d\n", __func__, g_tcm_scheme_ip_port );
-    }
+  if( ( init_files[nr_init_files] = find_init_file( tcm_init_file_locations ) ) != NULL )
+    ++nr_init_files;
+  else
+    tcm_message( "%s: no tcm init file read!\n", __func__ );
+
+  /* channels opened by the init files may go live and notify us while still loading */
+  p_tcm_server_ctx->p_scheme = p;
+  if( g_tcm_scheme_lazy_init )
+    __atomic_store_n( & p->lazy_state, t_tcm_scheme_lazy_loading, __ATOMIC_RELEASE );
+
+  /* evaluate from image when up to date, otherwise from source */
+  tcm_image_load_files( p, g_tcm_scheme_image_file, init_files, nr_init_files );
+
+  if( ! g_tcm_scheme_lazy_init ) {
+    start_servers( p );
+  } else {
+    __atomic_store_n( & p->lazy_state, t_tcm_scheme_lazy_waiting, __ATOMIC_SEQ_CST );
+    if( tcm_boot_channel_is_live() && claim_deferred( p ) )
+      run_deferred( p );
   }
 
   return p;
@@ -45,11 +45,37 @@ extern "C" {
  */
 
 
+/*! seconds after which deferred initialization is started when no channel went live */
+#define TCM_SCHEME_LAZY_INIT_TIMEOUT_S     10
+
+
+/*! lazy initialization state */
+typedef enum {
+  t_tcm_scheme_lazy_none,                               /*!< lazy initialization disabled */
+  t_tcm_scheme_lazy_loading,                            /*!< init files are being evaluated */
+  t_tcm_scheme_lazy_waiting,                            /*!< waiting for first live channel */
+  t_tcm_scheme_lazy_started                             /*!< deferred initialization done or running */
+} t_tcm_scheme_lazy_state;
+
+
 /*! scheme interpreter state data */
 typedef struct s_tcm_scheme {
   scheme                      sc;                       /*!< scheme interpreter state */
   pthread_mutex_t             mutex;                    /*!< access protection to avoid scheme rc */
   t_icom_server_state*        p_repl_server;            /*!< repl server */
+  struct s_tcm_rpc*           p_rpc;                    /*!< framed rpc endpoint */
+  FILE*                       p_null_file;              /*!< /dev/null for discarded output */
+  pointer                     p_null_port;              /*!< scheme output port writing to p_null_file */
+  pointer                     p_api_root;               /*!< gc root of objects held by C code */
+  int                         lazy_state;               /*!< t_tcm_scheme_lazy_state, accessed atomically */
+  pointer                     p_deferred;               /*!< thunks deferred until first live channel */
+  pointer                     p_awaits;                 /*!< (on-reply . on-timeout) of write-channel-await indexed by slot */
+  struct s_tcm_watchdog*      p_watchdog;               /*!< execution budget watchdog */
+  long                        nr_evaluations;           /*!< evaluations via tcm_scheme_lock(), accessed atomically */
+  long                        free_cells;               /*!< free cells after last evaluation, accessed atomically */
+  long                        nr_cell_segments;         /*!< allocated cell segments after last evaluation, accessed atomically */
+  pthread_t                   holder;                   /*!< thread holding the mutex, valid when holding is set */
+  int                         holding;                  /*!< set to 1 while mutex is held via tcm_scheme_lock(), accessed atomically */
   t_tcm_server_ctx*           p_tcm_server_ctx;         /*!< back reference to server ctx */
 } t_tcm_scheme;
 
@@ -67,6 +93,48 @@ typedef struct s_tcm_scheme {
 t_tcm_scheme* tcm_init_scheme( t_tcm_server_ctx* p_tcm_server_ctx );
 
 
+/*!
+ * take the interpreter mutex for an evaluation
+ *
+ * The holder is registered at the execution budget watchdog.
+ *
+ * \param p pointer to the scheme object
+ * \param owner name of the channel or service, e.g. "repl"
+ * \param handler name of the evaluated handler
+ */
+void tcm_scheme_lock( t_tcm_scheme* p, const char* owner, const char* handler );
+
+
+/*!
+ * release the interpreter mutex taken by tcm_scheme_lock()
+ *
+ * \param p pointer to the scheme object
+ */
+void tcm_scheme_unlock( t_tcm_scheme* p );
+
+
+/*!
+ * notify the interpreter that the first channel is live
+ *
+ * When lazy initialization is enabled the repl, rpc endpoint and deferred
+ * scheme thunks are started within a separate thread.
+ *
+ * \param p pointer to the scheme object
+ */
+void tcm_scheme_channel_live( t_tcm_scheme* p );
+
+
+/*!
+ * start deferred initialization when no channel went live in time
+ *
+ * To be invoked periodically from the main loop, triggers deferred
+ * initialization after TCM_SCHEME_LAZY_INIT_TIMEOUT_S seconds.
+ *
+ * \param p pointer to the scheme object
+ */
+void tcm_scheme_lazy_timeout( t_tcm_scheme* p );
+
+
 /*!
  * release scheme interpreter instance
  *
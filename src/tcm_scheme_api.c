@@ -0,0 +1,508 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <olcutils/alloc.h>
+#include <tcm_scheme_api.h>
+#include <tcm_log.h>
+
+
+/* slots of the vector bound to *tcm-api-root* */
+#define API_ROOT_NULL_PORT         0                    /* output port writing to /dev/null */
+#define API_ROOT_HANDLES           1                    /* list of (procedure . name) handle cells */
+#define API_ROOT_STACK             2                    /* objects under construction */
+#define API_ROOT_SIZE              3
+
+
+pointer tcm_scheme_protect( t_tcm_scheme* p, pointer x )
+{
+  scheme* sc = & p->sc;
+  pointer frame = cons( sc, x, vector_elem( p->p_api_root, API_ROOT_STACK ) );
+
+  set_vector_elem( p->p_api_root, API_ROOT_STACK, frame );
+  return frame;
+}
+
+void tcm_scheme_unprotect( t_tcm_scheme* p )
+{
+  pointer stack = vector_elem( p->p_api_root, API_ROOT_STACK );
+
+  set_vector_elem( p->p_api_root, API_ROOT_STACK, pair_cdr( stack ) );
+}
+
+
+static pointer value_to_cell( t_tcm_scheme* p, const t_tcm_value* v, int depth )
+{
+  scheme* sc = & p->sc;
+  pointer x, frame;
+  char symbuf[256];
+  int i, n;
+
+  if( depth > TCM_SCHEME_API_MAX_DEPTH )
+    return NULL;
+
+  switch( v->t )
+  {
+  case t_tcm_value_nil:
+    return sc->NIL;
+  case t_tcm_value_bool:
+    return( v->v.bval ? sc->T : sc->F );
+  case t_tcm_value_integer:
+    return mk_integer( sc, v->v.ival );
+  case t_tcm_value_real:
+    return mk_real( sc, v->v.rval );
+  case t_tcm_value_char:
+    return mk_character( sc, v->v.cval );
+  case t_tcm_value_string:
+  case t_tcm_value_bytes:
+    return mk_counted_string( sc, v->v.str.p, v->v.str.len );
+  case t_tcm_value_symbol:
+    n = ( v->v.str.len < sizeof( symbuf ) ) ? v->v.str.len : sizeof( symbuf ) - 1;
+    memcpy( symbuf, v->v.str.p, n );
+    symbuf[n] = '\0';
+    return mk_symbol( sc, symbuf );
+  case t_tcm_value_list:
+    /* built from the end, the partial list is kept in the frame's car */
+    frame = tcm_scheme_protect( p, sc->NIL );
+    for( i = v->v.seq.len - 1; i >= 0; --i ) {
+      if( ( x = value_to_cell( p, & v->v.seq.p[i], depth + 1 ) ) == NULL )
+        break;
+      set_car( frame, cons( sc, x, pair_car( frame ) ) );
+    }
+    x = ( i < 0 ) ? pair_car( frame ) : NULL;
+    tcm_scheme_unprotect( p );
+    return x;
+  case t_tcm_value_vector:
+    frame = tcm_scheme_protect( p, mk_vector( sc, v->v.seq.len ) );
+    for( i = 0; i < v->v.seq.len; ++i ) {
+      if( ( x = value_to_cell( p, & v->v.seq.p[i], depth + 1 ) ) == NULL )
+        break;
+      set_vector_elem( pair_car( frame ), i, x );
+    }
+    x = ( i == v->v.seq.len ) ? pair_car( frame ) : NULL;
+    tcm_scheme_unprotect( p );
+    return x;
+  default:
+    return NULL;
+  }
+}
+
+pointer tcm_scheme_value_to_cell( t_tcm_scheme* p, const t_tcm_value* v )
+{
+  return value_to_cell( p, v, 0 );
+}
+
+
+/*
+ * determine number of values and string bytes required to represent x
+ * returns -1 when x can't be represented
+ */
+static int measure_cell( t_tcm_scheme* p, pointer x, int depth, int* p_nr_values, int* p_nr_bytes )
+{
+  scheme* sc = & p->sc;
+  pointer l;
+  long i, n;
+
+  if( depth > TCM_SCHEME_API_MAX_DEPTH )
+    return -1;
+
+  ++(*p_nr_values);
+
+  if( x == sc->NIL || x == sc->T || x == sc->F || is_number( x ) || is_character( x ) ) {
+    return 0;
+  }
+  else if( is_string( x ) ) {
+    *p_nr_bytes += strlength( x ) + 1;
+  }
+  else if( is_symbol( x ) ) {
+    *p_nr_bytes += strlen( symname( x ) ) + 1;
+  }
+  else if( is_vector( x ) ) {
+    n = vector_length( x );
+    for( i = 0; i < n; ++i ) {
+      if( measure_cell( p, vector_elem( x, i ), depth + 1, p_nr_values, p_nr_bytes ) )
+        return -1;
+    }
+  }
+  else if( is_pair( x ) ) {
+    if( list_length( sc, x ) < 0 )
+      return -1; /* improper or circular list */
+    for( l = x; l != sc->NIL; l = pair_cdr( l ) ) {
+      if( measure_cell( p, pair_car( l ), depth + 1, p_nr_values, p_nr_bytes ) )
+        return -1;
+    }
+  }
+  else {
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * fill previously measured value, elements of lists and vectors are stored
+ * consecutively at *pp_next, strings at *pp_bytes
+ */
+static void fill_value( t_tcm_scheme* p, pointer x, t_tcm_value* v, t_tcm_value** pp_next, char** pp_bytes )
+{
+  scheme* sc = & p->sc;
+  const char* str;
+  pointer l;
+  long i;
+
+  if( x == sc->NIL ) {
+    v->t = t_tcm_value_nil;
+  }
+  else if( x == sc->T || x == sc->F ) {
+    v->t = t_tcm_value_bool;
+    v->v.bval = ( x == sc->T );
+  }
+  else if( is_real( x ) ) {
+    v->t = t_tcm_value_real;
+    v->v.rval = rvalue( x );
+  }
+  else if( is_number( x ) ) {
+    v->t = t_tcm_value_integer;
+    v->v.ival = ivalue( x );
+  }
+  else if( is_character( x ) ) {
+    v->t = t_tcm_value_char;
+    v->v.cval = charvalue( x );
+  }
+  else if( is_string( x ) || is_symbol( x ) ) {
+    if( is_string( x ) ) {
+      str = string_value( x );
+      v->v.str.len = strlength( x );
+      v->t = memchr( str, '\0', v->v.str.len ) ? t_tcm_value_bytes : t_tcm_value_string;
+    } else {
+      str = symname( x );
+      v->v.str.len = strlen( str );
+      v->t = t_tcm_value_symbol;
+    }
+    v->v.str.p = *pp_bytes;
+    memcpy( *pp_bytes, str, v->v.str.len );
+    (*pp_bytes)[v->v.str.len] = '\0';
+    *pp_bytes += v->v.str.len + 1;
+  }
+  else if( is_vector( x ) ) {
+    v->t = t_tcm_value_vector;
+    v->v.seq.len = vector_length( x );
+    v->v.seq.p = *pp_next;
+    *pp_next += v->v.seq.len;
+    for( i = 0; i < v->v.seq.len; ++i )
+      fill_value( p, vector_elem( x, i ), & v->v.seq.p[i], pp_next, pp_bytes );
+  }
+  else {
+    v->t = t_tcm_value_list;
+    v->v.seq.len = list_length( sc, x );
+    v->v.seq.p = *pp_next;
+    *pp_next += v->v.seq.len;
+    for( l = x, i = 0; l != sc->NIL; l = pair_cdr( l ), ++i )
+      fill_value( p, pair_car( l ), & v->v.seq.p[i], pp_next, pp_bytes );
+  }
+}
+
+int tcm_scheme_cell_to_value( t_tcm_scheme* p, pointer x, t_tcm_value** pp_result )
+{
+  int nr_values = 0, nr_bytes = 0;
+  t_tcm_value *p_values, *p_next;
+  char* p_bytes;
+
+  if( measure_cell( p, x, 0, & nr_values, & nr_bytes ) )
+    return t_tcm_scheme_api_err_result;
+
+  /* values and strings are returned within one single memory block */
+  p_values = cul_malloc( nr_values * sizeof( t_tcm_value ) + nr_bytes );
+  if( p_values == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return t_tcm_scheme_api_err_mem;
+  }
+
+  p_next = p_values + 1;
+  p_bytes = (char *)( p_values + nr_values );
+  fill_value( p, x, p_values, & p_next, & p_bytes );
+
+  *pp_result = p_values;
+  return t_tcm_scheme_api_ok;
+}
+
+void tcm_scheme_free_value( t_tcm_value* p )
+{
+  if( p )
+    cul_free( p );
+}
+
+
+int tcm_scheme_call_locked( t_tcm_scheme* p, pointer proc, pointer args, pointer* p_result )
+{
+  scheme* sc = & p->sc;
+  pointer saved_outport = sc->outport;
+
+  sc->outport = p->p_null_port;
+  sc->retcode = 0;
+  *p_result = scheme_call( sc, proc, args );
+  sc->outport = saved_outport;
+
+  return( sc->retcode ? t_tcm_scheme_api_err_eval : t_tcm_scheme_api_ok );
+}
+
+pointer tcm_scheme_lookup_locked( t_tcm_scheme* p, const char* name )
+{
+  scheme* sc = & p->sc;
+  pointer saved_outport = sc->outport;
+  pointer proc;
+
+  /* undefined symbols are reported to the output port */
+  sc->outport = p->p_null_port;
+  sc->retcode = 0;
+  proc = scheme_eval( sc, mk_symbol( sc, name ) );
+  sc->outport = saved_outport;
+
+  if( sc->retcode || !( is_closure( proc ) || is_proc( proc ) || is_foreign( proc ) ) )
+    return NULL;
+
+  return proc;
+}
+
+
+t_tcm_scheme_proc* tcm_scheme_lookup_proc( t_tcm_scheme* p, const char* name )
+{
+  scheme* sc = & p->sc;
+  t_tcm_scheme_proc* h;
+  pointer proc;
+
+  h = cul_malloc( sizeof( t_tcm_scheme_proc ) );
+  if( h == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+
+  h->p_scheme = p;
+
+  pthread_mutex_lock( & p->mutex );
+  proc = tcm_scheme_lookup_locked( p, name );
+  if( proc ) {
+    h->cell = cons( sc, proc, mk_symbol( sc, name ) );
+    set_vector_elem( p->p_api_root, API_ROOT_HANDLES,
+                     cons( sc, h->cell, vector_elem( p->p_api_root, API_ROOT_HANDLES ) ) );
+  }
+  pthread_mutex_unlock( & p->mutex );
+
+  if( proc == NULL ) {
+    tcm_error( "%s: procedure %s is not defined error!\n", __func__, name );
+    cul_free( h );
+    return NULL;
+  }
+
+  return h;
+}
+
+void tcm_scheme_release_proc( t_tcm_scheme_proc* h )
+{
+  t_tcm_scheme* p;
+  scheme* sc;
+  pointer l, prev = NULL;
+
+  if( h == NULL )
+    return;
+
+  p = h->p_scheme;
+  sc = & p->sc;
+
+  pthread_mutex_lock( & p->mutex );
+  for( l = vector_elem( p->p_api_root, API_ROOT_HANDLES ); l != sc->NIL; prev = l, l = pair_cdr( l ) ) {
+    if( pair_car( l ) == h->cell ) {
+      if( prev )
+        set_cdr( prev, pair_cdr( l ) );
+      else
+        set_vector_elem( p->p_api_root, API_ROOT_HANDLES, pair_cdr( l ) );
+      break;
+    }
+  }
+  pthread_mutex_unlock( & p->mutex );
+
+  cul_free( h );
+}
+
+
+int tcm_scheme_invoke( t_tcm_scheme_proc* h, const t_tcm_value* args, int argc, t_tcm_value** pp_result )
+{
+  t_tcm_scheme* p = h->p_scheme;
+  scheme* sc = & p->sc;
+  pointer frame, x, result;
+  int i, error = t_tcm_scheme_api_ok;
+
+  tcm_scheme_lock( p, "c-api", symname( pair_cdr( h->cell ) ) );
+
+  /* argument list is built from the end, the partial list is kept in the frame's car */
+  frame = tcm_scheme_protect( p, sc->NIL );
+  for( i = argc - 1; i >= 0; --i ) {
+    if( ( x = value_to_cell( p, & args[i], 0 ) ) == NULL ) {
+      error = t_tcm_scheme_api_err_arg;
+      break;
+    }
+    set_car( frame, cons( sc, x, pair_car( frame ) ) );
+  }
+
+  if( ! error )
+    error = tcm_scheme_call_locked( p, pair_car( h->cell ), pair_car( frame ), & result );
+
+  tcm_scheme_unprotect( p );
+
+  if( ! error && pp_result )
+    error = tcm_scheme_cell_to_value( p, result, pp_result );
+
+  tcm_scheme_unlock( p );
+
+  return error;
+}
+
+
+/*! benchmark parameters */
+typedef struct {
+  t_tcm_scheme*               p_scheme;                 /*!< interpreter */
+  char                        name[256];                /*!< procedure name */
+  int                         count;                    /*!< number of invocations per interface */
+} t_api_benchmark;
+
+static long elapsed_ns( const struct timespec* p_start )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return ( now.tv_sec - p_start->tv_sec ) * 1000000000L + ( now.tv_nsec - p_start->tv_nsec );
+}
+
+static void* benchmark_thread( void* p_arg )
+{
+  t_api_benchmark* p_bench = (t_api_benchmark *) p_arg;
+  t_tcm_scheme_proc* h;
+  t_tcm_value* p_result;
+  struct timespec start;
+  char expr[260];
+  long handle_ns, string_ns;
+  int i, errors = 0;
+
+  h = tcm_scheme_lookup_proc( p_bench->p_scheme, p_bench->name );
+  if( h ) {
+    clock_gettime( CLOCK_MONOTONIC, & start );
+    for( i = 0; i < p_bench->count; ++i ) {
+      p_result = NULL;
+      if( tcm_scheme_invoke( h, NULL, 0, & p_result ) == t_tcm_scheme_api_err_eval )
+        ++errors;
+      tcm_scheme_free_value( p_result );
+    }
+    handle_ns = elapsed_ns( & start );
+    tcm_scheme_release_proc( h );
+
+    snprintf( expr, sizeof( expr ), "(%s)", p_bench->name );
+    clock_gettime( CLOCK_MONOTONIC, & start );
+    for( i = 0; i < p_bench->count; ++i )
+      tcm_load_scheme_string( p_bench->p_scheme, expr, NULL );
+    string_ns = elapsed_ns( & start );
+
+    tcm_message( "%s: %d calls of %s, handle: %ld ns/call, string: %ld ns/call, %d errors\n", __func__,
+                 p_bench->count, p_bench->name, handle_ns / p_bench->count, string_ns / p_bench->count, errors );
+  }
+
+  cul_free( p_bench );
+  return NULL;
+}
+
+int tcm_scheme_benchmark_api( t_tcm_scheme* p, const char* name, int count )
+{
+  t_api_benchmark* p_bench;
+  pthread_attr_t attr;
+  pthread_t tid;
+  int retcode;
+
+  if( count <= 0 )
+    return -1;
+
+  p_bench = cul_malloc( sizeof( t_api_benchmark ) );
+  if( p_bench == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return -1;
+  }
+
+  p_bench->p_scheme = p;
+  strncpy( p_bench->name, name, sizeof( p_bench->name ) - 1 );
+  p_bench->name[sizeof( p_bench->name ) - 1] = '\0';
+  p_bench->count = count;
+
+  /* the caller may hold the interpreter lock, benchmark runs asynchronously */
+  pthread_attr_init( & attr );
+  pthread_attr_setdetachstate( & attr, PTHREAD_CREATE_DETACHED );
+  retcode = pthread_create( & tid, & attr, benchmark_thread, p_bench );
+  pthread_attr_destroy( & attr );
+
+  if( retcode ) {
+    tcm_error( "%s: could not create benchmark thread error!\n", __func__ );
+    cul_free( p_bench );
+    return -1;
+  }
+
+  return 0;
+}
+
+
+int tcm_scheme_init_api( t_tcm_scheme* p )
+{
+  scheme* sc = & p->sc;
+  pointer saved_outport = sc->outport;
+  pointer root_symbol;
+
+  p->p_null_file = fopen( "/dev/null", "w" );
+  if( p->p_null_file == NULL ) {
+    tcm_error( "%s: could not open /dev/null error!\n", __func__ );
+    return -1;
+  }
+
+  /* gc root for all objects held by C code */
+  root_symbol = mk_symbol( sc, "*tcm-api-root*" );
+  p->p_api_root = mk_vector( sc, API_ROOT_SIZE );
+  fill_vector( p->p_api_root, sc->NIL );
+  scheme_define( sc, sc->global_env, root_symbol, p->p_api_root );
+
+  scheme_set_output_port_file( sc, p->p_null_file );
+  p->p_null_port = sc->outport;
+  set_vector_elem( p->p_api_root, API_ROOT_NULL_PORT, p->p_null_port );
+  sc->outport = saved_outport;
+
+  return 0;
+}
+
+void tcm_scheme_release_api( t_tcm_scheme* p )
+{
+  if( p->p_null_file ) {
+    fclose( p->p_null_file );
+    p->p_null_file = NULL;
+  }
+}
@@ -0,0 +1,255 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_SCHEME_API_H
+#define TCM_SCHEME_API_H
+
+#include <tcm_scheme.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_scheme_api.h
+    \brief typed C interface for invoking scheme procedures
+
+    Native code  looks up a  globally defined  scheme procedure once  and keeps
+    the returned handle. The  handle protects the procedure object from garbage
+    collection and is invoked with an array of C typed arguments. Results are
+    converted into a tree of C values. In contrast to tcm_load_scheme_string()
+    neither arguments nor results are printed to or parsed from text.
+
+    A handle refers to the procedure object which has been bound to the name at
+    lookup time.  When the name is redefined e.g.  within the REPL, the handle
+    needs to be looked up again to invoke the new definition.
+
+    \addtogroup scheme
+    @{
+ */
+
+#define TCM_SCHEME_API_MAX_DEPTH   32                   /*!< maximum nesting level of lists and vectors */
+
+/*! length of scheme string, scheme strings are counted and may contain null characters */
+#ifndef strlength
+#define strlength( p )             ( (p)->_object._string._length )
+#endif
+
+/*! C value types */
+typedef enum {
+  t_tcm_value_nil,                                      /*!< empty list */
+  t_tcm_value_bool,                                     /*!< boolean, v.bval */
+  t_tcm_value_integer,                                  /*!< integer, v.ival */
+  t_tcm_value_real,                                     /*!< real, v.rval */
+  t_tcm_value_char,                                     /*!< character, v.cval */
+  t_tcm_value_string,                                   /*!< zero terminated string, v.str */
+  t_tcm_value_symbol,                                   /*!< symbol, v.str */
+  t_tcm_value_bytes,                                    /*!< byte array, v.str, passed as counted scheme string, strings containing null characters are returned as such */
+  t_tcm_value_list,                                     /*!< proper list, v.seq */
+  t_tcm_value_vector                                    /*!< vector, v.seq */
+} t_tcm_value_type;
+
+/*! C representation of scheme values */
+typedef struct s_tcm_value {
+  union {
+    int bval;                                           /*!< boolean value */
+    long ival;                                          /*!< integer value */
+    double rval;                                        /*!< real value */
+    int cval;                                           /*!< character value */
+    struct {
+      const char* p;                                    /*!< string data */
+      int len;                                          /*!< string length in bytes */
+    } str;                                              /*!< string, symbol and byte array value */
+    struct {
+      struct s_tcm_value* p;                            /*!< array of elements */
+      int len;                                          /*!< number of elements */
+    } seq;                                              /*!< list and vector value */
+  } v;                                                  /*!< union holding the value */
+  t_tcm_value_type t;                                   /*!< value type */
+} t_tcm_value;
+
+/*! error codes of the typed interface */
+typedef enum {
+  t_tcm_scheme_api_ok = 0,                              /*!< success */
+  t_tcm_scheme_api_err_arg = -1,                        /*!< invalid argument or unknown procedure */
+  t_tcm_scheme_api_err_eval = -2,                       /*!< evaluation error */
+  t_tcm_scheme_api_err_result = -3,                     /*!< result can't be represented as C value */
+  t_tcm_scheme_api_err_mem = -4                         /*!< out of memory */
+} t_tcm_scheme_api_error;
+
+/*! handle to scheme procedure */
+typedef struct s_tcm_scheme_proc {
+  t_tcm_scheme*               p_scheme;                 /*!< interpreter the procedure belongs to */
+  pointer                     cell;                     /*!< (procedure . name) element of rooted handle list */
+} t_tcm_scheme_proc;
+
+
+/*!
+ * look up globally defined scheme procedure
+ *
+ * \param p pointer to the scheme object
+ * \param name name of the procedure
+ * \return handle to procedure or NULL when not defined or in case of error
+ */
+t_tcm_scheme_proc* tcm_scheme_lookup_proc( t_tcm_scheme* p, const char* name );
+
+
+/*!
+ * release procedure handle
+ *
+ * \param h procedure handle to be released
+ */
+void tcm_scheme_release_proc( t_tcm_scheme_proc* h );
+
+
+/*!
+ * invoke scheme procedure
+ *
+ * Output written by the procedure is discarded.
+ *
+ * \param h procedure handle
+ * \param args array of arguments, may be NULL when argc is zero
+ * \param argc number of arguments
+ * \param pp_result optional pointer to write back result, release with tcm_scheme_free_value()
+ * \return 0 in case of success, otherwise negative error code of type t_tcm_scheme_api_error
+ */
+int tcm_scheme_invoke( t_tcm_scheme_proc* h, const t_tcm_value* args, int argc, t_tcm_value** pp_result );
+
+
+/*!
+ * release result returned by tcm_scheme_invoke()
+ *
+ * \param p pointer to result value
+ */
+void tcm_scheme_free_value( t_tcm_value* p );
+
+
+/*!
+ * look up globally defined procedure, interpreter lock must be held
+ *
+ * \param p pointer to the scheme object
+ * \param name name of the procedure
+ * \return procedure object or NULL when not defined
+ */
+pointer tcm_scheme_lookup_locked( t_tcm_scheme* p, const char* name );
+
+
+/*!
+ * call procedure discarding its output, interpreter lock must be held
+ *
+ * \param p pointer to the scheme object
+ * \param proc procedure object
+ * \param args argument list which must be protected from garbage collection
+ * \param p_result pointer to write back result object
+ * \return 0 in case of success, otherwise t_tcm_scheme_api_err_eval
+ */
+int tcm_scheme_call_locked( t_tcm_scheme* p, pointer proc, pointer args, pointer* p_result );
+
+
+/*!
+ * convert C value to scheme object, interpreter lock must be held
+ *
+ * \param p pointer to the scheme object
+ * \param v C value to convert
+ * \return scheme object or NULL in case of error
+ */
+pointer tcm_scheme_value_to_cell( t_tcm_scheme* p, const t_tcm_value* v );
+
+
+/*!
+ * convert scheme object to C value, interpreter lock must be held
+ *
+ * \param p pointer to the scheme object
+ * \param x scheme object to convert
+ * \param pp_result pointer to write back result, release with tcm_scheme_free_value()
+ * \return 0 in case of success, otherwise negative error code of type t_tcm_scheme_api_error
+ *
+ * Strings keep their full length. Strings containing null characters are
+ * returned as t_tcm_value_bytes, all string data is zero terminated anyway.
+ */
+int tcm_scheme_cell_to_value( t_tcm_scheme* p, pointer x, t_tcm_value** pp_result );
+
+
+/*!
+ * protect object from garbage collection, interpreter lock must be held
+ *
+ * Objects are kept on a stack and released in reverse order of protection
+ * by tcm_scheme_unprotect().
+ *
+ * \param p pointer to the scheme object
+ * \param x object to protect
+ * \return stack frame, its car holds x and may be replaced by set_car()
+ */
+pointer tcm_scheme_protect( t_tcm_scheme* p, pointer x );
+
+
+/*!
+ * release object protected last by tcm_scheme_protect()
+ *
+ * \param p pointer to the scheme object
+ */
+void tcm_scheme_unprotect( t_tcm_scheme* p );
+
+
+/*!
+ * compare typed interface against tcm_load_scheme_string()
+ *
+ * Starts a thread which invokes the given procedure without arguments the
+ * given number of times via both interfaces and logs the time per call.
+ *
+ * \param p pointer to the scheme object
+ * \param name name of the procedure
+ * \param count number of invocations per interface
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_scheme_benchmark_api( t_tcm_scheme* p, const char* name, int count );
+
+
+/*!
+ * initialize typed interface, called by tcm_init_scheme()
+ *
+ * \param p pointer to the scheme object
+ * \return 0 in case of success, otherwise negative error code
+ */
+int tcm_scheme_init_api( t_tcm_scheme* p );
+
+
+/*!
+ * release typed interface, called by tcm_release_scheme()
+ *
+ * \param p pointer to the scheme object
+ */
+void tcm_scheme_release_api( t_tcm_scheme* p );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_SCHEME_API_H */
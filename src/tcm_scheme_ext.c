@@ -26,7 +26,10 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <time.h>
 #include <string.h> /* memset() */
+#include <ctype.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -39,9 +42,25 @@
 #include <olcutils/alloc.h>
 #include <tinyscheme/dynload.h>
 #include <tcm_scheme.h>
+#include <tcm_scheme_api.h>
 #include <tcm_config.h>
 #include <tcm_log.h>
+#include <tcm_rt.h>
+#include <tcm_boot.h>
+#include <tcm_watchdog.h>
+#include <tcm_flightrec.h>
+#include <tcm_profile.h>
+#include <tcm_scheme_hash.h>
+#include <tcm_atcache.h>
+#include <tcm_arbiter.h>
+#include <tcm_pattern.h>
+#include <tcm_hayes.h>
+#include <tcm_at_vocabulary.h>
 #include <dev_channel.h>
+#include <cmux_channel.h>
+#include <shm_channel.h>
+#include <local_channel.h>
+#include <tcm_await.h>
 #include <client_sock_channel.h>
 #include <server_sock_channel.h>
 
@@ -105,7 +124,7 @@ static pointer scm_system(scheme *sc, pointer args)
   }
 
   if( ! errors ) {
-    errors =  system( strarg );
+    errors =  tcm_watchdog_system( ((t_tcm_scheme *)sc)->p_watchdog, strarg );
     if( errors ) {
       snprintf( outbuf, sizeof(outbuf), "execution error!\n" );
     } else {
@@ -148,7 +167,8 @@ static pointer scm_sleep(scheme *sc, pointer args)
   int     i = 0;
   char    outbuf[80] = { '\0' };
   int     errors = 0;
-  useconds_t usec;
+  useconds_t usec, slice;
+  struct timespec req;
 
   while( args != sc->NIL )
   {
@@ -177,7 +197,20 @@ static pointer scm_sleep(scheme *sc, pointer args)
 
   if( ! errors ) {
     tcm_message( "%s: blocking delay for %ld microseconds ...\n", __func__, usec );
-    errors =  usleep( usec );
+    /* sleep in slices to return early when the watchdog aborts the evaluation */
+    while( usec > 0 && ! errors ) {
+      if( tcm_watchdog_aborting( ((t_tcm_scheme *)sc)->p_watchdog ) ) {
+        errors = -1;
+        break;
+      }
+      slice = MIN( usec, 100000 );
+      req.tv_sec = 0;
+      req.tv_nsec = 1000L * slice;
+      /* profiler signals interrupt the sleep, the remaining time is slept thereafter */
+      while( ( errors = nanosleep( & req, & req ) ) && errno == EINTR )
+        ;
+      usec -= slice;
+    }
     tcm_message( "%s: done\n", __func__ );
     if( errors ) {
       snprintf( outbuf, sizeof(outbuf), "execution error!\n" );
@@ -219,29 +252,111 @@ static pointer scm_quit(scheme *sc, pointer args)
   return(retval);
 }
 
+/*!
+ * determine whether a scheme closure accepts at least the given number of arguments
+ *
+ * \param closure scheme closure object
+ * \param nr_args number of arguments
+ * \return 1 when the closure can be invoked with nr_args arguments, otherwise 0
+ */
+static int closure_takes_args( pointer closure, int nr_args )
+{
+  pointer params = pair_car( closure_code( closure ) );
+  int n = 0;
+
+  while( is_pair( params ) ) {
+    params = pair_cdr( params );
+    ++n;
+  }
+
+  /* symbol at the end of the parameter list takes rest arguments */
+  return( n >= nr_args || is_symbol( params ) );
+}
+
 /*!
  * wraps IPC callback to scheme callback function
  *
+ * Data events invoke the channel's callback closure with the received string
+ * and, when  the closure accepts  a second argument, the  connection identifier.
+ * Data answering a request of write-channel-await is passed to the reply
+ * closure of the request instead.
+ * Connect and disconnect events of server socket channels are forwarded to the
+ * optional connection event closure as (cb 'connect id) respectively (cb 'disconnect id).
+ *
  * p_evt pointer to libintercom event object
  */
 static int read_cb_wrapper( t_icom_evt* p_evt )
 {
-  t_dev_channel* p = (t_dev_channel *)p_evt->p_user_ctx;
-  t_base_channel* p_base = (t_base_channel *)p;
+  t_base_channel* p_base = (t_base_channel *)p_evt->p_user_ctx;
   t_tcm_scheme*  p_scheme = p_base->p_tcm_server_ctx->p_scheme;
   scheme* sc = (scheme *) p_scheme;
-  char    cb_symbol_name[80] = { '\0' };
+  const char* evt_name = NULL;
+  char name[TCM_WATCHDOG_MAX_NAME_LEN];
+  long conn_id = 0;
+  uint64_t t_start = tcm_flightrec_now_ns();
+  t_tcm_trace trace;
+  long seq;
+  int depth;
+  int slot;
+  pointer args;
+  pointer awaited;
   pointer retval;
 
+  depth = base_channel_queue_depth( p_base );
+  seq = base_channel_dispatched( p_base );
+
+  if( p_base->type == t_channel_server_sock_type )
+    conn_id = server_sock_channel_evt_conn_id( p_evt );
+
   if( p_evt->type == ICOM_EVT_SERVER_DATA || p_evt->type == ICOM_EVT_CLIENT_DATA )
   {
     tcm_message("%s: received: %.30s\n", __func__, (char *) p_evt->p_data );
+    tcm_trace_begin( & trace, p_base, p_base->trace_stamps, seq );
+
+    /* awaited replies are matched before the interpreter is locked */
+    slot = tcm_await_match( p_base, p_evt->p_data, p_evt->data_len );
+
+    tcm_scheme_lock( p_scheme, base_channel_name( p_base, name, sizeof( name ) ), p_base->cb_symbol_name );
+    tcm_trace_locked( & trace );
+    awaited = ( slot >= 0 ) ? vector_elem( p_scheme->p_awaits, slot ) : sc->F;
+    args = tcm_scheme_protect( p_scheme, sc->NIL );
+    if( p_base->cb_with_conn_id && ! is_pair( awaited ) )
+      set_car( args, cons( sc, mk_integer( sc, conn_id ), pair_car( args ) ) );
+    set_car( args, cons( sc, mk_string( sc, p_evt->p_data ), pair_car( args ) ) );
+    if( is_pair( awaited ) ) {
+      retval = scheme_call( sc, pair_car( awaited ), pair_car( args ) );
+      set_vector_elem( p_scheme->p_awaits, slot, sc->F );
+    } else {
+      retval = scheme_call( sc, p_base->p_cb_closure_code, pair_car( args ) );
+    }
+    tcm_scheme_unprotect( p_scheme );
+    tcm_scheme_unlock( p_scheme );
+
+    if( slot >= 0 )
+      tcm_await_done( slot );
+
+    tcm_trace_end( & trace, p_evt->p_data, p_evt->data_len );
+    tcm_flightrec_add( t_tcm_flightrec_cb, p_base, p_evt->p_data, p_evt->data_len, depth,
+                       ( tcm_flightrec_now_ns() - t_start ) / 1000 );
+  }
+  else if( p_evt->type == ICOM_EVT_SERVER_CON )
+    evt_name = "connect";
+  else if( p_evt->type == ICOM_EVT_SERVER_DIS )
+    evt_name = "disconnect";
+
+  if( evt_name && p_base->p_evt_cb_closure_code )
+  {
+    tcm_message("%s: connection %ld %s event\n", __func__, conn_id, evt_name );
 
-    snprintf( cb_symbol_name, sizeof(cb_symbol_name), "dev-ch-cb-%s", p->name );
+    tcm_scheme_lock( p_scheme, base_channel_name( p_base, name, sizeof( name ) ), p_base->evt_cb_symbol_name );
+    /* symbols are interned and thus never collected */
+    args = mk_symbol( sc, evt_name );
+    args = cons( sc, args, cons( sc, mk_integer( sc, conn_id ), sc->NIL ) );
+    retval = scheme_call( sc, p_base->p_evt_cb_closure_code, args );
+    tcm_scheme_unlock( p_scheme );
 
-    pthread_mutex_lock( & p_scheme->mutex );
-    retval = scheme_call( sc, p_base->p_cb_closure_code, cons( sc, mk_string( sc, p_evt->p_data ), sc->NIL ) );
-    pthread_mutex_unlock( & p_scheme->mutex );
+    tcm_flightrec_add( t_tcm_flightrec_cb, p_base, evt_name, strlen( evt_name ), depth,
+                       ( tcm_flightrec_now_ns() - t_start ) / 1000 );
   }
 
   return 0;
@@ -340,6 +455,142 @@ static pointer scm_make_dev_channel(scheme *sc, pointer args)
 }
 
 
+/*!
+ * create a new serial line channel
+ *
+ * The device is switched to raw mode and configured with the given baud rate
+ * and options each time it is (re)opened. Options are the symbols 'rtscts for
+ * hardware flow control and 'low-latency to disable buffering in the serial
+ * driver and the pairs (vmin . n) and (vtime . n) for the termios read
+ * settings which default to 1 and 0. vmin must be at least 1, otherwise
+ * read() would return 0 which is taken for a broken stream.
+ *
+ * try: (make-serial-channel "/dev/ttyUSB0" (lambda (s) (display s)) 115200 'rtscts 'low-latency)
+ *
+ * \param sc pointer to scheme context
+ * \param args pointer to argument list
+ * \return pointer to channel identifier
+ */
+static pointer scm_make_serial_channel(scheme *sc, pointer args)
+{
+  t_tcm_scheme* p_tcm_scheme = (t_tcm_scheme *)sc;
+  pointer arg;
+  pointer retval;
+  char    *filename;
+  char    *option;
+  int     i = 0;
+  char    outbuf[80] = { '\0' };
+  int     errors = 0;
+  pointer closure_code;
+  t_dev_serial_cfg cfg = { 0, 0, 1, 0, 0 };
+  t_dev_channel* p_dev_channel;
+  t_base_channel* p_base_channel;
+
+  while( args != sc->NIL )
+  {
+    arg = pair_car(args);
+
+    if( i == 0  ) {
+      if( is_string( arg ) ) {
+        filename = string_value( arg );
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "first argument must be file name string!\n" );
+        errors = -1;
+        break;
+      }
+    }
+    else if( i == 1 ) {
+      if( is_closure( arg ) ) {
+        closure_code = arg;
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "second argument must be call back function!\n" );
+        errors = -1;
+        break;
+      }
+    }
+    else if( i == 2 ) {
+      if( is_integer( arg ) ) {
+        cfg.baud = ivalue( arg );
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "third argument must be baud rate!\n" );
+        errors = -1;
+        break;
+      }
+    }
+    else if( is_symbol( arg ) ) {
+      option = symname( arg );
+      if( ! strcmp( option, "rtscts" ) ) {
+        cfg.rtscts = 1;
+      } else if( ! strcmp( option, "low-latency" ) ) {
+        cfg.low_latency = 1;
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "unknown option %.40s error!\n", option );
+        errors = -1;
+        break;
+      }
+    }
+    else if( is_pair( arg ) && is_symbol( pair_car( arg ) ) && is_integer( pair_cdr( arg ) ) &&
+             ivalue( pair_cdr( arg ) ) >= 0 && ivalue( pair_cdr( arg ) ) <= 255 ) {
+      option = symname( pair_car( arg ) );
+      if( ! strcmp( option, "vmin" ) && ivalue( pair_cdr( arg ) ) == 0 ) {
+        snprintf( outbuf, sizeof(outbuf), "vmin must be between 1 and 255 error!\n" );
+        errors = -1;
+        break;
+      } else if( ! strcmp( option, "vmin" ) ) {
+        cfg.vmin = ivalue( pair_cdr( arg ) );
+      } else if( ! strcmp( option, "vtime" ) ) {
+        cfg.vtime = ivalue( pair_cdr( arg ) );
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "unknown option %.40s error!\n", option );
+        errors = -1;
+        break;
+      }
+    }
+    else {
+      snprintf( outbuf, sizeof(outbuf), "options must be symbols or (vmin . n), (vtime . n) error!\n" );
+      errors = -1;
+      break;
+    }
+
+    args = pair_cdr( args );
+    ++i;
+  }
+
+  if( i >= 3 || errors ) {
+    if( ! errors ) {
+      p_dev_channel = init_serial_channel( p_tcm_scheme->p_tcm_server_ctx, filename, & cfg, read_cb_wrapper );
+      if( p_dev_channel ) {
+        p_base_channel = (t_base_channel *) p_dev_channel;
+        p_base_channel->p_cb_closure_code = closure_code;
+
+        /* link symbol to callback closure to avoid gc to clean it up */
+        snprintf( p_base_channel->cb_symbol_name, sizeof(p_base_channel->cb_symbol_name), "serial-ch-cb-%s", filename );
+        scheme_define( sc, sc->global_env, mk_symbol( sc, p_base_channel->cb_symbol_name ), closure_code );
+        sprintf( outbuf, "ok\n" );
+      } else {
+        sprintf( outbuf, "could not create serial channel error\n" );
+        errors = -1;
+      }
+    }
+  } else {
+    sprintf( outbuf, "function takes at least three arguments (device name, callback, baud) error\n" );
+    errors = -1;
+  }
+
+  if( outbuf[0] != '\0' )
+    putstr( sc, outbuf );
+
+  if( errors ) {
+    tcm_error( "%s: %s", __func__, outbuf );
+    retval = sc -> F;
+  } else {
+    retval = mk_integer( sc, (long)p_dev_channel );
+  }
+
+  return(retval);
+}
+
+
 /*!
  * create a new client socket channel
  *
@@ -440,8 +691,13 @@ static pointer scm_make_client_sock_channel(scheme *sc, pointer args)
 /*!
  * create a new server socket channel
  *
- * try: (make-server-sock-channel "127.0.0.1" 5000)
- *      (make-server-sock-channel "/tmp/test.sock" 0)
+ * The callback  function is invoked with  the received string and, if it takes a
+ * second argument, with the identifier of the connection the data came from. The
+ * optional  fourth argument specifies a function  which is invoked with the symbol
+ * connect or disconnect and the connection identifier for each connection change.
+ *
+ * try: (make-server-sock-channel "127.0.0.1" 5000 (lambda (s id) (write-channel-to ch id s)))
+ *      (make-server-sock-channel "/tmp/test.sock" 0 (lambda (s) (display s)) (lambda (evt id) (display evt)))
  *
  * \param sc pointer to scheme context
  * \param args pointer to argument lis t
@@ -458,13 +714,14 @@ static pointer scm_make_server_sock_channel(scheme *sc, pointer args)
   char    outbuf[80] = { '\0' };
   int     errors = 0;
   pointer closure_code;
+  pointer evt_closure_code = NULL;
   t_server_sock_channel* p_server_sock_channel;
   t_base_channel* p_base_channel;
 
   while( args != sc->NIL )
   {
-    if( i > 2 ) {
-      snprintf( outbuf, sizeof(outbuf), "function takes three arguments only error!\n" );
+    if( i > 3 ) {
+      snprintf( outbuf, sizeof(outbuf), "function takes three or four arguments error!\n" );
       errors = -1;
       break;
     }
@@ -495,21 +752,37 @@ static pointer scm_make_server_sock_channel(scheme *sc, pointer args)
         break;
       }
     }
+    else if( i == 3 ) {
+      if( is_closure( arg = pair_car(args) ) ) {
+        evt_closure_code = arg;
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "fourth argument must be connection event call back function!\n" );
+        errors = -1;
+        break;
+      }
+    }
 
     args = pair_cdr( args );
     ++i;
   }
 
-  if( i == 3 ) {
+  if( i == 3 || i == 4 ) {
     if( ! errors ) {
       p_server_sock_channel = init_server_sock_channel( p_tcm_scheme->p_tcm_server_ctx, addr, port, read_cb_wrapper );
       if( p_server_sock_channel ) {
         p_base_channel = (t_base_channel *) p_server_sock_channel;
         p_base_channel->p_cb_closure_code = closure_code;
+        p_base_channel->cb_with_conn_id = closure_takes_args( closure_code, 2 );
 
         /* link symbol to callback closure to avoid gc to clean it up */
-        snprintf( p_base_channel->cb_symbol_name, sizeof(p_base_channel->cb_symbol_name), "client-sock-ch-cb-%s-%d", addr, port );
+        snprintf( p_base_channel->cb_symbol_name, sizeof(p_base_channel->cb_symbol_name), "server-sock-ch-cb-%s-%d", addr, port );
         scheme_define( sc, sc->global_env, mk_symbol( sc, p_base_channel->cb_symbol_name ), closure_code );
+
+        if( evt_closure_code ) {
+          p_base_channel->p_evt_cb_closure_code = evt_closure_code;
+          snprintf( p_base_channel->evt_cb_symbol_name, sizeof(p_base_channel->evt_cb_symbol_name), "server-sock-ch-evt-cb-%s-%d", addr, port );
+          scheme_define( sc, sc->global_env, mk_symbol( sc, p_base_channel->evt_cb_symbol_name ), evt_closure_code );
+        }
         sprintf( outbuf, "ok\n" );
       } else {
         sprintf( outbuf, "could not create device channel error\n" );
@@ -517,7 +790,7 @@ static pointer scm_make_server_sock_channel(scheme *sc, pointer args)
       }
     }
   } else {
-    sprintf( outbuf, "function takes three arguments (addr, port, callback) error!\n" );
+    snprintf( outbuf, sizeof(outbuf), "function takes three or four arguments error!\n" );
     errors = -1;
   }
 
@@ -644,7 +917,11 @@ static pointer scm_write_channel(scheme *sc, pointer args)
 
   if( ! errors ) {
     tcm_message( "%s: successfully executed\n", __func__ );
+    tcm_trace_write_begin();
     bytes_written = p_base_channel->write( p_base_channel, p_write_buf, strlen( p_write_buf ) );
+    tcm_trace_write_end();
+    base_channel_count_tx( p_base_channel, bytes_written );
+    tcm_flightrec_add( t_tcm_flightrec_tx, p_base_channel, p_write_buf, bytes_written, 0, 0 );
   } else {
     tcm_error( "%s: could not write to file %s, descriptor: %d error!\n", __func__, p_dev_channel->name, p_dev_channel->fd );
   }
@@ -657,98 +934,2763 @@ static pointer scm_write_channel(scheme *sc, pointer args)
 }
 
 /*!
- *  close communication channel instance
+ * write bytes to one connection of a server socket channel
+ *
+ * try: (write-channel-to ch id "hello")
  *
  * \param sc pointer to scheme context
- * \param args pointer to argument list with one argument of channel instance to close
- * \return pointer to boolean value as result code, #t in case of success
+ * \param args pointer to argument list, 1st argument is server socket channel instance,
+ *        2nd argument is connection identifier, 3rd argument is string to be written
+ * \return pointer to scheme integer value providing the number of bytes successfully writting
  */
-static pointer scm_close_channel(scheme *sc, pointer args)
+static pointer scm_write_channel_to(scheme *sc, pointer args)
 {
-  t_tcm_scheme* p_tcm_scheme = (t_tcm_scheme *)sc;
   pointer arg;
   pointer retval;
   int     i = 0;
   char    outbuf[80] = { '\0' };
   int     errors = 0;
-  pointer closure_code;
   t_base_channel* p_base_channel;
+  long    conn_id;
   char* p_write_buf;
   int bytes_written = -1;
 
   while( args != sc->NIL )
   {
-    if( i > 0 ) {
-      snprintf( outbuf, sizeof(outbuf), "function takes one argument only error!\n" );
+    if( i > 2 ) {
+      snprintf( outbuf, sizeof(outbuf), "function takes three arguments only error!\n" );
       errors = -1;
       break;
     }
     else if( i == 0  ) {
       if( is_integer( arg = pair_car(args)) ) {
         p_base_channel = (t_base_channel *) ivalue( arg );
+        if( p_base_channel == NULL || p_base_channel->type != t_channel_server_sock_type ) {
+          snprintf( outbuf, sizeof(outbuf), "first argument must be server socket channel!\n" );
+          errors = -1;
+          break;
+        }
       } else {
         snprintf( outbuf, sizeof(outbuf), "first argument must be channel descriptor!\n" );
         errors = -1;
         break;
       }
     }
+    else if( i == 1 ) {
+      if( is_integer( arg = pair_car(args) ) ) {
+        conn_id = ivalue( arg );
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "second argument must be connection identifier!\n" );
+        errors = -1;
+        break;
+      }
+    }
+    else if( i == 2 ) {
+      if( is_string( arg = pair_car(args) ) ) {
+        p_write_buf = string_value( arg );
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "third argument must be string to write!\n" );
+        errors = -1;
+        break;
+      }
+    }
 
     args = pair_cdr( args );
     ++i;
   }
 
+  if( ! errors && i != 3 ) {
+    snprintf( outbuf, sizeof(outbuf), "function takes three arguments (channel, connection, string) error!\n" );
+    errors = -1;
+  }
+
   if( ! errors ) {
-    /* clear symbol linkage to call back function to allow gc to release callback closure */
-    scheme_define( sc, sc->global_env, mk_symbol( sc, p_base_channel->cb_symbol_name ), sc->NIL );
-    p_base_channel->release( p_base_channel );
+    tcm_trace_write_begin();
+    bytes_written = write_server_sock_channel_to( (t_server_sock_channel *)p_base_channel, conn_id, p_write_buf, strlen( p_write_buf ) );
+    tcm_trace_write_end();
+    base_channel_count_tx( p_base_channel, bytes_written );
+    tcm_flightrec_add( t_tcm_flightrec_tx, p_base_channel, p_write_buf, bytes_written, 0, 0 );
+  } else {
+    tcm_error( "%s: %s", __func__, outbuf );
   }
 
   if( outbuf[0] != '\0' )
     putstr( sc, outbuf );
 
-  if( errors ) {
-    tcm_error( "%s: %s", __func__, outbuf );
-    retval = sc -> F;
-  } else {
-    tcm_message( "%s: successfully executed\n", __func__ );
-    retval = sc -> T;
+  retval = mk_integer( sc, (long) bytes_written );
+  return(retval);
+}
+
+/*! argument kinds of quiet channel primitives */
+typedef enum {
+  t_ffi_arg_channel,                                    /*!< channel descriptor */
+  t_ffi_arg_server_channel,                             /*!< server socket channel descriptor */
+  t_ffi_arg_integer,                                    /*!< integer value */
+  t_ffi_arg_string,                                     /*!< string value */
+  t_ffi_arg_symbol,                                     /*!< symbol */
+  t_ffi_arg_arbiter,                                    /*!< AT arbiter descriptor */
+  t_ffi_arg_dev_channel,                                /*!< device channel descriptor */
+  t_ffi_arg_cmux,                                       /*!< CMUX multiplexer descriptor */
+  t_ffi_arg_local_channel,                              /*!< local channel descriptor */
+  t_ffi_arg_closure,                                    /*!< procedure */
+  t_ffi_arg_matcher                                     /*!< string or compiled pattern */
+} t_ffi_arg_kind;
+
+/*! signature of a quiet channel primitive */
+typedef struct {
+  const char*                   name;                   /*!< name of primitive for error messages */
+  int                           nr_args;                /*!< number of arguments */
+  t_ffi_arg_kind                kinds[6];               /*!< argument kinds */
+} t_ffi_signature;
+
+/*! converted argument of a quiet channel primitive */
+typedef union {
+  t_base_channel*               p_channel;              /*!< channel of t_ffi_arg_channel, t_ffi_arg_server_channel, t_ffi_arg_dev_channel and t_ffi_arg_local_channel */
+  long                          ivalue;                 /*!< value of t_ffi_arg_integer */
+  const char*                   p_str;                  /*!< value of t_ffi_arg_string and name of t_ffi_arg_symbol */
+  t_tcm_arbiter*                p_arbiter;              /*!< arbiter of t_ffi_arg_arbiter */
+  t_cmux*                       p_cmux;                 /*!< multiplexer of t_ffi_arg_cmux */
+  pointer                       closure;                /*!< procedure of t_ffi_arg_closure */
+  pointer                       matcher;                /*!< string or pattern object of t_ffi_arg_matcher */
+} t_ffi_arg;
+
+static const t_ffi_signature ffi_write_channel = { "%write-channel", 2, { t_ffi_arg_channel, t_ffi_arg_string } };
+static const t_ffi_signature ffi_write_channel_to = { "%write-channel-to", 3, { t_ffi_arg_server_channel, t_ffi_arg_integer, t_ffi_arg_string } };
+static const t_ffi_signature ffi_channel_open = { "%channel-open?", 1, { t_ffi_arg_channel } };
+
+static void* get_pattern( scheme* sc, pointer x );
+
+
+/*
+ * convert arguments according to signature, only errors are logged
+ */
+static int ffi_args( scheme* sc, pointer args, const t_ffi_signature* p_sig, t_ffi_arg* p_args )
+{
+  pointer x;
+  int i;
+
+  for( i = 0; i < p_sig->nr_args; ++i, args = pair_cdr( args ) ) {
+    if( ! is_pair( args ) )
+      break;
+
+    x = pair_car( args );
+    switch( p_sig->kinds[i] ) {
+    case t_ffi_arg_channel:
+    case t_ffi_arg_server_channel:
+    case t_ffi_arg_dev_channel:
+    case t_ffi_arg_local_channel:
+      if( ! is_integer( x ) || ivalue( x ) == 0 )
+        goto type_error;
+      p_args[i].p_channel = (t_base_channel *) ivalue( x );
+      if( p_sig->kinds[i] == t_ffi_arg_server_channel && p_args[i].p_channel->type != t_channel_server_sock_type )
+        goto type_error;
+      if( p_sig->kinds[i] == t_ffi_arg_dev_channel && p_args[i].p_channel->type != t_channel_dev_type )
+        goto type_error;
+      if( p_sig->kinds[i] == t_ffi_arg_local_channel && p_args[i].p_channel->type != t_channel_local_type )
+        goto type_error;
+      break;
+
+    case t_ffi_arg_integer:
+      if( ! is_integer( x ) )
+        goto type_error;
+      p_args[i].ivalue = ivalue( x );
+      break;
+
+    case t_ffi_arg_string:
+      if( ! is_string( x ) )
+        goto type_error;
+      p_args[i].p_str = string_value( x );
+      break;
+
+    case t_ffi_arg_symbol:
+      if( ! is_symbol( x ) )
+        goto type_error;
+      p_args[i].p_str = symname( x );
+      break;
+
+    case t_ffi_arg_arbiter:
+      if( ! is_integer( x ) || ! tcm_arbiter_is_valid( (t_tcm_arbiter *) ivalue( x ) ) )
+        goto type_error;
+      p_args[i].p_arbiter = (t_tcm_arbiter *) ivalue( x );
+      break;
+
+    case t_ffi_arg_cmux:
+      if( ! is_integer( x ) || ! cmux_is_valid( (t_cmux *) ivalue( x ) ) )
+        goto type_error;
+      p_args[i].p_cmux = (t_cmux *) ivalue( x );
+      break;
+
+    case t_ffi_arg_closure:
+      if( ! is_closure( x ) )
+        goto type_error;
+      p_args[i].closure = x;
+      break;
+
+    case t_ffi_arg_matcher:
+      if( ! is_string( x ) && get_pattern( sc, x ) == NULL )
+        goto type_error;
+      p_args[i].matcher = x;
+      break;
+    }
   }
 
-  return(retval);
+  if( i == p_sig->nr_args && args == sc->NIL )
+    return 0;
+
+  tcm_error( "%s: function takes %d arguments error!\n", p_sig->name, p_sig->nr_args );
+  return -1;
+
+type_error:
+  tcm_error( "%s: wrong type of argument %d error!\n", p_sig->name, i + 1 );
+  return -1;
 }
 
+
 /*!
- * returns the full qualified path name of the script installation directory
+ * write bytes to channel without console output and logging
  *
- * usually /usr/bin or /usr/local/bin
+ * Same as write-channel for use in callbacks, only errors are logged.
  *
- * \param sc pointer to scheme instance data
- * \param args not used
- * \return pointer to scheme string with full qualified script installation path name
+ * try: (%write-channel ch "hello")
+ *
+ * \param sc pointer to scheme context
+ * \param args pointer to argument list, channel instance and string to write
+ * \return pointer to scheme integer value providing the number of bytes written, -1 in case of error
  */
-static pointer scm_get_script_dir(scheme *sc, pointer args)
+static pointer scm_quiet_write_channel(scheme *sc, pointer args)
 {
-  const char* p_script_dir = SCHEMESCRIPTDIR;
-  pointer retval;
+  t_ffi_arg a[2];
+  int bytes_written;
 
-  retval = mk_string( sc, p_script_dir );
+  if( ffi_args( sc, args, & ffi_write_channel, a ) )
+    return mk_integer( sc, -1L );
 
-  return( retval );
+  tcm_trace_write_begin();
+  bytes_written = a[0].p_channel->write( a[0].p_channel, (char *)a[1].p_str, strlen( a[1].p_str ) );
+  tcm_trace_write_end();
+  base_channel_count_tx( a[0].p_channel, bytes_written );
+  tcm_flightrec_add( t_tcm_flightrec_tx, a[0].p_channel, a[1].p_str, bytes_written, 0, 0 );
+
+  return mk_integer( sc, (long) bytes_written );
 }
 
 
-void init_tcm_ff( scheme* sc )
+/*!
+ * write bytes to one connection of a server socket channel without console output
+ *
+ * Same as write-channel-to for use in callbacks, only errors are logged.
+ *
+ * try: (%write-channel-to ch id "hello")
+ *
+ * \param sc pointer to scheme context
+ * \param args pointer to argument list, server socket channel instance, connection identifier and string to write
+ * \return pointer to scheme integer value providing the number of bytes written, -1 in case of error
+ */
+static pointer scm_quiet_write_channel_to(scheme *sc, pointer args)
+{
+  t_ffi_arg a[3];
+  int bytes_written;
+
+  if( ffi_args( sc, args, & ffi_write_channel_to, a ) )
+    return mk_integer( sc, -1L );
+
+  tcm_trace_write_begin();
+  bytes_written = write_server_sock_channel_to( (t_server_sock_channel *)a[0].p_channel, a[1].ivalue, a[2].p_str, strlen( a[2].p_str ) );
+  tcm_trace_write_end();
+  base_channel_count_tx( a[0].p_channel, bytes_written );
+  tcm_flightrec_add( t_tcm_flightrec_tx, a[0].p_channel, a[2].p_str, bytes_written, 0, 0 );
+
+  return mk_integer( sc, (long) bytes_written );
+}
+
+
+/*!
+ * return channel's connection state without console output and logging
+ *
+ * try: (%channel-open? ch)
+ *
+ * \param sc pointer to scheme context
+ * \param args pointer to argument list, channel instance
+ * \return true when channel open
+ */
+static pointer scm_quiet_channel_open(scheme *sc, pointer args)
+{
+  t_ffi_arg a[1];
+
+  if( ffi_args( sc, args, & ffi_channel_open, a ) )
+    return sc->F;
+
+  return( a[0].p_channel->is_open( a[0].p_channel ) ? sc->T : sc->F );
+}
+
+
+/*!
+ * close one connection of a server socket channel
+ *
+ * try: (close-connection ch id)
+ *
+ * \param sc pointer to scheme context
+ * \param args pointer to argument list, 1st argument is server socket channel instance,
+ *        2nd argument is connection identifier
+ * \return pointer to boolean value as result code, #t in case of success
+ */
+static pointer scm_close_connection(scheme *sc, pointer args)
 {
+  pointer arg;
+  pointer retval;
+  int     i = 0;
+  char    outbuf[80] = { '\0' };
+  int     errors = 0;
+  t_base_channel* p_base_channel;
+  long    conn_id;
+
+  while( args != sc->NIL )
+  {
+    if( i > 1 ) {
+      snprintf( outbuf, sizeof(outbuf), "function takes two arguments only error!\n" );
+      errors = -1;
+      break;
+    }
+    else if( i == 0  ) {
+      if( is_integer( arg = pair_car(args)) ) {
+        p_base_channel = (t_base_channel *) ivalue( arg );
+        if( p_base_channel == NULL || p_base_channel->type != t_channel_server_sock_type ) {
+          snprintf( outbuf, sizeof(outbuf), "first argument must be server socket channel!\n" );
+          errors = -1;
+          break;
+        }
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "first argument must be channel descriptor!\n" );
+        errors = -1;
+        break;
+      }
+    }
+    else if( i == 1 ) {
+      if( is_integer( arg = pair_car(args) ) ) {
+        conn_id = ivalue( arg );
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "second argument must be connection identifier!\n" );
+        errors = -1;
+        break;
+      }
+    }
+
+    args = pair_cdr( args );
+    ++i;
+  }
+
+  if( ! errors && i != 2 ) {
+    snprintf( outbuf, sizeof(outbuf), "function takes two arguments (channel, connection) error!\n" );
+    errors = -1;
+  }
+
+  if( ! errors ) {
+    if( close_server_sock_channel_conn( (t_server_sock_channel *)p_base_channel, conn_id ) ) {
+      snprintf( outbuf, sizeof(outbuf), "connection %ld does not exist error!\n", conn_id );
+      errors = -1;
+    }
+  }
+
+  if( outbuf[0] != '\0' )
+    putstr( sc, outbuf );
+
+  if( errors ) {
+    tcm_error( "%s: %s", __func__, outbuf );
+    retval = sc -> F;
+  } else {
+    retval = sc -> T;
+  }
+
+  return(retval);
+}
+
+/*!
+ *  close communication channel instance
+ *
+ * \param sc pointer to scheme context
+ * \param args pointer to argument list with one argument of channel instance to close
+ * \return pointer to boolean value as result code, #t in case of success
+ */
+static pointer scm_close_channel(scheme *sc, pointer args)
+{
+  t_tcm_scheme* p_tcm_scheme = (t_tcm_scheme *)sc;
+  pointer arg;
+  pointer retval;
+  int     i = 0;
+  char    outbuf[80] = { '\0' };
+  int     errors = 0;
+  pointer closure_code;
+  t_base_channel* p_base_channel;
+  char* p_write_buf;
+  int bytes_written = -1;
+
+  while( args != sc->NIL )
+  {
+    if( i > 0 ) {
+      snprintf( outbuf, sizeof(outbuf), "function takes one argument only error!\n" );
+      errors = -1;
+      break;
+    }
+    else if( i == 0  ) {
+      if( is_integer( arg = pair_car(args)) ) {
+        p_base_channel = (t_base_channel *) ivalue( arg );
+      } else {
+        snprintf( outbuf, sizeof(outbuf), "first argument must be channel descriptor!\n" );
+        errors = -1;
+        break;
+      }
+    }
+
+    args = pair_cdr( args );
+    ++i;
+  }
+
+  if( ! errors ) {
+    /* clear symbol linkage to call back function to allow gc to release callback closure */
+    scheme_define( sc, sc->global_env, mk_symbol( sc, p_base_channel->cb_symbol_name ), sc->NIL );
+    if( p_base_channel->p_evt_cb_closure_code )
+      scheme_define( sc, sc->global_env, mk_symbol( sc, p_base_channel->evt_cb_symbol_name ), sc->NIL );
+    p_base_channel->release( p_base_channel );
+  }
+
+  if( outbuf[0] != '\0' )
+    putstr( sc, outbuf );
+
+  if( errors ) {
+    tcm_error( "%s: %s", __func__, outbuf );
+    retval = sc -> F;
+  } else {
+    tcm_message( "%s: successfully executed\n", __func__ );
+    retval = sc -> T;
+  }
+
+  return(retval);
+}
+
+/*!
+ * compare the typed C interface against string evaluation
+ *
+ * The given procedure is invoked asynchronously without arguments the given
+ * number of times via both interfaces. The time per call is logged.
+ *
+ * try:
+ * (define (bench-nop) 42)
+ * (benchmark-c-api "bench-nop" 10000)
+ *
+ * \param sc pointer to scheme context
+ * \param args pointer to argument list
+ * \return pointer to scheme boolean value, T when benchmark has been started
+ */
+static pointer scm_benchmark_c_api(scheme *sc, pointer args)
+{
+  pointer arg;
+  pointer retval;
+  char    *name = NULL;
+  int     count = 0;
+  int     i = 0;
+  char    outbuf[80] = { '\0' };
+  int     errors = 0;
+
+  while( args != sc->NIL )
+  {
+    if( i > 1 ) {
+      snprintf( outbuf, sizeof(outbuf), "function takes only two arguments error!\n" );
+      errors = -1;
+      break;
+    }
+    else if( i == 0 && is_string( arg = pair_car(args)) ) {
+      name = string_value( arg );
+    }
+    else if( i == 1 && is_integer( arg = pair_car(args)) ) {
+      count = ivalue( arg );
+    }
+    else {
+      snprintf( outbuf, sizeof(outbuf), "wrong argument type, must be procedure name and count!\n" );
+      errors = -1;
+      break;
+    }
+
+    args = pair_cdr( args );
+    ++i;
+  }
+
+  if( ! errors && ( name == NULL || count <= 0 ) ) {
+    snprintf( outbuf, sizeof(outbuf), "procedure name and positive count required error!\n" );
+    errors = -1;
+  }
+
+  if( ! errors ) {
+    errors = tcm_scheme_benchmark_api( (t_tcm_scheme *)sc, name, count );
+    if( errors ) {
+      snprintf( outbuf, sizeof(outbuf), "could not start benchmark error!\n" );
+    } else {
+      snprintf( outbuf, sizeof(outbuf), "benchmark started, refer to log for results\n" );
+    }
+  }
+
+  if( outbuf[0] != '\0' )
+    putstr( sc, outbuf );
+
+  if( errors ) {
+    tcm_error( "%s: %s", __func__, outbuf );
+    retval = sc -> F;
+  } else {
+    retval = sc -> T;
+  }
+
+  return(retval);
+}
+
+
+/*!
+ * compare the channel primitives against their quiet variants
+ *
+ * Each primitive is invoked the given number of times directly with the
+ * same argument list, output to the current port is discarded. Returns the
+ * list ((name . ns-per-call) ...) for write-channel, %write-channel,
+ * is-channel-open and %channel-open?. The writes are issued to the channel,
+ * use e.g. a device channel to /dev/null and an empty string.
+ *
+ * try:
+ * (define null-ch (make-dev-channel "/dev/null" (lambda (s) s)))
+ * (benchmark-channel-ffi null-ch 10000)
+ *
+ * \param sc pointer to scheme context
+ * \param args pointer to argument list, channel, count and optional string to write
+ * \return pointer to list of results or F in case of error
+ */
+static pointer scm_benchmark_channel_ffi(scheme *sc, pointer args)
+{
+  static const struct {
+    const char*                 name;
+    foreign_func                f;
+    int                         write;
+  } candidates[] = {
+    { "write-channel", scm_write_channel, 1 },
+    { "%write-channel", scm_quiet_write_channel, 1 },
+    { "is-channel-open", scm_is_channel_open, 0 },
+    { "%channel-open?", scm_quiet_channel_open, 0 }
+  };
+  const int nr_candidates = sizeof( candidates ) / sizeof( candidates[0] );
+  t_tcm_scheme* p = (t_tcm_scheme *)sc;
+  pointer write_args, open_args, frame, retval, saved_outport, x;
+  struct timespec t0, t1;
+  double ns[sizeof( candidates ) / sizeof( candidates[0] )];
+  long count, n;
+  int i;
+
+  if( ! is_pair( args ) || ! is_integer( pair_car( args ) ) || ivalue( pair_car( args ) ) == 0 ||
+      ! is_pair( pair_cdr( args ) ) || ! is_integer( pair_car( pair_cdr( args ) ) ) ||
+      ( count = ivalue( pair_car( pair_cdr( args ) ) ) ) <= 0 )
+  {
+    putstr( sc, "arguments must be channel, positive count and optional string!\n" );
+    tcm_error( "%s: arguments must be channel, positive count and optional string!\n", __func__ );
+    return sc->F;
+  }
+
+  /* argument lists (channel) and (channel string) */
+  frame = tcm_scheme_protect( p, sc->NIL );
+  open_args = cons( sc, pair_car( args ), sc->NIL );
+  set_car( frame, open_args );
+  if( is_pair( pair_cdr( pair_cdr( args ) ) ) && is_string( pair_car( pair_cdr( pair_cdr( args ) ) ) ) )
+    write_args = cons( sc, pair_car( args ), pair_cdr( pair_cdr( args ) ) );
+  else
+    write_args = cons( sc, pair_car( args ), cons( sc, mk_string( sc, "" ), sc->NIL ) );
+  set_car( frame, cons( sc, write_args, pair_car( frame ) ) );
+
+  saved_outport = sc->outport;
+  sc->outport = p->p_null_port;
+
+  for( i = 0; i < nr_candidates; ++i ) {
+    clock_gettime( CLOCK_MONOTONIC, & t0 );
+    for( n = 0; n < count; ++n )
+      candidates[i].f( sc, candidates[i].write ? write_args : open_args );
+    clock_gettime( CLOCK_MONOTONIC, & t1 );
+    ns[i] = ( ( t1.tv_sec - t0.tv_sec ) * 1e9 + ( t1.tv_nsec - t0.tv_nsec ) ) / count;
+    tcm_message( "%s: %s %.0f ns per call\n", __func__, candidates[i].name, ns[i] );
+  }
+
+  sc->outport = saved_outport;
+
+  /* results replace the argument lists in the protected frame */
+  set_car( frame, sc->NIL );
+  for( i = nr_candidates - 1; i >= 0; --i ) {
+    /* pair is created in place such that each allocation is reachable */
+    set_car( frame, cons( sc, mk_real( sc, ns[i] ), pair_car( frame ) ) );
+    x = pair_car( frame );
+    set_car( x, cons( sc, mk_string( sc, candidates[i].name ), pair_car( x ) ) );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( p );
+
+  return( retval );
+}
+
+
+/*!
+ * page fault and context switch statistics of all threads
+ *
+ * Returns a list with one entry (tid name policy priority minflt majflt voluntary involuntary)
+ * per thread. Policy is one of the symbols other, fifo, rr or batch.
+ *
+ * try: (thread-stats)
+ *
+ * \param sc pointer to scheme context
+ * \param args not used
+ * \return pointer to list of thread statistics or F in case of error
+ */
+static pointer scm_thread_stats(scheme *sc, pointer args)
+{
+  static const char* policies[] = { "other", "fifo", "rr", "batch", "iso", "idle", "deadline" };
+  t_tcm_rt_thread_stats* p_stats;
+  t_tcm_rt_thread_stats* s;
+  pointer retval, frame, entry;
+  int i, n;
+
+  p_stats = cul_malloc( TCM_RT_MAX_THREADS * sizeof( t_tcm_rt_thread_stats ) );
+  if( p_stats == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return sc->F;
+  }
+
+  n = tcm_rt_thread_stats( p_stats, TCM_RT_MAX_THREADS );
+  if( n < 0 ) {
+    cul_free( p_stats );
+    return sc->F;
+  }
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    s = & p_stats[i];
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    set_car( entry, cons( sc, mk_integer( sc, s->involuntary_switches ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->voluntary_switches ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->majflt ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->minflt ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->priority ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_symbol( sc, s->policy < sizeof( policies ) / sizeof( policies[0] ) ?
+                                         policies[s->policy] : "unknown" ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_string( sc, s->name ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->tid ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_stats );
+
+  return( retval );
+}
+
+
+/*!
+ * interpreter hold time statistics
+ *
+ * Returns a list with one entry (channel handler count overruns max-ms total-ms)
+ * per channel and handler sorted by the longest hold time. The statistics are
+ * cleared when the symbol reset is given as argument.
+ *
+ * try: (interpreter-lock-stats) or (interpreter-lock-stats 'reset)
+ *
+ * \param sc pointer to scheme context
+ * \param args optional symbol reset
+ * \return pointer to list of hold time statistics or F in case of error
+ */
+static pointer scm_interpreter_lock_stats(scheme *sc, pointer args)
+{
+  t_tcm_watchdog_stats* p_stats;
+  t_tcm_watchdog_stats* s;
+  pointer retval, frame, entry;
+  int i, n, reset = 0;
+
+  if( args != sc->NIL ) {
+    if( is_symbol( pair_car( args ) ) && ! strcmp( symname( pair_car( args ) ), "reset" ) ) {
+      reset = 1;
+    } else {
+      putstr( sc, "wrong argument, must be symbol reset!\n" );
+      tcm_error( "%s: wrong argument, must be symbol reset!\n", __func__ );
+      return sc->F;
+    }
+  }
+
+  p_stats = cul_malloc( TCM_WATCHDOG_MAX_HOLDERS * sizeof( t_tcm_watchdog_stats ) );
+  if( p_stats == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return sc->F;
+  }
+
+  n = tcm_watchdog_stats( ((t_tcm_scheme *)sc)->p_watchdog, p_stats, TCM_WATCHDOG_MAX_HOLDERS, reset );
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    s = & p_stats[i];
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    set_car( entry, cons( sc, mk_real( sc, s->total_ms ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_real( sc, s->max_ms ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->nr_overruns ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->count ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_string( sc, s->handler ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_string( sc, s->owner ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_stats );
+
+  return( retval );
+}
+
+
+/*!
+ * write flight recorder of recent channel events to file
+ *
+ * Without argument the file specified in the configuration is used.
+ *
+ * try: (dump-flight-recorder) or (dump-flight-recorder "/tmp/fr.log")
+ *
+ * \param sc pointer to scheme context
+ * \param args optional file name
+ * \return number of written events or F in case of error
+ */
+static pointer scm_dump_flight_recorder(scheme *sc, pointer args)
+{
+  const char* filename = NULL;
+  int nr_events;
+
+  if( args != sc->NIL ) {
+    if( is_string( pair_car( args ) ) ) {
+      filename = string_value( pair_car( args ) );
+    } else {
+      putstr( sc, "wrong argument type, must be string!\n" );
+      tcm_error( "%s: wrong argument type, must be string!\n", __func__ );
+      return sc->F;
+    }
+  }
+
+  nr_events = tcm_flightrec_dump( filename );
+  if( nr_events < 0 ) {
+    tcm_error( "%s: could not write flight recorder error!\n", __func__ );
+    return sc->F;
+  }
+
+  return mk_integer( sc, nr_events );
+}
+
+
+/*!
+ * per stage latency histograms of received messages
+ *
+ * Returns a list with one entry (stage count sum-us max-us buckets) per stage
+ * post, queue, lock, eval, write and total. Buckets is a list of pairs
+ * (upper-bound-us . count) of all non empty buckets. The histograms are
+ * cleared when the symbol reset is given as argument.
+ *
+ * try: (latency-histograms) or (latency-histograms 'reset)
+ *
+ * \param sc pointer to scheme context
+ * \param args optional symbol reset
+ * \return pointer to list of histograms or F in case of error
+ */
+static pointer scm_latency_histograms(scheme *sc, pointer args)
+{
+  t_tcm_trace_hist* p_hists;
+  t_tcm_trace_hist* h;
+  pointer retval, frame, entry, x;
+  int i, j, reset = 0;
+
+  if( args != sc->NIL ) {
+    if( is_symbol( pair_car( args ) ) && ! strcmp( symname( pair_car( args ) ), "reset" ) ) {
+      reset = 1;
+    } else {
+      putstr( sc, "wrong argument, must be symbol reset!\n" );
+      tcm_error( "%s: wrong argument, must be symbol reset!\n", __func__ );
+      return sc->F;
+    }
+  }
+
+  p_hists = cul_malloc( t_tcm_trace_nr_stages * sizeof( t_tcm_trace_hist ) );
+  if( p_hists == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return sc->F;
+  }
+
+  tcm_trace_histograms( p_hists, reset );
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = t_tcm_trace_nr_stages - 1; i >= 0; --i ) {
+    h = & p_hists[i];
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    for( j = TCM_TRACE_NR_BUCKETS - 1; j >= 0; --j ) {
+      if( h->buckets[j] ) {
+        /* pair is created in place such that each allocation is reachable */
+        set_car( entry, cons( sc, mk_integer( sc, h->buckets[j] ), pair_car( entry ) ) );
+        x = pair_car( entry );
+        set_car( x, cons( sc, mk_integer( sc, 1L << j ), pair_car( x ) ) );
+      }
+    }
+    set_car( entry, cons( sc, pair_car( entry ), sc->NIL ) );
+    set_car( entry, cons( sc, mk_integer( sc, h->max_us ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, h->sum_us ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, h->count ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_symbol( sc, g_tcm_trace_stage_names[i] ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_hists );
+
+  return( retval );
+}
+
+
+/*!
+ * recent messages whose latency exceeded the configured threshold
+ *
+ * Returns a list with one entry (channel end-ms payload writes post queue lock eval write total)
+ * per slow message, oldest first. Stage durations are given in microseconds,
+ * end-ms refers to the start of the daemon.
+ *
+ * try: (slow-traces)
+ *
+ * \param sc pointer to scheme context
+ * \param args not used
+ * \return pointer to list of slow traces or F in case of error
+ */
+static pointer scm_slow_traces(scheme *sc, pointer args)
+{
+  t_tcm_trace_slow* p_slow;
+  t_tcm_trace_slow* s;
+  pointer retval, frame, entry;
+  int i, j, n;
+
+  p_slow = cul_malloc( TCM_TRACE_NR_SLOW * sizeof( t_tcm_trace_slow ) );
+  if( p_slow == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return sc->F;
+  }
+
+  n = tcm_trace_slow( p_slow, TCM_TRACE_NR_SLOW );
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    s = & p_slow[i];
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    for( j = t_tcm_trace_nr_stages - 1; j >= 0; --j )
+      set_car( entry, cons( sc, mk_integer( sc, s->stage_us[j] ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->nr_writes ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_string( sc, s->prefix ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_real( sc, s->end_ms ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, (long)s->channel ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_slow );
+
+  return( retval );
+}
+
+
+/*!
+ * start sampling profiler of scheme procedures
+ *
+ * All procedures bound in the global environment are indexed and the
+ * interpreter is sampled at the given rate, 100 Hz by default. Previous
+ * samples are discarded.
+ *
+ * try: (profile-start) or (profile-start 1000)
+ *
+ * \param sc pointer to scheme context
+ * \param args optional sampling rate in Hz
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_profile_start(scheme *sc, pointer args)
+{
+  long hz = TCM_PROFILE_DEFAULT_HZ;
+
+  if( args != sc->NIL ) {
+    if( is_integer( pair_car( args ) ) && ivalue( pair_car( args ) ) > 0 &&
+        ivalue( pair_car( args ) ) <= TCM_PROFILE_MAX_HZ ) {
+      hz = ivalue( pair_car( args ) );
+    } else {
+      putstr( sc, "wrong argument, must be sampling rate in Hz!\n" );
+      tcm_error( "%s: wrong argument, must be sampling rate in Hz!\n", __func__ );
+      return sc->F;
+    }
+  }
+
+  if( tcm_profile_start( (t_tcm_scheme *)sc, (int)hz ) ) {
+    tcm_error( "%s: could not start profiler error!\n", __func__ );
+    return sc->F;
+  }
+
+  return sc->T;
+}
+
+
+/*!
+ * stop sampling profiler, samples are kept for evaluation
+ *
+ * Returns the list (samples idle dropped procedures) with the number of
+ * samples taken while the interpreter was held, the number of sampling
+ * periods without interpreter activity, the samples lost for lack of space
+ * and the number of indexed procedures.
+ *
+ * try: (profile-stop)
+ *
+ * \param sc pointer to scheme context
+ * \param args not used
+ * \return pointer to summary list
+ */
+static pointer scm_profile_stop(scheme *sc, pointer args)
+{
+  t_tcm_profile_summary summary;
+  pointer retval, frame;
+
+  tcm_profile_stop();
+  tcm_profile_summary( & summary );
+
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  set_car( frame, cons( sc, mk_integer( sc, summary.nr_procedures ), pair_car( frame ) ) );
+  set_car( frame, cons( sc, mk_integer( sc, summary.nr_dropped ), pair_car( frame ) ) );
+  set_car( frame, cons( sc, mk_integer( sc, summary.nr_idle ), pair_car( frame ) ) );
+  set_car( frame, cons( sc, mk_integer( sc, summary.nr_samples ), pair_car( frame ) ) );
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return( retval );
+}
+
+
+/*!
+ * flat profile of scheme procedures
+ *
+ * Returns a list with one entry (name location self total) per procedure
+ * sorted by self samples. Location is given as "file:line" of the
+ * definition or as empty string when unknown. Self counts the samples with
+ * the procedure innermost, total the samples with the procedure anywhere on
+ * the stack. Entries of the form "channel/handler" refer to the evaluation
+ * the samples have been taken in.
+ *
+ * try: (profile-flat)
+ *
+ * \param sc pointer to scheme context
+ * \param args not used
+ * \return pointer to list of profile entries or F in case of error
+ */
+static pointer scm_profile_flat(scheme *sc, pointer args)
+{
+  t_tcm_profile_entry* p_entries;
+  t_tcm_profile_entry* e;
+  t_tcm_profile_summary summary;
+  pointer retval, frame, entry;
+  int i, n, max;
+
+  tcm_profile_summary( & summary );
+  max = summary.nr_procedures + TCM_PROFILE_MAX_ROOTS;
+
+  p_entries = cul_malloc( max * sizeof( t_tcm_profile_entry ) );
+  if( p_entries == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return sc->F;
+  }
+
+  n = tcm_profile_flat( p_entries, max );
+  if( n < 0 ) {
+    cul_free( p_entries );
+    return sc->F;
+  }
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    e = & p_entries[i];
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    set_car( entry, cons( sc, mk_integer( sc, e->total ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, e->self ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_string( sc, e->location ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_string( sc, e->name ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_entries );
+
+  return( retval );
+}
+
+
+static pointer reverse_in_place( scheme *sc, pointer x )
+{
+  pointer prev = sc->NIL, next;
+
+  for( ; x != sc->NIL; prev = x, x = next ) {
+    next = pair_cdr( x );
+    set_cdr( x, prev );
+  }
+
+  return( prev );
+}
+
+
+/* node at *p_i including all nodes below, built as (name location samples children ...) */
+static pointer profile_subtree( scheme *sc, const t_tcm_profile_node* p_nodes, int n, int* p_i )
+{
+  const t_tcm_profile_node* p_node = & p_nodes[(*p_i)++];
+  pointer frame, retval;
+
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+
+  /* children are collected in reverse order and reversed in place */
+  while( *p_i < n && p_nodes[*p_i].depth > p_node->depth )
+    set_car( frame, cons( sc, profile_subtree( sc, p_nodes, n, p_i ), pair_car( frame ) ) );
+
+  set_car( frame, reverse_in_place( sc, pair_car( frame ) ) );
+
+  set_car( frame, cons( sc, mk_integer( sc, p_node->samples ), pair_car( frame ) ) );
+  set_car( frame, cons( sc, mk_string( sc, p_node->location ), pair_car( frame ) ) );
+  set_car( frame, cons( sc, mk_string( sc, p_node->name ), pair_car( frame ) ) );
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return( retval );
+}
+
+
+/*!
+ * call tree profile of scheme procedures
+ *
+ * Returns a list of trees, one per channel/handler the samples have been
+ * taken in. Each node is given as (name location samples children ...),
+ * children are sorted by samples.
+ *
+ * try: (profile-tree)
+ *
+ * \param sc pointer to scheme context
+ * \param args optional maximum number of nodes, 1000 by default
+ * \return pointer to list of trees or F in case of error
+ */
+static pointer scm_profile_tree(scheme *sc, pointer args)
+{
+  t_tcm_profile_node* p_nodes;
+  pointer retval, frame;
+  long max = 1000;
+  int i = 0, n;
+
+  if( args != sc->NIL ) {
+    if( is_integer( pair_car( args ) ) && ivalue( pair_car( args ) ) > 0 ) {
+      max = ivalue( pair_car( args ) );
+    } else {
+      putstr( sc, "wrong argument, must be positive integer!\n" );
+      tcm_error( "%s: wrong argument, must be positive integer!\n", __func__ );
+      return sc->F;
+    }
+  }
+
+  p_nodes = cul_malloc( max * sizeof( t_tcm_profile_node ) );
+  if( p_nodes == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return sc->F;
+  }
+
+  n = tcm_profile_tree( p_nodes, (int)max );
+  if( n < 0 ) {
+    cul_free( p_nodes );
+    return sc->F;
+  }
+
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  while( i < n )
+    set_car( frame, cons( sc, profile_subtree( sc, p_nodes, n, & i ), pair_car( frame ) ) );
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_nodes );
+
+  /* trees are given in order of decreasing samples */
+  return( reverse_in_place( sc, retval ) );
+}
+
+
+/*!
+ * write profile as collapsed stacks for flame graph generation
+ *
+ * Generate the graph e.g. with flamegraph.pl tcm.folded > tcm.svg
+ *
+ * try: (profile-write-collapsed "/tmp/tcm.folded")
+ *
+ * \param sc pointer to scheme context
+ * \param args file name
+ * \return number of written stacks or F in case of error
+ */
+static pointer scm_profile_write_collapsed(scheme *sc, pointer args)
+{
+  int n;
+
+  if( args == sc->NIL || ! is_string( pair_car( args ) ) ) {
+    putstr( sc, "wrong argument type, must be string!\n" );
+    tcm_error( "%s: wrong argument type, must be string!\n", __func__ );
+    return sc->F;
+  }
+
+  n = tcm_profile_write_collapsed( string_value( pair_car( args ) ) );
+  if( n < 0 )
+    return sc->F;
+
+  return mk_integer( sc, n );
+}
+
+
+/*!
+ * define cacheable AT command
+ *
+ * try: (at-cache-rule "AT+CGMI" 0) or (at-cache-rule "AT+CIMI" 60000)
+ *
+ * \param sc pointer to scheme context
+ * \param args command and time to live in milliseconds, 0 for until invalidated
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_at_cache_rule(scheme *sc, pointer args)
+{
+  if( args == sc->NIL || ! is_string( pair_car( args ) ) ||
+      pair_cdr( args ) == sc->NIL || ! is_integer( pair_car( pair_cdr( args ) ) ) ) {
+    putstr( sc, "wrong argument type, must be string and integer!\n" );
+    tcm_error( "%s: wrong argument type, must be string and integer!\n", __func__ );
+    return sc->F;
+  }
+
+  if( tcm_atcache_set_rule( string_value( pair_car( args ) ), ivalue( pair_car( pair_cdr( args ) ) ) ) < 0 )
+    return sc->F;
+
+  return sc->T;
+}
+
+
+/*!
+ * flush cached responses when modem message starts with prefix
+ *
+ * Without commands all cached responses are flushed.
+ *
+ * try: (at-cache-invalidate-on "+CPIN:" "AT+CIMI" "AT+CCID")
+ *
+ * \param sc pointer to scheme context
+ * \param args prefix and optional commands to flush
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_at_cache_invalidate_on(scheme *sc, pointer args)
+{
+  const char* prefix;
+  pointer x;
+
+  for( x = args; x != sc->NIL; x = pair_cdr( x ) ) {
+    if( ! is_string( pair_car( x ) ) ) {
+      putstr( sc, "wrong argument type, must be string!\n" );
+      tcm_error( "%s: wrong argument type, must be string!\n", __func__ );
+      return sc->F;
+    }
+  }
+
+  if( args == sc->NIL ) {
+    putstr( sc, "missing prefix argument!\n" );
+    tcm_error( "%s: missing prefix argument!\n", __func__ );
+    return sc->F;
+  }
+
+  prefix = string_value( pair_car( args ) );
+  if( pair_cdr( args ) == sc->NIL )
+    return( tcm_atcache_add_invalidation( prefix, NULL ) < 0 ? sc->F : sc->T );
+
+  for( x = pair_cdr( args ); x != sc->NIL; x = pair_cdr( x ) ) {
+    if( tcm_atcache_add_invalidation( prefix, string_value( pair_car( x ) ) ) < 0 )
+      return sc->F;
+  }
+
+  return sc->T;
+}
+
+
+/*!
+ * look up request from host in AT response cache
+ *
+ * Needs to be invoked for every request forwarded to the modem, refer
+ * to tcm_atcache.h for further explanation.
+ *
+ * try: (at-cache-lookup "AT+CGMI\r")
+ *
+ * \param sc pointer to scheme context
+ * \param args request string
+ * \return cached response or F when not cached
+ */
+static pointer scm_at_cache_lookup(scheme *sc, pointer args)
+{
+  char buf[TCM_ATCACHE_MAX_RESPONSE];
+  const char* s;
+  int n;
+
+  if( args == sc->NIL || ! is_string( pair_car( args ) ) ) {
+    tcm_error( "%s: wrong argument type, must be string!\n", __func__ );
+    return sc->F;
+  }
+
+  s = string_value( pair_car( args ) );
+  n = tcm_atcache_lookup( s, strlen( s ), buf, sizeof( buf ) );
+  if( n < 0 )
+    return sc->F;
+
+  return mk_counted_string( sc, buf, n );
+}
+
+
+/*!
+ * pass message from modem to AT response cache
+ *
+ * try: (at-cache-feed "\r\nOK\r\n")
+ *
+ * \param sc pointer to scheme context
+ * \param args message string
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_at_cache_feed(scheme *sc, pointer args)
+{
+  const char* s;
+
+  if( args == sc->NIL || ! is_string( pair_car( args ) ) ) {
+    tcm_error( "%s: wrong argument type, must be string!\n", __func__ );
+    return sc->F;
+  }
+
+  s = string_value( pair_car( args ) );
+  tcm_atcache_feed( s, strlen( s ) );
+
+  return sc->T;
+}
+
+
+/*!
+ * flush cached AT responses
+ *
+ * try: (at-cache-flush) or (at-cache-flush "AT+CIMI")
+ *
+ * \param sc pointer to scheme context
+ * \param args optional command, all responses are flushed when omitted
+ * \return number of flushed responses or F in case of error
+ */
+static pointer scm_at_cache_flush(scheme *sc, pointer args)
+{
+  const char* command = NULL;
+
+  if( args != sc->NIL ) {
+    if( ! is_string( pair_car( args ) ) ) {
+      putstr( sc, "wrong argument type, must be string!\n" );
+      tcm_error( "%s: wrong argument type, must be string!\n", __func__ );
+      return sc->F;
+    }
+    command = string_value( pair_car( args ) );
+  }
+
+  return mk_integer( sc, tcm_atcache_flush( command ) );
+}
+
+
+/*!
+ * statistics of AT response cache
+ *
+ * Returns a list with one entry (command ttl-ms hits misses stores
+ * invalidations cached) per cacheable command.
+ *
+ * try: (at-cache-stats)
+ *
+ * \param sc pointer to scheme context
+ * \param args not used
+ * \return pointer to list of statistics or F in case of error
+ */
+static pointer scm_at_cache_stats(scheme *sc, pointer args)
+{
+  t_tcm_atcache_stats* p_stats;
+  t_tcm_atcache_stats* s;
+  pointer retval, frame, entry;
+  int i, n;
+
+  p_stats = cul_malloc( TCM_ATCACHE_MAX_RULES * sizeof( t_tcm_atcache_stats ) );
+  if( p_stats == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return sc->F;
+  }
+
+  n = tcm_atcache_stats( p_stats, TCM_ATCACHE_MAX_RULES );
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    s = & p_stats[i];
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    set_car( entry, cons( sc, s->cached ? sc->T : sc->F, pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->invalidations ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->stores ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->misses ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->hits ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->ttl_ms ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_string( sc, s->command ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_stats );
+
+  return( retval );
+}
+
+
+/*
+ * symbol of command name, the scheme reader converts symbols to lower case
+ */
+static pointer at_name_symbol( scheme* sc, const char* name )
+{
+  char buf[TCM_AT_MAX_NAME];
+  int i;
+
+  for( i = 0; name[i] && i < TCM_AT_MAX_NAME - 1; ++i )
+    buf[i] = tolower( (unsigned char)name[i] );
+  buf[i] = '\0';
+
+  return mk_symbol( sc, buf );
+}
+
+
+/*
+ * prepends parameters of command to list held in car of protected frame
+ */
+static void at_params_to_list( scheme* sc, pointer frame, const char* s, const t_tcm_at_cmd* p_cmd,
+                               const t_tcm_at_param* p_params )
+{
+  const t_tcm_at_param* p;
+  int i;
+
+  for( i = p_cmd->nr_params - 1; i >= 0; --i ) {
+    p = & p_params[p_cmd->first_param + i];
+    switch( p->type ) {
+    case t_tcm_at_number:
+      set_car( frame, cons( sc, mk_integer( sc, p->number ), pair_car( frame ) ) );
+      break;
+    case t_tcm_at_string:
+    case t_tcm_at_token:
+      set_car( frame, cons( sc, mk_counted_string( sc, s + p->start, p->len ), pair_car( frame ) ) );
+      break;
+    default:
+      set_car( frame, cons( sc, sc->F, pair_car( frame ) ) );
+      break;
+    }
+  }
+}
+
+
+/*!
+ * split AT command line into its commands
+ *
+ * Each command is given as list of its lower case name symbol, its form
+ * execute, set, query or test and its parameters. Numbers are converted to
+ * integers, quoted strings and other text to strings and omitted parameters
+ * are given as F.
+ *
+ * try: (parse-at-command "AT+CREG=2;+CGREG?;E0") -> ((+creg set 2) (+cgreg query) (e execute 0))
+ *
+ * \param sc pointer to scheme context
+ * \param args command line
+ * \return list of commands or F in case of syntax error
+ */
+static pointer scm_parse_at_command(scheme *sc, pointer args)
+{
+  static const char* forms[] = { "execute", "set", "query", "test" };
+  t_tcm_at_cmd cmds[TCM_AT_MAX_COMMANDS];
+  t_tcm_at_param params[TCM_AT_MAX_PARAMS];
+  pointer frame, entry, retval;
+  const char* s;
+  int i, n;
+
+  if( args == sc->NIL || ! is_string( pair_car( args ) ) ) {
+    tcm_error( "%s: wrong argument type, must be string!\n", __func__ );
+    return sc->F;
+  }
+
+  s = string_value( pair_car( args ) );
+  n = tcm_at_parse_command( s, strlen( s ), cmds, TCM_AT_MAX_COMMANDS, params, TCM_AT_MAX_PARAMS );
+  if( n < 0 )
+    return sc->F;
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    at_params_to_list( sc, entry, s, & cmds[i], params );
+    set_car( entry, cons( sc, mk_symbol( sc, forms[ cmds[i].form ] ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, at_name_symbol( sc, cmds[i].name ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return retval;
+}
+
+
+/*!
+ * split AT result line into its prefix and parameters
+ *
+ * Result lines without prefix are returned as their lower case name symbol.
+ *
+ * try: (parse-at-result "+CREG: 0,1\r\n") -> (+creg 0 1)
+ *      (parse-at-result "OK\r\n") -> (ok)
+ *
+ * \param sc pointer to scheme context
+ * \param args result line
+ * \return list of prefix and parameters or F in case of syntax error
+ */
+static pointer scm_parse_at_result(scheme *sc, pointer args)
+{
+  t_tcm_at_cmd result;
+  t_tcm_at_param params[TCM_AT_MAX_PARAMS];
+  pointer frame, retval;
+  const char* s;
+
+  if( args == sc->NIL || ! is_string( pair_car( args ) ) ) {
+    tcm_error( "%s: wrong argument type, must be string!\n", __func__ );
+    return sc->F;
+  }
+
+  s = string_value( pair_car( args ) );
+  if( tcm_at_parse_result( s, strlen( s ), & result, params, TCM_AT_MAX_PARAMS ) < 0 )
+    return sc->F;
+
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  at_params_to_list( sc, frame, s, & result, params );
+  set_car( frame, cons( sc, at_name_symbol( sc, result.name ), pair_car( frame ) ) );
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return retval;
+}
+
+
+/*!
+ * look up AT command name or result code in the vocabulary
+ *
+ * The vocabulary entry is given as list of its identifier, its lower case
+ * name symbol, the list of its categories command, urc and final and its
+ * default priority from 0 (background) to 3 (urgent).
+ *
+ * try: (at-vocabulary-ref "+CREG") -> (57 +creg (command urc) 2)
+ *      (at-vocabulary-ref 'ok) -> (1 ok (final) 2)
+ *      (at-vocabulary-ref 1) -> (1 ok (final) 2)
+ *
+ * \param sc pointer to scheme context
+ * \param args name as string or symbol or identifier as integer
+ * \return vocabulary entry or F for unknown names
+ */
+static pointer scm_at_vocabulary_ref(scheme *sc, pointer args)
+{
+  const t_tcm_at_word* p_word;
+  pointer frame, retval, x;
+  const char* name;
+
+  if( args == sc->NIL ) {
+    tcm_error( "%s: missing argument!\n", __func__ );
+    return sc->F;
+  }
+
+  x = pair_car( args );
+  if( is_integer( x ) ) {
+    p_word = tcm_at_vocabulary_by_id( ivalue( x ) );
+  } else if( is_string( x ) || is_symbol( x ) ) {
+    name = is_string( x ) ? string_value( x ) : symname( x );
+    p_word = tcm_at_vocabulary_lookup( name, strlen( name ) );
+  } else {
+    tcm_error( "%s: wrong argument type, must be string, symbol or integer!\n", __func__ );
+    return sc->F;
+  }
+
+  if( ! p_word )
+    return sc->F;
+
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  if( p_word->categories & TCM_AT_FINAL )
+    set_car( frame, cons( sc, mk_symbol( sc, "final" ), pair_car( frame ) ) );
+  if( p_word->categories & TCM_AT_URC )
+    set_car( frame, cons( sc, mk_symbol( sc, "urc" ), pair_car( frame ) ) );
+  if( p_word->categories & TCM_AT_COMMAND )
+    set_car( frame, cons( sc, mk_symbol( sc, "command" ), pair_car( frame ) ) );
+  set_car( frame, cons( sc, pair_car( frame ), cons( sc, mk_integer( sc, p_word->priority ), sc->NIL ) ) );
+  set_car( frame, cons( sc, at_name_symbol( sc, p_word->name ), pair_car( frame ) ) );
+  set_car( frame, cons( sc, mk_integer( sc, p_word->id ), pair_car( frame ) ) );
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return retval;
+}
+
+
+/*
+ * returns compiled pattern of pattern object #(pattern source compiled) or NULL
+ */
+static void* get_pattern( scheme* sc, pointer x )
+{
+  pointer blob;
+
+  if( ! is_vector( x ) || vector_length( x ) != 3 || ! is_symbol( vector_elem( x, 0 ) ) ||
+      strcmp( symname( vector_elem( x, 0 ) ), "pattern" ) )
+    return NULL;
+
+  blob = vector_elem( x, 2 );
+  if( ! is_string( blob ) || ! tcm_pattern_is_valid( string_value( blob ) ) )
+    return NULL;
+
+  return string_value( blob );
+}
+
+
+/*!
+ * compile regular expression or glob pattern
+ *
+ * The compiled pattern is stored in the scheme heap and released by the
+ * garbage collector. Refer to tcm_pattern.h for the supported syntax.
+ *
+ * try: (define p (compile-pattern "^\\+CREG: ([0-9]),([15])"))
+ *      (define g (compile-pattern "AT+C*?" 'glob 'nocase))
+ *
+ * \param sc pointer to scheme context
+ * \param args pattern source and optional symbols glob and nocase
+ * \return pattern object or F in case of error
+ */
+static pointer scm_compile_pattern(scheme *sc, pointer args)
+{
+  char err[80], outbuf[128];
+  pointer x, frame, retval;
+  void* p_compiled;
+  int flags = 0, size;
+
+  if( args == sc->NIL || ! is_string( pair_car( args ) ) ) {
+    putstr( sc, "first argument must be pattern string!\n" );
+    tcm_error( "%s: first argument must be pattern string!\n", __func__ );
+    return sc->F;
+  }
+
+  for( x = pair_cdr( args ); x != sc->NIL; x = pair_cdr( x ) ) {
+    if( is_symbol( pair_car( x ) ) && ! strcmp( symname( pair_car( x ) ), "glob" ) ) {
+      flags |= TCM_PATTERN_GLOB;
+    } else if( is_symbol( pair_car( x ) ) && ! strcmp( symname( pair_car( x ) ), "nocase" ) ) {
+      flags |= TCM_PATTERN_NOCASE;
+    } else {
+      putstr( sc, "options must be symbols glob or nocase!\n" );
+      tcm_error( "%s: options must be symbols glob or nocase!\n", __func__ );
+      return sc->F;
+    }
+  }
+
+  p_compiled = tcm_pattern_compile( string_value( pair_car( args ) ), flags, & size, err, sizeof( err ) );
+  if( p_compiled == NULL ) {
+    snprintf( outbuf, sizeof( outbuf ), "invalid pattern: %s!\n", err );
+    putstr( sc, outbuf );
+    tcm_error( "%s: %s", __func__, outbuf );
+    return sc->F;
+  }
+
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, mk_vector( sc, 3 ) );
+  set_vector_elem( pair_car( frame ), 2, mk_counted_string( sc, p_compiled, size ) );
+  set_vector_elem( pair_car( frame ), 1, pair_car( args ) );
+  set_vector_elem( pair_car( frame ), 0, mk_symbol( sc, "pattern" ) );
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_compiled );
+
+  return retval;
+}
+
+
+/*!
+ * check whether object is compiled pattern
+ *
+ * try: (pattern? p)
+ *
+ * \param sc pointer to scheme context
+ * \param args object to check
+ * \return T for patterns, otherwise F
+ */
+static pointer scm_is_pattern(scheme *sc, pointer args)
+{
+  if( args == sc->NIL )
+    return sc->F;
+
+  return( get_pattern( sc, pair_car( args ) ) ? sc->T : sc->F );
+}
+
+
+/*!
+ * check whether string matches pattern without extracting captures
+ *
+ * try: (pattern-matches? p "+CREG: 0,1")
+ *
+ * \param sc pointer to scheme context
+ * \param args pattern and string
+ * \return T when string matches, otherwise F
+ */
+static pointer scm_pattern_matches(scheme *sc, pointer args)
+{
+  void* p_compiled;
+  const char* s;
+
+  if( args == sc->NIL || pair_cdr( args ) == sc->NIL || ! is_string( pair_car( pair_cdr( args ) ) ) ||
+      ( p_compiled = get_pattern( sc, pair_car( args ) ) ) == NULL ) {
+    tcm_error( "%s: arguments must be pattern and string!\n", __func__ );
+    return sc->F;
+  }
+
+  s = string_value( pair_car( pair_cdr( args ) ) );
+
+  return( tcm_pattern_match( p_compiled, s, strlen( s ), NULL, 0 ) ? sc->T : sc->F );
+}
+
+
+/*!
+ * match string against pattern and extract captures
+ *
+ * The first element of the returned list is the matching part of the string
+ * followed by one element per group, F for groups which did not participate.
+ *
+ * try: (pattern-match p "+CREG: 0,1") -> ("+CREG: 0,1" "0" "1")
+ *
+ * \param sc pointer to scheme context
+ * \param args pattern and string
+ * \return list of captures or F when string does not match
+ */
+static pointer scm_pattern_match(scheme *sc, pointer args)
+{
+  int caps[2 * ( TCM_PATTERN_MAX_GROUPS + 1 )];
+  pointer frame, retval;
+  void* p_compiled;
+  const char* s;
+  int i, n;
+
+  if( args == sc->NIL || pair_cdr( args ) == sc->NIL || ! is_string( pair_car( pair_cdr( args ) ) ) ||
+      ( p_compiled = get_pattern( sc, pair_car( args ) ) ) == NULL ) {
+    tcm_error( "%s: arguments must be pattern and string!\n", __func__ );
+    return sc->F;
+  }
+
+  s = string_value( pair_car( pair_cdr( args ) ) );
+  n = tcm_pattern_nr_captures( p_compiled );
+  if( ! tcm_pattern_match( p_compiled, s, strlen( s ), caps, n ) )
+    return sc->F;
+
+  /* list is built from the end */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    if( caps[2*i] < 0 )
+      set_car( frame, cons( sc, sc->F, pair_car( frame ) ) );
+    else
+      set_car( frame, cons( sc, mk_counted_string( sc, s + caps[2*i], caps[2*i+1] - caps[2*i] ), pair_car( frame ) ) );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return retval;
+}
+
+
+static const t_ffi_signature ffi_make_at_arbiter = { "make-at-arbiter", 2, { t_ffi_arg_channel, t_ffi_arg_server_channel } };
+static const t_ffi_signature ffi_at_arbiter_submit = { "at-arbiter-submit", 3, { t_ffi_arg_arbiter, t_ffi_arg_integer, t_ffi_arg_string } };
+static const t_ffi_signature ffi_at_arbiter_feed = { "at-arbiter-feed", 2, { t_ffi_arg_arbiter, t_ffi_arg_string } };
+static const t_ffi_signature ffi_at_arbiter_connection = { "at-arbiter-connection", 3, { t_ffi_arg_arbiter, t_ffi_arg_symbol, t_ffi_arg_integer } };
+static const t_ffi_signature ffi_at_arbiter_configure = { "at-arbiter-configure", 4, { t_ffi_arg_arbiter, t_ffi_arg_symbol, t_ffi_arg_integer, t_ffi_arg_integer } };
+static const t_ffi_signature ffi_at_arbiter_client = { "at-arbiter-client", 4, { t_ffi_arg_arbiter, t_ffi_arg_integer, t_ffi_arg_integer, t_ffi_arg_integer } };
+static const t_ffi_signature ffi_at_arbiter = { "at-arbiter", 1, { t_ffi_arg_arbiter } };
+
+
+/*!
+ * create arbiter for several AT clients sharing one modem channel
+ *
+ * The channel callbacks must pass received data to at-arbiter-submit and
+ * at-arbiter-feed, refer to README for an example.
+ *
+ * try: (define arb (make-at-arbiter modem-ch clients-ch))
+ *
+ * \param sc pointer to scheme context
+ * \param args modem channel and server socket channel of clients
+ * \return arbiter descriptor or F in case of error
+ */
+static pointer scm_make_at_arbiter(scheme *sc, pointer args)
+{
+  t_tcm_arbiter* p;
+  t_ffi_arg a[2];
+
+  if( ffi_args( sc, args, & ffi_make_at_arbiter, a ) )
+    return sc->F;
+
+  p = tcm_arbiter_create( a[0].p_channel, (t_server_sock_channel *) a[1].p_channel );
+  if( p == NULL )
+    return sc->F;
+
+  return mk_integer( sc, (long) p );
+}
+
+
+/*!
+ * pass data received from client to arbiter
+ *
+ * try: (at-arbiter-submit arb id "AT+CSQ\r")
+ *
+ * \param sc pointer to scheme context
+ * \param args arbiter, connection identifier and received string
+ * \return number of commands queued for the client or -1 in case of error
+ */
+static pointer scm_at_arbiter_submit(scheme *sc, pointer args)
+{
+  t_ffi_arg a[3];
+
+  if( ffi_args( sc, args, & ffi_at_arbiter_submit, a ) )
+    return mk_integer( sc, -1 );
+
+  return mk_integer( sc, tcm_arbiter_submit( a[0].p_arbiter, a[1].ivalue, a[2].p_str, strlen( a[2].p_str ) ) );
+}
+
+
+/*!
+ * pass data received from modem to arbiter
+ *
+ * try: (at-arbiter-feed arb "\r\nOK\r\n")
+ *
+ * \param sc pointer to scheme context
+ * \param args arbiter and received string
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_at_arbiter_feed(scheme *sc, pointer args)
+{
+  t_ffi_arg a[2];
+
+  if( ffi_args( sc, args, & ffi_at_arbiter_feed, a ) )
+    return sc->F;
+
+  tcm_arbiter_feed( a[0].p_arbiter, a[1].p_str, strlen( a[1].p_str ) );
+
+  return sc->T;
+}
+
+
+/*!
+ * pass connection event of server socket channel to arbiter
+ *
+ * try: (at-arbiter-connection arb 'connect id)
+ *
+ * \param sc pointer to scheme context
+ * \param args arbiter, symbol connect or disconnect and connection identifier
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_at_arbiter_connection(scheme *sc, pointer args)
+{
+  t_ffi_arg a[3];
+
+  if( ffi_args( sc, args, & ffi_at_arbiter_connection, a ) )
+    return sc->F;
+
+  tcm_arbiter_connection( a[0].p_arbiter, a[2].ivalue, ! strcmp( a[1].p_str, "connect" ) );
+
+  return sc->T;
+}
+
+
+/*!
+ * set arbitration policy, quota of newly connected clients and command timeout
+ *
+ * The policy is either fifo or round-robin.
+ *
+ * try: (at-arbiter-configure arb 'fifo 8 180000)
+ *
+ * \param sc pointer to scheme context
+ * \param args arbiter, policy, quota and timeout in milliseconds
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_at_arbiter_configure(scheme *sc, pointer args)
+{
+  t_tcm_arbiter_policy policy;
+  t_ffi_arg a[4];
+
+  if( ffi_args( sc, args, & ffi_at_arbiter_configure, a ) )
+    return sc->F;
+
+  if( ! strcmp( a[1].p_str, "fifo" ) ) {
+    policy = t_tcm_arbiter_fifo;
+  } else if( ! strcmp( a[1].p_str, "round-robin" ) ) {
+    policy = t_tcm_arbiter_round_robin;
+  } else {
+    putstr( sc, "policy must be fifo or round-robin!\n" );
+    tcm_error( "%s: policy must be fifo or round-robin!\n", __func__ );
+    return sc->F;
+  }
+
+  if( tcm_arbiter_configure( a[0].p_arbiter, policy, a[2].ivalue, a[3].ivalue ) < 0 )
+    return sc->F;
+
+  return sc->T;
+}
+
+
+/*!
+ * set round robin weight and quota of connected client
+ *
+ * try: (at-arbiter-client arb id 2 16)
+ *
+ * \param sc pointer to scheme context
+ * \param args arbiter, connection identifier, weight and quota
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_at_arbiter_client(scheme *sc, pointer args)
+{
+  t_ffi_arg a[4];
+
+  if( ffi_args( sc, args, & ffi_at_arbiter_client, a ) )
+    return sc->F;
+
+  if( tcm_arbiter_set_client( a[0].p_arbiter, a[1].ivalue, a[2].ivalue, a[3].ivalue ) < 0 )
+    return sc->F;
+
+  return sc->T;
+}
+
+
+/*!
+ * subscribe connected client to URCs
+ *
+ * Clients are subscribed to all URCs when connected. Without prefixes the
+ * client does not receive any URCs, unknown prefixes are added to the
+ * arbiter's URC prefixes.
+ *
+ * try: (at-arbiter-subscribe arb id "+CMTI:" "RING") or (at-arbiter-subscribe arb id 'all)
+ *
+ * \param sc pointer to scheme context
+ * \param args arbiter, connection identifier and URC prefixes or symbol all
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_at_arbiter_subscribe(scheme *sc, pointer args)
+{
+  t_tcm_arbiter* p;
+  uint32_t mask = 0;
+  long conn_id;
+  pointer x;
+  int idx;
+
+  if( ! is_pair( args ) || ! is_integer( pair_car( args ) ) ||
+      ! tcm_arbiter_is_valid( p = (t_tcm_arbiter *) ivalue( pair_car( args ) ) ) ||
+      ! is_pair( pair_cdr( args ) ) || ! is_integer( pair_car( pair_cdr( args ) ) ) ) {
+    putstr( sc, "first arguments must be arbiter and connection identifier!\n" );
+    tcm_error( "%s: first arguments must be arbiter and connection identifier!\n", __func__ );
+    return sc->F;
+  }
+
+  conn_id = ivalue( pair_car( pair_cdr( args ) ) );
+  for( x = pair_cdr( pair_cdr( args ) ); x != sc->NIL; x = pair_cdr( x ) ) {
+    if( is_symbol( pair_car( x ) ) && ! strcmp( symname( pair_car( x ) ), "all" ) ) {
+      mask = 0xffffffffU;
+    } else if( is_string( pair_car( x ) ) ) {
+      idx = tcm_arbiter_add_urc( p, string_value( pair_car( x ) ) );
+      if( idx < 0 )
+        return sc->F;
+      mask |= 1U << idx;
+    } else {
+      putstr( sc, "prefixes must be strings or symbol all!\n" );
+      tcm_error( "%s: prefixes must be strings or symbol all!\n", __func__ );
+      return sc->F;
+    }
+  }
+
+  if( tcm_arbiter_subscribe( p, conn_id, mask ) < 0 )
+    return sc->F;
+
+  return sc->T;
+}
+
+
+/*!
+ * per client statistics of arbiter
+ *
+ * Returns a list with one entry (id queued commands rejected timeouts urcs
+ * avg-delay-ms max-delay-ms) per connected client where the delay refers
+ * to the time commands have been queued before written to the modem.
+ *
+ * try: (at-arbiter-stats arb)
+ *
+ * \param sc pointer to scheme context
+ * \param args arbiter
+ * \return pointer to list of statistics or F in case of error
+ */
+static pointer scm_at_arbiter_stats(scheme *sc, pointer args)
+{
+  t_tcm_arbiter_stats* p_stats;
+  t_tcm_arbiter_stats* s;
+  pointer retval, frame, entry;
+  t_ffi_arg a[1];
+  int i, n;
+
+  if( ffi_args( sc, args, & ffi_at_arbiter, a ) )
+    return sc->F;
+
+  p_stats = cul_malloc( a[0].p_arbiter->nr_clients * sizeof( t_tcm_arbiter_stats ) );
+  if( p_stats == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return sc->F;
+  }
+
+  n = tcm_arbiter_stats( a[0].p_arbiter, p_stats, a[0].p_arbiter->nr_clients );
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    s = & p_stats[i];
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    set_car( entry, cons( sc, mk_real( sc, s->delay_max_ms ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_real( sc, s->delay_avg_ms ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->nr_urcs ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->nr_timeouts ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->nr_rejected ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->nr_commands ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->queued ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->id ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_stats );
+
+  return( retval );
+}
+
+
+/*!
+ * release arbiter, the channels stay open
+ *
+ * try: (close-at-arbiter arb)
+ *
+ * \param sc pointer to scheme context
+ * \param args arbiter
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_close_at_arbiter(scheme *sc, pointer args)
+{
+  t_ffi_arg a[1];
+
+  if( ffi_args( sc, args, & ffi_at_arbiter, a ) )
+    return sc->F;
+
+  tcm_arbiter_release( a[0].p_arbiter );
+
+  return sc->T;
+}
+
+
+static const t_ffi_signature ffi_dev_channel_coalesce = { "%dev-channel-coalesce", 5,
+  { t_ffi_arg_dev_channel, t_ffi_arg_string, t_ffi_arg_symbol, t_ffi_arg_integer, t_ffi_arg_integer } };
+static const t_ffi_signature ffi_dev_channel_coalesce_stats = { "dev-channel-coalesce-stats", 1, { t_ffi_arg_dev_channel } };
+
+/*! names of coalescing policies, indexed by t_tcm_coalesce_policy */
+static const char* coalesce_policies[] = { "off", "latest", "first", "count" };
+
+
+/*!
+ * define coalescing of lines starting with prefix
+ *
+ * Use the wrapper dev-channel-coalesce with optional interval and count.
+ *
+ * try: (%dev-channel-coalesce modem-ch "+CSQ:" 'latest 1000 1)
+ *
+ * \param sc pointer to scheme context
+ * \param args device channel, prefix, policy symbol off, latest, first or count,
+ *        interval in milliseconds and number of lines passed per interval
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_dev_channel_coalesce(scheme *sc, pointer args)
+{
+  t_dev_channel* p_dev_channel;
+  t_ffi_arg a[5];
+  int policy;
+
+  if( ffi_args( sc, args, & ffi_dev_channel_coalesce, a ) )
+    return sc->F;
+
+  for( policy = 0; policy < sizeof( coalesce_policies ) / sizeof( coalesce_policies[0] ); ++policy )
+    if( ! strcmp( a[2].p_str, coalesce_policies[policy] ) )
+      break;
+
+  if( policy == sizeof( coalesce_policies ) / sizeof( coalesce_policies[0] ) ) {
+    tcm_error( "%s: unknown policy %s, must be off, latest, first or count!\n", __func__, a[2].p_str );
+    return sc->F;
+  }
+
+  p_dev_channel = (t_dev_channel *) a[0].p_channel;
+  if( tcm_coalesce_set_rule( p_dev_channel->p_coalesce, a[1].p_str, (t_tcm_coalesce_policy) policy,
+                             a[3].ivalue, a[4].ivalue ) )
+    return sc->F;
+
+  return sc->T;
+}
+
+
+/*!
+ * statistics of URC coalescing
+ *
+ * Returns a list with one entry (prefix policy interval-ms count passed
+ * suppressed released) per rule. Suppressed lines are those which have not
+ * been passed immediately, released lines are suppressed lines which have
+ * been passed at the end of an interval.
+ *
+ * try: (dev-channel-coalesce-stats modem-ch)
+ *
+ * \param sc pointer to scheme context
+ * \param args device channel
+ * \return list of rule statistics or F in case of error
+ */
+static pointer scm_dev_channel_coalesce_stats(scheme *sc, pointer args)
+{
+  t_tcm_coalesce_stats stats[TCM_COALESCE_MAX_RULES];
+  t_tcm_coalesce_stats* s;
+  pointer retval, frame, entry;
+  t_ffi_arg a[1];
+  int i, n;
+
+  if( ffi_args( sc, args, & ffi_dev_channel_coalesce_stats, a ) )
+    return sc->F;
+
+  n = tcm_coalesce_stats( ((t_dev_channel *) a[0].p_channel)->p_coalesce, stats, TCM_COALESCE_MAX_RULES );
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    s = & stats[i];
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    set_car( entry, cons( sc, mk_integer( sc, s->released ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->suppressed ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->passed ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->limit ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->interval_ms ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_symbol( sc, coalesce_policies[ s->policy ] ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_string( sc, s->prefix ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return( retval );
+}
+
+
+static const t_ffi_signature ffi_make_cmux = { "%make-cmux", 5,
+  { t_ffi_arg_string, t_ffi_arg_integer, t_ffi_arg_symbol, t_ffi_arg_integer, t_ffi_arg_string } };
+static const t_ffi_signature ffi_make_cmux_channel = { "make-cmux-channel", 3, { t_ffi_arg_cmux, t_ffi_arg_integer, t_ffi_arg_closure } };
+static const t_ffi_signature ffi_cmux = { "cmux", 1, { t_ffi_arg_cmux } };
+
+/*! names of multiplexer and data link states, indexed by t_cmux_state */
+static const char* cmux_states[] = { "closed", "init", "opening", "open", "closing" };
+
+
+/*!
+ * create 27.010 multiplexer on serial line
+ *
+ * Use the wrapper make-cmux which sends AT+CMUX with the given frame option
+ * and size unless an initialization string is given explicitly. An empty
+ * string is given for modems which are already in multiplexer mode.
+ *
+ * try: (%make-cmux "/dev/ttyUSB0" 115200 'basic 127 "AT+CMUX=0,0,,127\r")
+ *
+ * \param sc pointer to scheme context
+ * \param args device name, baud rate, frame option 'basic or 'advanced,
+ *        maximum frame size and initialization string
+ * \return multiplexer descriptor or F in case of error
+ */
+static pointer scm_make_cmux(scheme *sc, pointer args)
+{
+  t_tcm_scheme* p_tcm_scheme = (t_tcm_scheme *)sc;
+  t_dev_serial_cfg cfg = { 0, 0, 1, 0, 1 };
+  t_tcm_cmux_mode mode;
+  t_cmux* p_cmux;
+  t_ffi_arg a[5];
+
+  if( ffi_args( sc, args, & ffi_make_cmux, a ) )
+    return sc->F;
+
+  if( ! strcmp( a[2].p_str, "basic" ) )
+    mode = t_tcm_cmux_basic;
+  else if( ! strcmp( a[2].p_str, "advanced" ) )
+    mode = t_tcm_cmux_advanced;
+  else {
+    tcm_error( "%s: unknown frame option %s, must be basic or advanced!\n", __func__, a[2].p_str );
+    return sc->F;
+  }
+
+  cfg.baud = a[1].ivalue;
+  p_cmux = init_cmux( p_tcm_scheme->p_tcm_server_ctx, a[0].p_str, & cfg, mode, a[3].ivalue, a[4].p_str );
+  if( p_cmux == NULL )
+    return sc->F;
+
+  return mk_integer( sc, (long)p_cmux );
+}
+
+
+/*!
+ * create virtual channel for data link connection of multiplexer
+ *
+ * The channel is used like any other one with write-channel, close-channel
+ * and friends. The connection is established as soon as the multiplexer is
+ * up and reestablished after the modem has been restarted.
+ *
+ * try: (make-cmux-channel mux 2 (lambda (s) (display s)))
+ *
+ * \param sc pointer to scheme context
+ * \param args multiplexer, DLCI and callback function
+ * \return pointer to channel identifier or F in case of error
+ */
+static pointer scm_make_cmux_channel(scheme *sc, pointer args)
+{
+  t_cmux_channel* p_cmux_channel;
+  t_base_channel* p_base_channel;
+  t_ffi_arg a[3];
+
+  if( ffi_args( sc, args, & ffi_make_cmux_channel, a ) )
+    return sc->F;
+
+  p_cmux_channel = init_cmux_channel( a[0].p_cmux, a[1].ivalue, read_cb_wrapper );
+  if( p_cmux_channel == NULL )
+    return sc->F;
+
+  p_base_channel = (t_base_channel *) p_cmux_channel;
+  p_base_channel->p_cb_closure_code = a[2].closure;
+
+  /* link symbol to callback closure to avoid gc to clean it up, device
+     names may be long, hence the multiplexer's address identifies it */
+  snprintf( p_base_channel->cb_symbol_name, sizeof(p_base_channel->cb_symbol_name), "cmux-ch-cb-%lx-%ld",
+            (long)a[0].p_cmux, a[1].ivalue );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, p_base_channel->cb_symbol_name ), a[2].closure );
+
+  return mk_integer( sc, (long)p_cmux_channel );
+}
+
+
+/*!
+ * close down multiplexer and its serial line
+ *
+ * All virtual channels must have been closed before.
+ *
+ * try: (close-cmux mux)
+ *
+ * \param sc pointer to scheme context
+ * \param args multiplexer
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_close_cmux(scheme *sc, pointer args)
+{
+  t_ffi_arg a[1];
+
+  if( ffi_args( sc, args, & ffi_cmux, a ) )
+    return sc->F;
+
+  return release_cmux( a[0].p_cmux ) ? sc->F : sc->T;
+}
+
+
+/*!
+ * statistics of multiplexer
+ *
+ * Returns a list with one entry (dlci state rx-frames tx-frames tx-dropped
+ * remote-fc local-fc) for the control channel and each virtual channel. The
+ * state is one of the symbols closed, init, opening, open or closing. The
+ * entry of the control channel with DLCI 0 counts all received frames.
+ *
+ * try: (cmux-stats mux)
+ *
+ * \param sc pointer to scheme context
+ * \param args multiplexer
+ * \return list of data link statistics or F in case of error
+ */
+static pointer scm_cmux_stats(scheme *sc, pointer args)
+{
+  t_cmux_stats stats[TCM_CMUX_MAX_DLCI+1];
+  t_cmux_stats* s;
+  pointer retval, frame, entry;
+  t_ffi_arg a[1];
+  int i, n;
+
+  if( ffi_args( sc, args, & ffi_cmux, a ) )
+    return sc->F;
+
+  n = cmux_stats( a[0].p_cmux, stats, TCM_CMUX_MAX_DLCI+1 );
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    s = & stats[i];
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    set_car( entry, cons( sc, s->local_fc ? sc->T : sc->F, pair_car( entry ) ) );
+    set_car( entry, cons( sc, s->remote_fc ? sc->T : sc->F, pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->nr_tx_dropped ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->nr_tx_frames ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->nr_rx_frames ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_symbol( sc, cmux_states[ s->state ] ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_integer( sc, s->dlci ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return( retval );
+}
+
+
+static const t_ffi_signature ffi_make_shm_channel = { "%make-shm-channel", 3, { t_ffi_arg_string, t_ffi_arg_closure, t_ffi_arg_integer } };
+
+/*!
+ * create shared memory channel for a local client process
+ *
+ * Use the wrapper make-shm-channel with optional ring size. The client
+ * attaches with tcm_shm_client_open() of libtcmshm.
+ *
+ * try: (%make-shm-channel "diag" (lambda (s) (display s)) 65536)
+ *
+ * \param sc pointer to scheme context
+ * \param args channel name, callback function and size of each ring in bytes
+ * \return pointer to channel identifier or F in case of error
+ */
+static pointer scm_make_shm_channel(scheme *sc, pointer args)
+{
+  t_tcm_scheme* p_tcm_scheme = (t_tcm_scheme *)sc;
+  t_shm_channel* p_shm_channel;
+  t_base_channel* p_base_channel;
+  t_ffi_arg a[3];
+
+  if( ffi_args( sc, args, & ffi_make_shm_channel, a ) )
+    return sc->F;
+
+  p_shm_channel = init_shm_channel( p_tcm_scheme->p_tcm_server_ctx, a[0].p_str, a[2].ivalue, read_cb_wrapper );
+  if( p_shm_channel == NULL )
+    return sc->F;
+
+  p_base_channel = (t_base_channel *) p_shm_channel;
+  p_base_channel->p_cb_closure_code = a[1].closure;
+
+  /* link symbol to callback closure to avoid gc to clean it up */
+  snprintf( p_base_channel->cb_symbol_name, sizeof(p_base_channel->cb_symbol_name), "shm-ch-cb-%s", a[0].p_str );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, p_base_channel->cb_symbol_name ), a[1].closure );
+
+  return mk_integer( sc, (long)p_shm_channel );
+}
+
+
+static const t_ffi_signature ffi_make_local_channel = { "make-local-channel", 2, { t_ffi_arg_string, t_ffi_arg_closure } };
+static const t_ffi_signature ffi_subscribe = { "subscribe", 2, { t_ffi_arg_string, t_ffi_arg_closure } };
+static const t_ffi_signature ffi_local_channel_subscribe = { "local-channel-subscribe", 2, { t_ffi_arg_local_channel, t_ffi_arg_string } };
+static const t_ffi_signature ffi_publish = { "publish", 2, { t_ffi_arg_string, t_ffi_arg_string } };
+
+
+/*
+ * create local channel and link callback closure to symbol to avoid gc to clean it up
+ */
+static t_local_channel* make_local_channel( scheme *sc, const char* name, pointer closure )
+{
+  t_tcm_scheme* p_tcm_scheme = (t_tcm_scheme *)sc;
+  t_local_channel* p_local_channel;
+  t_base_channel* p_base_channel;
+
+  p_local_channel = init_local_channel( p_tcm_scheme->p_tcm_server_ctx, name, read_cb_wrapper );
+  if( p_local_channel == NULL )
+    return NULL;
+
+  p_base_channel = (t_base_channel *) p_local_channel;
+  p_base_channel->p_cb_closure_code = closure;
+
+  /* names need not be unique, hence the descriptor is part of the symbol */
+  snprintf( p_base_channel->cb_symbol_name, sizeof(p_base_channel->cb_symbol_name), "local-ch-cb-%s-%lx",
+            name, (long)p_local_channel );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, p_base_channel->cb_symbol_name ), closure );
+
+  return p_local_channel;
+}
+
+
+/*!
+ * create in-process channel
+ *
+ * Data written to the channel is passed to its callback by its own
+ * processing thread, e.g. to decouple components within one tcm instance.
+ *
+ * try: (define log-ch (make-local-channel "log" (lambda (s) (display s))))
+ *      (write-channel log-ch "hello")
+ *
+ * \param sc pointer to scheme context
+ * \param args channel name and callback function
+ * \return pointer to channel identifier or F in case of error
+ */
+static pointer scm_make_local_channel(scheme *sc, pointer args)
+{
+  t_local_channel* p_local_channel;
+  t_ffi_arg a[2];
+
+  if( ffi_args( sc, args, & ffi_make_local_channel, a ) )
+    return sc->F;
+
+  p_local_channel = make_local_channel( sc, a[0].p_str, a[1].closure );
+  if( p_local_channel == NULL )
+    return sc->F;
+
+  return mk_integer( sc, (long)p_local_channel );
+}
+
+
+/*!
+ * subscribe callback to topic of the bus
+ *
+ * The callback is invoked by the processing thread of a local channel named
+ * after the topic which is returned. The subscription ends when this channel
+ * is closed with close-channel.
+ *
+ * try: (define sub (subscribe "signal" (lambda (s) (display s))))
+ *
+ * \param sc pointer to scheme context
+ * \param args topic and callback function
+ * \return channel identifier of subscription or F in case of error
+ */
+static pointer scm_subscribe(scheme *sc, pointer args)
+{
+  t_local_channel* p_local_channel;
+  t_ffi_arg a[2];
+
+  if( ffi_args( sc, args, & ffi_subscribe, a ) )
+    return sc->F;
+
+  p_local_channel = make_local_channel( sc, a[0].p_str, a[1].closure );
+  if( p_local_channel == NULL )
+    return sc->F;
+
+  if( local_channel_subscribe( p_local_channel, a[0].p_str ) ) {
+    scheme_define( sc, sc->global_env, mk_symbol( sc, ((t_base_channel *)p_local_channel)->cb_symbol_name ), sc->NIL );
+    ((t_base_channel *)p_local_channel)->release( (t_base_channel *)p_local_channel );
+    return sc->F;
+  }
+
+  return mk_integer( sc, (long)p_local_channel );
+}
+
+
+/*!
+ * subscribe existing local channel to further topic
+ *
+ * try: (local-channel-subscribe sub "network")
+ *
+ * \param sc pointer to scheme context
+ * \param args local channel and topic
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_local_channel_subscribe(scheme *sc, pointer args)
+{
+  t_ffi_arg a[2];
+
+  if( ffi_args( sc, args, & ffi_local_channel_subscribe, a ) )
+    return sc->F;
+
+  if( local_channel_subscribe( (t_local_channel *) a[0].p_channel, a[1].p_str ) )
+    return sc->F;
+
+  return sc->T;
+}
+
+
+/*!
+ * publish message to topic of the bus
+ *
+ * The message is stored once and queued to each subscribed local channel.
+ * It is delivered asynchronously, also when published from a subscriber.
+ *
+ * try: (publish "signal" "+CSQ: 20,99")
+ *
+ * \param sc pointer to scheme context
+ * \param args topic and message string
+ * \return number of subscribers the message has been queued to or F in case of error
+ */
+static pointer scm_publish(scheme *sc, pointer args)
+{
+  t_ffi_arg a[2];
+  int n;
+
+  if( ffi_args( sc, args, & ffi_publish, a ) )
+    return sc->F;
+
+  n = local_channel_publish( a[0].p_str, a[1].p_str, strlen( a[1].p_str ) );
+  if( n < 0 )
+    return sc->F;
+
+  return mk_integer( sc, n );
+}
+
+
+
+static const t_ffi_signature ffi_write_channel_await = { "write-channel-await", 6,
+  { t_ffi_arg_channel, t_ffi_arg_string, t_ffi_arg_matcher, t_ffi_arg_integer, t_ffi_arg_closure, t_ffi_arg_closure } };
+
+
+/*
+ * invoked from the await timer thread, passes timeout to closure of request
+ */
+static void await_expire_cb( void* p_ctx, int slot )
+{
+  t_tcm_scheme* p_scheme = (t_tcm_scheme *)p_ctx;
+  scheme* sc = (scheme *) p_scheme;
+  pointer awaited;
+
+  tcm_scheme_lock( p_scheme, "await-timer", "on-timeout" );
+  awaited = vector_elem( p_scheme->p_awaits, slot );
+  if( is_pair( awaited ) ) {
+    scheme_call( sc, pair_cdr( awaited ), sc->NIL );
+    set_vector_elem( p_scheme->p_awaits, slot, sc->F );
+  }
+  tcm_scheme_unlock( p_scheme );
+
+  tcm_await_done( slot );
+}
+
+
+/*!
+ * write request to channel and await its reply
+ *
+ * The first  data received  from the  channel which  contains the  given
+ * string respectively  matches the given compiled  pattern is passed to
+ * on-reply instead of the channel's callback. When no such reply arrives
+ * within timeout milliseconds, on-timeout is invoked without arguments.
+ * Received data is matched natively, hence the scheme interpreter is only
+ * entered once per request. Pending requests are answered in the order
+ * they have been written.
+ *
+ * try: (write-channel-await ch "AT+CSQ\r" "+CSQ:" 500
+ *        (lambda (s) (display s))
+ *        (lambda () (display "no reply\n")))
+ *
+ * \param sc pointer to scheme context
+ * \param args channel, request string, string or pattern matching the reply,
+ *             timeout in milliseconds, reply and timeout closures
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_write_channel_await(scheme *sc, pointer args)
+{
+  t_tcm_scheme* p_tcm_scheme = (t_tcm_scheme *)sc;
+  t_ffi_arg a[6];
+  const char* match = NULL;
+  void* p_pattern = NULL;
+  int slot, bytes_written;
+
+  if( ffi_args( sc, args, & ffi_write_channel_await, a ) )
+    return sc->F;
+
+  if( a[3].ivalue <= 0 ) {
+    tcm_error( "%s: timeout must be positive error!\n", __func__ );
+    return sc->F;
+  }
+
+  if( tcm_await_start( await_expire_cb, p_tcm_scheme ) )
+    return sc->F;
+
+  if( is_string( a[2].matcher ) )
+    match = string_value( a[2].matcher );
+  else
+    p_pattern = get_pattern( sc, a[2].matcher );
+
+  slot = tcm_await_add( a[0].p_channel, match, p_pattern, (int) a[3].ivalue );
+  if( slot < 0 )
+    return sc->F;
+
+  set_vector_elem( p_tcm_scheme->p_awaits, slot, cons( sc, a[4].closure, a[5].closure ) );
+
+  tcm_trace_write_begin();
+  bytes_written = a[0].p_channel->write( a[0].p_channel, (char *)a[1].p_str, strlen( a[1].p_str ) );
+  tcm_trace_write_end();
+  base_channel_count_tx( a[0].p_channel, bytes_written );
+  tcm_flightrec_add( t_tcm_flightrec_tx, a[0].p_channel, a[1].p_str, bytes_written, 0, 0 );
+
+  if( bytes_written < 0 ) {
+    tcm_await_cancel( slot );
+    set_vector_elem( p_tcm_scheme->p_awaits, slot, sc->F );
+    return sc->F;
+  }
+
+  return sc->T;
+}
+
+
+/*!
+ * statistics of write-channel-await
+ *
+ * try: (await-stats) -> (pending replied expired cancelled)
+ *
+ * \param sc pointer to scheme context
+ * \param args not used
+ * \return list of pending requests and numbers of replied, expired and cancelled requests
+ */
+static pointer scm_await_stats(scheme *sc, pointer args)
+{
+  t_tcm_await_stats stats;
+  pointer result;
+
+  tcm_await_stats( & stats );
+
+  result = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  set_car( result, cons( sc, mk_integer( sc, stats.nr_cancelled ), pair_car( result ) ) );
+  set_car( result, cons( sc, mk_integer( sc, stats.nr_expired ), pair_car( result ) ) );
+  set_car( result, cons( sc, mk_integer( sc, stats.nr_replied ), pair_car( result ) ) );
+  set_car( result, cons( sc, mk_integer( sc, stats.nr_pending ), pair_car( result ) ) );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return pair_car( result );
+}
+
+/*!
+ * startup timeline
+ *
+ * Returns a list with one entry (name duration end) per completed startup
+ * phase. Duration and end are given in milliseconds where end refers to the
+ * start of the daemon.
+ *
+ * try: (boot-timeline)
+ *
+ * \param sc pointer to scheme context
+ * \param args not used
+ * \return pointer to list of startup phases or F in case of error
+ */
+static pointer scm_boot_timeline(scheme *sc, pointer args)
+{
+  t_tcm_boot_phase* p_phases;
+  pointer retval, frame, entry;
+  int i, n;
+
+  p_phases = cul_malloc( TCM_BOOT_MAX_PHASES * sizeof( t_tcm_boot_phase ) );
+  if( p_phases == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return sc->F;
+  }
+
+  n = tcm_boot_phases( p_phases, TCM_BOOT_MAX_PHASES );
+
+  /* list is built from the end, each entry from its last element */
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = n - 1; i >= 0; --i ) {
+    entry = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+    set_car( entry, cons( sc, mk_real( sc, p_phases[i].end_ms ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_real( sc, p_phases[i].duration_ms ), pair_car( entry ) ) );
+    set_car( entry, cons( sc, mk_string( sc, p_phases[i].name ), pair_car( entry ) ) );
+    set_car( frame, cons( sc, pair_car( entry ), pair_car( frame ) ) );
+    tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  cul_free( p_phases );
+
+  return( retval );
+}
+
+
+/*!
+ * check whether initialization is deferred until first channel is live
+ *
+ * Returns true while the init files are evaluated or the interpreter waits
+ * for the first live channel with lazy initialization enabled. Used by
+ * defer-until-live.
+ *
+ * \param sc pointer to scheme context
+ * \param args not used
+ * \return T when thunks are deferred, otherwise F
+ */
+static pointer scm_tcm_deferring(scheme *sc, pointer args)
+{
+  int state = __atomic_load_n( & ((t_tcm_scheme *)sc)->lazy_state, __ATOMIC_ACQUIRE );
+
+  if( state == t_tcm_scheme_lazy_loading || state == t_tcm_scheme_lazy_waiting )
+    return sc->T;
+  else
+    return sc->F;
+}
+
+
+/*!
+ * register thunk to be evaluated after first channel is live
+ *
+ * Thunks are evaluated in registration order after the repl has been started.
+ * Usually invoked via defer-until-live.
+ *
+ * try: (defer-until-live (lambda () (load "optional.scm")))
+ *
+ * \param sc pointer to scheme context
+ * \param args procedure without arguments
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_tcm_defer(scheme *sc, pointer args)
+{
+  t_tcm_scheme* p = (t_tcm_scheme *)sc;
+  pointer cell, x;
+
+  if( args == sc->NIL || !( is_closure( pair_car( args ) ) || is_proc( pair_car( args ) ) ||
+                            is_foreign( pair_car( args ) ) ) ) {
+    putstr( sc, "procedure argument expected error!\n" );
+    tcm_error( "%s: procedure argument expected error!\n", __func__ );
+    return sc->F;
+  }
+
+  cell = cons( sc, pair_car( args ), sc->NIL );
+  if( p->p_deferred == sc->NIL ) {
+    p->p_deferred = cell;
+    scheme_define( sc, sc->global_env, mk_symbol( sc, "*tcm-deferred-thunks*" ), cell );
+  } else {
+    for( x = p->p_deferred; pair_cdr( x ) != sc->NIL; x = pair_cdr( x ) )
+      ;
+    set_cdr( x, cell );
+  }
+
+  return sc->T;
+}
+
+
+/*!
+ * returns the full qualified path name of the script installation directory
+ *
+ * usually /usr/bin or /usr/local/bin
+ *
+ * \param sc pointer to scheme instance data
+ * \param args not used
+ * \return pointer to scheme string with full qualified script installation path name
+ */
+static pointer scm_get_script_dir(scheme *sc, pointer args)
+{
+  const char* p_script_dir = SCHEMESCRIPTDIR;
+  pointer retval;
+
+  retval = mk_string( sc, p_script_dir );
+
+  return( retval );
+}
+
+
+void init_tcm_ff( scheme* sc )
+{
+  t_tcm_scheme* p_tcm_scheme = (t_tcm_scheme *)sc;
+  char def[160];
+
+  /* closures of awaited replies are kept reachable by the garbage collector through this binding */
+  p_tcm_scheme->p_awaits = mk_vector( sc, TCM_AWAIT_MAX_PENDING );
+  fill_vector( p_tcm_scheme->p_awaits, sc->F );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "*tcm-await-closures*" ), p_tcm_scheme->p_awaits );
+
   scheme_define( sc, sc->global_env, mk_symbol( sc, "system" ), mk_foreign_func( sc, scm_system ) );
   scheme_define( sc, sc->global_env, mk_symbol( sc, "sleep" ), mk_foreign_func( sc, scm_sleep ) );
   scheme_define( sc, sc->global_env, mk_symbol( sc, "quit" ), mk_foreign_func( sc, scm_quit ) );
   scheme_define( sc, sc->global_env, mk_symbol( sc, "make-dev-channel" ), mk_foreign_func( sc, scm_make_dev_channel ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "make-serial-channel" ), mk_foreign_func( sc, scm_make_serial_channel ) );
   scheme_define( sc, sc->global_env, mk_symbol( sc, "make-client-sock-channel" ), mk_foreign_func( sc, scm_make_client_sock_channel ) );
   scheme_define( sc, sc->global_env, mk_symbol( sc, "make-server-sock-channel" ), mk_foreign_func( sc, scm_make_server_sock_channel ) );
   scheme_define( sc, sc->global_env, mk_symbol( sc, "is-channel-open" ), mk_foreign_func( sc, scm_is_channel_open ) );
   scheme_define( sc, sc->global_env, mk_symbol( sc, "write-channel" ), mk_foreign_func( sc, scm_write_channel ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "write-channel-to" ), mk_foreign_func( sc, scm_write_channel_to ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "%write-channel" ), mk_foreign_func( sc, scm_quiet_write_channel ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "%write-channel-to" ), mk_foreign_func( sc, scm_quiet_write_channel_to ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "%channel-open?" ), mk_foreign_func( sc, scm_quiet_channel_open ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "close-connection" ), mk_foreign_func( sc, scm_close_connection ) );
   scheme_define( sc, sc->global_env, mk_symbol( sc, "close-channel" ), mk_foreign_func( sc, scm_close_channel ) );
   scheme_define( sc, sc->global_env, mk_symbol( sc, "get-script-dir" ), mk_foreign_func( sc, scm_get_script_dir ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "benchmark-c-api" ), mk_foreign_func( sc, scm_benchmark_c_api ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "benchmark-channel-ffi" ), mk_foreign_func( sc, scm_benchmark_channel_ffi ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "thread-stats" ), mk_foreign_func( sc, scm_thread_stats ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "boot-timeline" ), mk_foreign_func( sc, scm_boot_timeline ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "interpreter-lock-stats" ), mk_foreign_func( sc, scm_interpreter_lock_stats ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "dump-flight-recorder" ), mk_foreign_func( sc, scm_dump_flight_recorder ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "latency-histograms" ), mk_foreign_func( sc, scm_latency_histograms ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "slow-traces" ), mk_foreign_func( sc, scm_slow_traces ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "profile-start" ), mk_foreign_func( sc, scm_profile_start ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "profile-stop" ), mk_foreign_func( sc, scm_profile_stop ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "profile-flat" ), mk_foreign_func( sc, scm_profile_flat ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "profile-tree" ), mk_foreign_func( sc, scm_profile_tree ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "profile-write-collapsed" ), mk_foreign_func( sc, scm_profile_write_collapsed ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-cache-rule" ), mk_foreign_func( sc, scm_at_cache_rule ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-cache-invalidate-on" ), mk_foreign_func( sc, scm_at_cache_invalidate_on ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-cache-lookup" ), mk_foreign_func( sc, scm_at_cache_lookup ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-cache-feed" ), mk_foreign_func( sc, scm_at_cache_feed ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-cache-flush" ), mk_foreign_func( sc, scm_at_cache_flush ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-cache-stats" ), mk_foreign_func( sc, scm_at_cache_stats ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "parse-at-command" ), mk_foreign_func( sc, scm_parse_at_command ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "parse-at-result" ), mk_foreign_func( sc, scm_parse_at_result ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-vocabulary-ref" ), mk_foreign_func( sc, scm_at_vocabulary_ref ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "compile-pattern" ), mk_foreign_func( sc, scm_compile_pattern ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "pattern?" ), mk_foreign_func( sc, scm_is_pattern ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "pattern-matches?" ), mk_foreign_func( sc, scm_pattern_matches ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "pattern-match" ), mk_foreign_func( sc, scm_pattern_match ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "make-at-arbiter" ), mk_foreign_func( sc, scm_make_at_arbiter ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-arbiter-submit" ), mk_foreign_func( sc, scm_at_arbiter_submit ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-arbiter-feed" ), mk_foreign_func( sc, scm_at_arbiter_feed ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-arbiter-connection" ), mk_foreign_func( sc, scm_at_arbiter_connection ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-arbiter-configure" ), mk_foreign_func( sc, scm_at_arbiter_configure ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-arbiter-client" ), mk_foreign_func( sc, scm_at_arbiter_client ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-arbiter-subscribe" ), mk_foreign_func( sc, scm_at_arbiter_subscribe ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "at-arbiter-stats" ), mk_foreign_func( sc, scm_at_arbiter_stats ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "close-at-arbiter" ), mk_foreign_func( sc, scm_close_at_arbiter ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "%dev-channel-coalesce" ), mk_foreign_func( sc, scm_dev_channel_coalesce ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "dev-channel-coalesce-stats" ), mk_foreign_func( sc, scm_dev_channel_coalesce_stats ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "%make-cmux" ), mk_foreign_func( sc, scm_make_cmux ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "make-cmux-channel" ), mk_foreign_func( sc, scm_make_cmux_channel ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "close-cmux" ), mk_foreign_func( sc, scm_close_cmux ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "cmux-stats" ), mk_foreign_func( sc, scm_cmux_stats ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "%make-shm-channel" ), mk_foreign_func( sc, scm_make_shm_channel ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "make-local-channel" ), mk_foreign_func( sc, scm_make_local_channel ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "subscribe" ), mk_foreign_func( sc, scm_subscribe ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "local-channel-subscribe" ), mk_foreign_func( sc, scm_local_channel_subscribe ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "publish" ), mk_foreign_func( sc, scm_publish ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "write-channel-await" ), mk_foreign_func( sc, scm_write_channel_await ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "await-stats" ), mk_foreign_func( sc, scm_await_stats ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "tcm-deferring?" ), mk_foreign_func( sc, scm_tcm_deferring ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "tcm-defer!" ), mk_foreign_func( sc, scm_tcm_defer ) );
+
+  init_tcm_hash_ff( sc );
+
+  /* interval and count are optional, e.g. (dev-channel-coalesce ch "+CSQ:" 'off) */
+  scheme_load_string( sc,
+    "(define (dev-channel-coalesce ch prefix policy . args)"
+    "  (%dev-channel-coalesce ch prefix policy"
+    "    (if (pair? args) (car args) 0)"
+    "    (if (and (pair? args) (pair? (cdr args))) (cadr args) 1)))" );
+
+  /* modem is switched by AT+CMUX unless initialization string is given, e.g. (make-cmux "/dev/ttyUSB0" 115200 'basic 127) */
+  scheme_load_string( sc,
+    "(define (make-cmux dev baud mode n1 . init)"
+    "  (%make-cmux dev baud mode n1"
+    "    (if (pair? init) (car init)"
+    "      (string-append \"AT+CMUX=\" (if (eq? mode 'advanced) \"1\" \"0\") \",0,,\" (number->string n1) \"\\r\"))))" );
+
+  /* ring size is optional, e.g. (make-shm-channel "diag" (lambda (s) (display s))) */
+  snprintf( def, sizeof( def ),
+    "(define (make-shm-channel name cb . ring-size)"
+    "  (%%make-shm-channel name cb (if (pair? ring-size) (car ring-size) %d)))", SHM_CH_DEFAULT_RING_SIZE );
+  scheme_load_string( sc, def );
+
+  /* thunks are evaluated immediately unless initialization is deferred */
+  scheme_load_string( sc, "(define (defer-until-live thunk) (if (tcm-deferring?) (tcm-defer! thunk) (thunk)))" );
 }
 
 /*! @} */
@@ -0,0 +1,529 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <tcm_scheme.h>
+#include <tcm_scheme_api.h>
+#include <tcm_scheme_hash.h>
+#include <tcm_log.h>
+
+
+/* slots of the hash table vector */
+enum { HT_TAG, HT_COUNT, HT_BUCKETS, HT_SIZE };
+
+
+static uint32_t hash_string( const char* s )
+{
+  uint32_t h = 2166136261u;
+
+  while( *s )
+    h = ( h ^ (unsigned char) *s++ ) * 16777619u;
+
+  return h;
+}
+
+
+static uint32_t hash_key( pointer key )
+{
+  uint64_t v;
+
+  if( is_string( key ) )
+    return hash_string( string_value( key ) );
+
+  /* symbols and strings of the same name share hash values but never compare equal */
+  if( is_symbol( key ) )
+    return hash_string( symname( key ) );
+
+  v = (uint64_t) ivalue( key ) * 0x9e3779b97f4a7c15ULL;
+  return (uint32_t)( v >> 32 );
+}
+
+
+static int keys_equal( pointer a, pointer b )
+{
+  if( is_string( a ) )
+    return is_string( b ) && ! strcmp( string_value( a ), string_value( b ) );
+  if( is_symbol( a ) )
+    return a == b;
+  return is_integer( b ) && ivalue( a ) == ivalue( b );
+}
+
+
+int tcm_hash_is_key( pointer x )
+{
+  return is_string( x ) || is_symbol( x ) || is_integer( x );
+}
+
+
+int tcm_hash_is_table( scheme* sc, pointer x )
+{
+  return is_vector( x ) && vector_length( x ) == HT_SIZE &&
+         is_symbol( vector_elem( x, HT_TAG ) ) && ! strcmp( symname( vector_elem( x, HT_TAG ) ), "hash-table" ) &&
+         is_integer( vector_elem( x, HT_COUNT ) ) && is_vector( vector_elem( x, HT_BUCKETS ) );
+}
+
+
+long tcm_hash_count( pointer ht )
+{
+  return ivalue( vector_elem( ht, HT_COUNT ) );
+}
+
+
+pointer tcm_hash_make( scheme* sc, long size_hint )
+{
+  pointer ht, buckets;
+  long size = TCM_HASH_MIN_BUCKETS;
+
+  while( size < size_hint && size < TCM_HASH_MAX_BUCKETS )
+    size *= 2;
+
+  /* vectors are initialized with NIL, the table is protected while its slots are allocated */
+  ht = mk_vector( sc, HT_SIZE );
+  if( ! is_vector( ht ) )
+    return sc->F;
+  tcm_scheme_protect( (t_tcm_scheme *)sc, ht );
+  buckets = mk_vector( sc, size );
+  if( is_vector( buckets ) ) {
+    set_vector_elem( ht, HT_BUCKETS, buckets );
+    set_vector_elem( ht, HT_COUNT, mk_integer( sc, 0 ) );
+    set_vector_elem( ht, HT_TAG, mk_symbol( sc, "hash-table" ) );
+  }
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  if( ! is_vector( buckets ) ) {
+    tcm_error( "%s: could not allocate %ld buckets error!\n", __func__, size );
+    return sc->F;
+  }
+
+  return ht;
+}
+
+
+pointer tcm_hash_lookup( scheme* sc, pointer ht, pointer key )
+{
+  pointer buckets = vector_elem( ht, HT_BUCKETS );
+  pointer x;
+
+  x = vector_elem( buckets, hash_key( key ) & ( vector_length( buckets ) - 1 ) );
+  for( ; x != sc->NIL; x = pair_cdr( x ) ) {
+    if( keys_equal( key, pair_car( pair_car( x ) ) ) )
+      return pair_car( x );
+  }
+
+  return sc->NIL;
+}
+
+
+static void grow( scheme* sc, pointer ht )
+{
+  pointer old = vector_elem( ht, HT_BUCKETS );
+  long old_size = vector_length( old );
+  long size = 2 * old_size;
+  pointer buckets, x, next;
+  long i, j;
+
+  if( size > TCM_HASH_MAX_BUCKETS )
+    return;
+
+  /* the old buckets stay reachable from the table while allocating */
+  buckets = mk_vector( sc, size );
+  if( ! is_vector( buckets ) ) {
+    tcm_error( "%s: could not allocate %ld buckets error!\n", __func__, size );
+    return;
+  }
+
+  for( i = 0; i < old_size; ++i ) {
+    for( x = vector_elem( old, i ); x != sc->NIL; x = next ) {
+      next = pair_cdr( x );
+      j = hash_key( pair_car( pair_car( x ) ) ) & ( size - 1 );
+      set_cdr( x, vector_elem( buckets, j ) );
+      set_vector_elem( buckets, j, x );
+    }
+    set_vector_elem( old, i, sc->NIL );
+  }
+
+  set_vector_elem( ht, HT_BUCKETS, buckets );
+}
+
+
+void tcm_hash_set( scheme* sc, pointer ht, pointer key, pointer value )
+{
+  pointer buckets, entry;
+  long count, i;
+
+  entry = tcm_hash_lookup( sc, ht, key );
+  if( entry != sc->NIL ) {
+    set_cdr( entry, value );
+    return;
+  }
+
+  count = tcm_hash_count( ht );
+  if( count >= vector_length( vector_elem( ht, HT_BUCKETS ) ) )
+    grow( sc, ht ); /* keeps the old buckets when at limit or out of memory */
+
+  buckets = vector_elem( ht, HT_BUCKETS );
+  i = hash_key( key ) & ( vector_length( buckets ) - 1 );
+  set_vector_elem( buckets, i, cons( sc, cons( sc, key, value ), vector_elem( buckets, i ) ) );
+  set_vector_elem( ht, HT_COUNT, mk_integer( sc, count + 1 ) );
+}
+
+
+int tcm_hash_delete( scheme* sc, pointer ht, pointer key )
+{
+  pointer buckets = vector_elem( ht, HT_BUCKETS );
+  pointer x, prev = sc->NIL;
+  long i;
+
+  i = hash_key( key ) & ( vector_length( buckets ) - 1 );
+  for( x = vector_elem( buckets, i ); x != sc->NIL; prev = x, x = pair_cdr( x ) ) {
+    if( keys_equal( key, pair_car( pair_car( x ) ) ) ) {
+      if( prev == sc->NIL )
+        set_vector_elem( buckets, i, pair_cdr( x ) );
+      else
+        set_cdr( prev, pair_cdr( x ) );
+      set_vector_elem( ht, HT_COUNT, mk_integer( sc, tcm_hash_count( ht ) - 1 ) );
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/*
+ * scheme functions
+ */
+
+/*
+ * fetch up to max arguments into argv, the first one must be a hash table
+ * unless min is 0, the second one a key when with_key is set
+ */
+static int get_args( scheme* sc, pointer args, int min, int max, int with_key, pointer* argv, const char* func )
+{
+  const char* msg = NULL;
+  int n = 0;
+
+  for( ; is_pair( args ) && n < max; args = pair_cdr( args ) )
+    argv[n++] = pair_car( args );
+
+  if( n < min || args != sc->NIL )
+    msg = "wrong number of arguments!\n";
+  else if( min > 0 && ! tcm_hash_is_table( sc, argv[0] ) )
+    msg = "first argument must be hash table!\n";
+  else if( with_key && ! tcm_hash_is_key( argv[1] ) )
+    msg = "key must be string, symbol or integer!\n";
+
+  if( msg ) {
+    putstr( sc, msg );
+    tcm_error( "%s: %s", func, msg );
+    return -1;
+  }
+
+  return n;
+}
+
+
+/*!
+ * create hash table
+ *
+ * try: (define ht (make-hash-table)) or (make-hash-table 1000)
+ *
+ * \param sc pointer to scheme context
+ * \param args optional expected number of entries
+ * \return hash table or F in case of error
+ */
+static pointer scm_make_hash_table(scheme *sc, pointer args)
+{
+  pointer argv[1];
+  int n;
+
+  n = get_args( sc, args, 0, 1, 0, argv, __func__ );
+  if( n < 0 )
+    return sc->F;
+
+  if( n == 1 && ! is_integer( argv[0] ) ) {
+    putstr( sc, "size hint must be integer!\n" );
+    tcm_error( "%s: size hint must be integer!\n", __func__ );
+    return sc->F;
+  }
+
+  return tcm_hash_make( sc, n ? ivalue( argv[0] ) : 0 );
+}
+
+
+/*!
+ * check whether object is hash table
+ *
+ * try: (hash-table? ht)
+ *
+ * \param sc pointer to scheme context
+ * \param args object to check
+ * \return T for hash tables, otherwise F
+ */
+static pointer scm_is_hash_table(scheme *sc, pointer args)
+{
+  pointer argv[1];
+
+  if( get_args( sc, args, 0, 1, 0, argv, __func__ ) != 1 )
+    return sc->F;
+
+  return( tcm_hash_is_table( sc, argv[0] ) ? sc->T : sc->F );
+}
+
+
+/*!
+ * retrieve value of key
+ *
+ * try: (hash-table-ref ht "key") or (hash-table-ref ht 'key 'default)
+ *
+ * \param sc pointer to scheme context
+ * \param args hash table, key and optional default value
+ * \return value of key, otherwise default value or F
+ */
+static pointer scm_hash_table_ref(scheme *sc, pointer args)
+{
+  pointer argv[3], entry;
+  int n;
+
+  n = get_args( sc, args, 2, 3, 1, argv, __func__ );
+  if( n < 0 )
+    return sc->F;
+
+  entry = tcm_hash_lookup( sc, argv[0], argv[1] );
+  if( entry != sc->NIL )
+    return pair_cdr( entry );
+
+  return( n == 3 ? argv[2] : sc->F );
+}
+
+
+/*!
+ * check whether key exists
+ *
+ * try: (hash-table-contains? ht "key")
+ *
+ * \param sc pointer to scheme context
+ * \param args hash table and key
+ * \return T when key exists, otherwise F
+ */
+static pointer scm_hash_table_contains(scheme *sc, pointer args)
+{
+  pointer argv[2];
+
+  if( get_args( sc, args, 2, 2, 1, argv, __func__ ) < 0 )
+    return sc->F;
+
+  return( tcm_hash_lookup( sc, argv[0], argv[1] ) != sc->NIL ? sc->T : sc->F );
+}
+
+
+/*!
+ * add entry or replace value of existing entry
+ *
+ * try: (hash-table-set! ht "key" 42)
+ *
+ * \param sc pointer to scheme context
+ * \param args hash table, key and value
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_hash_table_set(scheme *sc, pointer args)
+{
+  pointer argv[3];
+
+  if( get_args( sc, args, 3, 3, 1, argv, __func__ ) < 0 )
+    return sc->F;
+
+  tcm_hash_set( sc, argv[0], argv[1], argv[2] );
+
+  return sc->T;
+}
+
+
+/*!
+ * remove entry
+ *
+ * try: (hash-table-delete! ht "key")
+ *
+ * \param sc pointer to scheme context
+ * \param args hash table and key
+ * \return T when entry has been removed, F when key did not exist
+ */
+static pointer scm_hash_table_delete(scheme *sc, pointer args)
+{
+  pointer argv[2];
+
+  if( get_args( sc, args, 2, 2, 1, argv, __func__ ) < 0 )
+    return sc->F;
+
+  return( tcm_hash_delete( sc, argv[0], argv[1] ) ? sc->T : sc->F );
+}
+
+
+/*!
+ * number of entries
+ *
+ * try: (hash-table-count ht)
+ *
+ * \param sc pointer to scheme context
+ * \param args hash table
+ * \return number of entries or F in case of error
+ */
+static pointer scm_hash_table_count(scheme *sc, pointer args)
+{
+  pointer argv[1];
+
+  if( get_args( sc, args, 1, 1, 0, argv, __func__ ) < 0 )
+    return sc->F;
+
+  return mk_integer( sc, tcm_hash_count( argv[0] ) );
+}
+
+
+/*!
+ * remove all entries
+ *
+ * try: (hash-table-clear! ht)
+ *
+ * \param sc pointer to scheme context
+ * \param args hash table
+ * \return T in case of success, otherwise F
+ */
+static pointer scm_hash_table_clear(scheme *sc, pointer args)
+{
+  pointer argv[1], buckets;
+
+  if( get_args( sc, args, 1, 1, 0, argv, __func__ ) < 0 )
+    return sc->F;
+
+  buckets = mk_vector( sc, TCM_HASH_MIN_BUCKETS );
+  if( ! is_vector( buckets ) )
+    return sc->F;
+  set_vector_elem( argv[0], HT_BUCKETS, buckets );
+  set_vector_elem( argv[0], HT_COUNT, mk_integer( sc, 0 ) );
+
+  return sc->T;
+}
+
+
+/* what hash_table_list() collects */
+enum { LIST_KEYS, LIST_VALUES, LIST_ENTRIES };
+
+static pointer hash_table_list( scheme* sc, pointer args, int what, const char* func )
+{
+  pointer argv[1], buckets, frame, retval, x;
+  long i;
+
+  if( get_args( sc, args, 1, 1, 0, argv, func ) < 0 )
+    return sc->F;
+
+  buckets = vector_elem( argv[0], HT_BUCKETS );
+  frame = tcm_scheme_protect( (t_tcm_scheme *)sc, sc->NIL );
+  for( i = vector_length( buckets ) - 1; i >= 0; --i ) {
+    for( x = vector_elem( buckets, i ); x != sc->NIL; x = pair_cdr( x ) ) {
+      if( what == LIST_KEYS )
+        set_car( frame, cons( sc, pair_car( pair_car( x ) ), pair_car( frame ) ) );
+      else if( what == LIST_VALUES )
+        set_car( frame, cons( sc, pair_cdr( pair_car( x ) ), pair_car( frame ) ) );
+      else /* entries are copied such that the table cannot be modified via the list */
+        set_car( frame, cons( sc, cons( sc, pair_car( pair_car( x ) ), pair_cdr( pair_car( x ) ) ), pair_car( frame ) ) );
+    }
+  }
+  retval = pair_car( frame );
+  tcm_scheme_unprotect( (t_tcm_scheme *)sc );
+
+  return retval;
+}
+
+
+/*!
+ * list of all keys in unspecified order
+ *
+ * try: (hash-table-keys ht)
+ *
+ * \param sc pointer to scheme context
+ * \param args hash table
+ * \return list of keys or F in case of error
+ */
+static pointer scm_hash_table_keys(scheme *sc, pointer args)
+{
+  return hash_table_list( sc, args, LIST_KEYS, __func__ );
+}
+
+
+/*!
+ * list of all values in unspecified order
+ *
+ * try: (hash-table-values ht)
+ *
+ * \param sc pointer to scheme context
+ * \param args hash table
+ * \return list of values or F in case of error
+ */
+static pointer scm_hash_table_values(scheme *sc, pointer args)
+{
+  return hash_table_list( sc, args, LIST_VALUES, __func__ );
+}
+
+
+/*!
+ * association list of all entries in unspecified order
+ *
+ * try: (hash-table->alist ht)
+ *
+ * \param sc pointer to scheme context
+ * \param args hash table
+ * \return list of pairs (key . value) or F in case of error
+ */
+static pointer scm_hash_table_to_alist(scheme *sc, pointer args)
+{
+  return hash_table_list( sc, args, LIST_ENTRIES, __func__ );
+}
+
+
+void init_tcm_hash_ff( scheme* sc )
+{
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "make-hash-table" ), mk_foreign_func( sc, scm_make_hash_table ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table?" ), mk_foreign_func( sc, scm_is_hash_table ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table-ref" ), mk_foreign_func( sc, scm_hash_table_ref ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table-contains?" ), mk_foreign_func( sc, scm_hash_table_contains ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table-set!" ), mk_foreign_func( sc, scm_hash_table_set ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table-delete!" ), mk_foreign_func( sc, scm_hash_table_delete ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table-count" ), mk_foreign_func( sc, scm_hash_table_count ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table-clear!" ), mk_foreign_func( sc, scm_hash_table_clear ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table-keys" ), mk_foreign_func( sc, scm_hash_table_keys ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table-values" ), mk_foreign_func( sc, scm_hash_table_values ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "hash-table->alist" ), mk_foreign_func( sc, scm_hash_table_to_alist ) );
+
+  /* iteration works on a snapshot, the procedure may modify the table */
+  scheme_load_string( sc,
+    "(define (hash-table-for-each ht proc)"
+    "  (for-each (lambda (e) (proc (car e) (cdr e))) (hash-table->alist ht)))" );
+  scheme_load_string( sc,
+    "(define (hash-table-update! ht key proc . default)"
+    "  (hash-table-set! ht key (proc (hash-table-ref ht key (if (pair? default) (car default) #f)))))" );
+}
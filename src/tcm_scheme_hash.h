@@ -0,0 +1,158 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_SCHEME_HASH_H
+#define TCM_SCHEME_HASH_H
+
+#include <tinyscheme/scheme.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_scheme_hash.h
+    \brief hash tables for the embedded scheme script interpreter
+
+    A hash table is  an ordinary  scheme vector #(hash-table count buckets)
+    where buckets is a vector of association lists with a power of two size.
+    Hence all keys  and  values  are  traced by  the garbage collector  of the
+    interpreter without further measures. Keys are strings compared by
+    content, symbols and integers. The bucket vector is doubled when the
+    number of entries exceeds its size, the list cells are relinked into the
+    new buckets such that growing allocates only the new vector.
+
+    The interpreter allocates a vector within one cell segment of CELL_SEGSIZE
+    cells, two elements per cell. Hence the number of buckets is limited to
+    TCM_HASH_MAX_BUCKETS, larger tables just get longer chains.
+
+    \code
+    (define calls (make-hash-table))
+    (hash-table-set! calls "+4912345" 'ringing)
+    (hash-table-ref calls "+4912345")          ; => ringing
+    (hash-table-ref calls "+4967890" 'idle)    ; => idle
+    (hash-table-delete! calls "+4912345")
+    (hash-table-for-each calls (lambda (k v) (display k)))
+    \endcode
+
+    \addtogroup scheme
+    @{
+ */
+
+#define TCM_HASH_MIN_BUCKETS       16                   /*!< initial number of buckets */
+#define TCM_HASH_MAX_BUCKETS       8192                 /*!< largest power of two fitting into one cell segment */
+
+
+/*!
+ * create hash table
+ *
+ * \param sc pointer to scheme interpreter environment
+ * \param size_hint expected number of entries
+ * \return hash table object or F when the interpreter ran out of memory
+ */
+pointer tcm_hash_make( scheme* sc, long size_hint );
+
+
+/*!
+ * check whether object is a hash table
+ *
+ * \param sc pointer to scheme interpreter environment
+ * \param x object to check
+ * \return 1 for hash tables, otherwise 0
+ */
+int tcm_hash_is_table( scheme* sc, pointer x );
+
+
+/*!
+ * check whether object can be used as key
+ *
+ * \param x object to check
+ * \return 1 for strings, symbols and integers, otherwise 0
+ */
+int tcm_hash_is_key( pointer x );
+
+
+/*!
+ * look up entry of key
+ *
+ * \param sc pointer to scheme interpreter environment
+ * \param ht hash table object
+ * \param key key object
+ * \return pair (key . value) or NIL when key is not found
+ */
+pointer tcm_hash_lookup( scheme* sc, pointer ht, pointer key );
+
+
+/*!
+ * add entry or replace value of existing entry
+ *
+ * Table, key and value must be reachable by the garbage collector, e.g. as
+ * arguments of the calling foreign function.
+ *
+ * \param sc pointer to scheme interpreter environment
+ * \param ht hash table object
+ * \param key key object
+ * \param value value object
+ */
+void tcm_hash_set( scheme* sc, pointer ht, pointer key, pointer value );
+
+
+/*!
+ * remove entry
+ *
+ * \param sc pointer to scheme interpreter environment
+ * \param ht hash table object
+ * \param key key object
+ * \return 1 when entry has been removed, 0 when key is not found
+ */
+int tcm_hash_delete( scheme* sc, pointer ht, pointer key );
+
+
+/*!
+ * number of entries
+ *
+ * \param ht hash table object
+ * \return number of entries
+ */
+long tcm_hash_count( pointer ht );
+
+
+/*!
+ * register hash table functions in interpreter
+ *
+ * \param sc pointer to scheme interpreter environment
+ */
+void init_tcm_hash_ff( scheme* sc );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_SCHEME_HASH_H */
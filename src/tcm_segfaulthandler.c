@@ -27,39 +27,60 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <execinfo.h>
 #include <tcm_segfaulthandler.h>
+#include <tcm_flightrec.h>
+#include <tcm_config.h>
 #include <tcm_log.h>
 
 
-static void tcm_print_trace( void )
+static void write_str( int fd, const char* s )
 {
-  void *array[10];
-  size_t size;
-  char **strings;
-  size_t i;
+  if( write( fd, s, strlen( s ) ) < 0 )
+    return;
+}
+
+
+void segfaulthandler( int sig_num )
+{
+  void *array[32];
+  int size, fd;
 
-  size = backtrace (array, 10);
-  strings = backtrace_symbols (array, size);
+  /* only async-signal-safe functions are used here */
+  write_str( STDERR_FILENO, "segfaulthandler: !!!!! RECEIVED FATAL SIGNAL, dumping flight recorder !!!!!\n" );
 
-  tcm_error ("Obtained %zd stack frames.\n", size);
+  fd = open( g_tcm_flightrec_file, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if( fd >= 0 ) {
+    write_str( fd, "fatal signal " );
+    write_str( fd, sig_num == SIGSEGV ? "SIGSEGV" : sig_num == SIGABRT ? "SIGABRT" :
+                   sig_num == SIGFPE ? "SIGFPE" : sig_num == SIGPIPE ? "SIGPIPE" : "other" );
+    write_str( fd, "\n" );
 
-  for (i = 0; i < size; i++)
-    tcm_error ("%s\n", strings[i]);
+    size = backtrace( array, sizeof( array ) / sizeof( array[0] ) );
+    backtrace_symbols_fd( array, size, fd );
 
-  free (strings);
+    tcm_flightrec_write( fd );
+    close( fd );
+  }
+
+  /* terminate with default action, e.g. core dump */
+  signal( sig_num, SIG_DFL );
+  raise( sig_num );
 }
 
-void segfaulthandler( int sig_num )
-{
 
-  tcm_error( "%s: !!!!! RECEIVED SEGMENTATION FAULT !!!!!\n", __func__ );
-  tcm_error( "=======================================\n" );
-  tcm_print_trace();
+void tcm_segfaulthandler_init( void )
+{
+  void *array[1];
 
-  exit( -1 );
+  /* backtrace() loads libgcc on first use which is not safe within the handler */
+  backtrace( array, 1 );
 }
 
+
 int tcm_enforce_crash( int reccount )
 {
   int result;
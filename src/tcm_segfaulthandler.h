@@ -46,11 +46,21 @@ extern "C" {
 
 /*!
  * segmentation fault handler
+ *
+ * Writes a backtrace and the flight recorder to the flight recorder file
+ * and terminates the process with the signal's default action.
+ *
  * \param sig_num: received signal
  */
 void segfaulthandler( int sig_num );
 
 
+/*!
+ * prepare segmentation fault handler, to be invoked before registration
+ */
+void tcm_segfaulthandler_init( void );
+
+
 /*!
  * function to enforce crash after specified number of recursions.
  * Do not invoke this!
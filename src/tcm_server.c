@@ -45,6 +45,10 @@
 #include <tcm_scheme.h>
 #include <tcm_config.h>
 #include <tcm_log.h>
+#include <tcm_rt.h>
+#include <tcm_boot.h>
+#include <tcm_flightrec.h>
+#include <tcm_metrics.h>
 
 #include <dev_channel.h>
 
@@ -54,6 +58,11 @@ static void tcm_release( t_tcm_server_ctx* p )
   if( ! p )
     return;
 
+  if( p->p_metrics ) {
+    tcm_release_metrics( p->p_metrics );
+    tcm_message("\tmetrics endpoint stopped\n" );
+  }
+
   tcm_release_scheme( p->p_scheme );
   tcm_message("\tscheme interpreter killed\n" );
 
@@ -78,6 +87,10 @@ static t_tcm_server_ctx* tcm_init( void )
     return NULL;
   }
 
+  /* the daemon keeps running without metrics when the endpoint cannot be opened */
+  if( g_tcm_metrics_address[0] )
+    p->p_metrics = tcm_init_metrics( p, g_tcm_metrics_address, g_tcm_metrics_port );
+
   return p;
 }
 
@@ -96,6 +109,7 @@ int tcm(void)
   long run_loop_cnt = 1;
   t_dev_channel* p_dev_channel = NULL;
 
+  tcm_boot_init();
   memtrace_enable();
 
   tcm_log_init();
@@ -104,12 +118,17 @@ int tcm(void)
   tcm_message("libcutils revision: %s\n", g_cutillib_revision );
   tcm_message("libintercom revision: %s\n", g_icomlib_revision );
   tcm_init_config();
+  tcm_flightrec_init( g_tcm_flightrec_file );
+  tcm_boot_mark( "config" );
+  tcm_rt_init();
+  tcm_boot_mark( "realtime" );
 
   p =  tcm_init();
   if( ! p ) {
     tcm_error( "%s: server initialization error!\n" );
     return -1;
   }
+  tcm_boot_init_done();
 
 
   /* test case for crashdump */
@@ -118,6 +137,7 @@ int tcm(void)
   /* main process loop waits just for termination */
   while( ! p->termination_request ) {
     sleep( 1 );
+    tcm_scheme_lazy_timeout( p->p_scheme );
     if( ! (run_loop_cnt % 10) )
       tcm_message("alive\n");
     ++run_loop_cnt;
@@ -166,6 +186,8 @@ int tcm(void)
 
 int main( int argc, char* argv[] )
 {
+  tcm_segfaulthandler_init();
+
   if( signal( SIGSEGV, segfaulthandler ) == SIG_ERR )
     tcm_error( "Could not register SIGSEGV error!\n");
 
@@ -175,5 +197,8 @@ int main( int argc, char* argv[] )
   if( signal( SIGPIPE, segfaulthandler ) == SIG_ERR )
     tcm_error( "Could not register SIGPIPE error!\n");
 
+  if( signal( SIGABRT, segfaulthandler ) == SIG_ERR )
+    tcm_error( "Could not register SIGABRT error!\n");
+
   return tcm();
 }
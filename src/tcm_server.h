@@ -45,6 +45,7 @@ extern "C" {
 
 
 struct s_tcm_scheme;
+struct s_tcm_metrics;
 
 /*!
  * tcm server respectively daemon state
@@ -53,6 +54,7 @@ struct s_tcm_scheme;
  */
 typedef struct s_tcm_server_ctx {
   struct s_tcm_scheme*        p_scheme;                 /*!< pointer to scheme instance object */
+  struct s_tcm_metrics*       p_metrics;                /*!< metrics endpoint, NULL when disabled */
   int                         termination_request;      /*!< terminate process when set to 1 */
 } t_tcm_server_ctx;
 
@@ -0,0 +1,197 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * throughput of a shared memory channel compared to a server socket channel
+ *
+ * Messages are sent with up to window messages outstanding and tcm is
+ * expected to echo them back, e.g. with:
+ *
+ *   (define bench-ch (make-shm-channel "bench" (lambda (s) (%write-channel bench-ch s))))
+ *   (define bench-sock
+ *     (make-server-sock-channel "127.0.0.1" 5010 (lambda (s id) (%write-channel-to bench-sock id s))))
+ *
+ * usage: tcm_shm_bench [-n count] [-s size] [-w window] [-p port] name
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <tcm_shm_client.h>
+
+
+#define TIMEOUT_MS                 2000
+
+
+static double now_s( void )
+{
+  struct timespec t;
+
+  clock_gettime( CLOCK_MONOTONIC, & t );
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+
+static void report( const char* name, long count, int size, double seconds )
+{
+  printf( "%-8s %8ld messages of %4d bytes in %7.3f s: %9.0f messages/s %8.2f MB/s %7.2f us per message\n",
+          name, count, size, seconds, count / seconds, count * (double)size / seconds / 1e6,
+          seconds * 1e6 / count );
+}
+
+
+static int bench_shm( const char* name, long count, int size, int window )
+{
+  char msg[TCM_SHM_MAX_MSG], buf[TCM_SHM_MAX_MSG];
+  t_tcm_shm_client* p;
+  long sent = 0, received = 0;
+  double t0;
+  int len;
+
+  p = tcm_shm_client_open( name );
+  if( p == NULL ) {
+    fprintf( stderr, "could not attach to shm channel %s: %s\n", name, strerror( errno ) );
+    return -1;
+  }
+
+  memset( msg, 'x', size );
+  t0 = now_s();
+
+  while( received < count ) {
+    /* ring full: echoes must be consumed first to avoid a deadlock */
+    while( sent < count && sent - received < window && tcm_shm_client_send( p, msg, size, 0 ) == size )
+      ++sent;
+
+    len = tcm_shm_client_recv( p, buf, sizeof( buf ), TIMEOUT_MS );
+    if( len != size ) {
+      fprintf( stderr, "shm receive %s\n", len ? "size mismatch" : "timeout" );
+      goto error;
+    }
+    ++received;
+  }
+
+  report( "shm", count, size, now_s() - t0 );
+  tcm_shm_client_close( p );
+  return 0;
+
+error:
+  tcm_shm_client_close( p );
+  return -1;
+}
+
+
+static int bench_socket( int port, long count, int size, int window )
+{
+  char msg[TCM_SHM_MAX_MSG], buf[65536];
+  struct sockaddr_in addr;
+  long sent = 0, received = 0, total = count * size;
+  double t0;
+  int fd, len, one = 1;
+
+  fd = socket( AF_INET, SOCK_STREAM, 0 );
+  memset( & addr, 0, sizeof( addr ) );
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons( port );
+  addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+  if( fd < 0 || connect( fd, (struct sockaddr *) & addr, sizeof( addr ) ) ) {
+    fprintf( stderr, "could not connect to port %d: %s\n", port, strerror( errno ) );
+    if( fd >= 0 )
+      close( fd );
+    return -1;
+  }
+  setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, & one, sizeof( one ) );
+
+  /* wait for the connection to be accepted before measuring */
+  usleep( 100000 );
+
+  memset( msg, 'x', size );
+  t0 = now_s();
+
+  /* stream does not preserve message boundaries, hence bytes are counted */
+  while( received < total ) {
+    while( sent < count && sent - received / size < window ) {
+      if( write( fd, msg, size ) != size ) {
+        fprintf( stderr, "socket write error: %s\n", strerror( errno ) );
+        goto error;
+      }
+      ++sent;
+    }
+
+    len = read( fd, buf, sizeof( buf ) );
+    if( len <= 0 ) {
+      fprintf( stderr, "socket read error\n" );
+      goto error;
+    }
+    received += len;
+  }
+
+  report( "socket", count, size, now_s() - t0 );
+  close( fd );
+  return 0;
+
+error:
+  close( fd );
+  return -1;
+}
+
+
+int main( int argc, char* argv[] )
+{
+  long count = 100000;
+  int size = 64, window = 16, port = 0;
+  int opt, retcode = 0;
+
+  while( ( opt = getopt( argc, argv, "n:s:w:p:" ) ) != -1 ) {
+    switch( opt ) {
+    case 'n': count = atol( optarg ); break;
+    case 's': size = atoi( optarg ); break;
+    case 'w': window = atoi( optarg ); break;
+    case 'p': port = atoi( optarg ); break;
+    default: optind = argc + 1; break;
+    }
+  }
+
+  if( optind != argc - 1 || count <= 0 || size < 1 || size > TCM_SHM_MAX_MSG || window < 1 ) {
+    fprintf( stderr, "usage: %s [-n count] [-s size 1..%d] [-w window] [-p port] name\n", argv[0], TCM_SHM_MAX_MSG );
+    return 1;
+  }
+
+  if( bench_shm( argv[optind], count, size, window ) )
+    retcode = 1;
+
+  if( port && bench_socket( port, count, size, window ) )
+    retcode = 1;
+
+  return retcode;
+}
@@ -0,0 +1,154 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <tcm_shm_ring.h>
+#include <tcm_shm_client.h>
+
+
+struct s_tcm_shm_client {
+  t_tcm_shm_header*             p_hdr;                  /*!< mapped segment */
+  unsigned long                 size;                   /*!< size of segment */
+  t_tcm_shm_view                to_server;              /*!< private view of request ring */
+  t_tcm_shm_view                to_client;              /*!< private view of reply ring */
+};
+
+
+t_tcm_shm_client* tcm_shm_client_open( const char* name )
+{
+  char path[sizeof( TCM_SHM_PREFIX ) + TCM_SHM_MAX_NAME];
+  t_tcm_shm_client* p;
+  struct stat st;
+  int32_t pid;
+  int fd, err;
+
+  if( strlen( name ) >= TCM_SHM_MAX_NAME || strchr( name, '/' ) ) {
+    errno = EINVAL;
+    return NULL;
+  }
+  snprintf( path, sizeof( path ), "%s%s", TCM_SHM_PREFIX, name );
+
+  p = malloc( sizeof( t_tcm_shm_client ) );
+  if( p == NULL )
+    return NULL;
+
+  fd = shm_open( path, O_RDWR, 0 );
+  if( fd < 0 || fstat( fd, & st ) ) {
+    err = errno;
+    goto error;
+  }
+
+  p->size = st.st_size;
+  p->p_hdr = mmap( NULL, p->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  close( fd );
+  fd = -1;
+  if( p->p_hdr == MAP_FAILED ) {
+    err = errno;
+    goto error;
+  }
+
+  if( tcm_shm_check( p->p_hdr, p->size ) ) {
+    munmap( p->p_hdr, p->size );
+    err = EPROTO;
+    goto error;
+  }
+
+  /* single consumer and producer per direction, take over from dead clients */
+  pid = __atomic_load_n( & p->p_hdr->client_pid, __ATOMIC_ACQUIRE );
+  if( pid && ( kill( pid, 0 ) == 0 || errno != ESRCH ) ) {
+    munmap( p->p_hdr, p->size );
+    err = EBUSY;
+    goto error;
+  }
+  if( ! __atomic_compare_exchange_n( & p->p_hdr->client_pid, & pid, getpid(), 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) ) {
+    munmap( p->p_hdr, p->size );
+    err = EBUSY;
+    goto error;
+  }
+
+  /* ring geometry is read once, later changes by the peer are ignored */
+  tcm_shm_view_init( p->p_hdr, TCM_SHM_TO_SERVER, p->p_hdr->rings[0].size, 1, & p->to_server );
+  tcm_shm_view_init( p->p_hdr, TCM_SHM_TO_CLIENT, p->p_hdr->rings[0].size, 0, & p->to_client );
+
+  /* messages addressed to a previous client */
+  tcm_shm_discard( & p->to_client );
+
+  return p;
+
+error:
+  if( fd >= 0 )
+    close( fd );
+  free( p );
+  errno = err;
+  return NULL;
+}
+
+
+int tcm_shm_client_send( t_tcm_shm_client* p, const void* data, int len, int timeout_ms )
+{
+  int retcode;
+
+  while( ( retcode = tcm_shm_push( & p->to_server, data, len ) ) == 0 ) {
+    if( timeout_ms == 0 || ! tcm_shm_wait_space( & p->to_server, len, timeout_ms ) )
+      break;
+  }
+
+  return retcode;
+}
+
+
+int tcm_shm_client_recv( t_tcm_shm_client* p, void* buf, int size, int timeout_ms )
+{
+  int retcode;
+
+  while( ( retcode = tcm_shm_pop( & p->to_client, buf, size ) ) == 0 ) {
+    if( timeout_ms == 0 || ! tcm_shm_wait_data( & p->to_client, timeout_ms ) )
+      break;
+  }
+
+  return retcode;
+}
+
+
+void tcm_shm_client_close( t_tcm_shm_client* p )
+{
+  int32_t pid = getpid();
+
+  if( p ) {
+    __atomic_compare_exchange_n( & p->p_hdr->client_pid, & pid, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+    munmap( p->p_hdr, p->size );
+    free( p );
+  }
+}
@@ -0,0 +1,108 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_SHM_CLIENT_H
+#define TCM_SHM_CLIENT_H
+
+#include <tcm_shm_ring.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+    \file tcm_shm_client.h
+    \brief client library for shared memory channels of tcm
+
+    Local processes exchange messages with a shared memory channel of tcm
+    which has been created with make-shm-channel. Each message is delivered
+    as a whole to the callback of the channel respectively returned by one
+    call of tcm_shm_client_recv(). Only one client can be attached to a
+    channel at a time, a client which terminates without detaching is
+    detected by tcm and replaced by the next one.
+
+    The library is thread safe as long as sending and receiving each happen
+    from one thread only. Link with -ltcmshm.
+
+    \addtogroup channels
+    @{
+ */
+
+/*!
+ * opaque client handle
+ */
+typedef struct s_tcm_shm_client t_tcm_shm_client;
+
+
+/*!
+ * attach to shared memory channel
+ *
+ * \param name name of channel as given to make-shm-channel
+ * \return client handle or NULL in case of error with errno set, EBUSY when
+ *         another client is attached, ENOENT when the channel does not exist
+ */
+t_tcm_shm_client* tcm_shm_client_open( const char* name );
+
+
+/*!
+ * send message to tcm
+ *
+ * \param p client handle
+ * \param data message
+ * \param len length of message, between 1 and TCM_SHM_MAX_MSG
+ * \param timeout_ms maximum time to wait for space, 0 for none, negative to wait forever
+ * \return len in case of success, 0 on timeout, -1 when length is invalid
+ */
+int tcm_shm_client_send( t_tcm_shm_client* p, const void* data, int len, int timeout_ms );
+
+
+/*!
+ * receive message from tcm
+ *
+ * \param p client handle
+ * \param buf buffer where message is copied to, messages exceeding it are truncated
+ * \param size size of buffer
+ * \param timeout_ms maximum time to wait for a message, 0 for none, negative to wait forever
+ * \return length of message, 0 on timeout
+ */
+int tcm_shm_client_recv( t_tcm_shm_client* p, void* buf, int size, int timeout_ms );
+
+
+/*!
+ * detach from channel and release handle
+ *
+ * \param p client handle
+ */
+void tcm_shm_client_close( t_tcm_shm_client* p );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_SHM_CLIENT_H */
@@ -0,0 +1,280 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <tcm_shm_ring.h>
+
+
+#define RECORD_SIZE( len )         ( 4 + ( ( (len) + 3 ) & ~3 ) )
+
+
+/* segment is shared between processes, hence no private futex operations */
+static int futex_wait( uint32_t* p_word, uint32_t val, const struct timespec* p_timeout )
+{
+  return syscall( SYS_futex, p_word, FUTEX_WAIT, val, p_timeout, NULL, 0 );
+}
+
+
+static void futex_wake( uint32_t* p_word )
+{
+  syscall( SYS_futex, p_word, FUTEX_WAKE, 1, NULL, NULL, 0 );
+}
+
+
+/* bytes available to consumer, 0 when the producer's position is not plausible */
+static uint32_t ring_avail( t_tcm_shm_view* v )
+{
+  uint32_t used = __atomic_load_n( & v->r->head, __ATOMIC_ACQUIRE ) - v->pos;
+
+  return( used <= v->size && ! ( used & 3 ) ) ? used : 0;
+}
+
+
+/* bytes available to producer, 0 when the consumer's position is not plausible */
+static uint32_t ring_free( t_tcm_shm_view* v )
+{
+  uint32_t used = v->pos - __atomic_load_n( & v->r->tail, __ATOMIC_ACQUIRE );
+
+  return( used <= v->size ) ? v->size - used : 0;
+}
+
+
+unsigned long tcm_shm_segment_size( uint32_t ring_size )
+{
+  return sizeof( t_tcm_shm_header ) + 2UL * ring_size;
+}
+
+
+void tcm_shm_init( t_tcm_shm_header* p, uint32_t ring_size )
+{
+  int i;
+
+  memset( p, 0, sizeof( t_tcm_shm_header ) );
+  for( i = 0; i < 2; ++i ) {
+    p->rings[i].size = ring_size;
+    p->rings[i].offset = sizeof( t_tcm_shm_header ) + i * ring_size;
+  }
+  p->version = TCM_SHM_VERSION;
+  p->server_pid = getpid();
+
+  /* clients check the magic number last */
+  __atomic_store_n( & p->magic, TCM_SHM_MAGIC, __ATOMIC_RELEASE );
+}
+
+
+int tcm_shm_check( const t_tcm_shm_header* p, unsigned long size )
+{
+  int i;
+
+  if( size < sizeof( t_tcm_shm_header ) || __atomic_load_n( & p->magic, __ATOMIC_ACQUIRE ) != TCM_SHM_MAGIC ||
+      p->version != TCM_SHM_VERSION )
+    return -1;
+
+  for( i = 0; i < 2; ++i ) {
+    if( p->rings[i].size != p->rings[0].size || p->rings[i].size < TCM_SHM_MIN_RING_SIZE ||
+        p->rings[i].size > TCM_SHM_MAX_RING_SIZE || ( p->rings[i].size & ( p->rings[i].size - 1 ) ) ||
+        p->rings[i].offset != sizeof( t_tcm_shm_header ) + i * p->rings[i].size ||
+        (unsigned long)p->rings[i].offset + p->rings[i].size > size )
+      return -1;
+  }
+
+  return 0;
+}
+
+
+void tcm_shm_view_init( t_tcm_shm_header* p, int ring, uint32_t ring_size, int producer, t_tcm_shm_view* v )
+{
+  v->r = & p->rings[ring];
+  v->p_data = (uint8_t *)p + sizeof( t_tcm_shm_header ) + ring * ring_size;
+  v->size = ring_size;
+
+  /* positions are multiples of 4 so that length words never wrap */
+  v->pos = __atomic_load_n( producer ? & v->r->head : & v->r->tail, __ATOMIC_ACQUIRE ) & ~3U;
+}
+
+
+int tcm_shm_push( t_tcm_shm_view* v, const void* data, int len )
+{
+  t_tcm_shm_ring* r = v->r;
+  uint32_t pos, n;
+
+  if( len < 1 || len > TCM_SHM_MAX_MSG )
+    return -1;
+
+  if( RECORD_SIZE( len ) > ring_free( v ) )
+    return 0;
+
+  pos = v->pos & ( v->size - 1 );
+  *(uint32_t *)( v->p_data + pos ) = len;
+  pos = ( pos + 4 ) & ( v->size - 1 );
+  n = ( len < v->size - pos ) ? len : v->size - pos;
+  memcpy( v->p_data + pos, data, n );
+  memcpy( v->p_data, (const uint8_t *)data + n, len - n );
+
+  v->pos += RECORD_SIZE( len );
+  __atomic_store_n( & r->head, v->pos, __ATOMIC_RELEASE );
+
+  /* pairs with the fence in tcm_shm_wait_data() */
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+  if( __atomic_load_n( & r->consumer_waiting, __ATOMIC_RELAXED ) ) {
+    __atomic_add_fetch( & r->data_futex, 1, __ATOMIC_SEQ_CST );
+    futex_wake( & r->data_futex );
+  }
+
+  return len;
+}
+
+
+int tcm_shm_pop( t_tcm_shm_view* v, void* buf, int size )
+{
+  t_tcm_shm_ring* r = v->r;
+  uint32_t avail, pos, len, n;
+
+  avail = ring_avail( v );
+  if( avail == 0 )
+    return 0;
+
+  pos = v->pos & ( v->size - 1 );
+  len = *(volatile uint32_t *)( v->p_data + pos );
+  if( len < 1 || len > TCM_SHM_MAX_MSG || RECORD_SIZE( len ) > avail ) {
+    /* corrupted by peer, drop everything written so far */
+    v->pos += avail;
+    len = 0;
+    n = 0;
+  } else {
+    pos = ( pos + 4 ) & ( v->size - 1 );
+    n = ( len < size ) ? len : size;
+    if( n > v->size - pos ) {
+      memcpy( buf, v->p_data + pos, v->size - pos );
+      memcpy( (uint8_t *)buf + v->size - pos, v->p_data, n - ( v->size - pos ) );
+    } else {
+      memcpy( buf, v->p_data + pos, n );
+    }
+    v->pos += RECORD_SIZE( len );
+  }
+
+  __atomic_store_n( & r->tail, v->pos, __ATOMIC_RELEASE );
+
+  /* pairs with the fence in tcm_shm_wait_space() */
+  __atomic_thread_fence( __ATOMIC_SEQ_CST );
+  if( __atomic_load_n( & r->producer_waiting, __ATOMIC_RELAXED ) ) {
+    __atomic_add_fetch( & r->space_futex, 1, __ATOMIC_SEQ_CST );
+    futex_wake( & r->space_futex );
+  }
+
+  return n;
+}
+
+
+void tcm_shm_discard( t_tcm_shm_view* v )
+{
+  v->pos += ring_avail( v );
+  __atomic_store_n( & v->r->tail, v->pos, __ATOMIC_RELEASE );
+}
+
+
+/*
+ * sleep on futex word until condition holds, returns 1 when it holds, otherwise 0
+ */
+static int wait_until( t_tcm_shm_view* v, uint32_t* p_word, uint32_t* p_waiting, uint32_t len, int timeout_ms )
+{
+  struct timespec now, deadline, timeout;
+  uint32_t val;
+  int ready;
+
+  clock_gettime( CLOCK_MONOTONIC, & deadline );
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += ( timeout_ms % 1000 ) * 1000000L;
+  if( deadline.tv_nsec >= 1000000000L ) {
+    deadline.tv_nsec -= 1000000000L;
+    ++deadline.tv_sec;
+  }
+
+  while( 1 ) {
+    __atomic_store_n( p_waiting, 1, __ATOMIC_RELAXED );
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+    val = __atomic_load_n( p_word, __ATOMIC_SEQ_CST );
+
+    /* len 0 denotes waiting for data, otherwise for space */
+    ready = len ? ( ring_free( v ) >= len ) : ( ring_avail( v ) > 0 );
+    if( ready )
+      break;
+
+    if( timeout_ms >= 0 ) {
+      clock_gettime( CLOCK_MONOTONIC, & now );
+      timeout.tv_sec = deadline.tv_sec - now.tv_sec;
+      timeout.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+      if( timeout.tv_nsec < 0 ) {
+        timeout.tv_nsec += 1000000000L;
+        --timeout.tv_sec;
+      }
+      if( timeout.tv_sec < 0 )
+        break;
+    }
+
+    if( futex_wait( p_word, val, timeout_ms >= 0 ? & timeout : NULL ) && errno == ETIMEDOUT )
+      break;
+
+    /* explicit wakeup without data */
+    if( __atomic_load_n( p_word, __ATOMIC_SEQ_CST ) != val &&
+        ! ( len ? ( ring_free( v ) >= len ) : ( ring_avail( v ) > 0 ) ) )
+      break;
+  }
+
+  __atomic_store_n( p_waiting, 0, __ATOMIC_RELAXED );
+
+  return ready;
+}
+
+
+int tcm_shm_wait_data( t_tcm_shm_view* v, int timeout_ms )
+{
+  if( ring_avail( v ) > 0 )
+    return 1;
+
+  return wait_until( v, & v->r->data_futex, & v->r->consumer_waiting, 0, timeout_ms );
+}
+
+
+int tcm_shm_wait_space( t_tcm_shm_view* v, int len, int timeout_ms )
+{
+  if( ring_free( v ) >= RECORD_SIZE( len ) )
+    return 1;
+
+  return wait_until( v, & v->r->space_futex, & v->r->producer_waiting, RECORD_SIZE( len ), timeout_ms );
+}
+
+
+void tcm_shm_wakeup( t_tcm_shm_view* v )
+{
+  __atomic_add_fetch( & v->r->data_futex, 1, __ATOMIC_SEQ_CST );
+  futex_wake( & v->r->data_futex );
+}
@@ -0,0 +1,225 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_SHM_RING_H
+#define TCM_SHM_RING_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+    \file tcm_shm_ring.h
+    \brief message rings in shared memory between tcm and one local client
+
+    A shared memory segment holds a header and two single producer single
+    consumer rings, one for each direction. Messages are stored as 32 bit
+    length followed by the data, padded to 4 bytes, and may wrap around the
+    end of the ring. Producer and consumer each own one free running position.
+    A side which finds its ring empty respectively full announces itself as
+    waiting and sleeps on a futex which the other side only wakes when this
+    has been announced, so no system call is made while data is flowing.
+
+    Each side accesses a ring through a private view holding the geometry of
+    the ring and its own position. Since the peer may modify the segment at
+    will, only the position of the other side, the futex words and the
+    records are read from shared memory, and they are checked against the
+    private geometry before use.
+
+    This file is shared by the shm channel of tcm and the client library
+    libtcmshm and must not depend on anything else.
+
+    \addtogroup channels
+    @{
+ */
+
+#define TCM_SHM_MAGIC              0x54434d53           /*!< "TCMS" */
+#define TCM_SHM_VERSION            1                    /*!< layout version */
+#define TCM_SHM_PREFIX             "/tcm-"              /*!< prefix of segment name given to shm_open() */
+#define TCM_SHM_MAX_NAME           64                   /*!< maximum length of channel name */
+#define TCM_SHM_MAX_MSG            4096                 /*!< maximum message size */
+#define TCM_SHM_MIN_RING_SIZE      16384                /*!< minimum ring size in bytes */
+#define TCM_SHM_MAX_RING_SIZE      (16*1024*1024)       /*!< maximum ring size in bytes */
+
+#define TCM_SHM_TO_SERVER          0                    /*!< ring written by the client */
+#define TCM_SHM_TO_CLIENT          1                    /*!< ring written by tcm */
+
+
+/*!
+ * control block of one ring, positions are kept on separate cache lines
+ */
+typedef struct s_tcm_shm_ring {
+  uint32_t                      head;                   /*!< written by producer, free running */
+  uint32_t                      pad0[15];
+  uint32_t                      tail;                   /*!< written by consumer, free running */
+  uint32_t                      pad1[15];
+  uint32_t                      data_futex;             /*!< bumped when data arrives for a waiting consumer */
+  uint32_t                      consumer_waiting;       /*!< 1 while consumer sleeps or is about to */
+  uint32_t                      space_futex;            /*!< bumped when space is freed for a waiting producer */
+  uint32_t                      producer_waiting;       /*!< 1 while producer sleeps or is about to */
+  uint32_t                      pad2[12];
+  uint32_t                      size;                   /*!< size of data area, power of two */
+  uint32_t                      offset;                 /*!< offset of data area from start of segment */
+  uint32_t                      pad3[14];
+} t_tcm_shm_ring;
+
+
+/*!
+ * header at the start of the shared memory segment
+ */
+typedef struct s_tcm_shm_header {
+  uint32_t                      magic;                  /*!< TCM_SHM_MAGIC once initialized */
+  uint32_t                      version;                /*!< TCM_SHM_VERSION */
+  int32_t                       server_pid;             /*!< process id of tcm */
+  int32_t                       client_pid;             /*!< process id of attached client or 0 */
+  uint32_t                      pad[12];
+  t_tcm_shm_ring                rings[2];               /*!< indexed by TCM_SHM_TO_SERVER, TCM_SHM_TO_CLIENT */
+} t_tcm_shm_header;
+
+
+/*!
+ * process private view of one ring
+ */
+typedef struct s_tcm_shm_view {
+  t_tcm_shm_ring*               r;                      /*!< control block in segment */
+  uint8_t*                      p_data;                 /*!< start of data area */
+  uint32_t                      size;                   /*!< size of data area, power of two */
+  uint32_t                      pos;                    /*!< own position, head of producer respectively tail of consumer */
+} t_tcm_shm_view;
+
+
+/*!
+ * size of segment for given ring size
+ *
+ * \param ring_size size of each ring, power of two
+ * \return size in bytes
+ */
+unsigned long tcm_shm_segment_size( uint32_t ring_size );
+
+
+/*!
+ * initialize header and rings of freshly created segment
+ *
+ * \param p pointer to start of segment of size tcm_shm_segment_size()
+ * \param ring_size size of each ring, power of two
+ */
+void tcm_shm_init( t_tcm_shm_header* p, uint32_t ring_size );
+
+
+/*!
+ * check header of mapped segment
+ *
+ * \param p pointer to start of segment
+ * \param size size of segment
+ * \return 0 when valid, otherwise -1
+ */
+int tcm_shm_check( const t_tcm_shm_header* p, unsigned long size );
+
+
+/*!
+ * set up private view of ring
+ *
+ * The server passes the ring size it has initialized the segment with, a
+ * client the ring size of the segment after it has been checked with
+ * tcm_shm_check().
+ *
+ * \param p pointer to segment
+ * \param ring TCM_SHM_TO_SERVER or TCM_SHM_TO_CLIENT
+ * \param ring_size size of each ring, power of two
+ * \param producer 1 when the ring is written, 0 when it is read through the view
+ * \param v pointer to view which is initialized
+ */
+void tcm_shm_view_init( t_tcm_shm_header* p, int ring, uint32_t ring_size, int producer, t_tcm_shm_view* v );
+
+
+/*!
+ * append message to ring, invoked by producer only
+ *
+ * \param v view of ring
+ * \param data message
+ * \param len length of message, between 1 and TCM_SHM_MAX_MSG
+ * \return len in case of success, 0 when the ring is full, -1 when length is invalid
+ */
+int tcm_shm_push( t_tcm_shm_view* v, const void* data, int len );
+
+
+/*!
+ * remove message from ring, invoked by consumer only
+ *
+ * \param v view of ring
+ * \param buf buffer where message is copied to
+ * \param size size of buffer, messages exceeding it are truncated
+ * \return length of message copied, 0 when the ring is empty or has been corrupted by the peer
+ */
+int tcm_shm_pop( t_tcm_shm_view* v, void* buf, int size );
+
+
+/*!
+ * drop all messages in ring, invoked by consumer only
+ *
+ * \param v view of ring
+ */
+void tcm_shm_discard( t_tcm_shm_view* v );
+
+
+/*!
+ * wait until ring holds a message, invoked by consumer only
+ *
+ * \param v view of ring
+ * \param timeout_ms maximum time to wait, negative to wait forever
+ * \return 1 when data is available, 0 on timeout, interruption or wakeup by tcm_shm_wakeup()
+ */
+int tcm_shm_wait_data( t_tcm_shm_view* v, int timeout_ms );
+
+
+/*!
+ * wait until ring has space for message of given length, invoked by producer only
+ *
+ * \param v view of ring
+ * \param len length of message
+ * \param timeout_ms maximum time to wait, negative to wait forever
+ * \return 1 when space is available, 0 on timeout or interruption
+ */
+int tcm_shm_wait_space( t_tcm_shm_view* v, int len, int timeout_ms );
+
+
+/*!
+ * wake up consumer waiting in tcm_shm_wait_data() e.g. for termination
+ *
+ * \param v view of ring
+ */
+void tcm_shm_wakeup( t_tcm_shm_view* v );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_SHM_RING_H */
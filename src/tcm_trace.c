@@ -0,0 +1,236 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <tcm_trace.h>
+#include <tcm_boot.h>
+#include <tcm_config.h>
+
+
+const char* g_tcm_trace_stage_names[t_tcm_trace_nr_stages] = {
+  "post", "queue", "lock", "eval", "write", "total"
+};
+
+/*! return of last read() of the reader thread */
+static __thread uint64_t tls_t_read;
+
+/*! trace of the callback evaluated by the dispatcher thread */
+static __thread t_tcm_trace* tls_trace;
+
+/*! stage histograms, updated with atomic operations */
+static t_tcm_trace_hist hists[t_tcm_trace_nr_stages];
+
+/*! ring of slow traces */
+static struct {
+  pthread_mutex_t               mutex;                  /*!< access protection */
+  t_tcm_trace_slow              ring[TCM_TRACE_NR_SLOW];/*!< slow traces */
+  long                          nr_slow;                /*!< number of recorded slow traces */
+} slow = { PTHREAD_MUTEX_INITIALIZER };
+
+
+uint64_t tcm_trace_now( void )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+void tcm_trace_read_done( void )
+{
+  tls_t_read = tcm_trace_now();
+}
+
+
+void tcm_trace_queued( t_tcm_trace_stamp* p_stamps, long seq )
+{
+  t_tcm_trace_stamp* s = & p_stamps[seq & ( TCM_TRACE_STAMPS - 1 )];
+
+  __atomic_store_n( & s->seq, 0, __ATOMIC_RELAXED );
+  __atomic_thread_fence( __ATOMIC_RELEASE );
+  s->t_queued = tcm_trace_now();
+  s->t_read = tls_t_read;
+  tls_t_read = 0;
+  __atomic_store_n( & s->seq, seq + 1, __ATOMIC_RELEASE );
+}
+
+
+void tcm_trace_begin( t_tcm_trace* p_trace, const void* channel, t_tcm_trace_stamp* p_stamps, long seq )
+{
+  t_tcm_trace_stamp* s = & p_stamps[seq & ( TCM_TRACE_STAMPS - 1 )];
+
+  memset( p_trace, 0, sizeof( t_tcm_trace ) );
+  p_trace->channel = channel;
+  p_trace->t_dispatched = tcm_trace_now();
+
+  /* stamps are unknown when overwritten by later events or not posted by tcm */
+  if( __atomic_load_n( & s->seq, __ATOMIC_ACQUIRE ) == seq + 1 ) {
+    p_trace->t_read = s->t_read;
+    p_trace->t_queued = s->t_queued;
+  }
+
+  tls_trace = p_trace;
+}
+
+
+void tcm_trace_locked( t_tcm_trace* p_trace )
+{
+  p_trace->t_locked = tcm_trace_now();
+}
+
+
+void tcm_trace_write_begin( void )
+{
+  if( tls_trace )
+    tls_trace->t_write_start = tcm_trace_now();
+}
+
+
+void tcm_trace_write_end( void )
+{
+  if( tls_trace && tls_trace->t_write_start ) {
+    tls_trace->write_ns += tcm_trace_now() - tls_trace->t_write_start;
+    tls_trace->t_write_start = 0;
+    ++tls_trace->nr_writes;
+  }
+}
+
+
+static void add_sample( t_tcm_trace_stage stage, uint64_t us )
+{
+  t_tcm_trace_hist* h = & hists[stage];
+  uint64_t max;
+  int bucket = 0;
+
+  while( bucket < TCM_TRACE_NR_BUCKETS - 1 && us >= ( 1ULL << bucket ) )
+    ++bucket;
+
+  __atomic_add_fetch( & h->buckets[bucket], 1, __ATOMIC_RELAXED );
+  __atomic_add_fetch( & h->count, 1, __ATOMIC_RELAXED );
+  __atomic_add_fetch( & h->sum_us, us, __ATOMIC_RELAXED );
+
+  max = __atomic_load_n( & h->max_us, __ATOMIC_RELAXED );
+  while( us > max && ! __atomic_compare_exchange_n( & h->max_us, & max, us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+    ;
+}
+
+
+void tcm_trace_end( t_tcm_trace* p_trace, const char* data, int len )
+{
+  uint64_t t_end = tcm_trace_now();
+  uint64_t stage_us[t_tcm_trace_nr_stages];
+  uint64_t t_start, eval_ns;
+  t_tcm_trace_slow* s;
+  int i, n, known[t_tcm_trace_nr_stages];
+
+  tls_trace = NULL;
+
+  memset( known, 0, sizeof( known ) );
+  if( p_trace->t_read && p_trace->t_queued ) {
+    stage_us[t_tcm_trace_post] = ( p_trace->t_queued - p_trace->t_read ) / 1000;
+    known[t_tcm_trace_post] = 1;
+  }
+  if( p_trace->t_queued ) {
+    stage_us[t_tcm_trace_queue] = ( p_trace->t_dispatched - p_trace->t_queued ) / 1000;
+    known[t_tcm_trace_queue] = 1;
+  }
+  if( p_trace->t_locked ) {
+    eval_ns = t_end - p_trace->t_locked;
+    eval_ns = ( eval_ns > p_trace->write_ns ) ? eval_ns - p_trace->write_ns : 0;
+    stage_us[t_tcm_trace_lock] = ( p_trace->t_locked - p_trace->t_dispatched ) / 1000;
+    stage_us[t_tcm_trace_eval] = eval_ns / 1000;
+    known[t_tcm_trace_lock] = known[t_tcm_trace_eval] = 1;
+  }
+  if( p_trace->nr_writes ) {
+    stage_us[t_tcm_trace_write] = p_trace->write_ns / 1000;
+    known[t_tcm_trace_write] = 1;
+  }
+
+  /* total latency refers to the earliest known stamp */
+  t_start = p_trace->t_read ? p_trace->t_read : p_trace->t_queued ? p_trace->t_queued : p_trace->t_dispatched;
+  stage_us[t_tcm_trace_total] = ( t_end - t_start ) / 1000;
+  known[t_tcm_trace_total] = 1;
+
+  for( i = 0; i < t_tcm_trace_nr_stages; ++i )
+    if( known[i] )
+      add_sample( i, stage_us[i] );
+
+  if( g_tcm_trace_slow_us <= 0 || stage_us[t_tcm_trace_total] < g_tcm_trace_slow_us )
+    return;
+
+  pthread_mutex_lock( & slow.mutex );
+  s = & slow.ring[slow.nr_slow++ % TCM_TRACE_NR_SLOW];
+  s->channel = (uint64_t)(unsigned long)p_trace->channel;
+  s->end_ms = tcm_boot_elapsed_ms();
+  for( i = 0; i < t_tcm_trace_nr_stages; ++i )
+    s->stage_us[i] = known[i] ? stage_us[i] : 0;
+  s->nr_writes = p_trace->nr_writes;
+  n = ( len < TCM_TRACE_PREFIX_LEN - 1 ) ? len : TCM_TRACE_PREFIX_LEN - 1;
+  if( data && n > 0 )
+    memcpy( s->prefix, data, n );
+  else
+    n = 0;
+  s->prefix[n] = '\0';
+  pthread_mutex_unlock( & slow.mutex );
+}
+
+
+void tcm_trace_histograms( t_tcm_trace_hist* p_hists, int reset )
+{
+  int i, j;
+
+  for( i = 0; i < t_tcm_trace_nr_stages; ++i ) {
+    p_hists[i].count = __atomic_load_n( & hists[i].count, __ATOMIC_RELAXED );
+    p_hists[i].sum_us = __atomic_load_n( & hists[i].sum_us, __ATOMIC_RELAXED );
+    p_hists[i].max_us = __atomic_load_n( & hists[i].max_us, __ATOMIC_RELAXED );
+    for( j = 0; j < TCM_TRACE_NR_BUCKETS; ++j )
+      p_hists[i].buckets[j] = __atomic_load_n( & hists[i].buckets[j], __ATOMIC_RELAXED );
+  }
+
+  /* samples added concurrently to a reset may be lost */
+  if( reset )
+    memset( hists, 0, sizeof( hists ) );
+}
+
+
+int tcm_trace_slow( t_tcm_trace_slow* p_slow, int max )
+{
+  long first;
+  int n = 0;
+
+  pthread_mutex_lock( & slow.mutex );
+  first = ( slow.nr_slow > TCM_TRACE_NR_SLOW ) ? slow.nr_slow - TCM_TRACE_NR_SLOW : 0;
+  for( ; first < slow.nr_slow && n < max; ++first )
+    p_slow[n++] = slow.ring[first % TCM_TRACE_NR_SLOW];
+  pthread_mutex_unlock( & slow.mutex );
+
+  return n;
+}
@@ -0,0 +1,226 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_TRACE_H
+#define TCM_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_trace.h
+    \brief per-message latency tracing across pipeline stages
+
+    Each received message is stamped with the monotonic clock when read() has
+    returned, when it has been queued, when its callback has been dispatched,
+    when the interpreter mutex has been taken and when the callback has
+    returned. Writes to channels issued by the callback are attributed to the
+    message. The durations of the stages
+
+    \verbatim
+    post   read() returned  -> event queued
+    queue  event queued     -> callback dispatched
+    lock   dispatched       -> interpreter mutex taken
+    eval   mutex taken      -> callback returned, without writes
+    write  sum of all write() calls issued by the callback
+    total  read() returned  -> callback returned
+    \endverbatim
+
+    are collected in histograms with power of two buckets. Messages whose total
+    latency exceeds the configured threshold are kept in a ring of slow traces.
+
+    \addtogroup utils
+    @{
+ */
+
+#define TCM_TRACE_STAMPS           64                   /*!< stamped events per channel, power of two */
+#define TCM_TRACE_NR_BUCKETS       24                   /*!< histogram buckets, upper bounds 1us .. 8s */
+#define TCM_TRACE_NR_SLOW          32                   /*!< number of kept slow traces */
+#define TCM_TRACE_PREFIX_LEN       32                   /*!< recorded payload bytes of slow traces */
+
+
+/*!
+ * pipeline stages
+ */
+typedef enum {
+  t_tcm_trace_post,                                     /*!< read() returned until queued */
+  t_tcm_trace_queue,                                    /*!< queued until dispatched */
+  t_tcm_trace_lock,                                     /*!< dispatched until interpreter mutex is taken */
+  t_tcm_trace_eval,                                     /*!< callback evaluation without writes */
+  t_tcm_trace_write,                                    /*!< writes issued by callback */
+  t_tcm_trace_total,                                    /*!< read() returned until callback returned */
+  t_tcm_trace_nr_stages                                 /*!< number of stages */
+} t_tcm_trace_stage;
+
+
+/*!
+ * time stamps of a queued event, stored within the channel
+ */
+typedef struct s_tcm_trace_stamp {
+  long                          seq;                    /*!< sequence number of the event + 1 */
+  uint64_t                      t_read;                 /*!< read() returned or 0 when unknown */
+  uint64_t                      t_queued;               /*!< event queued */
+} t_tcm_trace_stamp;
+
+
+/*!
+ * trace of one message while its callback is evaluated
+ */
+typedef struct s_tcm_trace {
+  const void*                   channel;                /*!< channel object */
+  uint64_t                      t_read;                 /*!< read() returned or 0 when unknown */
+  uint64_t                      t_queued;               /*!< event queued or 0 when unknown */
+  uint64_t                      t_dispatched;           /*!< callback dispatched */
+  uint64_t                      t_locked;               /*!< interpreter mutex taken */
+  uint64_t                      t_write_start;          /*!< start of current write */
+  uint64_t                      write_ns;               /*!< accumulated write time */
+  int                           nr_writes;              /*!< number of writes */
+} t_tcm_trace;
+
+
+/*!
+ * histogram of one stage
+ */
+typedef struct s_tcm_trace_hist {
+  uint64_t                      count;                  /*!< number of samples */
+  uint64_t                      sum_us;                 /*!< accumulated duration */
+  uint64_t                      max_us;                 /*!< longest duration */
+  uint64_t                      buckets[TCM_TRACE_NR_BUCKETS]; /*!< bucket i counts durations below 2^i us */
+} t_tcm_trace_hist;
+
+
+/*!
+ * slow message trace
+ */
+typedef struct s_tcm_trace_slow {
+  uint64_t                      channel;                /*!< channel identifier as used in scheme */
+  double                        end_ms;                 /*!< end of callback since daemon start */
+  uint32_t                      stage_us[t_tcm_trace_nr_stages]; /*!< stage durations */
+  int                           nr_writes;              /*!< number of writes */
+  char                          prefix[TCM_TRACE_PREFIX_LEN]; /*!< first bytes of payload */
+} t_tcm_trace_slow;
+
+
+/*!
+ * stage names as used for export
+ */
+extern const char* g_tcm_trace_stage_names[t_tcm_trace_nr_stages];
+
+
+/*!
+ * monotonic time in nanoseconds
+ *
+ * \return current time
+ */
+uint64_t tcm_trace_now( void );
+
+
+/*!
+ * mark return of read() within reader thread, consumed by next queued event
+ */
+void tcm_trace_read_done( void );
+
+
+/*!
+ * stamp event when queued, invoked within reader thread
+ *
+ * \param p_stamps stamp array of the channel
+ * \param seq sequence number of the event
+ */
+void tcm_trace_queued( t_tcm_trace_stamp* p_stamps, long seq );
+
+
+/*!
+ * begin trace when callback is dispatched and make it the current trace of the thread
+ *
+ * \param p_trace trace object
+ * \param channel channel object
+ * \param p_stamps stamp array of the channel
+ * \param seq sequence number of the event
+ */
+void tcm_trace_begin( t_tcm_trace* p_trace, const void* channel, t_tcm_trace_stamp* p_stamps, long seq );
+
+
+/*!
+ * mark interpreter mutex as taken
+ *
+ * \param p_trace trace object
+ */
+void tcm_trace_locked( t_tcm_trace* p_trace );
+
+
+/*!
+ * mark start of a write issued by the current trace of the thread, if any
+ */
+void tcm_trace_write_begin( void );
+
+
+/*!
+ * mark end of a write issued by the current trace of the thread, if any
+ */
+void tcm_trace_write_end( void );
+
+
+/*!
+ * end trace when callback has returned, update histograms and slow traces
+ *
+ * \param p_trace trace object
+ * \param data payload
+ * \param len payload length
+ */
+void tcm_trace_end( t_tcm_trace* p_trace, const char* data, int len );
+
+
+/*!
+ * retrieve stage histograms
+ *
+ * \param p_hists array of t_tcm_trace_nr_stages elements
+ * \param reset when 1 the histograms are cleared afterwards
+ */
+void tcm_trace_histograms( t_tcm_trace_hist* p_hists, int reset );
+
+
+/*!
+ * retrieve slow traces, oldest first
+ *
+ * \param p_slow array where traces are written to
+ * \param max maximum number of array elements
+ * \return number of traces written
+ */
+int tcm_trace_slow( t_tcm_trace_slow* p_slow, int max );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_TRACE_H */
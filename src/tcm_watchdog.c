@@ -0,0 +1,332 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include <olcutils/alloc.h>
+#include <tcm_watchdog.h>
+#include <tcm_log.h>
+
+extern char** environ;
+
+
+static double elapsed_ms( const struct timespec* p_t0 )
+{
+  struct timespec now;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+  return ( now.tv_sec - p_t0->tv_sec ) * 1e3 + ( now.tv_nsec - p_t0->tv_nsec ) * 1e-6;
+}
+
+
+static void* watchdog_handler( void* p_ctx )
+{
+  t_tcm_watchdog* p = (t_tcm_watchdog *)p_ctx;
+  char owner[TCM_WATCHDOG_MAX_NAME_LEN];
+  char handler[TCM_WATCHDOG_MAX_NAME_LEN];
+  struct timespec wakeup;
+  int period_ms, overrun;
+  double held_ms = 0.0;
+  pid_t child = 0;
+
+  /* check four times per budget but not more often than every 10ms */
+  period_ms = p->budget_ms / 4;
+  if( period_ms < 10 )
+    period_ms = 10;
+  if( period_ms > 1000 )
+    period_ms = 1000;
+
+  pthread_mutex_lock( & p->mutex );
+  clock_gettime( CLOCK_MONOTONIC, & wakeup );
+  while( ! p->terminate )
+  {
+    wakeup.tv_nsec += period_ms * 1000000L;
+    wakeup.tv_sec += wakeup.tv_nsec / 1000000000L;
+    wakeup.tv_nsec %= 1000000000L;
+    pthread_cond_timedwait( & p->cond, & p->mutex, & wakeup );
+    if( p->terminate )
+      break;
+
+    overrun = 0;
+    if( p->held && p->reported != p->generation ) {
+      held_ms = elapsed_ms( & p->t_enter );
+      if( held_ms > p->budget_ms ) {
+        overrun = 1;
+        p->reported = p->generation;
+        strcpy( owner, p->owner );
+        strcpy( handler, p->handler );
+        if( p->abort ) {
+          p->aborting = 1;
+          child = p->child;
+          if( child )
+            kill( child, SIGKILL );
+        }
+      }
+    }
+
+    if( overrun ) {
+      /* do not log while blocking the holder */
+      pthread_mutex_unlock( & p->mutex );
+      tcm_error( "%s: channel %s handler %s holds interpreter for %.0f ms, budget of %d ms exceeded!\n",
+                 __func__, owner, handler, held_ms, p->budget_ms );
+      if( p->abort ) {
+        if( child )
+          tcm_error( "%s: killed hung command with pid %d\n", __func__, (int)child );
+        else
+          tcm_error( "%s: evaluation can't be interrupted, abort at next system or sleep call\n", __func__ );
+      }
+      pthread_mutex_lock( & p->mutex );
+    }
+  }
+  pthread_mutex_unlock( & p->mutex );
+
+  return p;
+}
+
+
+t_tcm_watchdog* tcm_watchdog_init( int budget_ms, int abort )
+{
+  t_tcm_watchdog* p;
+  pthread_condattr_t attr;
+
+  p = cul_malloc( sizeof( t_tcm_watchdog ) );
+  if( p == NULL ) {
+    tcm_error( "%s: out of memory error!\n", __func__ );
+    return NULL;
+  }
+
+  memset( p, 0, sizeof( t_tcm_watchdog ) );
+  p->budget_ms = budget_ms;
+  p->abort = abort;
+
+  pthread_mutex_init( & p->mutex, NULL );
+  pthread_condattr_init( & attr );
+  pthread_condattr_setclock( & attr, CLOCK_MONOTONIC );
+  pthread_cond_init( & p->cond, & attr );
+  pthread_condattr_destroy( & attr );
+
+  if( budget_ms > 0 ) {
+    if( pthread_create( & p->thread, NULL, watchdog_handler, p ) ) {
+      tcm_error( "%s: could not create watchdog thread error!\n", __func__ );
+    } else {
+      p->running = 1;
+      tcm_message( "%s: interpreter budget is %d ms\n", __func__, budget_ms );
+    }
+  }
+
+  return p;
+}
+
+
+void tcm_watchdog_release( t_tcm_watchdog* p )
+{
+  if( p == NULL )
+    return;
+
+  if( p->running ) {
+    pthread_mutex_lock( & p->mutex );
+    p->terminate = 1;
+    pthread_cond_signal( & p->cond );
+    pthread_mutex_unlock( & p->mutex );
+    pthread_join( p->thread, NULL );
+  }
+
+  pthread_cond_destroy( & p->cond );
+  pthread_mutex_destroy( & p->mutex );
+  cul_free( p );
+}
+
+
+void tcm_watchdog_enter( t_tcm_watchdog* p, const char* owner, const char* handler )
+{
+  struct timespec now;
+
+  if( p == NULL )
+    return;
+
+  clock_gettime( CLOCK_MONOTONIC, & now );
+
+  pthread_mutex_lock( & p->mutex );
+  p->t_enter = now;
+  strncpy( p->owner, owner, sizeof( p->owner ) - 1 );
+  p->owner[sizeof( p->owner ) - 1] = '\0';
+  strncpy( p->handler, handler, sizeof( p->handler ) - 1 );
+  p->handler[sizeof( p->handler ) - 1] = '\0';
+  p->aborting = 0;
+  p->child = 0;
+  ++p->generation;
+  p->held = 1;
+  pthread_mutex_unlock( & p->mutex );
+}
+
+
+/* caller holds the mutex */
+static t_tcm_watchdog_stats* find_stats( t_tcm_watchdog* p )
+{
+  t_tcm_watchdog_stats* s;
+  int i, min = 0;
+
+  for( i = 0; i < p->nr_stats; ++i ) {
+    s = & p->stats[i];
+    if( ! strcmp( s->owner, p->owner ) && ! strcmp( s->handler, p->handler ) )
+      return s;
+    if( s->max_ms < p->stats[min].max_ms )
+      min = i;
+  }
+
+  /* when the table is full the entry with the shortest hold time is replaced */
+  if( p->nr_stats < TCM_WATCHDOG_MAX_HOLDERS )
+    s = & p->stats[p->nr_stats++];
+  else
+    s = & p->stats[min];
+
+  memset( s, 0, sizeof( t_tcm_watchdog_stats ) );
+  strcpy( s->owner, p->owner );
+  strcpy( s->handler, p->handler );
+
+  return s;
+}
+
+
+void tcm_watchdog_leave( t_tcm_watchdog* p )
+{
+  t_tcm_watchdog_stats* s;
+  double held_ms;
+  int overrun;
+
+  if( p == NULL )
+    return;
+
+  held_ms = elapsed_ms( & p->t_enter );
+
+  pthread_mutex_lock( & p->mutex );
+  s = find_stats( p );
+  ++s->count;
+  s->total_ms += held_ms;
+  if( held_ms > s->max_ms )
+    s->max_ms = held_ms;
+  overrun = ( p->budget_ms > 0 && held_ms > p->budget_ms );
+  if( overrun )
+    ++s->nr_overruns;
+  p->held = 0;
+  p->aborting = 0;
+  pthread_mutex_unlock( & p->mutex );
+
+  if( overrun )
+    tcm_message( "%s: channel %s handler %s released interpreter after %.0f ms\n",
+                 __func__, p->owner, p->handler, held_ms );
+}
+
+
+int tcm_watchdog_aborting( t_tcm_watchdog* p )
+{
+  int aborting;
+
+  if( p == NULL )
+    return 0;
+
+  pthread_mutex_lock( & p->mutex );
+  aborting = p->aborting;
+  pthread_mutex_unlock( & p->mutex );
+
+  return aborting;
+}
+
+
+int tcm_watchdog_system( t_tcm_watchdog* p, const char* command )
+{
+  char* argv[] = { "sh", "-c", (char *)command, NULL };
+  pid_t pid;
+  int status;
+
+  if( tcm_watchdog_aborting( p ) ) {
+    tcm_error( "%s: evaluation aborted, command %s not executed\n", __func__, command );
+    return -1;
+  }
+
+  /* unlike fork posix_spawn does not copy locked memory */
+  if( posix_spawn( & pid, "/bin/sh", NULL, NULL, argv, environ ) ) {
+    tcm_error( "%s: could not execute %s error!\n", __func__, command );
+    return -1;
+  }
+
+  if( p ) {
+    pthread_mutex_lock( & p->mutex );
+    p->child = pid;
+    if( p->aborting )
+      kill( pid, SIGKILL );
+    pthread_mutex_unlock( & p->mutex );
+  }
+
+  while( waitpid( pid, & status, 0 ) < 0 ) {
+    if( errno != EINTR ) {
+      status = -1;
+      break;
+    }
+  }
+
+  if( p ) {
+    pthread_mutex_lock( & p->mutex );
+    p->child = 0;
+    pthread_mutex_unlock( & p->mutex );
+  }
+
+  return status;
+}
+
+
+static int compare_stats( const void* a, const void* b )
+{
+  const t_tcm_watchdog_stats* s1 = (const t_tcm_watchdog_stats *)a;
+  const t_tcm_watchdog_stats* s2 = (const t_tcm_watchdog_stats *)b;
+
+  return ( s1->max_ms < s2->max_ms ) - ( s1->max_ms > s2->max_ms );
+}
+
+
+int tcm_watchdog_stats( t_tcm_watchdog* p, t_tcm_watchdog_stats* p_stats, int max, int reset )
+{
+  int n;
+
+  if( p == NULL )
+    return 0;
+
+  pthread_mutex_lock( & p->mutex );
+  qsort( p->stats, p->nr_stats, sizeof( t_tcm_watchdog_stats ), compare_stats );
+  n = ( p->nr_stats < max ) ? p->nr_stats : max;
+  memcpy( p_stats, p->stats, n * sizeof( t_tcm_watchdog_stats ) );
+  if( reset )
+    p->nr_stats = 0;
+  pthread_mutex_unlock( & p->mutex );
+
+  return n;
+}
@@ -0,0 +1,180 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCM_WATCHDOG_H
+#define TCM_WATCHDOG_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*!
+    \file tcm_watchdog.h
+    \brief execution budget watchdog of the scheme interpreter
+
+    Channel callbacks, REPL requests and RPC calls are evaluated with the
+    interpreter's mutex held. The holder of the mutex is registered together
+    with the time it was taken. A background thread logs the channel and the
+    handler whenever the mutex is held longer than the configured budget.
+
+    TinyScheme provides no hook to interrupt a running evaluation. When abort
+    is enabled, the command started by the holder via (system ...) is killed
+    and (sleep ...) as well as further (system ...) calls return immediately
+    until the holder releases the mutex.
+
+    For each pair of channel and handler the number of evaluations, the
+    longest and the accumulated hold time are recorded.
+
+    \addtogroup scheme
+    @{
+ */
+
+#define TCM_WATCHDOG_MAX_HOLDERS   32                   /*!< maximum number of recorded holders */
+#define TCM_WATCHDOG_MAX_NAME_LEN  64                   /*!< maximum length of channel and handler name */
+
+
+/*!
+ * hold time statistics of one channel and handler
+ */
+typedef struct s_tcm_watchdog_stats {
+  char                          owner[TCM_WATCHDOG_MAX_NAME_LEN];   /*!< channel or service name */
+  char                          handler[TCM_WATCHDOG_MAX_NAME_LEN]; /*!< handler name */
+  long                          count;                  /*!< number of evaluations */
+  long                          nr_overruns;            /*!< number of evaluations exceeding the budget */
+  double                        max_ms;                 /*!< longest hold time */
+  double                        total_ms;               /*!< accumulated hold time */
+} t_tcm_watchdog_stats;
+
+
+/*!
+ * watchdog state
+ */
+typedef struct s_tcm_watchdog {
+  pthread_mutex_t               mutex;                  /*!< protects the following data */
+  pthread_cond_t                cond;                   /*!< wakes up the watchdog thread on termination */
+  pthread_t                     thread;                 /*!< watchdog thread */
+  int                           running;                /*!< watchdog thread has been started */
+  int                           terminate;              /*!< set to 1 to stop the watchdog thread */
+
+  int                           budget_ms;              /*!< maximum hold time, 0 disables the thread */
+  int                           abort;                  /*!< kill hung system commands when set to 1 */
+
+  int                           held;                   /*!< interpreter mutex is currently held */
+  long                          generation;             /*!< incremented for each evaluation */
+  long                          reported;               /*!< generation of last reported overrun */
+  struct timespec               t_enter;                /*!< time the mutex was taken */
+  char                          owner[TCM_WATCHDOG_MAX_NAME_LEN];   /*!< current holder's channel */
+  char                          handler[TCM_WATCHDOG_MAX_NAME_LEN]; /*!< current holder's handler */
+  pid_t                         child;                  /*!< pid of running system command or 0 */
+  int                           aborting;               /*!< current evaluation is to be aborted */
+
+  t_tcm_watchdog_stats          stats[TCM_WATCHDOG_MAX_HOLDERS]; /*!< hold time statistics */
+  int                           nr_stats;               /*!< number of used stats entries */
+} t_tcm_watchdog;
+
+
+/*!
+ * create watchdog
+ *
+ * \param budget_ms maximum hold time in milliseconds, 0 records statistics only
+ * \param abort when 1 hung system commands of the holder are killed
+ * \return pointer to watchdog object or NULL in case of error
+ */
+t_tcm_watchdog* tcm_watchdog_init( int budget_ms, int abort );
+
+
+/*!
+ * stop watchdog thread and release watchdog
+ *
+ * \param p pointer to watchdog object
+ */
+void tcm_watchdog_release( t_tcm_watchdog* p );
+
+
+/*!
+ * register new holder, to be invoked right after the interpreter mutex is taken
+ *
+ * \param p pointer to watchdog object
+ * \param owner channel or service name
+ * \param handler handler name
+ */
+void tcm_watchdog_enter( t_tcm_watchdog* p, const char* owner, const char* handler );
+
+
+/*!
+ * unregister holder, to be invoked right before the interpreter mutex is released
+ *
+ * \param p pointer to watchdog object
+ */
+void tcm_watchdog_leave( t_tcm_watchdog* p );
+
+
+/*!
+ * check whether the current evaluation is to be aborted
+ *
+ * \param p pointer to watchdog object
+ * \return 1 when the budget is exceeded and abort is enabled, otherwise 0
+ */
+int tcm_watchdog_aborting( t_tcm_watchdog* p );
+
+
+/*!
+ * execute shell command on behalf of the current holder
+ *
+ * Same as system() but the command is killed when the budget of the holder is
+ * exceeded and abort is enabled.
+ *
+ * \param p pointer to watchdog object
+ * \param command shell command
+ * \return wait status of the command or -1 in case of error
+ */
+int tcm_watchdog_system( t_tcm_watchdog* p, const char* command );
+
+
+/*!
+ * retrieve hold time statistics, sorted by longest hold time
+ *
+ * \param p pointer to watchdog object
+ * \param p_stats array where statistics are written to
+ * \param max maximum number of array elements
+ * \param reset when 1 the statistics are cleared afterwards
+ * \return number of entries written
+ */
+int tcm_watchdog_stats( t_tcm_watchdog* p, t_tcm_watchdog_stats* p_stats, int max, int reset );
+
+
+/*! @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* #ifndef TCM_WATCHDOG_H */
@@ -0,0 +1,112 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Unit test of the response capture of the AT command cache
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tcm_atcache.h>
+
+
+static int nr_failures = 0;
+
+#define CHECK( cond ) \
+  do { if( !( cond ) ) { fprintf( stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond ); ++nr_failures; } } while( 0 )
+
+
+static void feed( const char* s )
+{
+  tcm_atcache_feed( s, strlen( s ) );
+}
+
+
+static int lookup( const char* request, char* buf, int size )
+{
+  return tcm_atcache_lookup( request, strlen( request ), buf, size );
+}
+
+
+/* unsolicited messages in between are not replayed */
+static void test_urc_skipped( void )
+{
+  static const char expected[] = "AT+CSQ\r\r\n+CSQ: 20,99\r\n\r\nOK\r\n";
+  char buf[TCM_ATCACHE_MAX_RESPONSE];
+
+  CHECK( tcm_atcache_set_rule( "AT+CSQ", 0 ) == 0 );
+  CHECK( lookup( "at+csq\r", buf, sizeof( buf ) ) < 0 );
+
+  feed( "AT+CSQ\r\r\n+CS" );
+  feed( "Q: 20,99\r\n\r\n+CREG: 1,\"00C3\",\"1234\"\r\n" );
+  feed( "\r\nRING\r\n" );
+  feed( "\r\nOK\r\n" );
+
+  CHECK( lookup( "AT+CSQ\r", buf, sizeof( buf ) ) == strlen( expected ) );
+  CHECK( ! strcmp( buf, expected ) );
+}
+
+
+/* information text without prefix is part of the response */
+static void test_unprefixed( void )
+{
+  static const char expected[] = "\r\n356938035643809\r\n\r\nOK\r\n";
+  char buf[TCM_ATCACHE_MAX_RESPONSE];
+
+  CHECK( tcm_atcache_set_rule( "AT+CGSN", 0 ) == 0 );
+  CHECK( lookup( "AT+CGSN\r", buf, sizeof( buf ) ) < 0 );
+
+  feed( "\r\n356938035643809\r\n\r\n+CGREG: 0\r\n\r\nOK\r\n" );
+
+  CHECK( lookup( "AT+CGSN\r", buf, sizeof( buf ) ) == strlen( expected ) );
+  CHECK( ! strcmp( buf, expected ) );
+}
+
+
+/* error responses are not stored */
+static void test_error( void )
+{
+  char buf[TCM_ATCACHE_MAX_RESPONSE];
+
+  CHECK( tcm_atcache_set_rule( "AT+COPS?", 0 ) == 0 );
+  CHECK( lookup( "AT+COPS?\r", buf, sizeof( buf ) ) < 0 );
+  feed( "\r\n+CME ERROR: 10\r\n" );
+  CHECK( lookup( "AT+COPS?\r", buf, sizeof( buf ) ) < 0 );
+}
+
+
+int main( int argc, char* argv[] )
+{
+  test_urc_skipped();
+  test_unprefixed();
+  test_error();
+
+  if( nr_failures )
+    fprintf( stderr, "%d checks failed\n", nr_failures );
+
+  return( nr_failures ? EXIT_FAILURE : EXIT_SUCCESS );
+}
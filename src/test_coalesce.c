@@ -0,0 +1,112 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Unit test of the coalescing of unsolicited result codes
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tcm_coalesce.h>
+
+
+static int nr_failures = 0;
+
+#define CHECK( cond ) \
+  do { if( !( cond ) ) { fprintf( stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond ); ++nr_failures; } } while( 0 )
+
+
+static char out[TCM_COALESCE_OUT_SIZE( 256 ) + 1];
+
+static const char* filter( t_tcm_coalesce* p, const char* data )
+{
+  int len = tcm_coalesce_filter( p, data, strlen( data ), out, sizeof( out ) - 1 );
+
+  out[len] = '\0';
+  return out;
+}
+
+
+/* URCs within the window are suppressed */
+static void test_urc( void )
+{
+  t_tcm_coalesce* p = tcm_coalesce_create( NULL );
+
+  CHECK( tcm_coalesce_set_rule( p, "+CSQ:", t_tcm_coalesce_latest, 1000, 0 ) == 0 );
+  CHECK( ! strcmp( filter( p, "\r\n+CSQ: 20,99\r\n" ), "\r\n+CSQ: 20,99\r\n" ) );
+  CHECK( ! strcmp( filter( p, "\r\n+CSQ: 21,99\r\n" ), "" ) );
+  CHECK( ! strcmp( filter( p, "\r\nRING\r\n" ), "\r\nRING\r\n" ) );
+
+  tcm_coalesce_release( p );
+}
+
+
+/* responses to commands sent through the channel are passed */
+static void test_command( void )
+{
+  static const char response[] = "\r\n+CSQ: 21,99\r\n\r\nOK\r\n";
+  t_tcm_coalesce* p = tcm_coalesce_create( NULL );
+
+  CHECK( tcm_coalesce_set_rule( p, "+CSQ:", t_tcm_coalesce_latest, 1000, 0 ) == 0 );
+  CHECK( ! strcmp( filter( p, "\r\n+CSQ: 20,99\r\n" ), "\r\n+CSQ: 20,99\r\n" ) );
+
+  tcm_coalesce_command( p );
+  CHECK( ! strcmp( filter( p, response ), response ) );
+
+  /* coalescing resumes after the final result code */
+  CHECK( ! strcmp( filter( p, "\r\n+CSQ: 22,99\r\n" ), "" ) );
+
+  tcm_coalesce_release( p );
+}
+
+
+/* responses are recognized by the command echo as well, even when split */
+static void test_echo( void )
+{
+  t_tcm_coalesce* p = tcm_coalesce_create( NULL );
+
+  CHECK( tcm_coalesce_set_rule( p, "+CREG:", t_tcm_coalesce_latest, 500, 0 ) == 0 );
+  CHECK( ! strcmp( filter( p, "\r\n+CREG: 1\r\n" ), "\r\n+CREG: 1\r\n" ) );
+  CHECK( ! strcmp( filter( p, "AT+CR" ), "" ) );
+  CHECK( ! strcmp( filter( p, "EG?\r\r\n+CREG: 0,1\r\n\r\nOK\r\n" ), "AT+CREG?\r\r\n+CREG: 0,1\r\n\r\nOK\r\n" ) );
+  CHECK( ! strcmp( filter( p, "\r\n+CREG: 5\r\n" ), "" ) );
+
+  tcm_coalesce_release( p );
+}
+
+
+int main( int argc, char* argv[] )
+{
+  test_urc();
+  test_command();
+  test_echo();
+
+  if( nr_failures )
+    fprintf( stderr, "%d checks failed\n", nr_failures );
+
+  return( nr_failures ? EXIT_FAILURE : EXIT_SUCCESS );
+}
@@ -0,0 +1,171 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Unit test of the request decoder of the rpc endpoint
+
+    The decoder is static, hence the endpoint's translation unit is included
+    and the functions it uses from other modules are stubbed out.
+*/
+
+#include "tcm_rpc.c"
+
+#include <stdlib.h>
+
+
+static int nr_failures = 0;
+
+#define CHECK( cond ) \
+  do { if( !( cond ) ) { fprintf( stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond ); ++nr_failures; } } while( 0 )
+
+
+/* stubs */
+
+int g_tcm_server_sock_max_connections = 1;
+
+long base_channel_dispatched( t_base_channel* p ) { return 0; }
+t_server_sock_channel* init_server_sock_channel( t_tcm_server_ctx* p_tcm_server_ctx, const char* addr, int port,
+                                                 t_channel_cb p_read_cb ) { return NULL; }
+long server_sock_channel_evt_conn_id( const t_icom_evt* p_evt ) { return 0; }
+int server_sock_channel_conn_index( long conn_id ) { return 0; }
+int write_server_sock_channel_to( t_server_sock_channel* p, long conn_id, const void* p_arg, const int len ) { return len; }
+int close_server_sock_channel_conn( t_server_sock_channel* p, long conn_id ) { return 0; }
+void tcm_scheme_lock( t_tcm_scheme* p, const char* owner, const char* handler ) { }
+void tcm_scheme_unlock( t_tcm_scheme* p ) { }
+pointer tcm_scheme_lookup_locked( t_tcm_scheme* p, const char* name ) { return NULL; }
+int tcm_scheme_call_locked( t_tcm_scheme* p, pointer proc, pointer args, pointer* p_result ) { return -1; }
+
+
+/* count values of payload, -1 when malformed */
+static int count( const unsigned char* p, int len )
+{
+  t_rpc_reader r = { p, len, 0 };
+  int n = count_values( & r, 0 );
+
+  return( n >= 0 && r.pos == len ? n : ( n < 0 ? -1 : -2 ) );
+}
+
+static void test_valid( void )
+{
+  static const unsigned char list[] = {
+    t_tcm_rpc_list, 0, 0, 0, 3,
+    t_tcm_rpc_integer, 0, 0, 0, 0, 0, 0, 0, 42,
+    t_tcm_rpc_string, 0, 0, 0, 3, 'a', 0, 'b',
+    t_tcm_rpc_symbol, 0, 2, 'o', 'k' };
+
+  CHECK( count( list, sizeof( list ) ) == 4 );
+}
+
+static void test_truncated( void )
+{
+  static const unsigned char string[] = { t_tcm_rpc_string, 0, 0, 0, 10, 'a', 'b', 'c' };
+  static const unsigned char symbol[] = { t_tcm_rpc_symbol, 0, 4, 'a' };
+  static const unsigned char integer[] = { t_tcm_rpc_integer, 0, 0, 0 };
+  static const unsigned char real[] = { t_tcm_rpc_real };
+  static const unsigned char character[] = { t_tcm_rpc_char };
+  static const unsigned char list[] = { t_tcm_rpc_list, 0, 0, 0, 2, t_tcm_rpc_true };
+  static const unsigned char header[] = { t_tcm_rpc_string, 0, 0 };
+
+  CHECK( count( string, sizeof( string ) ) == -1 );
+  CHECK( count( symbol, sizeof( symbol ) ) == -1 );
+  CHECK( count( integer, sizeof( integer ) ) == -1 );
+  CHECK( count( real, sizeof( real ) ) == -1 );
+  CHECK( count( character, sizeof( character ) ) == -1 );
+  CHECK( count( list, sizeof( list ) ) == -1 );
+  CHECK( count( header, sizeof( header ) ) == -1 );
+}
+
+static void test_huge_length( void )
+{
+  static const unsigned char string[] = { t_tcm_rpc_string, 0xff, 0xff, 0xff, 0xf8, 'a', 'b', 'c' };
+  static const unsigned char string_wrap[] = { t_tcm_rpc_string, 0x80, 0, 0, 0, 'a' };
+  static const unsigned char symbol[] = { t_tcm_rpc_symbol, 0xff, 0xff, 'a' };
+  static const unsigned char list[] = { t_tcm_rpc_list, 0xff, 0xff, 0xff, 0xff, t_tcm_rpc_true };
+  static const unsigned char vector[] = { t_tcm_rpc_vector, 0x7f, 0xff, 0xff, 0xff, t_tcm_rpc_true };
+
+  CHECK( count( string, sizeof( string ) ) == -1 );
+  CHECK( count( string_wrap, sizeof( string_wrap ) ) == -1 );
+  CHECK( count( symbol, sizeof( symbol ) ) == -1 );
+  CHECK( count( list, sizeof( list ) ) == -1 );
+  CHECK( count( vector, sizeof( vector ) ) == -1 );
+}
+
+static void test_decode( void )
+{
+  static const unsigned char valid[] = { t_tcm_rpc_string, 0, 0, 0, 3, 'a', 0, 'b' };
+  static const unsigned char huge[] = { t_tcm_rpc_string, 0xff, 0xff, 0xff, 0xf8, 'a', 'b', 'c' };
+  static const unsigned char nested[] = { t_tcm_rpc_vector, 0, 0, 0, 1, t_tcm_rpc_symbol, 0xff, 0xff, 'a' };
+  static scheme sc;
+  static t_rpc_writer w;
+  t_rpc_reader r;
+  pointer v, x;
+  int idx;
+
+  if( ! scheme_init( & sc ) ) {
+    fprintf( stderr, "could not initialize scheme interpreter\n" );
+    ++nr_failures;
+    return;
+  }
+
+  v = mk_vector( & sc, 2 );
+  scheme_define( & sc, sc.global_env, mk_symbol( & sc, "*test-root*" ), v );
+
+  r = (t_rpc_reader){ valid, sizeof( valid ), 0 };
+  idx = 0;
+  x = decode_value( & sc, & r, v, & idx );
+  CHECK( x != NULL && is_string( x ) && ! memcmp( string_value( x ), "a\0b", 3 ) );
+  CHECK( r.pos == sizeof( valid ) );
+
+  /* strings are encoded with their full length */
+  if( x != NULL ) {
+    CHECK( encode_value( & sc, & w, x, 0 ) == 0 );
+    CHECK( w.len == sizeof( valid ) && ! memcmp( w.buf, valid, sizeof( valid ) ) );
+  }
+
+  r = (t_rpc_reader){ huge, sizeof( huge ), 0 };
+  idx = 0;
+  CHECK( decode_value( & sc, & r, v, & idx ) == NULL );
+
+  r = (t_rpc_reader){ nested, sizeof( nested ), 0 };
+  idx = 0;
+  CHECK( decode_value( & sc, & r, v, & idx ) == NULL );
+
+  scheme_deinit( & sc );
+}
+
+
+int main( int argc, char* argv[] )
+{
+  test_valid();
+  test_truncated();
+  test_huge_length();
+  test_decode();
+
+  if( nr_failures )
+    fprintf( stderr, "%d checks failed\n", nr_failures );
+
+  return( nr_failures ? EXIT_FAILURE : EXIT_SUCCESS );
+}
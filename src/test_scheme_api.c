@@ -0,0 +1,115 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Unit test of the conversion between C values and scheme objects
+
+    The translation unit of the typed interface is included and the functions
+    it uses from other modules are stubbed out.
+*/
+
+#include "tcm_scheme_api.c"
+
+#include <stdlib.h>
+
+
+static int nr_failures = 0;
+
+#define CHECK( cond ) \
+  do { if( !( cond ) ) { fprintf( stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond ); ++nr_failures; } } while( 0 )
+
+
+/* stubs */
+
+void tcm_scheme_lock( t_tcm_scheme* p, const char* owner, const char* handler ) { }
+void tcm_scheme_unlock( t_tcm_scheme* p ) { }
+int tcm_load_scheme_string( t_tcm_scheme* p, char* string, t_tcm_scheme_ret_val* p_ret ) { return -1; }
+
+
+/* convert C value to scheme and back again */
+static t_tcm_value* round_trip( t_tcm_scheme* p, const t_tcm_value* v )
+{
+  t_tcm_value* p_result = NULL;
+  pointer x = tcm_scheme_value_to_cell( p, v );
+
+  if( x == NULL || tcm_scheme_cell_to_value( p, x, & p_result ) )
+    return NULL;
+
+  return p_result;
+}
+
+
+static void test_embedded_null( t_tcm_scheme* p )
+{
+  static const char data[] = { 'a', '\0', 'b', '\0' };
+  t_tcm_value v, elems[2], *r;
+
+  v.t = t_tcm_value_bytes;
+  v.v.str.p = data;
+  v.v.str.len = sizeof( data );
+  r = round_trip( p, & v );
+  CHECK( r != NULL && r->t == t_tcm_value_bytes );
+  CHECK( r != NULL && r->v.str.len == sizeof( data ) && ! memcmp( r->v.str.p, data, sizeof( data ) ) );
+  tcm_scheme_free_value( r );
+
+  /* nested strings keep their length as well */
+  elems[0] = v;
+  elems[1].t = t_tcm_value_string;
+  elems[1].v.str.p = "ok";
+  elems[1].v.str.len = 2;
+  v.t = t_tcm_value_list;
+  v.v.seq.p = elems;
+  v.v.seq.len = 2;
+  r = round_trip( p, & v );
+  CHECK( r != NULL && r->t == t_tcm_value_list && r->v.seq.len == 2 );
+  if( r != NULL && r->v.seq.len == 2 ) {
+    CHECK( r->v.seq.p[0].t == t_tcm_value_bytes && r->v.seq.p[0].v.str.len == sizeof( data ) );
+    CHECK( ! memcmp( r->v.seq.p[0].v.str.p, data, sizeof( data ) ) );
+    CHECK( r->v.seq.p[1].t == t_tcm_value_string && ! strcmp( r->v.seq.p[1].v.str.p, "ok" ) );
+  }
+  tcm_scheme_free_value( r );
+}
+
+
+int main( int argc, char* argv[] )
+{
+  static t_tcm_scheme tcm_scheme;
+
+  if( ! scheme_init( & tcm_scheme.sc ) || tcm_scheme_init_api( & tcm_scheme ) ) {
+    fprintf( stderr, "could not initialize scheme interpreter\n" );
+    return EXIT_FAILURE;
+  }
+
+  test_embedded_null( & tcm_scheme );
+
+  tcm_scheme_release_api( & tcm_scheme );
+  scheme_deinit( & tcm_scheme.sc );
+
+  if( nr_failures )
+    fprintf( stderr, "%d checks failed\n", nr_failures );
+
+  return( nr_failures ? EXIT_FAILURE : EXIT_SUCCESS );
+}
@@ -0,0 +1,115 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Unit test of the hash tables of the scheme interpreter
+
+    The translation unit is included to access the table layout, the
+    protection stack is taken from the typed interface.
+*/
+
+#include "tcm_scheme_hash.c"
+
+#include <stdlib.h>
+
+
+static int nr_failures = 0;
+
+#define CHECK( cond ) \
+  do { if( !( cond ) ) { fprintf( stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond ); ++nr_failures; } } while( 0 )
+
+
+/* stubs */
+
+void tcm_scheme_lock( t_tcm_scheme* p, const char* owner, const char* handler ) { }
+void tcm_scheme_unlock( t_tcm_scheme* p ) { }
+int tcm_load_scheme_string( t_tcm_scheme* p, char* string, t_tcm_scheme_ret_val* p_ret ) { return -1; }
+
+
+#define NR_KEYS 20000
+
+
+/* more entries than the largest bucket vector the interpreter can allocate */
+static void test_many_keys( scheme* sc )
+{
+  pointer ht, entry;
+  long i, nr_found = 0;
+
+  ht = tcm_hash_make( sc, 0 );
+  CHECK( tcm_hash_is_table( sc, ht ) );
+  scheme_define( sc, sc->global_env, mk_symbol( sc, "*test-table*" ), ht );
+
+  for( i = 0; i < NR_KEYS; ++i )
+    tcm_hash_set( sc, ht, mk_integer( sc, i ), mk_integer( sc, 2 * i ) );
+
+  CHECK( tcm_hash_count( ht ) == NR_KEYS );
+  CHECK( vector_length( vector_elem( ht, HT_BUCKETS ) ) == TCM_HASH_MAX_BUCKETS );
+  CHECK( ! sc->no_memory );
+
+  for( i = 0; i < NR_KEYS; ++i ) {
+    entry = tcm_hash_lookup( sc, ht, mk_integer( sc, i ) );
+    if( entry != sc->NIL && ivalue( pair_cdr( entry ) ) == 2 * i )
+      ++nr_found;
+  }
+  CHECK( nr_found == NR_KEYS );
+
+  CHECK( tcm_hash_delete( sc, ht, mk_integer( sc, 4711 ) ) == 1 );
+  CHECK( tcm_hash_lookup( sc, ht, mk_integer( sc, 4711 ) ) == sc->NIL );
+  CHECK( tcm_hash_count( ht ) == NR_KEYS - 1 );
+}
+
+
+/* size hints beyond the limit are capped */
+static void test_size_hint( scheme* sc )
+{
+  pointer ht = tcm_hash_make( sc, 1L << 24 );
+
+  CHECK( tcm_hash_is_table( sc, ht ) );
+  CHECK( vector_length( vector_elem( ht, HT_BUCKETS ) ) == TCM_HASH_MAX_BUCKETS );
+  CHECK( ! sc->no_memory );
+}
+
+
+int main( int argc, char* argv[] )
+{
+  static t_tcm_scheme tcm_scheme;
+
+  if( ! scheme_init( & tcm_scheme.sc ) || tcm_scheme_init_api( & tcm_scheme ) ) {
+    fprintf( stderr, "could not initialize scheme interpreter\n" );
+    return EXIT_FAILURE;
+  }
+
+  test_many_keys( & tcm_scheme.sc );
+  test_size_hint( & tcm_scheme.sc );
+
+  tcm_scheme_release_api( & tcm_scheme );
+  scheme_deinit( & tcm_scheme.sc );
+
+  if( nr_failures )
+    fprintf( stderr, "%d checks failed\n", nr_failures );
+
+  return( nr_failures ? EXIT_FAILURE : EXIT_SUCCESS );
+}
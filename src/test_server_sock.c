@@ -0,0 +1,190 @@
+/*
+    Asynchronous Communication Channels for Tinyscheme
+
+    The original motivation for the development of this scheme extension was the
+    processing of the Hayes AT command set  as used in USB based Wireless Mobile
+    Communication Devices  (USB CDC-TCM).  Since we believe  that there  is much
+    broader  scope  of  potential  applications, the  implementation  should  be
+    considered as a general design pattern.
+
+    Copyright 2016 Otto Linnemann
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see
+    <http://www.gnu.org/licenses/>.
+*/
+
+/*
+    Unit test of connection identifiers and backpressure of the server socket channel
+
+    The channel's reader functions are static, hence its translation unit is
+    included and the event pool is replaced by a small one under test control.
+*/
+
+#include "server_sock_channel.c"
+
+#include <stdlib.h>
+
+
+static int nr_failures = 0;
+
+#define CHECK( cond ) \
+  do { if( !( cond ) ) { fprintf( stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond ); ++nr_failures; } } while( 0 )
+
+
+/* stubs */
+
+#define POOL_SIZE 2
+
+static t_icom_evt evts[POOL_SIZE];
+static char evt_data[POOL_SIZE][SERVER_SOCK_CH_MAX_DATA_SIZE];
+static t_icom_evt* pool[POOL_SIZE];
+static int nr_pool = 0;
+static t_icom_evt* posted[16];
+static int nr_posted = 0;
+
+int g_tcm_server_sock_max_connections = 1;
+int g_tcm_server_sock_max_out_queue = 4096;
+
+t_icom_evt* base_channel_alloc_evt( t_icom_events* p_events ) { abort(); }
+t_icom_evt* base_channel_try_alloc_evt( t_icom_events* p_events ) { return nr_pool ? pool[--nr_pool] : NULL; }
+int base_channel_pool_available( t_icom_events* p_events ) { return nr_pool > 0; }
+void base_channel_free_evt( t_icom_events* p_events, t_icom_evt* p_evt ) { pool[nr_pool++] = p_evt; }
+void base_channel_post_evt( t_icom_events* p_events, t_icom_evt* p_evt ) { posted[nr_posted++] = p_evt; }
+void base_channel_register( t_base_channel* p ) { }
+void base_channel_unregister( t_base_channel* p ) { }
+void tcm_rt_begin_spawn( t_channel_type type, t_tcm_rt_saved* p_saved ) { }
+void tcm_rt_end_spawn( const t_tcm_rt_saved* p_saved ) { }
+void tcm_trace_read_done( void ) { }
+
+
+/* processing thread releases the oldest posted event */
+static t_icom_evt* process( void )
+{
+  t_icom_evt* p_evt = posted[0];
+
+  memmove( posted, posted + 1, --nr_posted * sizeof( posted[0] ) );
+  base_channel_free_evt( NULL, p_evt );
+
+  return p_evt;
+}
+
+
+static int nr_ready( t_server_sock_channel* p )
+{
+  struct epoll_event ev;
+
+  return epoll_wait( p->epoll_fd, & ev, 1, 0 );
+}
+
+
+static void test_conn_id_wrap( void )
+{
+  t_server_sock_channel ch;
+  long id;
+
+  memset( & ch, 0, sizeof( ch ) );
+  ch.last_conn_seq = SERVER_SOCK_CH_MAX_CONN_SEQ - 1;
+
+  id = next_conn_id( & ch, SLOT_MASK );
+  CHECK( id > 0 );
+  CHECK( server_sock_channel_conn_index( id ) == SLOT_MASK );
+  CHECK( ( id >> SERVER_SOCK_CH_SLOT_BITS ) == SERVER_SOCK_CH_MAX_CONN_SEQ );
+
+  /* wraps to the first sequence number instead of overflowing */
+  id = next_conn_id( & ch, 3 );
+  CHECK( id > 0 );
+  CHECK( server_sock_channel_conn_index( id ) == 3 );
+  CHECK( ( id >> SERVER_SOCK_CH_SLOT_BITS ) == 1 );
+}
+
+
+static void test_backpressure( void )
+{
+  t_server_sock_conn conn;
+  t_server_sock_channel ch;
+  struct epoll_event ev;
+  int active = 0, free_slot, sv[2], i;
+  long id;
+
+  for( i = 0; i < POOL_SIZE; ++i ) {
+    evts[i].p_data = evt_data[i];
+    evts[i].max_data_size = SERVER_SOCK_CH_MAX_DATA_SIZE;
+    pool[nr_pool++] = & evts[i];
+  }
+
+  memset( & ch, 0, sizeof( ch ) );
+  memset( & conn, 0, sizeof( conn ) );
+  pthread_mutex_init( & ch.mutex, 0 );
+  ch.conns = & conn;
+  ch.active = & active;
+  ch.free_slots = & free_slot;
+  ch.max_connections = 1;
+  ch.nr_connections = 1;
+  ch.epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+  CHECK( socketpair( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv ) == 0 );
+  conn.fd = sv[0];
+  conn.id = id = next_conn_id( & ch, 0 );
+  memset( & ev, 0, sizeof( ev ) );
+  ev.events = EPOLLIN;
+  CHECK( epoll_ctl( ch.epoll_fd, EPOLL_CTL_ADD, conn.fd, & ev ) == 0 );
+
+  /* two chunks fill the pool */
+  CHECK( write( sv[1], "abc", 3 ) == 3 );
+  read_conn( & ch, 0 );
+  CHECK( write( sv[1], "def", 3 ) == 3 );
+  read_conn( & ch, 0 );
+  CHECK( nr_posted == 2 && ! strcmp( posted[0]->p_data, "abc" ) && ! strcmp( posted[1]->p_data, "def" ) );
+
+  /* third chunk stays in the socket, connection is not polled anymore */
+  CHECK( write( sv[1], "ghi", 3 ) == 3 );
+  read_conn( & ch, 0 );
+  CHECK( nr_posted == 2 && ch.nr_throttled == 1 && conn.throttled );
+  CHECK( nr_ready( & ch ) == 0 );
+
+  /* pending events are kept, reading resumes once one of them is processed */
+  CHECK( ! strcmp( process()->p_data, "abc" ) );
+  CHECK( base_channel_pool_available( NULL ) );
+  resume_reading( & ch );
+  CHECK( ch.nr_throttled == 0 && ! conn.throttled );
+  CHECK( nr_ready( & ch ) == 1 );
+  read_conn( & ch, 0 );
+  CHECK( nr_posted == 2 && ! strcmp( posted[1]->p_data, "ghi" ) );
+
+  /* disconnect is not lost with exhausted pool either */
+  close( sv[1] );
+  read_conn( & ch, 0 );
+  CHECK( ch.nr_throttled == 1 );
+  process();
+  process();
+  resume_reading( & ch );
+  read_conn( & ch, 0 );
+  CHECK( nr_posted == 1 && posted[0]->type == ICOM_EVT_SERVER_DIS );
+  CHECK( server_sock_channel_evt_conn_id( posted[0] ) == id );
+  CHECK( conn.fd == -1 && ch.nr_connections == 0 && ch.nr_free_slots == 1 );
+
+  close( ch.epoll_fd );
+  pthread_mutex_destroy( & ch.mutex );
+}
+
+
+int main( int argc, char* argv[] )
+{
+  test_conn_id_wrap();
+  test_backpressure();
+
+  if( nr_failures )
+    fprintf( stderr, "%d checks failed\n", nr_failures );
+
+  return( nr_failures ? EXIT_FAILURE : EXIT_SUCCESS );
+}